@@ -2,4 +2,23 @@
 
 
 #include "GrapleCableActor.h"
+#include "CableComponent.h"
+
+void AGrapleCableActor::ActivateCable(const FVector& Location, const FRotator& Rotation, AActor* EndActor)
+{
+	SetActorLocationAndRotation(Location, Rotation);
+
+	// The component stays registered between shots, re-registering would rebuild its scene proxy every time.
+	// Both ends are pinned where they belong on the first tick, the particles in between catch up in a few substeps
+	CableComponent->SetAttachEndTo(EndActor, NAME_None);
+	CableComponent->EndLocation = FVector::ZeroVector;
+	CableComponent->SetComponentTickEnabled(true);
+	CableComponent->SetVisibility(true);
+}
+
+void AGrapleCableActor::DeactivateCable()
+{
+	CableComponent->SetComponentTickEnabled(false);
+	CableComponent->SetVisibility(false);
+}
 
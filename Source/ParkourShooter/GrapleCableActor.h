@@ -7,11 +7,25 @@
 #include "GrapleCableActor.generated.h"
 
 /**
- * 
+ * Cable between the character and the grappling hook. Created once and reused for every shot
  */
 UCLASS()
 class PARKOURSHOOTER_API AGrapleCableActor : public ACableActor
 {
 	GENERATED_BODY()
-	
+
+public:
+
+	/// <summary>
+	/// Show the cable again, going from the given location to the end actor
+	/// </summary>
+	/// <param name="Location"> Where the cable starts </param>
+	/// <param name="Rotation"> Rotation of the cable actor </param>
+	/// <param name="EndActor"> Actor the end of the cable is attached to </param>
+	void ActivateCable(const FVector& Location, const FRotator& Rotation, AActor* EndActor);
+
+	/// <summary>
+	/// Hide the cable and stop simulating it
+	/// </summary>
+	void DeactivateCable();
 };
@@ -22,10 +22,83 @@ void AGrapleHook::BeginPlay()
 	
 }
 
+void AGrapleHook::ActivateHook(const FVector& Location, const FRotator& Rotation, const FVector& Velocity)
+{
+	SetActorLocationAndRotation(Location, Rotation, false, nullptr, ETeleportType::ResetPhysics);
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+	SetActorTickEnabled(true);
+
+	// Projectile movement lets go of its component when it stops after a hit, so give it back
+	bFlightActive = false;
+	HookVelocity = Velocity;
+	ProjectileMovementComponent->SetUpdatedComponent(MeshComponent);
+	ProjectileMovementComponent->Velocity = Velocity;
+	ProjectileMovementComponent->UpdateComponentVelocity();
+	ProjectileMovementComponent->Activate(true);
+}
+
+void AGrapleHook::ActivateHookFlight(const FVector& Start, const FVector& End, const FRotator& Rotation, float Duration)
+{
+	SetActorLocationAndRotation(Start, Rotation, false, nullptr, ETeleportType::ResetPhysics);
+	SetActorHiddenInGame(false);
+
+	// No collision while flying, we already know what we're going to hit
+	SetActorEnableCollision(false);
+	SetActorTickEnabled(true);
+
+	FlightStart = Start;
+	FlightEnd = End;
+	FlightStartTime = GetWorld()->GetTimeSeconds();
+	FlightDuration = FMath::Max(Duration, KINDA_SMALL_NUMBER);
+	HookVelocity = (End - Start) / FlightDuration;
+	bFlightActive = true;
+}
+
+void AGrapleHook::FinishHookFlight(const FVector& Location)
+{
+	bFlightActive = false;
+	HookVelocity = FVector::ZeroVector;
+	SetActorLocation(Location, false, nullptr, ETeleportType::ResetPhysics);
+
+	// Nothing left to animate while attached
+	SetActorTickEnabled(false);
+}
+
+FVector AGrapleHook::GetFlightLocation() const
+{
+	if (!bFlightActive)
+		return GetActorLocation();
+
+	float Alpha = FMath::Clamp((GetWorld()->GetTimeSeconds() - FlightStartTime) / FlightDuration, 0.f, 1.f);
+	return FMath::Lerp(FlightStart, FlightEnd, Alpha);
+}
+
+void AGrapleHook::DeactivateHook()
+{
+	bFlightActive = false;
+	HookVelocity = FVector::ZeroVector;
+	ProjectileMovementComponent->StopMovementImmediately();
+	ProjectileMovementComponent->SetUpdatedComponent(nullptr);
+	ProjectileMovementComponent->Deactivate();
+
+	SetActorTickEnabled(false);
+	SetActorEnableCollision(false);
+	SetActorHiddenInGame(true);
+}
+
 // Called every frame
 void AGrapleHook::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
+
+	// Straight flight is just a visual, it depends on the time only and not on the frame rate
+	if (bFlightActive)
+	{
+		SetActorLocation(GetFlightLocation());
+		return;
+	}
+
 	ProjectileMovementComponent->Velocity = HookVelocity;
 }
 
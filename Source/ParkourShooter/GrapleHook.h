@@ -19,6 +19,39 @@ public:
 	void SetVelocity(FVector NewVelocity) { HookVelocity = NewVelocity; }
 	FVector GetVelocity() const { return HookVelocity; }
 
+	/// <summary>
+	/// Show the hook and fire it from the given location. The hook is created once and reused for every shot
+	/// </summary>
+	/// <param name="Location"> Where to fire it from </param>
+	/// <param name="Rotation"> Rotation of the hook while flying </param>
+	/// <param name="Velocity"> Velocity to fly with </param>
+	void ActivateHook(const FVector& Location, const FRotator& Rotation, const FVector& Velocity);
+
+	/// <summary>
+	/// Show the hook and move it along a straight line without any physics. Used when we already know
+	/// where the hook lands, someone else decides when it gets there
+	/// </summary>
+	/// <param name="Start"> Where to fire it from </param>
+	/// <param name="End"> Where it lands </param>
+	/// <param name="Rotation"> Rotation of the hook while flying </param>
+	/// <param name="Duration"> Seconds it takes to get from start to end </param>
+	void ActivateHookFlight(const FVector& Start, const FVector& End, const FRotator& Rotation, float Duration);
+
+	/// <summary>
+	/// Stop flying along the line and stay at the given location
+	/// </summary>
+	void FinishHookFlight(const FVector& Location);
+
+	/// <summary>
+	/// Where the hook is along its flight line at this time
+	/// </summary>
+	FVector GetFlightLocation() const;
+
+	/// <summary>
+	/// Stop, hide and disable the hook until it's fired again
+	/// </summary>
+	void DeactivateHook();
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
@@ -31,6 +64,13 @@ protected:
 
 	FVector HookVelocity;
 
+	// Straight flight, only used when the hook was activated with ActivateHookFlight
+	bool bFlightActive = false;
+	FVector FlightStart;
+	FVector FlightEnd;
+	float FlightStartTime = 0;
+	float FlightDuration = 0;
+
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
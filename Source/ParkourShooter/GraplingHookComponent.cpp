@@ -2,24 +2,26 @@
 
 
 #include "GraplingHookComponent.h"
+#include "ParkourShooter.h"
 #include "CableComponent.h"
 #include "ParkourShooterCharacter.h"
-#include "GameFramework/CharacterMovementComponent.h"
+#include "ParkourMovementComponent.h"
 #include "DrawDebugHelpers.h"
 #include "GrapleHook.h"
+#include "TimerManager.h"
+#include "ParkourStats.h"
+#include "ParkourQueryBudget.h"
 
 // Sets default values for this component's properties
 UGraplingHookComponent::UGraplingHookComponent()
 {
-	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
-	// off to improve performance if you don't need them.
+	// We only have something to check while the hook is out, FireGrapple and CancelGrapple turn the tick on and off
 	PrimaryComponentTick.bCanEverTick = true;
-
-	// ...
+	PrimaryComponentTick.bStartWithTickEnabled = false;
 }
 
 
-void UGraplingHookComponent::FireGrapple(const FVector& Target, const FVector& LocalOffset)
+void UGraplingHookComponent::FireGrapple(const FVector& Target, const FVector& LocalOffset, const FHitResult* PredictedHit)
 {
 	// Some sanity checks first thing in the morning:
 	
@@ -27,19 +29,12 @@ void UGraplingHookComponent::FireGrapple(const FVector& Target, const FVector& L
 	if (IsInUse() || GetWorld() == nullptr)
 		return;
 
-	// You can crash the app if you don't check if this class is valid
-	if (!IsValid(HookClass))
-	{
-		UE_LOG(LogTemp, Error, TEXT("Could not spawn graple hook actor since it's not a valid subclass. Did you forget to set the class to be spawned?"));
+	// Hook and cable are created once, they may be missing if they failed or got destroyed
+	if (!EnsureGrappleActors())
 		return;
-	}
 
-	if (!IsValid(CableClass))
-	{
-		UE_LOG(LogTemp, Error, TEXT("Can't spawn grapple hook cable since it's not a valid subclass. Did you forget to set the cable class to be spawned?"))
-		return;
-	}
 	CurrentState = GrapplingState::Firing;
+	SetComponentTickEnabled(!bBatchedTick);
 
 	// We want to get the direction we will be moving on, we get that by substracting target
 	// location by the start location in world coordinates
@@ -47,62 +42,52 @@ void UGraplingHookComponent::FireGrapple(const FVector& Target, const FVector& L
 	GrappleDirection.Normalize();
 	FireDirection = GrappleDirection;
 
-
-	FActorSpawnParameters SpawnParams;
-	SpawnParams.Owner = GetOwner();
+	// Bring back the hook and cable from where the last shot left them
 	FVector StartLocation = GrapplingHookStartLocation(LocalOffset);
-	HookObject =
-		GetWorld()->SpawnActor<AGrapleHook>(
-			HookClass, 
-			StartLocation,
-			GetOwner()->GetActorRotation(),
-			SpawnParams
-		);
-
-	if (HookObject == nullptr)
+	CableObject->ActivateCable(StartLocation, GrappleDirection.Rotation(), HookObject);
+
+	// We already know where the hook lands, so we know when it gets there too. The hook just moves
+	// along the line to look right, and we only check the target is still there when it arrives
+	if (bPredictImpact && PredictedHit != nullptr && HookSpeed > 0)
 	{
-		UE_LOG(LogTemp, Error, TEXT("Could not spawn hook actor"));
-		CurrentState = GrapplingState::ReadyToFire;
+		PredictedImpactPoint = PredictedHit->ImpactPoint;
+		float TimeToArrive = FVector::Dist(StartLocation, PredictedImpactPoint) / HookSpeed;
+
+		HookObject->ActivateHookFlight(StartLocation, PredictedImpactPoint, GetOwner()->GetActorRotation(), TimeToArrive);
+		GetWorld()->GetTimerManager().SetTimer(ArrivalTimerHandle, this, &UGraplingHookComponent::OnHookArrived, FMath::Max(TimeToArrive, KINDA_SMALL_NUMBER), false);
 		return;
 	}
 
-	// Set up hook object: Set velocity and bind relevant events
-	HookObject->SetVelocity(GrappleDirection * HookSpeed);
-	// Use OnHit Event to know when you hit some wall
-	HookObject->OnActorHit.AddDynamic(this, &UGraplingHookComponent::OnHookHit); 
+	HookObject->ActivateHook(StartLocation, GetOwner()->GetActorRotation(), GrappleDirection * HookSpeed);
 
-	// Use OnDestroyed to know when to stop pulling to the hook
-	HookObject->OnDestroyed.AddDynamic(this, &UGraplingHookComponent::OnGrappleDestroyed);
-
-	// Now spawn the cable from the start point to the contact point
-	CableObject = GetWorld()->SpawnActor<AGrapleCableActor>(
-		CableClass, 
-		StartLocation, 
-		GrappleDirection.Rotation(),
-		SpawnParams
-		);
+	UE_LOG(LogParkour, Verbose, TEXT("Hook fired with speed of %f"), HookSpeed);
+}
 
-	// If failed to spawn, reset everything
-	if (CableObject == nullptr)
-	{
-		UE_LOG(LogTemp, Error, TEXT("Could not spawn hook cable actor"));
-		GetWorld()->DestroyActor(HookObject);
-		HookObject = nullptr;
-		CurrentState = GrapplingState::ReadyToFire;
+void UGraplingHookComponent::OnHookArrived()
+{
+	if (CurrentState != GrapplingState::Firing || !IsValid(HookObject))
 		return;
-	}
 
-	// Now set up end points of cable to corresponding locations
-	FAttachmentTransformRules Rules(EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, true);
+	// Short sweep around the predicted impact, the target might have moved or be gone since we shot
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(GrappleArrival), false, GetOwner());
+	Params.AddIgnoredActor(HookObject);
 
-	// Attach to start
-	CableObject->AttachToActor(GetOwner(), Rules);
+	FVector SweepStart = PredictedImpactPoint - FireDirection * ArrivalSweepDistance;
+	FVector SweepEnd = PredictedImpactPoint + FireDirection * ArrivalSweepDistance;
 
-	// Attach to end
-	CableObject->CableComponent->SetAttachEndTo(HookObject, NAME_None);
-	CableObject->CableComponent->EndLocation = FVector::ZeroVector;
+	// The hook is already there, it can't wait
+	FHitResult Hit;
+	UParkourQueryBudget::TryConsumeIn(GetWorld(), this, EParkourQueryPriority::Critical);
+	PARKOUR_COUNT_QUERY(Grapple);
+	bool bHitSomething = GetWorld()->SweepSingleByChannel(Hit, SweepStart, SweepEnd, FQuat::Identity, ECC_Parkour, FCollisionShape::MakeSphere(ArrivalSweepRadius), Params);
+	if (!bHitSomething || Hit.bStartPenetrating)
+	{
+		CancelGrapple();
+		return;
+	}
 
-	UE_LOG(LogTemp, Warning, TEXT("Spawned with speed of %f"), HookSpeed);
+	HookObject->FinishHookFlight(Hit.Location);
+	AttachHook(Hit.Location);
 }
 
 void UGraplingHookComponent::CancelGrapple()
@@ -111,56 +96,94 @@ void UGraplingHookComponent::CancelGrapple()
 	if (!IsInUse())
 		return;
 
-	// Sanity check: If the world is not valid, we have nothing to do
-	if (!IsValid(GetWorld()))
-		return;
+	if (GetWorld() != nullptr)
+		GetWorld()->GetTimerManager().ClearTimer(ArrivalTimerHandle);
 
-	// Try to destroy grapple hook and cable
+	// Hide hook and cable until next shot
 	if (IsValid(HookObject))
-		GetWorld()->DestroyActor(HookObject);
+		HookObject->DeactivateHook();
 
 	if (IsValid(CableObject))
-		GetWorld()->DestroyActor(CableObject);
-
-	// Reset Variables
-	HookObject = nullptr;
-	CableObject = nullptr;
+		CableObject->DeactivateCable();
 
 	// Reset state
 	GrapplingState PrevState = CurrentState;
 	CurrentState = GrapplingState::ReadyToFire;
+	SetComponentTickEnabled(false);
 
-	// If Prev state was attached, we have to reset movement properties
+	// If Prev state was attached, we have to stop pulling
 	if (PrevState != GrapplingState::Attached)
 		return;
 
-	// Reset movement properties
-	AActor* OwnerActor = GetOwner();
-	AParkourShooterCharacter* OwnerCharacter = Cast<AParkourShooterCharacter>(OwnerActor);
+	UParkourMovementComponent* MovementComp = GetOwnerMovement();
+	if (MovementComp == nullptr)
+		return;
 
-	// Check if Cast was valid
-	if (!IsValid(OwnerCharacter))
+	// The character leaves the grapple mode keeping its velocity, so the movement 
+	// is not suddenly interrupted
+	MovementComp->EndGrapple();
+}
+
+bool UGraplingHookComponent::EnsureGrappleActors()
+{
+	if (IsValid(HookObject) && IsValid(CableObject))
+		return true;
+
+	if (GetWorld() == nullptr)
+		return false;
+
+	// You can crash the app if you don't check if this class is valid
+	if (!IsValid(HookClass))
 	{
-		UE_LOG(LogTemp, Error, TEXT("Can't get parkour shooter character owner: Failed cast"));
-		return;
+		UE_LOG(LogParkour, Error, TEXT("Could not spawn graple hook actor since it's not a valid subclass. Did you forget to set the class to be spawned?"));
+		return false;
 	}
 
-	// Now get movement component
-	UCharacterMovementComponent* MovementComp = OwnerCharacter->GetCharacterMovement();
-	if (MovementComp == nullptr)
+	if (!IsValid(CableClass))
 	{
-		UE_LOG(LogTemp, Error, TEXT("Can't get movement component from owning Parkour Shooter Character"));
-		return;
+		UE_LOG(LogParkour, Error, TEXT("Can't spawn grapple hook cable since it's not a valid subclass. Did you forget to set the cable class to be spawned?"))
+		return false;
 	}
 
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.Owner = GetOwner();
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	FVector StartLocation = GetOwner()->GetActorLocation();
+
+	if (!IsValid(HookObject))
+	{
+		HookObject = GetWorld()->SpawnActor<AGrapleHook>(HookClass, StartLocation, GetOwner()->GetActorRotation(), SpawnParams);
+		if (HookObject == nullptr)
+		{
+			UE_LOG(LogParkour, Error, TEXT("Could not spawn hook actor"));
+			return false;
+		}
+
+		// Bind events once, the hook lives as long as we do.
+		// Use OnHit Event to know when you hit some wall
+		HookObject->OnActorHit.AddDynamic(this, &UGraplingHookComponent::OnHookHit);
+
+		// Use OnDestroyed to know if we lost our hook
+		HookObject->OnDestroyed.AddDynamic(this, &UGraplingHookComponent::OnGrappleDestroyed);
+		HookObject->DeactivateHook();
+	}
 
-	OwnerCharacter->RestoreMovementProperties();
+	if (!IsValid(CableObject))
+	{
+		CableObject = GetWorld()->SpawnActor<AGrapleCableActor>(CableClass, StartLocation, FRotator::ZeroRotator, SpawnParams);
+		if (CableObject == nullptr)
+		{
+			UE_LOG(LogParkour, Error, TEXT("Could not spawn hook cable actor"));
+			return false;
+		}
+
+		// The cable starts at the character and goes with it everywhere
+		FAttachmentTransformRules Rules(EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, true);
+		CableObject->AttachToActor(GetOwner(), Rules);
+		CableObject->DeactivateCable();
+	}
 
-	// Launch character to avoid the feeling that the movement 
-	// Is suddenly interrupted
-	OwnerCharacter->LaunchCharacter(MovementComp->Velocity, true, true);
-	HorizontalMovement = 0;
-	VerticalMovement = 0;
+	return true;
 }
 
 // Called when the game starts
@@ -168,7 +191,49 @@ void UGraplingHookComponent::BeginPlay()
 {
 	Super::BeginPlay();
 	CurrentState = GrapplingState::ReadyToFire;
-	
+
+	// Create hook and cable now so the first shot doesn't have to
+	EnsureGrappleActors();
+
+	// The pull itself runs in the movement component, it only needs our tuning
+	UParkourMovementComponent* MovementComp = GetOwnerMovement();
+	if (MovementComp != nullptr)
+	{
+		FParkourGrappleParams Params;
+		Params.ContinousPullSpeed = ContinousPullSpeed;
+		Params.MaxHorizontalMovementSpeed = MaxHorizontalMovementSpeed;
+		Params.MaxVerticalMovementSpeed = MaxVerticalMovementSpeed;
+		Params.ContinousHorizontalSpeed = ContinousHorizontalSpeed;
+		Params.ContinousVerticalSpeed = ContinousVerticalSpeed;
+		Params.InitialSpeed = PullInitialSpeed;
+
+		AParkourShooterCharacter* OwnerCharacter = Cast<AParkourShooterCharacter>(GetOwner());
+		if (OwnerCharacter != nullptr)
+			Params.MaxAnchorDistance = OwnerCharacter->GetMaxHookReachDistance();
+
+		MovementComp->SetGrappleParams(Params);
+	}
+}
+
+void UGraplingHookComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (GetWorld() != nullptr)
+		GetWorld()->GetTimerManager().ClearTimer(ArrivalTimerHandle);
+
+	// Hook and cable were ours, they go away with us
+	if (IsValid(HookObject))
+	{
+		HookObject->OnDestroyed.RemoveDynamic(this, &UGraplingHookComponent::OnGrappleDestroyed);
+		HookObject->Destroy();
+	}
+
+	if (IsValid(CableObject))
+		CableObject->Destroy();
+
+	HookObject = nullptr;
+	CableObject = nullptr;
+
+	Super::EndPlay(EndPlayReason);
 }
 
 FVector UGraplingHookComponent::GetMovementDirection(const FVector& Target, const FVector& LocalOffset) const
@@ -187,61 +252,55 @@ FVector UGraplingHookComponent::GrapplingHookStartLocation(const FVector& LocalO
 }
 
 void UGraplingHookComponent::OnHookHit(AActor* SelfActor, AActor* OtherActor, FVector NormalImpulse, const FHitResult& Hit)
+{
+	AttachHook(HookObject->GetActorLocation());
+}
+
+void UGraplingHookComponent::AttachHook(const FVector& AnchorLocation)
 {
 	// Change state to attached since we hit something to attach to
 	CurrentState = GrapplingState::Attached;
 
-	// Now we have to change the movement controller so that it's easier to pull the character to the attach point
-	AActor* OwnerActor = GetOwner();
-	AParkourShooterCharacter* OwnerCharacter = Cast<AParkourShooterCharacter>(OwnerActor);
-
-	// Check if Cast was valid
-	if (!IsValid(OwnerCharacter))
-	{
-		UE_LOG(LogTemp, Error, TEXT("Can't get parkour shooter character owner: Failed cast"));
-		return;
-	}
-
-	// Now get movement component
-	UCharacterMovementComponent* MovementComp = OwnerCharacter->GetCharacterMovement();
+	// Now the movement component pulls the character to the attach point in its grapple mode.
+	// No gravity there, so we don't have to launch the character off the ground first
+	UParkourMovementComponent* MovementComp = GetOwnerMovement();
 	if (MovementComp == nullptr)
-	{
-		UE_LOG(LogTemp, Error, TEXT("Can't get movement component from owning Parkour Shooter Character"));
 		return;
-	}
-
-	// Now we have to set all movement properties to values that are suitable for pulling the character to the attach point
-	SetMovementProperties(MovementComp, { 0.0f, 0.0f, 0.2f });
-
-	// Clear forces
-	auto Owner = Cast<AParkourShooterCharacter>(GetOwner());
-	if (IsValid(Owner) && FMath::IsNearlyZero(Owner->GetCharacterMovement()->Velocity.Z))
-		Owner->LaunchCharacter(FVector(0, 500, 0), false, true);
 
 	FVector ToHook = ToGrappleHook();
-	MovementComp->Velocity = PullInitialSpeed * ToHook;
-	
+	MovementComp->BeginGrapple(AnchorLocation);
+
 	InitialHookDirection2D = FVector2D(ToHook);
 	InitialHookDirection2D.Normalize();
 
-	UE_LOG(LogTemp, Warning, TEXT("Hit something!"));
+	UE_LOG(LogParkour, Verbose, TEXT("Hook attached at %s"), *AnchorLocation.ToString());
 }
 
 void UGraplingHookComponent::OnGrappleDestroyed(AActor* DestroyedActor)
 {
-	UE_LOG(LogTemp, Warning, TEXT("Hook destroyed"));
-}
+	UE_LOG(LogParkour, Warning, TEXT("Hook destroyed"));
 
-void UGraplingHookComponent::SetMovementProperties(UCharacterMovementComponent* MovementComponent, const UGraplingHookComponent::MovementProperties& Properties) const
-{
-	MovementComponent->GroundFriction = Properties.GroundFriction;
-	MovementComponent->GravityScale = Properties.GravityScale;
-	MovementComponent->AirControl = Properties.AirControl;
+	// Something destroyed our hook, stop using it. A new one is created on next shot
+	CancelGrapple();
+	HookObject = nullptr;
 }
 
-UGraplingHookComponent::MovementProperties UGraplingHookComponent::GetMovementProperties(UCharacterMovementComponent* MovementComponent) const
+UParkourMovementComponent* UGraplingHookComponent::GetOwnerMovement() const
 {
-	return MovementProperties{MovementComponent->GroundFriction, MovementComponent->GravityScale, MovementComponent->AirControl};
+	AParkourShooterCharacter* OwnerCharacter = Cast<AParkourShooterCharacter>(GetOwner());
+
+	// Check if Cast was valid
+	if (!IsValid(OwnerCharacter))
+	{
+		UE_LOG(LogParkour, Error, TEXT("Can't get parkour shooter character owner: Failed cast"));
+		return nullptr;
+	}
+
+	UParkourMovementComponent* MovementComp = OwnerCharacter->GetParkourMovement();
+	if (MovementComp == nullptr)
+		UE_LOG(LogParkour, Error, TEXT("Can't get movement component from owning Parkour Shooter Character"));
+
+	return MovementComp;
 }
 
 FVector UGraplingHookComponent::ToGrappleHook() const
@@ -279,32 +338,22 @@ bool UGraplingHookComponent::HookPassed() const
 	return FVector2D::DotProduct(ToHook2D, InitialHookDirection2D) < 0;
 }
 
-void UGraplingHookComponent::UpdateMovement(float NewDirection, float &Axis, float Speed, float DeltaTime, float MaxSpeed) const
+// Called every frame
+void UGraplingHookComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
-	bool DirectionIsZero = FMath::IsNearlyZero(NewDirection);
-
-	// If no change is requested and axis is already 0, nothing to do 
-	if (DirectionIsZero && FMath::IsNearlyZero(Axis))
-		return;
-
-	// If new direction is zero, but axis is not zero, it means we have to pull it to the opposite side
-	if (DirectionIsZero)
-	{
-		NewDirection = -FMath::Sign(Axis);
-		Speed *= 2;
-	}
-
-	Axis = FMath::Clamp(Axis + NewDirection * Speed * DeltaTime, -MaxSpeed, MaxSpeed);
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	UpdateGrapple();
+}
 
-	// Clamp it to zero if small enough
-	if (FMath::IsNearlyZero(Axis, 0.01f))
-		Axis = 0;
+void UGraplingHookComponent::SetBatchedTick(bool bBatched)
+{
+	bBatchedTick = bBatched;
+	SetComponentTickEnabled(!bBatchedTick && IsInUse());
 }
 
-// Called every frame
-void UGraplingHookComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+void UGraplingHookComponent::UpdateGrapple()
 {
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	PARKOUR_SCOPE_CYCLE_COUNTER(STAT_ParkourGrappleTick);
 
 	if (CurrentState == GrapplingState::Firing && IsTooFarFromHook())
 	{
@@ -317,36 +366,11 @@ void UGraplingHookComponent::TickComponent(float DeltaTime, ELevelTick TickType,
 		return;
 
 
-	// If attached, pull the character towards the hook every frame
-	AActor* OwnerActor = GetOwner();
-	AParkourShooterCharacter* OwnerCharacter = Cast<AParkourShooterCharacter>(OwnerActor);
-	if (!IsValid(OwnerCharacter))
-		return;
-
-	// Check if should cancel attachement. You cancel it if you pass the hook or if you're too close
+	// Check if should cancel attachement. You cancel it if you pass the hook or if you're too close.
+	// The pull itself happens in the movement component
 	if (IsTooCloseToHook() || HookPassed())
 	{
-		UE_LOG(LogTemp, Warning, TEXT("Hook Reached"));
+		UE_LOG(LogParkour, Verbose, TEXT("Hook reached"));
 		CancelGrapple();
 	}
-
-	// Pull to the specified direction
-	UCharacterMovementComponent* MovementComponent = OwnerCharacter->GetCharacterMovement();
-	FVector Direction = ToGrappleHook();
-
-	// Change direction a bit depending on if you want to go a bit to the side or a bit up or down
-	UpdateMovement(HorizontalMovement, HorizontalSpeed, ContinousHorizontalSpeed, DeltaTime, MaxHorizontalMovementSpeed);
-	UpdateMovement(VerticalMovement, VerticalSpeed, ContinousVerticalSpeed, DeltaTime, MaxVerticalMovementSpeed);
-
-	Direction += DeltaTime * HorizontalSpeed * OwnerCharacter->GetActorRightVector();
-	Direction += DeltaTime * VerticalSpeed * OwnerCharacter->GetActorUpVector();
-	UE_LOG(LogTemp, Warning, TEXT("Speed is (%f, %f)"), HorizontalSpeed, VerticalSpeed);
-
-	// DrawDebugDirectionalArrow(GetWorld(), OwnerCharacter->GetActorLocation(), OwnerCharacter->GetActorLocation() + OwnerCharacter->GetActorRightVector() * 1000, 5, FColor::Red, true, 0.1);
-	// MovementComponent->AddForce(Direction*ContinousPullSpeed);
-	// What if we try a velocity approach?
-	Direction.Normalize();
-	MovementComponent->Velocity = Direction * ContinousPullSpeed * DeltaTime;
-
 }
-
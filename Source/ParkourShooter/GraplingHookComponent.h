@@ -8,7 +8,7 @@
 #include "GrapleCableActor.h"
 #include "GraplingHookComponent.generated.h"
 
-class UCharacterMovementComponent;
+class UParkourMovementComponent;
 
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class PARKOURSHOOTER_API UGraplingHookComponent : public UActorComponent
@@ -43,25 +43,34 @@ public:
 	/// <returns> true if current state is firing or attached </returns>
 	bool IsInUse() const { return CurrentState == GrapplingState::Firing || CurrentState == GrapplingState::Attached; }
 
-	void FireGrapple(const FVector& Target, const FVector& LocalOffset);
+	/// <summary>
+	/// Fire the hook towards the target
+	/// </summary>
+	/// <param name="Target"> Position to fire to </param>
+	/// <param name="LocalOffset"> Offset relative to the owning player to start shooting the hook </param>
+	/// <param name="PredictedHit"> What the aim trace hit at the target, if anything. With it we know when the hook lands
+	/// and skip the hook physics </param>
+	void FireGrapple(const FVector& Target, const FVector& LocalOffset, const FHitResult* PredictedHit = nullptr);
 
 	void CancelGrapple();
 
-	void SetHorizontalMovement(float NewMovement) { HorizontalMovement = NewMovement; }
+	/// <summary>
+	/// Check if the hook should let go, called every frame while it's in use
+	/// </summary>
+	void UpdateGrapple();
 
-	void SetVerticalMovement(float NewMovement) { VerticalMovement = NewMovement; }
+	/// <summary>
+	/// Let the tick manager call UpdateGrapple for us instead of ticking on our own
+	/// </summary>
+	void SetBatchedTick(bool bBatched);
 
 protected:
 
-	struct MovementProperties
-	{
-		float GroundFriction;
-		float GravityScale;
-		float AirControl;
-	};
-
 	// Called when the game starts
 	virtual void BeginPlay() override;
+
+	// Called when the game ends or the owner is destroyed
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	
 	/// <summary>
 	/// Get direction to move given the target position
@@ -84,17 +93,27 @@ protected:
 	void OnGrappleDestroyed(AActor* DestroyedActor);
 
 	/// <summary>
-	/// Set movement properties of this movement component so they're better fit for pulling to 
-	/// attach point
+	/// Called when a hook with a predicted impact should be landing. Checks the target is still there
+	/// with a short sweep and attaches to it, cancels otherwise
 	/// </summary>
-	/// <param name="MovementComponent"> Movemenet component to modify </param>
-	void SetMovementProperties(UCharacterMovementComponent* MovementComponent, const MovementProperties& Properties) const;
-	
+	void OnHookArrived();
+
 	/// <summary>
-	/// Get *relevant* movement properties from movement component
+	/// The hook got attached at the given location, start pulling the character
 	/// </summary>
-	/// <returns>Relevant properties of this movement component</returns>
-	MovementProperties GetMovementProperties(UCharacterMovementComponent* MovementComponent) const;
+	void AttachHook(const FVector& AnchorLocation);
+
+	/// <summary>
+	/// Create the hook and cable we reuse for every shot, if we don't have them yet. They start hidden and disabled
+	/// </summary>
+	/// <returns> True if both hook and cable are ready to use </returns>
+	bool EnsureGrappleActors();
+
+	/// <summary>
+	/// Get the parkour movement component of the owning character, the one doing the actual pull
+	/// </summary>
+	/// <returns> Movement component of owner, nullptr if the owner is not a parkour shooter character </returns>
+	UParkourMovementComponent* GetOwnerMovement() const;
 
 	/// <summary>
 	/// Return a unit vector pointing from the character to the grapple hook head. Returns 0 if no 
@@ -121,13 +140,6 @@ protected:
 	/// <returns> If you already passed the hook </returns>
 	bool HookPassed() const;
 
-	/// <summary>
-	/// Utility function to update movement axis based on a new direction, used to update the horizontal and vertical movement
-	/// scalars when asking to pull the character a bit up or a bit to the side foring a hook pull
-	/// </summary>
-	/// <returns> If you already passed the hook </returns>
-	void UpdateMovement(float NewDirection, float &Axis, float Speed, float DeltaTime, float MaxSpeed) const;
-
 	/// <summary>
 	/// Direction we're currently traveling to 
 	/// </summary>
@@ -152,6 +164,18 @@ protected:
 	UPROPERTY(EditAnywhere, Category = "Hook")
 	float MaxHookDistanceFromCharacter = 100000;
 
+	/** Use the aim trace to know where and when the hook lands, instead of simulating the hook flight */
+	UPROPERTY(EditAnywhere, Category = "Hook")
+	bool bPredictImpact = true;
+
+	/** How far around the predicted impact to sweep when the hook lands, in case the target moved */
+	UPROPERTY(EditAnywhere, Category = "Hook")
+	float ArrivalSweepDistance = 100;
+
+	/** Radius of the sphere swept when the hook lands */
+	UPROPERTY(EditAnywhere, Category = "Hook")
+	float ArrivalSweepRadius = 10;
+
 	/** Max horizontal speed to add when trying to go a bit to the right  during hook pull*/
 	UPROPERTY(EditAnywhere, Category = "Movement")
 	float MaxHorizontalMovementSpeed = 10;
@@ -168,24 +192,26 @@ protected:
 	UPROPERTY(EditAnywhere, Category = "Movement")
 	float ContinousVerticalSpeed = 500;
 
-	float VerticalSpeed = 0;
-	float HorizontalSpeed = 0;
-
 	// Direction we started to pull to. We don't care about the Z component,
 	// we only care about the direction in the XY plane.
 	FVector2D InitialHookDirection2D;
 
-	// Currently active hook in scene
-	AGrapleHook* HookObject = nullptr;
+	// Where the aim trace says the hook will land, when flying with a predicted impact
+	FVector PredictedImpactPoint;
 
-	// Currently active cable in scene
-	AGrapleCableActor* CableObject = nullptr;
+	// Fires when the hook with a predicted impact lands
+	FTimerHandle ArrivalTimerHandle;
+
+	// The tick manager updates us, so we never tick on our own
+	bool bBatchedTick = false;
 
-	// Direction beeing requested by user. This is required to provide a bit of manemaneuverability
-	// in mid air since we're not using a force-based approach
-	float HorizontalMovement = 0;
-	float VerticalMovement = 0;
+	// Our hook, hidden while we're ready to fire
+	UPROPERTY()
+	AGrapleHook* HookObject = nullptr;
 
+	// Our cable, hidden while we're ready to fire
+	UPROPERTY()
+	AGrapleCableActor* CableObject = nullptr;
 
 public:	
 	// Called every frame
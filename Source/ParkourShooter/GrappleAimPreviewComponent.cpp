@@ -0,0 +1,119 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GrappleAimPreviewComponent.h"
+#include "ParkourShooter.h"
+#include "ParkourShooterCharacter.h"
+#include "ParkourStats.h"
+#include "ParkourQueryBudget.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+
+UGrappleAimPreviewComponent::UGrappleAimPreviewComponent()
+{
+	// Only local players preview, StartPreview turns the tick on for them. After the camera moved for this frame
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+	PrimaryComponentTick.TickGroup = TG_PostUpdateWork;
+}
+
+void UGrappleAimPreviewComponent::BeginPlay()
+{
+	Super::BeginPlay();
+	ShooterCharacter = Cast<AParkourShooterCharacter>(GetOwner());
+
+	// Bind it once, every trace reuses it
+	AimTraceDelegate.BindUObject(this, &UGrappleAimPreviewComponent::OnAimTraceDone);
+}
+
+void UGrappleAimPreviewComponent::StartPreview()
+{
+	SetComponentTickEnabled(bEnablePreview);
+}
+
+void UGrappleAimPreviewComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	// We may have lost the player since the preview started
+	APlayerController* PlayerController = ShooterCharacter != nullptr ? Cast<APlayerController>(ShooterCharacter->GetController()) : nullptr;
+	if (PlayerController == nullptr || !PlayerController->IsLocalController() || PlayerController->PlayerCameraManager == nullptr)
+	{
+		Result = AimResult();
+		AimTraceHandle.Invalidate();
+		SetComponentTickEnabled(false);
+		return;
+	}
+
+	FVector Origin = PlayerController->PlayerCameraManager->GetCameraLocation();
+	FVector Direction = PlayerController->PlayerCameraManager->GetCameraRotation().Vector();
+
+	// Still aiming about where the last trace went, its answer holds. One in flight will answer soon enough
+	if (Result.bValid && IsRequestClose(Result.Request, Origin, Direction))
+		return;
+
+	if (AimTraceHandle.IsValid() && IsRequestClose(PendingRequest, Origin, Direction))
+		return;
+
+	// Only for the reticle, it can wait for a frame with room to spare. Shooting traces on its own if it has to
+	if (!UParkourQueryBudget::TryConsumeIn(GetWorld(), this, EParkourQueryPriority::Low))
+		return;
+
+	PendingRequest = { Origin, Direction, GetWorld()->GetTimeSeconds() };
+
+	FCollisionQueryParams Params = FCollisionQueryParams::DefaultQueryParam;
+	Params.AddIgnoredActor(ShooterCharacter);
+
+	PARKOUR_COUNT_QUERY(Grapple);
+	AimTraceHandle = GetWorld()->AsyncLineTraceByChannel(
+		EAsyncTraceType::Single,
+		Origin,
+		Origin + Direction * ShooterCharacter->GetMaxHookReachDistance(),
+		ECC_Parkour,
+		Params,
+		FCollisionResponseParams::DefaultResponseParam,
+		&AimTraceDelegate
+	);
+}
+
+void UGrappleAimPreviewComponent::OnAimTraceDone(const FTraceHandle& Handle, FTraceDatum& Datum)
+{
+	// A newer trace replaced this one
+	if (!(Handle == AimTraceHandle))
+		return;
+
+	AimTraceHandle.Invalidate();
+
+	bool bWillLandBefore = WillHookLand();
+
+	FHitResult* Hit = FHitResult::GetFirstBlockingHit(Datum.OutHits);
+	Result.Request = PendingRequest;
+	Result.bValid = true;
+	Result.bHitSomething = Hit != nullptr;
+	Result.Hit = Hit != nullptr ? *Hit : FHitResult(Datum.Start, Datum.End);
+
+	if (WillHookLand() != bWillLandBefore)
+		OnPreviewChanged(WillHookLand());
+}
+
+bool UGrappleAimPreviewComponent::GetPreview(const FVector& Origin, const FVector& Direction, FHitResult& OutHit, bool& bOutHitSomething) const
+{
+	if (!Result.bValid || !IsRequestClose(Result.Request, Origin, Direction))
+		return false;
+
+	OutHit = Result.Hit;
+	bOutHitSomething = Result.bHitSomething;
+	return true;
+}
+
+bool UGrappleAimPreviewComponent::IsRequestClose(const AimRequest& Request, const FVector& Origin, const FVector& Direction) const
+{
+	if (GetWorld()->GetTimeSeconds() - Request.Time > MaxReuseAge)
+		return false;
+
+	if (FVector::DistSquared(Request.Origin, Origin) > MaxReuseDistance * MaxReuseDistance)
+		return false;
+
+	float MinCos = FMath::Cos(FMath::DegreesToRadians(MaxReuseAngle));
+	return FVector::DotProduct(Request.Direction, Direction.GetSafeNormal()) >= MinCos;
+}
@@ -0,0 +1,100 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "WorldCollision.h"
+#include "GrappleAimPreviewComponent.generated.h"
+
+class AParkourShooterCharacter;
+
+/**
+ * Tells the local player whether the grappling hook would land before they shoot it. Runs the aim trace
+ * asynchronously from the camera, at most one per frame, and keeps the last result while the camera barely moves.
+ * Shooting reuses that result instead of tracing the whole reach again
+ */
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class PARKOURSHOOTER_API UGrappleAimPreviewComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+
+	UGrappleAimPreviewComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	/// <summary>
+	/// Start previewing, only for characters controlled by a local player
+	/// </summary>
+	void StartPreview();
+
+	/// <summary>
+	/// Latest aim result, if it was traced close enough to the given aim to stand for it
+	/// </summary>
+	/// <param name="bOutHitSomething"> If the hook would land, OutHit is where </param>
+	/// <returns> False if there's no result we can use, then the caller has to trace </returns>
+	bool GetPreview(const FVector& Origin, const FVector& Direction, FHitResult& OutHit, bool& bOutHitSomething) const;
+
+	/** If the hook would land where we aim right now, for the reticle */
+	UFUNCTION(BlueprintCallable, Category = "Aim Preview")
+	bool WillHookLand() const { return Result.bValid && Result.bHitSomething; }
+
+	/** Called when the hook goes from landing to not landing where we aim, or the other way around */
+	UFUNCTION(BlueprintImplementableEvent, Category = "Aim Preview")
+	void OnPreviewChanged(bool bWillLand);
+
+protected:
+
+	virtual void BeginPlay() override;
+
+	/** Trace where the hook would land while we aim */
+	UPROPERTY(EditAnywhere, Category = "Aim Preview")
+	bool bEnablePreview = true;
+
+	/** Keep the last result while the camera turns less than this from where it was traced, in degrees */
+	UPROPERTY(EditAnywhere, Category = "Aim Preview")
+	float MaxReuseAngle = 0.25f;
+
+	/** Keep the last result while the camera moves less than this from where it was traced */
+	UPROPERTY(EditAnywhere, Category = "Aim Preview")
+	float MaxReuseDistance = 10;
+
+	/** Oldest result to keep, in seconds, something may have moved into the aim line since */
+	UPROPERTY(EditAnywhere, Category = "Aim Preview")
+	float MaxReuseAge = 0.25f;
+
+	// Where the camera was for a trace, and when
+	struct AimRequest
+	{
+		FVector Origin = FVector::ZeroVector;
+		FVector Direction = FVector::ForwardVector;
+		float Time = 0;
+	};
+
+	struct AimResult
+	{
+		AimRequest Request;
+		bool bValid = false;
+		bool bHitSomething = false;
+		FHitResult Hit;
+	};
+
+	/// <summary>
+	/// Checks if a result traced from the given request can stand for the given aim
+	/// </summary>
+	bool IsRequestClose(const AimRequest& Request, const FVector& Origin, const FVector& Direction) const;
+
+	void OnAimTraceDone(const FTraceHandle& Handle, FTraceDatum& Datum);
+
+	UPROPERTY()
+	AParkourShooterCharacter* ShooterCharacter;
+
+	FTraceHandle AimTraceHandle;
+	AimRequest PendingRequest;
+	FTraceDelegate AimTraceDelegate;
+
+	// Latest complete trace
+	AimResult Result;
+};
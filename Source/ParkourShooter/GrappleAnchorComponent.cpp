@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GrappleAnchorComponent.h"
+#include "GrappleAnchorSubsystem.h"
+#include "Engine/World.h"
+
+UGrappleAnchorComponent::UGrappleAnchorComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+}
+
+void UGrappleAnchorComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	UGrappleAnchorSubsystem* Anchors = GetWorld()->GetSubsystem<UGrappleAnchorSubsystem>();
+	if (Anchors != nullptr)
+		Anchors->RegisterAnchor(this);
+}
+
+void UGrappleAnchorComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	UGrappleAnchorSubsystem* Anchors = GetWorld() != nullptr ? GetWorld()->GetSubsystem<UGrappleAnchorSubsystem>() : nullptr;
+	if (Anchors != nullptr)
+		Anchors->UnregisterAnchor(this);
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UGrappleAnchorComponent::OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	Super::OnUpdateTransform(UpdateTransformFlags, Teleport);
+
+	// Anchors on moving platforms have to change cells as they go
+	if (AnchorIndex == INDEX_NONE)
+		return;
+
+	UGrappleAnchorSubsystem* Anchors = GetWorld()->GetSubsystem<UGrappleAnchorSubsystem>();
+	if (Anchors != nullptr)
+		Anchors->UpdateAnchor(this);
+}
+
+void UGrappleAnchorComponent::SetHighlighted(bool bNewHighlighted)
+{
+	if (bHighlighted == bNewHighlighted)
+		return;
+
+	bHighlighted = bNewHighlighted;
+	OnHighlightChanged(bHighlighted);
+}
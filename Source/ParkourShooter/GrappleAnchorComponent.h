@@ -0,0 +1,51 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SceneComponent.h"
+#include "GrappleAnchorComponent.generated.h"
+
+/**
+ * A point the grappling hook can aim for. Place it on the surface the hook should grab, the aim assist picks the
+ * anchor closest to where the player looks and checks with a short trace that it's not blocked
+ */
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class PARKOURSHOOTER_API UGrappleAnchorComponent : public USceneComponent
+{
+	GENERATED_BODY()
+
+public:
+
+	UGrappleAnchorComponent();
+
+	/// <summary>
+	/// Show or hide this anchor as the one the hook would go to
+	/// </summary>
+	void SetHighlighted(bool bNewHighlighted);
+
+	bool IsHighlighted() const { return bHighlighted; }
+
+	float GetAcceptRadius() const { return AcceptRadius; }
+
+	/** Called when the anchor becomes or stops being the one the hook would go to, show it however you like */
+	UFUNCTION(BlueprintImplementableEvent, Category = "Anchor")
+	void OnHighlightChanged(bool bNewHighlighted);
+
+protected:
+
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport = ETeleportType::None) override;
+
+	/** How far from the anchor the confirmation trace can hit and still count as reaching it */
+	UPROPERTY(EditAnywhere, Category = "Anchor")
+	float AcceptRadius = 100;
+
+	bool bHighlighted = false;
+
+	// Where we are in the anchor subsystem, INDEX_NONE if we're not registered
+	int32 AnchorIndex = INDEX_NONE;
+
+	friend class UGrappleAnchorSubsystem;
+};
@@ -0,0 +1,325 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "GrappleAnchorSubsystem.h"
+#include "ParkourShooter.h"
+#include "GrappleAnchorComponent.h"
+#include "ParkourShooterCharacter.h"
+#include "ParkourStats.h"
+#include "ParkourQueryBudget.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+
+void UGrappleAnchorSubsystem::Deinitialize()
+{
+	for (UGrappleAnchorComponent* Anchor : Anchors)
+	{
+		if (Anchor != nullptr)
+			Anchor->AnchorIndex = INDEX_NONE;
+	}
+
+	Anchors.Reset();
+	Locations.Reset();
+	AnchorCells.Reset();
+	Cells.Reset();
+	Highlighted = nullptr;
+	HighlightCandidate = nullptr;
+
+	Super::Deinitialize();
+}
+
+void UGrappleAnchorSubsystem::Tick(float DeltaTime)
+{
+	UpdateHighlight();
+}
+
+bool UGrappleAnchorSubsystem::IsTickable() const
+{
+	return Anchors.Num() > 0 || Highlighted != nullptr;
+}
+
+ETickableTickType UGrappleAnchorSubsystem::GetTickableTickType() const
+{
+	// The class default object must never tick
+	return HasAnyFlags(RF_ClassDefaultObject) ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UGrappleAnchorSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UGrappleAnchorSubsystem, STATGROUP_Tickables);
+}
+
+void UGrappleAnchorSubsystem::RegisterAnchor(UGrappleAnchorComponent* Anchor)
+{
+	if (Anchor == nullptr || Anchor->AnchorIndex != INDEX_NONE)
+		return;
+
+	FVector Location = Anchor->GetComponentLocation();
+	FIntVector Cell = GetCell(Location);
+
+	Anchor->AnchorIndex = Anchors.Add(Anchor);
+	Locations.Add(Location);
+	AnchorCells.Add(Cell);
+	AddToCell(Cell, Anchor->AnchorIndex);
+}
+
+void UGrappleAnchorSubsystem::UnregisterAnchor(UGrappleAnchorComponent* Anchor)
+{
+	if (Anchor == nullptr || !Anchors.IsValidIndex(Anchor->AnchorIndex) || Anchors[Anchor->AnchorIndex] != Anchor)
+		return;
+
+	int32 Index = Anchor->AnchorIndex;
+	int32 Last = Anchors.Num() - 1;
+	RemoveFromCell(AnchorCells[Index], Index);
+
+	// The last anchor takes the free slot, its cell has to point to the new index
+	if (Index != Last)
+	{
+		TArray<int32>& LastCell = Cells.FindChecked(AnchorCells[Last]);
+		LastCell[LastCell.IndexOfByKey(Last)] = Index;
+		Anchors[Last]->AnchorIndex = Index;
+	}
+
+	Anchors.RemoveAtSwap(Index, 1, false);
+	Locations.RemoveAtSwap(Index, 1, false);
+	AnchorCells.RemoveAtSwap(Index, 1, false);
+	Anchor->AnchorIndex = INDEX_NONE;
+
+	if (Highlighted == Anchor)
+		Highlighted = nullptr;
+
+	if (HighlightCandidate == Anchor)
+		HighlightCandidate = nullptr;
+}
+
+void UGrappleAnchorSubsystem::UpdateAnchor(UGrappleAnchorComponent* Anchor)
+{
+	if (Anchor == nullptr || !Anchors.IsValidIndex(Anchor->AnchorIndex) || Anchors[Anchor->AnchorIndex] != Anchor)
+		return;
+
+	int32 Index = Anchor->AnchorIndex;
+	Locations[Index] = Anchor->GetComponentLocation();
+
+	FIntVector Cell = GetCell(Locations[Index]);
+	if (Cell == AnchorCells[Index])
+		return;
+
+	RemoveFromCell(AnchorCells[Index], Index);
+	AddToCell(Cell, Index);
+	AnchorCells[Index] = Cell;
+}
+
+void UGrappleAnchorSubsystem::QueryCone(const FVector& Origin, const FVector& Direction, float MaxDistance, TArray<UGrappleAnchorComponent*>& OutAnchors, int32 MaxResults) const
+{
+	PARKOUR_SCOPE_CYCLE_COUNTER(STAT_ParkourGrappleAnchorQuery);
+
+	OutAnchors.Reset();
+	if (Anchors.Num() == 0 || MaxDistance <= 0)
+		return;
+
+	FVector Forward = Direction.GetSafeNormal();
+	float ConeAngle = FMath::DegreesToRadians(FMath::Clamp(AimConeAngle, 0.f, 89.f));
+	float CosAngle = FMath::Cos(ConeAngle);
+
+	// Box around the cone: its tip and the disk at the end of the reach
+	FVector End = Origin + Forward * MaxDistance;
+	FVector EndExtent(MaxDistance * FMath::Tan(ConeAngle));
+	FBox ConeBox(Origin, Origin);
+	ConeBox += End - EndExtent;
+	ConeBox += End + EndExtent;
+
+	FIntVector MinCell = GetCell(ConeBox.Min);
+	FIntVector MaxCell = GetCell(ConeBox.Max);
+	int64 NumInBox = static_cast<int64>(MaxCell.X - MinCell.X + 1) * (MaxCell.Y - MinCell.Y + 1) * (MaxCell.Z - MinCell.Z + 1);
+
+	// How close to the aim direction each anchor in the cone is, and its index
+	TArray<TPair<float, int32>, TInlineAllocator<32>> Found;
+
+	auto GatherCell = [&](const TArray<int32>& Indices)
+	{
+		for (int32 Index : Indices)
+		{
+			FVector ToAnchor = Locations[Index] - Origin;
+			float DistanceSquared = ToAnchor.SizeSquared();
+			if (DistanceSquared > MaxDistance * MaxDistance || DistanceSquared < KINDA_SMALL_NUMBER)
+				continue;
+
+			float Cos = FVector::DotProduct(ToAnchor, Forward) * FMath::InvSqrt(DistanceSquared);
+			if (Cos >= CosAngle)
+				Found.Emplace(Cos, Index);
+		}
+	};
+
+	// A long reach can cover way more cells than we have anchors in, then it's cheaper to go through the ones we have
+	if (NumInBox > Cells.Num())
+	{
+		for (const TPair<FIntVector, TArray<int32>>& Cell : Cells)
+		{
+			const FIntVector& Key = Cell.Key;
+			bool bInBox = Key.X >= MinCell.X && Key.X <= MaxCell.X && Key.Y >= MinCell.Y && Key.Y <= MaxCell.Y && Key.Z >= MinCell.Z && Key.Z <= MaxCell.Z;
+			if (bInBox && CellTouchesCone(Key, Origin, Forward, MaxDistance, ConeAngle))
+				GatherCell(Cell.Value);
+		}
+	}
+	else
+	{
+		for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+		{
+			for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+			{
+				for (int32 Z = MinCell.Z; Z <= MaxCell.Z; Z++)
+				{
+					FIntVector Key(X, Y, Z);
+					const TArray<int32>* Indices = Cells.Find(Key);
+					if (Indices != nullptr && CellTouchesCone(Key, Origin, Forward, MaxDistance, ConeAngle))
+						GatherCell(*Indices);
+				}
+			}
+		}
+	}
+
+	Found.Sort([](const TPair<float, int32>& A, const TPair<float, int32>& B) { return A.Key > B.Key; });
+
+	int32 NumResults = MaxResults > 0 ? FMath::Min(MaxResults, Found.Num()) : Found.Num();
+	OutAnchors.Reserve(NumResults);
+	for (int32 i = 0; i < NumResults; i++)
+		OutAnchors.Add(Anchors[Found[i].Value]);
+}
+
+UGrappleAnchorComponent* UGrappleAnchorSubsystem::FindBestAnchor(const FVector& Origin, const FVector& Direction, float MaxDistance, const FCollisionQueryParams& Params, FHitResult& OutHit) const
+{
+	TArray<UGrappleAnchorComponent*> Candidates;
+	QueryCone(Origin, Direction, MaxDistance, Candidates, MaxConfirmTraces);
+
+	// The player is shooting right now, it can't wait. It still counts against the budget
+	if (Candidates.Num() > 0)
+		UParkourQueryBudget::TryConsumeIn(GetWorld(), this, EParkourQueryPriority::Critical, Candidates.Num(), 1);
+
+	for (UGrappleAnchorComponent* Candidate : Candidates)
+	{
+		if (ConfirmAnchor(Candidate, Origin, Params, OutHit))
+			return Candidate;
+	}
+
+	return nullptr;
+}
+
+FIntVector UGrappleAnchorSubsystem::GetCell(const FVector& Location) const
+{
+	return FIntVector(
+		FMath::FloorToInt(Location.X / CellSize),
+		FMath::FloorToInt(Location.Y / CellSize),
+		FMath::FloorToInt(Location.Z / CellSize)
+	);
+}
+
+bool UGrappleAnchorSubsystem::CellTouchesCone(const FIntVector& Cell, const FVector& Origin, const FVector& Direction, float MaxDistance, float ConeAngle) const
+{
+	// Test the sphere around the cell against the cone
+	FVector Center = (FVector(Cell) + FVector(0.5f)) * CellSize;
+	float Radius = CellSize * 0.5f * 1.7320508f;
+
+	FVector ToCenter = Center - Origin;
+	float Distance = ToCenter.Size();
+	if (Distance <= Radius)
+		return true;
+
+	if (Distance - Radius > MaxDistance)
+		return false;
+
+	// The sphere covers some angle around its center, part of it is in the cone if that angle reaches the cone
+	float AngleToCenter = FMath::Acos(FMath::Clamp(FVector::DotProduct(ToCenter, Direction) / Distance, -1.f, 1.f));
+	float SphereAngle = FMath::Asin(Radius / Distance);
+	return AngleToCenter - SphereAngle <= ConeAngle;
+}
+
+bool UGrappleAnchorSubsystem::ConfirmAnchor(const UGrappleAnchorComponent* Anchor, const FVector& Origin, const FCollisionQueryParams& Params, FHitResult& OutHit) const
+{
+	FVector Location = Anchor->GetComponentLocation();
+	FVector End = Location + (Location - Origin).GetSafeNormal() * ConfirmOvershoot;
+
+	PARKOUR_COUNT_QUERY(Grapple);
+	if (!GetWorld()->LineTraceSingleByChannel(OutHit, Origin, End, ECC_Parkour, Params))
+		return false;
+
+	// We have to hit the surface the anchor is on, not something in the way
+	float AcceptRadius = Anchor->GetAcceptRadius();
+	return FVector::DistSquared(OutHit.ImpactPoint, Location) <= AcceptRadius * AcceptRadius;
+}
+
+void UGrappleAnchorSubsystem::AddToCell(const FIntVector& Cell, int32 Index)
+{
+	Cells.FindOrAdd(Cell).Add(Index);
+}
+
+void UGrappleAnchorSubsystem::RemoveFromCell(const FIntVector& Cell, int32 Index)
+{
+	TArray<int32>* Indices = Cells.Find(Cell);
+	if (Indices == nullptr)
+		return;
+
+	Indices->RemoveSingleSwap(Index, false);
+	if (Indices->Num() == 0)
+		Cells.Remove(Cell);
+}
+
+void UGrappleAnchorSubsystem::UpdateHighlight()
+{
+	APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	AParkourShooterCharacter* Character = PlayerController != nullptr ? Cast<AParkourShooterCharacter>(PlayerController->GetPawn()) : nullptr;
+	if (!bHighlightAnchor || Character == nullptr || !Character->IsLocallyControlled())
+	{
+		SetHighlighted(nullptr);
+		return;
+	}
+
+	FVector Origin;
+	FRotator Rotation;
+	PlayerController->GetPlayerViewPoint(Origin, Rotation);
+
+	TArray<UGrappleAnchorComponent*> Candidates;
+	QueryCone(Origin, Rotation.Vector(), Character->GetMaxHookReachDistance(), Candidates, MaxConfirmTraces);
+
+	// The hash is cheap enough for every frame, traces are not: only confirm again when the best candidate changes,
+	// or once in a while in case something moved in the way
+	UGrappleAnchorComponent* Best = Candidates.Num() > 0 ? Candidates[0] : nullptr;
+	float Now = GetWorld()->GetTimeSeconds();
+	if (Best == HighlightCandidate && Now - HighlightConfirmTime < HighlightConfirmInterval)
+		return;
+
+	// Only for show, it can wait for a frame with room to spare. We keep the current highlight until then
+	if (Candidates.Num() > 0 && !UParkourQueryBudget::TryConsumeIn(GetWorld(), this, EParkourQueryPriority::Low, Candidates.Num()))
+		return;
+
+	HighlightCandidate = Best;
+	HighlightConfirmTime = Now;
+
+	FCollisionQueryParams Params = FCollisionQueryParams::DefaultQueryParam;
+	Params.AddIgnoredActor(Character);
+
+	UGrappleAnchorComponent* Reachable = nullptr;
+	FHitResult Hit;
+	for (UGrappleAnchorComponent* Candidate : Candidates)
+	{
+		if (ConfirmAnchor(Candidate, Origin, Params, Hit))
+		{
+			Reachable = Candidate;
+			break;
+		}
+	}
+
+	SetHighlighted(Reachable);
+}
+
+void UGrappleAnchorSubsystem::SetHighlighted(UGrappleAnchorComponent* Anchor)
+{
+	if (Highlighted == Anchor)
+		return;
+
+	if (Highlighted != nullptr)
+		Highlighted->SetHighlighted(false);
+
+	Highlighted = Anchor;
+
+	if (Highlighted != nullptr)
+		Highlighted->SetHighlighted(true);
+}
@@ -0,0 +1,130 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "CollisionQueryParams.h"
+#include "GrappleAnchorSubsystem.generated.h"
+
+class UGrappleAnchorComponent;
+
+/**
+ * Spatial hash of every grapple anchor in the world. Answers "best anchor in the view cone within reach" by only
+ * looking at the cells the cone touches, and confirms the pick with a short trace to the anchor instead of tracing
+ * the whole reach of the hook. Every frame it highlights the anchor the local player would grapple to
+ */
+UCLASS(config=Game)
+class PARKOURSHOOTER_API UGrappleAnchorSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	void RegisterAnchor(UGrappleAnchorComponent* Anchor);
+
+	void UnregisterAnchor(UGrappleAnchorComponent* Anchor);
+
+	/// <summary>
+	/// Move an anchor to the cell of its current location
+	/// </summary>
+	void UpdateAnchor(UGrappleAnchorComponent* Anchor);
+
+	bool HasAnchors() const { return Anchors.Num() > 0; }
+
+	/// <summary>
+	/// Anchors inside the aim cone and within reach, best first: the ones closest to the aim direction
+	/// </summary>
+	/// <param name="MaxResults"> Stop after this many, 0 for all of them </param>
+	void QueryCone(const FVector& Origin, const FVector& Direction, float MaxDistance, TArray<UGrappleAnchorComponent*>& OutAnchors, int32 MaxResults = 0) const;
+
+	/// <summary>
+	/// Best anchor in the aim cone that a trace from the origin can reach
+	/// </summary>
+	/// <param name="OutHit"> Hit of the confirmation trace on the anchor, where the hook lands </param>
+	/// <returns> The anchor, nullptr if none in the cone is reachable </returns>
+	UGrappleAnchorComponent* FindBestAnchor(const FVector& Origin, const FVector& Direction, float MaxDistance, const FCollisionQueryParams& Params, FHitResult& OutHit) const;
+
+	/// <summary>
+	/// Anchor highlighted for the local player, the one the hook goes to if they fire now
+	/// </summary>
+	UGrappleAnchorComponent* GetHighlightedAnchor() const { return Highlighted; }
+
+protected:
+
+	/** Size of the cells of the hash. About the distance between anchors works best */
+	UPROPERTY(config)
+	float CellSize = 2000;
+
+	/** Half angle of the aim cone, in degrees */
+	UPROPERTY(config)
+	float AimConeAngle = 8;
+
+	/** How many of the best anchors to confirm with a trace before giving up, the best one may be blocked */
+	UPROPERTY(config)
+	int32 MaxConfirmTraces = 3;
+
+	/** Highlight the anchor the local player would grapple to */
+	UPROPERTY(config)
+	bool bHighlightAnchor = true;
+
+	/** Seconds between confirmation traces for the highlight while the best anchor in the cone doesn't change */
+	UPROPERTY(config)
+	float HighlightConfirmInterval = 0.1f;
+
+	/** How far past the anchor the confirmation trace goes, so it reaches the surface the anchor is on */
+	UPROPERTY(config)
+	float ConfirmOvershoot = 50;
+
+	FIntVector GetCell(const FVector& Location) const;
+
+	/// <summary>
+	/// Checks if any part of a cell could be inside the aim cone
+	/// </summary>
+	bool CellTouchesCone(const FIntVector& Cell, const FVector& Origin, const FVector& Direction, float MaxDistance, float ConeAngle) const;
+
+	/// <summary>
+	/// Trace from the origin to an anchor and check we reach it
+	/// </summary>
+	bool ConfirmAnchor(const UGrappleAnchorComponent* Anchor, const FVector& Origin, const FCollisionQueryParams& Params, FHitResult& OutHit) const;
+
+	void AddToCell(const FIntVector& Cell, int32 Index);
+	void RemoveFromCell(const FIntVector& Cell, int32 Index);
+
+	/// <summary>
+	/// Find the anchor the local player would grapple to and highlight it
+	/// </summary>
+	void UpdateHighlight();
+
+	void SetHighlighted(UGrappleAnchorComponent* Anchor);
+
+	// Every anchor, with its location and cell at the same index
+	UPROPERTY()
+	TArray<UGrappleAnchorComponent*> Anchors;
+
+	TArray<FVector> Locations;
+	TArray<FIntVector> AnchorCells;
+
+	// Indices of the anchors in every cell that has any
+	TMap<FIntVector, TArray<int32>> Cells;
+
+	UPROPERTY()
+	UGrappleAnchorComponent* Highlighted = nullptr;
+
+	// Best anchor in the cone the last time we confirmed the highlight, and when
+	UPROPERTY()
+	UGrappleAnchorComponent* HighlightCandidate = nullptr;
+
+	float HighlightConfirmTime = 0;
+};
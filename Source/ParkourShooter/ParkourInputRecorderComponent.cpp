@@ -0,0 +1,488 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ParkourInputRecorderComponent.h"
+#include "ParkourShooter.h"
+#include "ParkourShooterCharacter.h"
+#include "ParkourStats.h"
+#include "CoreGlobals.h"
+#include "Engine/World.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+static FAutoConsoleCommandWithWorldAndArgs RecordInputCommand(
+	TEXT("Parkour.RecordInput"),
+	TEXT("Record the input of the local parkour character. Usage: Parkour.RecordInput Start | Stop [Path]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&UParkourInputRecorderComponent::RecordCommand)
+);
+
+static FAutoConsoleCommandWithWorldAndArgs ReplayInputCommand(
+	TEXT("Parkour.ReplayInput"),
+	TEXT("Replay recorded input on the local parkour character and check where it ends. ")
+	TEXT("Usage: Parkour.ReplayInput [Path] [Step=Seconds] [Update] [Quit]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&UParkourInputRecorderComponent::ReplayCommand)
+);
+
+namespace ParkourInputRecorder
+{
+	static FString GetDefaultPath()
+	{
+		return FPaths::ProjectSavedDir() / TEXT("ParkourInput") / TEXT("Recording.pkinput");
+	}
+
+	static int8 QuantizeAxis(float Value)
+	{
+		return static_cast<int8>(FMath::RoundToInt(FMath::Clamp(Value, -1.f, 1.f) * 127.f));
+	}
+
+	static float DequantizeAxis(int8 Value)
+	{
+		return Value / 127.f;
+	}
+
+	static bool HasAction(uint8 Actions, EParkourInputAction Action)
+	{
+		return (Actions & static_cast<uint8>(Action)) != 0;
+	}
+}
+
+FArchive& operator<<(FArchive& Ar, FParkourInputFrame& Frame)
+{
+	Ar << Frame.DeltaTime;
+	Ar << Frame.ForwardAxis << Frame.RightAxis;
+	Ar << Frame.Pitch << Frame.Yaw;
+	Ar << Frame.Actions;
+	return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FParkourInputState& State)
+{
+	Ar << State.Location << State.Rotation << State.ControlRotation << State.Velocity;
+	Ar << State.MovementMode << State.ParkourMovementState;
+	return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FParkourInputRecording& Recording)
+{
+	uint32 FileMagic = FParkourInputRecording::Magic;
+	uint32 FileVersion = FParkourInputRecording::Version;
+	Ar << FileMagic << FileVersion;
+
+	if (Ar.IsLoading() && (FileMagic != FParkourInputRecording::Magic || FileVersion != FParkourInputRecording::Version))
+	{
+		Ar.SetError();
+		return Ar;
+	}
+
+	Ar << Recording.StartState;
+	Ar << Recording.Frames;
+	Ar << Recording.bHasExpectedEndState;
+	Ar << Recording.ExpectedEndState;
+	Ar << Recording.ReplayDeltaTime;
+	return Ar;
+}
+
+bool FParkourInputRecording::SaveToFile(const FString& Path)
+{
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	Writer << *this;
+
+	return FFileHelper::SaveArrayToFile(Bytes, *Path);
+}
+
+bool FParkourInputRecording::LoadFromFile(const FString& Path)
+{
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *Path))
+		return false;
+
+	FMemoryReader Reader(Bytes);
+	Reader << *this;
+
+	return !Reader.IsError();
+}
+
+// Sets default values for this component's properties
+UParkourInputRecorderComponent::UParkourInputRecorderComponent()
+{
+	// We only tick while recording or replaying
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+}
+
+// Called when the game starts
+void UParkourInputRecorderComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	ShooterCharacter = Cast<AParkourShooterCharacter>(GetOwner());
+}
+
+void UParkourInputRecorderComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Don't leave the engine in fixed timestep if we go away in the middle of a replay
+	if (bReplaying)
+	{
+		FApp::SetUseFixedTimeStep(bPreviousUseFixedTimeStep);
+		FApp::SetFixedDeltaTime(PreviousFixedDeltaTime);
+		bReplaying = false;
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+// Called every frame
+void UParkourInputRecorderComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (bRecording)
+	{
+		RecordFrame(DeltaTime);
+		return;
+	}
+
+	if (!bReplaying)
+		return;
+
+	// The first frame still ran at whatever step we had before the replay started
+	if (ReplayFrameIndex > 0)
+		ReplayGameThreadMs.Add(FPlatformTime::ToMilliseconds(GGameThreadTime));
+
+	if (ReplayFrameIndex >= Recording.Frames.Num())
+	{
+		FinishReplay();
+		return;
+	}
+
+	ReplayFrame(Recording.Frames[ReplayFrameIndex++]);
+}
+
+void UParkourInputRecorderComponent::StartRecording()
+{
+	if (ShooterCharacter == nullptr || bReplaying)
+		return;
+
+	// We can only put the character back in states that don't depend on what it's touching
+	EMovementMode Mode = ShooterCharacter->GetCharacterMovement()->MovementMode;
+	if ((Mode != MOVE_Walking && Mode != MOVE_Falling) || ShooterCharacter->IsVaulting())
+	{
+		UE_LOG(LogParkour, Warning, TEXT("Input recording has to start on the ground or in the air"));
+		return;
+	}
+
+	SetupTickOrder();
+
+	Recording = FParkourInputRecording();
+	Recording.StartState = CaptureState();
+	PendingActions = 0;
+	bRecording = true;
+
+	SetComponentTickEnabled(true);
+
+	UE_LOG(LogParkour, Log, TEXT("Recording input of %s"), *ShooterCharacter->GetName());
+}
+
+bool UParkourInputRecorderComponent::StopRecording(const FString& Path)
+{
+	if (!bRecording)
+		return false;
+
+	bRecording = false;
+	SetComponentTickEnabled(false);
+
+	if (!Recording.SaveToFile(Path))
+	{
+		UE_LOG(LogParkour, Error, TEXT("Couldn't write input recording to %s"), *Path);
+		return false;
+	}
+
+	UE_LOG(LogParkour, Log, TEXT("Recorded %d frames of input to %s"), Recording.Frames.Num(), *Path);
+	return true;
+}
+
+bool UParkourInputRecorderComponent::StartReplay(const FString& Path, float DeltaTime, bool bUpdateExpected, bool bQuitWhenDone)
+{
+	if (ShooterCharacter == nullptr || bRecording || bReplaying)
+		return false;
+
+	if (!Recording.LoadFromFile(Path))
+	{
+		UE_LOG(LogParkour, Error, TEXT("Couldn't read input recording from %s"), *Path);
+		return false;
+	}
+
+	APlayerController* PlayerController = Cast<APlayerController>(ShooterCharacter->GetController());
+	if (PlayerController == nullptr)
+	{
+		UE_LOG(LogParkour, Error, TEXT("Input replay needs the character to be possessed by a player"));
+		return false;
+	}
+
+	// The expected end state only holds for the step it was taken at
+	if (DeltaTime > 0 && Recording.bHasExpectedEndState && !FMath::IsNearlyEqual(DeltaTime, Recording.ReplayDeltaTime) && !bUpdateExpected)
+	{
+		UE_LOG(LogParkour, Warning, TEXT("Replaying at %f but the expected end state is for %f, it won't be checked"), DeltaTime, Recording.ReplayDeltaTime);
+		Recording.bHasExpectedEndState = false;
+	}
+
+	if (DeltaTime > 0)
+		Recording.ReplayDeltaTime = DeltaTime;
+
+	SetupTickOrder();
+
+	// Only the recording moves the character from now on
+	ShooterCharacter->DisableInput(PlayerController);
+
+	bPreviousUseFixedTimeStep = FApp::UseFixedTimeStep();
+	PreviousFixedDeltaTime = FApp::GetFixedDeltaTime();
+	FApp::SetUseFixedTimeStep(true);
+	FApp::SetFixedDeltaTime(Recording.ReplayDeltaTime);
+
+	ApplyState(Recording.StartState);
+
+	ReplayPath = Path;
+	bUpdateExpectedOnReplay = bUpdateExpected;
+	bQuitAfterReplay = bQuitWhenDone;
+	ReplayFrameIndex = 0;
+	ReplayGameThreadMs.Reset(Recording.Frames.Num());
+	bReplaying = true;
+
+	SetComponentTickEnabled(true);
+
+	UE_LOG(LogParkour, Log, TEXT("Replaying %d frames of input from %s at %f"), Recording.Frames.Num(), *Path, Recording.ReplayDeltaTime);
+	return true;
+}
+
+void UParkourInputRecorderComponent::RecordAction(EParkourInputAction Action)
+{
+	if (bRecording)
+		PendingActions |= static_cast<uint8>(Action);
+}
+
+FParkourInputState UParkourInputRecorderComponent::CaptureState() const
+{
+	FParkourInputState State;
+	State.Location = ShooterCharacter->GetActorLocation();
+	State.Rotation = ShooterCharacter->GetActorRotation();
+	State.ControlRotation = ShooterCharacter->GetControlRotation();
+	State.Velocity = ShooterCharacter->GetCharacterMovement()->Velocity;
+	State.MovementMode = static_cast<uint8>(ShooterCharacter->GetCharacterMovement()->MovementMode);
+	State.ParkourMovementState = static_cast<uint8>(ShooterCharacter->CurrentMovementState);
+	return State;
+}
+
+void UParkourInputRecorderComponent::ApplyState(const FParkourInputState& State)
+{
+	// Let go of anything that would keep moving the character on its own
+	ShooterCharacter->CancelGrapplingHook();
+	ShooterCharacter->IsCrouchKeyDown = false;
+	ShooterCharacter->ForwardAxis = 0;
+	ShooterCharacter->RightAxis = 0;
+	ShooterCharacter->StopJumping();
+
+	ShooterCharacter->SetActorLocationAndRotation(State.Location, State.Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+	if (AController* Controller = ShooterCharacter->GetController())
+		Controller->SetControlRotation(State.ControlRotation);
+
+	UCharacterMovementComponent* Movement = ShooterCharacter->GetCharacterMovement();
+	Movement->SetMovementMode(static_cast<EMovementMode>(State.MovementMode));
+	Movement->Velocity = State.Velocity;
+
+	ShooterCharacter->SetMovementState(static_cast<MovementState>(State.ParkourMovementState));
+}
+
+void UParkourInputRecorderComponent::RecordFrame(float DeltaTime)
+{
+	using namespace ParkourInputRecorder;
+
+	// The controller already ran this frame's input through the character handlers
+	FRotator ControlRotation = ShooterCharacter->GetControlRotation();
+
+	FParkourInputFrame& Frame = Recording.Frames.AddDefaulted_GetRef();
+	Frame.DeltaTime = DeltaTime;
+	Frame.ForwardAxis = QuantizeAxis(ShooterCharacter->ForwardAxis);
+	Frame.RightAxis = QuantizeAxis(ShooterCharacter->RightAxis);
+	Frame.Pitch = FRotator::CompressAxisToShort(ControlRotation.Pitch);
+	Frame.Yaw = FRotator::CompressAxisToShort(ControlRotation.Yaw);
+	Frame.Actions = PendingActions;
+
+	PendingActions = 0;
+}
+
+void UParkourInputRecorderComponent::ReplayFrame(const FParkourInputFrame& Frame)
+{
+	using namespace ParkourInputRecorder;
+
+	// Look first, movement input is relative to where the character faces
+	FRotator ControlRotation(FRotator::DecompressAxisFromShort(Frame.Pitch), FRotator::DecompressAxisFromShort(Frame.Yaw), 0);
+	if (AController* Controller = ShooterCharacter->GetController())
+		Controller->SetControlRotation(ControlRotation);
+	ShooterCharacter->FaceRotation(ControlRotation, Frame.DeltaTime);
+
+	ShooterCharacter->MoveForward(DequantizeAxis(Frame.ForwardAxis));
+	ShooterCharacter->MoveRight(DequantizeAxis(Frame.RightAxis));
+
+	// Actions run in the order of their bits, the same order every time
+	if (HasAction(Frame.Actions, EParkourInputAction::JumpPressed))
+		ShooterCharacter->Jump();
+	if (HasAction(Frame.Actions, EParkourInputAction::JumpRepeat))
+		ShooterCharacter->VaultOnHold();
+	if (HasAction(Frame.Actions, EParkourInputAction::JumpReleased))
+		ShooterCharacter->StopJumping();
+	if (HasAction(Frame.Actions, EParkourInputAction::SlidePressed))
+		ShooterCharacter->Slide();
+	if (HasAction(Frame.Actions, EParkourInputAction::SlideReleased))
+		ShooterCharacter->SlideRelease();
+	if (HasAction(Frame.Actions, EParkourInputAction::GrapplePressed))
+		ShooterCharacter->ShootGrapplingHook();
+	if (HasAction(Frame.Actions, EParkourInputAction::GrappleReleased))
+		ShooterCharacter->CancelGrapplingHook();
+	if (HasAction(Frame.Actions, EParkourInputAction::Fire))
+		ShooterCharacter->OnFire();
+}
+
+void UParkourInputRecorderComponent::FinishReplay()
+{
+	bReplaying = false;
+	SetComponentTickEnabled(false);
+
+	FApp::SetUseFixedTimeStep(bPreviousUseFixedTimeStep);
+	FApp::SetFixedDeltaTime(PreviousFixedDeltaTime);
+
+	if (APlayerController* PlayerController = Cast<APlayerController>(ShooterCharacter->GetController()))
+		ShooterCharacter->EnableInput(PlayerController);
+
+	// What the replay cost, so it works as a benchmark too
+	FParkourSampleStats Stats = FParkourSampleStats::Compute(ReplayGameThreadMs);
+	if (Stats.Num > 0)
+		UE_LOG(LogParkour, Display, TEXT("Input replay game thread ms: p50 %.4f p95 %.4f p99 %.4f max %.4f over %d frames"),
+			Stats.P50, Stats.P95, Stats.P99, Stats.Max, Stats.Num);
+
+	FParkourInputState EndState = CaptureState();
+	bool bPassed = true;
+
+	if (bUpdateExpectedOnReplay)
+	{
+		Recording.bHasExpectedEndState = true;
+		Recording.ExpectedEndState = EndState;
+		if (Recording.SaveToFile(ReplayPath))
+		{
+			UE_LOG(LogParkour, Display, TEXT("Input replay end state stored in %s"), *ReplayPath);
+		}
+		else
+		{
+			UE_LOG(LogParkour, Error, TEXT("Couldn't write input recording to %s"), *ReplayPath);
+			bPassed = false;
+		}
+	}
+	else
+	{
+		bPassed = CheckEndState(EndState);
+	}
+
+	if (bQuitAfterReplay)
+		FPlatformMisc::RequestExitWithStatus(false, bPassed ? 0 : 1);
+}
+
+bool UParkourInputRecorderComponent::CheckEndState(const FParkourInputState& EndState) const
+{
+	if (!Recording.bHasExpectedEndState)
+	{
+		UE_LOG(LogParkour, Display, TEXT("Input replay ended at %s, there's no expected end state to check against"), *EndState.Location.ToString());
+		return true;
+	}
+
+	const FParkourInputState& Expected = Recording.ExpectedEndState;
+	float LocationError = FVector::Dist(EndState.Location, Expected.Location);
+	float VelocityError = FVector::Dist(EndState.Velocity, Expected.Velocity);
+
+	bool bPassed = LocationError <= LocationTolerance
+		&& VelocityError <= VelocityTolerance
+		&& EndState.MovementMode == Expected.MovementMode
+		&& EndState.ParkourMovementState == Expected.ParkourMovementState;
+
+	if (bPassed)
+	{
+		UE_LOG(LogParkour, Display, TEXT("Input replay matches the expected end state (location off by %f, velocity off by %f)"), LocationError, VelocityError);
+	}
+	else
+	{
+		UE_LOG(LogParkour, Error, TEXT("Input replay ended at %s moving at %s (mode %d, state %d), expected %s moving at %s (mode %d, state %d)"),
+			*EndState.Location.ToString(), *EndState.Velocity.ToString(), EndState.MovementMode, EndState.ParkourMovementState,
+			*Expected.Location.ToString(), *Expected.Velocity.ToString(), Expected.MovementMode, Expected.ParkourMovementState);
+	}
+
+	return bPassed;
+}
+
+void UParkourInputRecorderComponent::SetupTickOrder()
+{
+	AController* Controller = ShooterCharacter->GetController();
+	if (Controller != nullptr)
+		PrimaryComponentTick.AddPrerequisite(Controller, Controller->PrimaryActorTick);
+
+	// The character and its movement have to see the input we record or replay on the same frame
+	ShooterCharacter->PrimaryActorTick.AddPrerequisite(this, PrimaryComponentTick);
+	ShooterCharacter->GetCharacterMovement()->PrimaryComponentTick.AddPrerequisite(this, PrimaryComponentTick);
+}
+
+UParkourInputRecorderComponent* UParkourInputRecorderComponent::FindLocalRecorder(UWorld* World)
+{
+	APlayerController* PlayerController = World != nullptr ? World->GetFirstPlayerController() : nullptr;
+	APawn* Pawn = PlayerController != nullptr ? PlayerController->GetPawn() : nullptr;
+	UParkourInputRecorderComponent* Recorder = Pawn != nullptr ? Pawn->FindComponentByClass<UParkourInputRecorderComponent>() : nullptr;
+
+	if (Recorder == nullptr)
+		UE_LOG(LogParkour, Error, TEXT("Input recording needs a local player with a parkour character"));
+
+	return Recorder;
+}
+
+void UParkourInputRecorderComponent::RecordCommand(const TArray<FString>& Args, UWorld* World)
+{
+	UParkourInputRecorderComponent* Recorder = FindLocalRecorder(World);
+	if (Recorder == nullptr)
+		return;
+
+	if (Args.Num() > 0 && Args[0].Equals(TEXT("Start"), ESearchCase::IgnoreCase))
+	{
+		Recorder->StartRecording();
+	}
+	else if (Args.Num() > 0 && Args[0].Equals(TEXT("Stop"), ESearchCase::IgnoreCase))
+	{
+		Recorder->StopRecording(Args.Num() > 1 ? Args[1] : ParkourInputRecorder::GetDefaultPath());
+	}
+	else
+	{
+		UE_LOG(LogParkour, Warning, TEXT("Usage: Parkour.RecordInput Start | Stop [Path]"));
+	}
+}
+
+void UParkourInputRecorderComponent::ReplayCommand(const TArray<FString>& Args, UWorld* World)
+{
+	FString Path = ParkourInputRecorder::GetDefaultPath();
+	float Step = 0;
+	bool bUpdate = false;
+	bool bQuit = false;
+
+	for (const FString& Arg : Args)
+	{
+		if (Arg.Equals(TEXT("Update"), ESearchCase::IgnoreCase))
+			bUpdate = true;
+		else if (Arg.Equals(TEXT("Quit"), ESearchCase::IgnoreCase))
+			bQuit = true;
+		else if (!FParse::Value(*Arg, TEXT("Step="), Step))
+			Path = Arg;
+	}
+
+	UParkourInputRecorderComponent* Recorder = FindLocalRecorder(World);
+	if ((Recorder == nullptr || !Recorder->StartReplay(Path, Step, bUpdate, bQuit)) && bQuit)
+		FPlatformMisc::RequestExitWithStatus(false, 1);
+}
@@ -0,0 +1,183 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "ParkourInputRecorderComponent.generated.h"
+
+class AParkourShooterCharacter;
+
+/** Action bindings of the parkour character, as bits of a recorded frame. Replayed in this order */
+enum class EParkourInputAction : uint8
+{
+	JumpPressed = 1 << 0,
+	JumpRepeat = 1 << 1,
+	JumpReleased = 1 << 2,
+	SlidePressed = 1 << 3,
+	SlideReleased = 1 << 4,
+	GrapplePressed = 1 << 5,
+	GrappleReleased = 1 << 6,
+	Fire = 1 << 7
+};
+
+/** Input of a single frame, quantized to keep recordings small */
+struct FParkourInputFrame
+{
+	float DeltaTime = 0;
+
+	// MoveForward and MoveRight axis values, from -127 to 127
+	int8 ForwardAxis = 0;
+	int8 RightAxis = 0;
+
+	// Control rotation after this frame's input, compressed to shorts
+	uint16 Pitch = 0;
+	uint16 Yaw = 0;
+
+	// EParkourInputAction bits of the actions that fired this frame
+	uint8 Actions = 0;
+
+	friend FArchive& operator<<(FArchive& Ar, FParkourInputFrame& Frame);
+};
+
+/** Where the character was and what it was doing at some point of a recording */
+struct FParkourInputState
+{
+	FVector Location = FVector::ZeroVector;
+	FRotator Rotation = FRotator::ZeroRotator;
+	FRotator ControlRotation = FRotator::ZeroRotator;
+	FVector Velocity = FVector::ZeroVector;
+	uint8 MovementMode = 0;
+	uint8 ParkourMovementState = 0;
+
+	friend FArchive& operator<<(FArchive& Ar, FParkourInputState& State);
+};
+
+/** A recorded session: starting state, input for every frame and, once replayed, the expected result */
+struct FParkourInputRecording
+{
+	static const uint32 Magic = 0x4B52504B; // "PKRK"
+	static const uint32 Version = 1;
+
+	FParkourInputState StartState;
+	TArray<FParkourInputFrame> Frames;
+
+	/** Where a replay at ReplayDeltaTime ends. Replays are checked against it if we have it */
+	bool bHasExpectedEndState = false;
+	FParkourInputState ExpectedEndState;
+	float ReplayDeltaTime = 1.f / 60.f;
+
+	bool SaveToFile(const FString& Path);
+	bool LoadFromFile(const FString& Path);
+
+	friend FArchive& operator<<(FArchive& Ar, FParkourInputRecording& Recording);
+};
+
+/**
+ * Records the input of the parkour character as it reaches its handlers, and feeds a recording back into the
+ * same handlers at a fixed timestep, with live input disabled. A replay always produces the same movement, so
+ * a session captured in the field can be rerun headless as a benchmark and to check movement didn't change:
+ *
+ *   Parkour.RecordInput Start / Parkour.RecordInput Stop [Path]
+ *   Parkour.ReplayInput [Path] [Step=Seconds] [Update] [Quit]
+ *
+ * Update stores the replay result in the file as the expected one, later replays report if they end anywhere else.
+ * Replays read the quantized input, not what the player actually pressed, so only replays are compared to each
+ * other. Recordings start on the ground or in the air, we can't put the character back on a wall or a ledge.
+ */
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class PARKOURSHOOTER_API UParkourInputRecorderComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this component's properties
+	UParkourInputRecorderComponent();
+
+	// Called every frame
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	/// <summary>
+	/// Start recording from the next frame on, with the current state of the character as the starting state
+	/// </summary>
+	void StartRecording();
+
+	/// <summary>
+	/// Stop recording and write what we got
+	/// </summary>
+	/// <returns> True if the file was written </returns>
+	bool StopRecording(const FString& Path);
+
+	/// <summary>
+	/// Put the character in the recording starting state and replay its input, one recorded frame per tick
+	/// </summary>
+	/// <param name="Path"> Recording to replay </param>
+	/// <param name="DeltaTime"> Fixed timestep to replay at </param>
+	/// <param name="bUpdateExpected"> Store where the replay ends as the expected end state </param>
+	/// <param name="bQuitWhenDone"> Close the game when done, with a non zero exit code if the check failed </param>
+	bool StartReplay(const FString& Path, float DeltaTime, bool bUpdateExpected, bool bQuitWhenDone);
+
+	bool IsRecording() const { return bRecording; }
+	bool IsReplaying() const { return bReplaying; }
+
+	/// <summary>
+	/// Called by the character action handlers, so the action ends up in this frame of the recording
+	/// </summary>
+	void RecordAction(EParkourInputAction Action);
+
+	static void RecordCommand(const TArray<FString>& Args, UWorld* World);
+	static void ReplayCommand(const TArray<FString>& Args, UWorld* World);
+
+protected:
+	// Called when the game starts
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	FParkourInputState CaptureState() const;
+	void ApplyState(const FParkourInputState& State);
+
+	void RecordFrame(float DeltaTime);
+	void ReplayFrame(const FParkourInputFrame& Frame);
+	void FinishReplay();
+
+	/// <summary>
+	/// Check the state the replay ended in against the expected one
+	/// </summary>
+	/// <returns> True if they match, or if there's nothing to check against </returns>
+	bool CheckEndState(const FParkourInputState& EndState) const;
+
+	/// <summary>
+	/// Make our tick run after the controller processed input and before the character moves
+	/// </summary>
+	void SetupTickOrder();
+
+	static UParkourInputRecorderComponent* FindLocalRecorder(UWorld* World);
+
+	/** Max distance between the replay end and the expected end to consider it the same */
+	UPROPERTY(EditAnywhere, Category = "Recording")
+	float LocationTolerance = 1;
+
+	/** Max velocity difference between the replay end and the expected end to consider it the same */
+	UPROPERTY(EditAnywhere, Category = "Recording")
+	float VelocityTolerance = 1;
+
+	UPROPERTY()
+	AParkourShooterCharacter* ShooterCharacter = nullptr;
+
+	FParkourInputRecording Recording;
+
+	bool bRecording = false;
+	uint8 PendingActions = 0;
+
+	bool bReplaying = false;
+	int32 ReplayFrameIndex = 0;
+	FString ReplayPath;
+	bool bUpdateExpectedOnReplay = false;
+	bool bQuitAfterReplay = false;
+	TArray<float> ReplayGameThreadMs;
+
+	// Engine timestep settings to put back after a replay
+	bool bPreviousUseFixedTimeStep = false;
+	double PreviousFixedDeltaTime = 0;
+};
@@ -0,0 +1,799 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ParkourMovementComponent.h"
+#include "ParkourShooter.h"
+#include "GameFramework/Character.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Curves/CurveFloat.h"
+#include "Engine/World.h"
+#include "ParkourStats.h"
+#include "ParkourQueryBudget.h"
+
+namespace ParkourMovement
+{
+	/** Round a location the way FVector_NetQuantize10 sends it, so the owning client simulates what the server gets */
+	static FVector QuantizeLocation(const FVector& Location)
+	{
+		return FVector(FMath::RoundToFloat(Location.X * 10.f), FMath::RoundToFloat(Location.Y * 10.f), FMath::RoundToFloat(Location.Z * 10.f)) / 10.f;
+	}
+}
+
+FVector FParkourVaultProfile::Evaluate(const FVector& Start, const FVector& End, float Alpha) const
+{
+	if (Alpha >= 1.f)
+		return End;
+
+	// Without curves, go up first, easing out as we reach the top, then forward, easing in and out
+	float Rise, Forward;
+	if (HeightCurve != nullptr)
+		Rise = HeightCurve->GetFloatValue(Alpha);
+	else
+		Rise = FMath::InterpEaseOut(0.f, 1.f, FMath::Min(Alpha / FMath::Max(LiftPortion, KINDA_SMALL_NUMBER), 1.f), 2.f);
+
+	if (ForwardCurve != nullptr)
+		Forward = ForwardCurve->GetFloatValue(Alpha);
+	else
+		Forward = FMath::InterpEaseInOut(0.f, 1.f, FMath::Max((Alpha - LiftPortion) / (1.f - LiftPortion), 0.f), 2.f);
+
+	FVector Location = FMath::Lerp(Start, End, Forward);
+	Location.Z = FMath::Lerp(Start.Z, End.Z, Rise) + ArcHeight * FMath::Sin(PI * Alpha);
+	return Location;
+}
+
+UParkourMovementComponent::UParkourMovementComponent()
+{
+	bWantsToWallRun = false;
+	bWantsToSlide = false;
+	bWantsToVault = false;
+	bWantsToGrapple = false;
+
+	WallRunDirection = FVector::ZeroVector;
+	VaultStartLocation = FVector::ZeroVector;
+	VaultEndLocation = FVector::ZeroVector;
+	GrappleAnchor = FVector::ZeroVector;
+
+	PrevStepLocation = FVector::ZeroVector;
+	LastStepLocation = FVector::ZeroVector;
+	StepVisualOffset = FVector::ZeroVector;
+	StepMeshOffset = FVector::ZeroVector;
+	StepCameraOffset = FVector::ZeroVector;
+}
+
+bool UParkourMovementComponent::IsCustomMode(EParkourMovementMode Mode) const
+{
+	return MovementMode == MOVE_Custom && CustomMovementMode == static_cast<uint8>(Mode);
+}
+
+bool UParkourMovementComponent::IsMovingOnGround() const
+{
+	// Sliding is walking with less friction, everything that cares about being on the floor should see it that way
+	return Super::IsMovingOnGround() || (IsCustomMode(EParkourMovementMode::Slide) && UpdatedComponent != nullptr);
+}
+
+float UParkourMovementComponent::GetMaxSpeed() const
+{
+	if (MovementMode != MOVE_Custom)
+		return Super::GetMaxSpeed();
+
+	switch (static_cast<EParkourMovementMode>(CustomMovementMode))
+	{
+	case EParkourMovementMode::WallRun:
+	case EParkourMovementMode::Slide:
+		return MaxWalkSpeed;
+	default:
+		break;
+	}
+
+	return Super::GetMaxSpeed();
+}
+
+float UParkourMovementComponent::GetMaxBrakingDeceleration() const
+{
+	if (IsCustomMode(EParkourMovementMode::Slide))
+		return SlideParams.BrakingDeceleration;
+
+	return Super::GetMaxBrakingDeceleration();
+}
+
+void UParkourMovementComponent::CalcVelocity(float DeltaTime, float Friction, bool bFluid, float BrakingDeceleration)
+{
+	// Slide uses its own friction, so we don't have to touch the walking one
+	if (IsCustomMode(EParkourMovementMode::Slide))
+		Friction = SlideParams.GroundFriction;
+
+	Super::CalcVelocity(DeltaTime, Friction, bFluid, BrakingDeceleration);
+}
+
+FNetworkPredictionData_Client* UParkourMovementComponent::GetPredictionData_Client() const
+{
+	check(PawnOwner != nullptr);
+
+	if (ClientPredictionData == nullptr)
+	{
+		UParkourMovementComponent* MutableThis = const_cast<UParkourMovementComponent*>(this);
+		MutableThis->ClientPredictionData = new FNetworkPredictionData_Client_Parkour(*this);
+	}
+
+	return ClientPredictionData;
+}
+
+void UParkourMovementComponent::BeginWallRun(const FVector& Direction)
+{
+	SetWallRunDirection(Direction);
+	bWantsToWallRun = true;
+}
+
+void UParkourMovementComponent::SetWallRunDirection(const FVector& Direction)
+{
+	// This is updated every fixed step while wallrunning, only bother the server when it actually changes
+	const bool bChanged = !WallRunDirection.Equals(Direction, KINDA_SMALL_NUMBER);
+	WallRunDirection = Direction;
+
+	if (bChanged && IsOwningClient())
+		ServerSetWallRunDirection(Direction);
+}
+
+void UParkourMovementComponent::EndWallRun()
+{
+	bWantsToWallRun = false;
+}
+
+FVector UParkourMovementComponent::ComputeFloorInfluence(FVector FloorNormal) const
+{
+	// There's no influence if we're in a flat surface
+	if (FloorNormal == FVector::UpVector) return FVector::ZeroVector;
+
+	// The first cross product will give us a vector pointing forward or backwards depending on floor normal,
+	// The second one will give us a vector inside the floor plane pointing downwards
+	FVector SurfaceDownwardsDirection = FVector::CrossProduct(FloorNormal, FVector::CrossProduct(FloorNormal, FVector::UpVector));
+	SurfaceDownwardsDirection.Normalize();
+
+	// Now we will scale this direction to how steep this floor is
+	float Projection = FMath::Clamp(1.f - FVector::DotProduct(FloorNormal, FVector::UpVector), 0.f, 1.f);
+	FVector ResultingInfluence = Projection * SlideParams.FloorInfluenceForce * SurfaceDownwardsDirection;
+	PARKOUR_LOG_THROTTLED(Verbose, 1.f, TEXT("Floor influence is: (%f, %f, %f)"), ResultingInfluence.X, ResultingInfluence.Y, ResultingInfluence.Z);
+
+	return ResultingInfluence;
+}
+
+void UParkourMovementComponent::BeginVault(const FVector& EndLocation)
+{
+	// The end location is a capsule half height over the ledge, like we are over our feet, so the difference is
+	// the height of the ledge
+	const FVector Location = UpdatedComponent->GetComponentLocation();
+	const float LedgeHeight = EndLocation.Z - Location.Z;
+
+	VaultEndLocation = ParkourMovement::QuantizeLocation(EndLocation);
+	VaultProfile = static_cast<uint8>(FindVaultProfile(LedgeHeight));
+	VaultProgress = 0;
+	bWantsToVault = true;
+
+	// Where to and how is all the server needs, it takes the start from where our move puts us
+	if (IsOwningClient())
+		ServerBeginVault(VaultEndLocation, VaultProfile);
+}
+
+int32 UParkourMovementComponent::FindVaultProfile(float LedgeHeight) const
+{
+	for (int32 i = 0; i < VaultProfiles.Num(); i++)
+	{
+		if (LedgeHeight <= VaultProfiles[i].MaxLedgeHeight)
+			return i;
+	}
+
+	return FMath::Max(VaultProfiles.Num() - 1, 0);
+}
+
+const FParkourVaultProfile& UParkourMovementComponent::GetVaultProfile() const
+{
+	static const FParkourVaultProfile DefaultProfile;
+	return VaultProfiles.IsValidIndex(VaultProfile) ? VaultProfiles[VaultProfile] : DefaultProfile;
+}
+
+void UParkourMovementComponent::BeginGrapple(const FVector& Anchor)
+{
+	GrappleAnchor = ParkourMovement::QuantizeLocation(Anchor);
+	bWantsToGrapple = true;
+
+	// The initial velocity comes from where the mode starts, the server works it out on its side
+	if (IsOwningClient())
+		ServerBeginGrapple(GrappleAnchor);
+}
+
+void UParkourMovementComponent::EndGrapple()
+{
+	bWantsToGrapple = false;
+}
+
+void UParkourMovementComponent::UpdateFromCompressedFlags(uint8 Flags)
+{
+	Super::UpdateFromCompressedFlags(Flags);
+
+	bWantsToWallRun = (Flags & FSavedMove_Character::FLAG_Custom_0) != 0;
+	bWantsToSlide = (Flags & FSavedMove_Character::FLAG_Custom_1) != 0;
+	bWantsToVault = (Flags & FSavedMove_Character::FLAG_Custom_2) != 0;
+	bWantsToGrapple = (Flags & FSavedMove_Character::FLAG_Custom_3) != 0;
+}
+
+void UParkourMovementComponent::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
+{
+	Super::UpdateCharacterStateBeforeMovement(DeltaSeconds);
+
+	// Leave any parkour mode nobody wants anymore
+	if (IsCustomMode(EParkourMovementMode::Slide) && !bWantsToSlide)
+		SetMovementMode(MOVE_Walking);
+	else if (IsCustomMode(EParkourMovementMode::WallRun) && !bWantsToWallRun)
+		SetMovementMode(MOVE_Falling);
+	else if (IsCustomMode(EParkourMovementMode::Grapple) && !bWantsToGrapple)
+		SetMovementMode(MOVE_Falling);
+	else if (IsCustomMode(EParkourMovementMode::Vault) && !bWantsToVault)
+		SetMovementMode(MOVE_Falling);
+
+	// Now enter the one we asked for. Vault and grapple win over everything else since they're explicit requests
+	if (bWantsToVault)
+	{
+		if (!IsCustomMode(EParkourMovementMode::Vault) && ConsumeModeData(bVaultDataReceived))
+		{
+			VaultStartLocation = UpdatedComponent->GetComponentLocation();
+			VaultProgress = 0;
+
+			if (IsServerForRemoteClient() && !IsValidVault(VaultStartLocation, VaultEndLocation))
+			{
+				UE_LOG(LogParkour, Warning, TEXT("%s: rejected vault to %s"), *GetNameSafe(CharacterOwner), *VaultEndLocation.ToString());
+			}
+			else
+			{
+				SetMovementMode(MOVE_Custom, static_cast<uint8>(EParkourMovementMode::Vault));
+			}
+		}
+	}
+	else if (bWantsToGrapple)
+	{
+		if (!IsCustomMode(EParkourMovementMode::Grapple) && ConsumeModeData(bGrappleDataReceived))
+		{
+			if (IsServerForRemoteClient() && !IsValidGrappleAnchor(GrappleAnchor))
+			{
+				UE_LOG(LogParkour, Warning, TEXT("%s: rejected grapple to %s"), *GetNameSafe(CharacterOwner), *GrappleAnchor.ToString());
+			}
+			else
+			{
+				GrappleHorizontalSpeed = 0;
+				GrappleVerticalSpeed = 0;
+				SetMovementMode(MOVE_Custom, static_cast<uint8>(EParkourMovementMode::Grapple));
+				Velocity = GrappleParams.InitialSpeed * (GrappleAnchor - UpdatedComponent->GetComponentLocation()).GetSafeNormal();
+			}
+		}
+	}
+	else if (bWantsToWallRun)
+	{
+		// We can only start running on a wall while in the air
+		if (IsFalling())
+		{
+			SetMovementMode(MOVE_Custom, static_cast<uint8>(EParkourMovementMode::WallRun));
+			Velocity.Z = 0;
+		}
+	}
+	else if (bWantsToSlide)
+	{
+		// Slide starts from the ground, if we're in the air it will start as soon as we land
+		if (MovementMode == MOVE_Walking)
+		{
+			SetMovementMode(MOVE_Custom, static_cast<uint8>(EParkourMovementMode::Slide));
+
+			// Push us forward, unless we're already faster than that
+			if (Velocity.SizeSquared2D() < SlideParams.InitialSpeed * SlideParams.InitialSpeed)
+				Velocity = SlideParams.InitialSpeed * CharacterOwner->GetActorForwardVector();
+		}
+	}
+}
+
+void UParkourMovementComponent::OnMovementModeChanged(EMovementMode PreviousMovementMode, uint8 PreviousCustomMode)
+{
+	Super::OnMovementModeChanged(PreviousMovementMode, PreviousCustomMode);
+
+	if (MovementMode == MOVE_Custom)
+	{
+		TRACE_BOOKMARK(TEXT("%s: parkour mode %s"), *GetNameSafe(CharacterOwner), *UEnum::GetValueAsString(static_cast<EParkourMovementMode>(CustomMovementMode)));
+	}
+
+	// Every mode starts its fixed steps from scratch
+	ParkourStepAccumulator = 0;
+	bHasFixedStepLocation = false;
+	SetStepVisualOffset(FVector::ZeroVector);
+
+	// The base class forgets the floor for every mode other than walking, but slide needs it to move along the ground
+	if (IsCustomMode(EParkourMovementMode::Slide))
+	{
+		bCrouchMaintainsBaseLocation = true;
+		FindFloor(UpdatedComponent->GetComponentLocation(), CurrentFloor, false);
+		AdjustFloorHeight();
+		SetBaseFromFloor(CurrentFloor);
+	}
+}
+
+void UParkourMovementComponent::PhysCustom(float deltaTime, int32 Iterations)
+{
+	Super::PhysCustom(deltaTime, Iterations);
+
+	switch (static_cast<EParkourMovementMode>(CustomMovementMode))
+	{
+	case EParkourMovementMode::WallRun:
+	case EParkourMovementMode::Slide:
+	case EParkourMovementMode::Grapple:
+		PhysFixedSteps(deltaTime, Iterations);
+		break;
+	case EParkourMovementMode::Vault:
+		// Vault follows its profile over its duration, it doesn't depend on the frame rate already
+		PhysVault(deltaTime, Iterations);
+		break;
+	default:
+		UE_LOG(LogParkour, Error, TEXT("Invalid parkour movement mode: %d"), CustomMovementMode);
+		SetMovementMode(MOVE_Falling);
+		break;
+	}
+}
+
+void UParkourMovementComponent::PhysFixedSteps(float deltaTime, int32 Iterations)
+{
+	PARKOUR_SCOPE_CYCLE_COUNTER(STAT_ParkourFixedSteps);
+
+	const EParkourMovementMode Mode = static_cast<EParkourMovementMode>(CustomMovementMode);
+	const float StepTime = GetParkourStepTime();
+
+	// If something else moved us since the last step, like a correction from the server, start over from there
+	if (bHasFixedStepLocation && !UpdatedComponent->GetComponentLocation().Equals(LastStepLocation, KINDA_SMALL_NUMBER))
+		bHasFixedStepLocation = false;
+
+	if (!bHasFixedStepLocation)
+	{
+		PrevStepLocation = UpdatedComponent->GetComponentLocation();
+		LastStepLocation = PrevStepLocation;
+	}
+
+	ParkourStepAccumulator += deltaTime;
+
+	// Nobody replays moves on a listen server or standalone, but the owning client does after a correction
+	const bool bNotifySteps = CharacterOwner->IsLocallyControlled() && !CharacterOwner->bClientUpdating;
+
+	int32 Steps = 0;
+	while (ParkourStepAccumulator >= StepTime && Steps < MaxParkourSteps)
+	{
+		ParkourStepAccumulator -= StepTime;
+		Steps++;
+
+		PrevStepLocation = UpdatedComponent->GetComponentLocation();
+
+		switch (Mode)
+		{
+		case EParkourMovementMode::WallRun:
+			PhysWallRun(StepTime, Iterations);
+			break;
+		case EParkourMovementMode::Slide:
+			PhysSlide(StepTime, Iterations);
+			break;
+		case EParkourMovementMode::Grapple:
+			PhysGrapple(StepTime, Iterations);
+			break;
+		default:
+			break;
+		}
+
+		// The step might have left the mode, like sliding off a ledge. The new mode takes it from here
+		if (!IsCustomMode(Mode))
+		{
+			SetStepVisualOffset(FVector::ZeroVector);
+			return;
+		}
+
+		LastStepLocation = UpdatedComponent->GetComponentLocation();
+		bHasFixedStepLocation = true;
+
+		if (bNotifySteps)
+			OnParkourStep.Broadcast(Mode, StepTime);
+
+		// Someone listening to the step might have ended the mode as well
+		if (!IsCustomMode(Mode))
+		{
+			SetStepVisualOffset(FVector::ZeroVector);
+			return;
+		}
+	}
+
+	// Too far behind, drop the time we couldn't simulate instead of trying to catch up forever
+	if (Steps >= MaxParkourSteps)
+		ParkourStepAccumulator = FMath::Min(ParkourStepAccumulator, StepTime);
+
+	if (!bInterpolateParkourSteps || !bHasFixedStepLocation)
+	{
+		SetStepVisualOffset(FVector::ZeroVector);
+		return;
+	}
+
+	// Show the character in between the last two steps, so it moves smoothly when we update faster than we step.
+	// The capsule stays at the last step, collision and the next steps only see the simulated location
+	const float Alpha = FMath::Clamp(ParkourStepAccumulator / StepTime, 0.f, 1.f);
+	SetStepVisualOffset(FMath::Lerp(PrevStepLocation, LastStepLocation, Alpha) - LastStepLocation);
+}
+
+void UParkourMovementComponent::SetStepVisualOffset(const FVector& NewOffset)
+{
+	StepVisualOffset = NewOffset;
+	if (UpdatedComponent == nullptr || CharacterOwner == nullptr)
+		return;
+
+	// Mesh and camera hang from the capsule, so the offset goes in its space. Same as the smoothing of simulated
+	// proxies, we only touch the relative locations
+	const FVector RelativeOffset = UpdatedComponent->GetComponentTransform().InverseTransformVector(NewOffset);
+
+	USkeletalMeshComponent* Mesh = CharacterOwner->GetMesh();
+	if (Mesh != nullptr && !RelativeOffset.Equals(StepMeshOffset))
+	{
+		Mesh->SetRelativeLocation(Mesh->GetRelativeLocation() - StepMeshOffset + RelativeOffset);
+		StepMeshOffset = RelativeOffset;
+	}
+
+	if (StepVisualCamera != nullptr && !RelativeOffset.Equals(StepCameraOffset))
+	{
+		StepVisualCamera->SetRelativeLocation(StepVisualCamera->GetRelativeLocation() - StepCameraOffset + RelativeOffset);
+		StepCameraOffset = RelativeOffset;
+	}
+}
+
+void UParkourMovementComponent::SmoothClientPosition_UpdateVisuals()
+{
+	USkeletalMeshComponent* Mesh = CharacterOwner != nullptr ? CharacterOwner->GetMesh() : nullptr;
+	if (Mesh == nullptr || StepMeshOffset.IsZero())
+	{
+		Super::SmoothClientPosition_UpdateVisuals();
+		return;
+	}
+
+	// The smoothing might place the mesh from scratch or leave it be, take our offset out and put it back on top
+	Mesh->SetRelativeLocation(Mesh->GetRelativeLocation() - StepMeshOffset);
+	Super::SmoothClientPosition_UpdateVisuals();
+	Mesh->SetRelativeLocation(Mesh->GetRelativeLocation() + StepMeshOffset);
+}
+
+void UParkourMovementComponent::PhysWallRun(float deltaTime, int32 Iterations)
+{
+	if (deltaTime < MIN_TICK_TIME)
+		return;
+
+	// Run along the wall without falling. The character keeps the direction up to date as the wall changes
+	FVector NewVelocity = WallRunDirection * GetMaxSpeed();
+	NewVelocity.Z = 0;
+	Velocity = NewVelocity;
+
+	MoveWithVelocity(deltaTime);
+}
+
+void UParkourMovementComponent::PhysSlide(float deltaTime, int32 Iterations)
+{
+	if (deltaTime < MIN_TICK_TIME)
+		return;
+
+	// Slopes pull us downhill. Same as AddForce, but applied in the move itself so it's replayed with it
+	if (CurrentFloor.IsWalkableFloor())
+	{
+		FVector Influence = ComputeFloorInfluence(CurrentFloor.HitResult.Normal);
+		Velocity += Influence * deltaTime / FMath::Max(Mass, KINDA_SMALL_NUMBER);
+	}
+
+	// Now clamp velocity
+	Velocity = Velocity.GetClampedToMaxSize(SlideParams.MaxSpeed);
+
+	// From here it's regular walking, with slide friction and braking thanks to our overrides
+	PhysWalking(deltaTime, Iterations);
+}
+
+void UParkourMovementComponent::PhysVault(float deltaTime, int32 Iterations)
+{
+	if (deltaTime < MIN_TICK_TIME)
+		return;
+
+	const FParkourVaultProfile& Profile = GetVaultProfile();
+	VaultProgress = FMath::Clamp(VaultProgress + deltaTime / FMath::Max(Profile.Duration, KINDA_SMALL_NUMBER), 0.f, 1.f);
+
+	// Head for where the profile wants us now, as a velocity, so the move is a regular move and not a teleport
+	const FVector OldLocation = UpdatedComponent->GetComponentLocation();
+	const FVector TargetLocation = Profile.Evaluate(VaultStartLocation, VaultEndLocation, VaultProgress);
+	Velocity = (TargetLocation - OldLocation) / deltaTime;
+
+	// Always sweep, sliding along the wall we climb. Client and server have to move the same way, and the
+	// server can't let a client's vault take it through anything
+	MoveWithVelocity(deltaTime);
+
+	// If close enough to the end, we're done
+	const FVector NewLocation = UpdatedComponent->GetComponentLocation();
+	const float MinDistanceToTarget = 10;
+	if (VaultProgress >= 1.f || FVector::DistSquared(NewLocation, VaultEndLocation) <= MinDistanceToTarget * MinDistanceToTarget)
+	{
+		bWantsToVault = false;
+		Velocity = FVector::ZeroVector;
+		SetMovementMode(MOVE_Falling);
+	}
+}
+
+void UParkourMovementComponent::PhysGrapple(float deltaTime, int32 Iterations)
+{
+	if (deltaTime < MIN_TICK_TIME)
+		return;
+
+	const FVector Right = UpdatedComponent->GetRightVector();
+	const FVector Up = UpdatedComponent->GetUpVector();
+
+	// Movement input lets us go a bit to the side, and forward input a bit up
+	const float MaxAccel = GetMaxAcceleration();
+	const FVector Input = MaxAccel > 0 ? Acceleration / MaxAccel : FVector::ZeroVector;
+	const float HorizontalMovement = FVector::DotProduct(Input, Right);
+	const float VerticalMovement = FVector::DotProduct(Input, UpdatedComponent->GetForwardVector());
+
+	// Change direction a bit depending on if you want to go a bit to the side or a bit up or down
+	UpdateGrappleAxis(HorizontalMovement, GrappleHorizontalSpeed, GrappleParams.ContinousHorizontalSpeed, deltaTime, GrappleParams.MaxHorizontalMovementSpeed);
+	UpdateGrappleAxis(VerticalMovement, GrappleVerticalSpeed, GrappleParams.ContinousVerticalSpeed, deltaTime, GrappleParams.MaxVerticalMovementSpeed);
+	PARKOUR_LOG_THROTTLED(Verbose, 1.f, TEXT("Grapple side speed is (%f, %f)"), GrappleHorizontalSpeed, GrappleVerticalSpeed);
+
+	// Pull speed and side deflection were tuned as a push per step at ParkourStepRate. Use that step and not
+	// deltaTime, so characters stepping at a lower rate for their LOD get pulled just as fast
+	const float TuningStepTime = 1.f / FMath::Max(ParkourStepRate, 1.f);
+
+	FVector Direction = (GrappleAnchor - UpdatedComponent->GetComponentLocation()).GetSafeNormal();
+	Direction += TuningStepTime * GrappleHorizontalSpeed * Right;
+	Direction += TuningStepTime * GrappleVerticalSpeed * Up;
+	Direction.Normalize();
+
+	Velocity = Direction * GrappleParams.ContinousPullSpeed * TuningStepTime;
+
+	MoveWithVelocity(deltaTime);
+}
+
+void UParkourMovementComponent::MoveWithVelocity(float deltaTime)
+{
+	bJustTeleported = false;
+	const FVector OldLocation = UpdatedComponent->GetComponentLocation();
+	const FVector Delta = Velocity * deltaTime;
+
+	FHitResult Hit(1.f);
+	SafeMoveUpdatedComponent(Delta, UpdatedComponent->GetComponentQuat(), true, Hit);
+
+	if (Hit.Time < 1.f)
+	{
+		HandleImpact(Hit, deltaTime, Delta);
+		SlideAlongSurface(Delta, 1.f - Hit.Time, Hit.Normal, Hit, true);
+	}
+
+	// Make velocity reflect the actual move
+	if (!bJustTeleported)
+		Velocity = (UpdatedComponent->GetComponentLocation() - OldLocation) / deltaTime;
+}
+
+void UParkourMovementComponent::UpdateGrappleAxis(float NewDirection, float& Axis, float Speed, float DeltaTime, float MaxSpeed) const
+{
+	bool DirectionIsZero = FMath::IsNearlyZero(NewDirection);
+
+	// If no change is requested and axis is already 0, nothing to do
+	if (DirectionIsZero && FMath::IsNearlyZero(Axis))
+		return;
+
+	// If new direction is zero, but axis is not zero, it means we have to pull it to the opposite side
+	if (DirectionIsZero)
+	{
+		NewDirection = -FMath::Sign(Axis);
+		Speed *= 2;
+	}
+
+	Axis = FMath::Clamp(Axis + NewDirection * Speed * DeltaTime, -MaxSpeed, MaxSpeed);
+
+	// Clamp it to zero if small enough
+	if (FMath::IsNearlyZero(Axis, 0.01f))
+		Axis = 0;
+}
+
+bool UParkourMovementComponent::IsOwningClient() const
+{
+	return CharacterOwner != nullptr && CharacterOwner->GetLocalRole() == ROLE_AutonomousProxy;
+}
+
+bool UParkourMovementComponent::IsServerForRemoteClient() const
+{
+	return CharacterOwner != nullptr && CharacterOwner->GetLocalRole() == ROLE_Authority && CharacterOwner->GetRemoteRole() == ROLE_AutonomousProxy;
+}
+
+bool UParkourMovementComponent::ConsumeModeData(bool& bDataReceived) const
+{
+	if (!IsServerForRemoteClient())
+		return true;
+
+	// Not here yet, a later move will start the mode once it is. The client gets corrected in the meantime
+	if (!bDataReceived)
+		return false;
+
+	bDataReceived = false;
+	return true;
+}
+
+bool UParkourMovementComponent::IsValidVault(const FVector& Start, const FVector& End) const
+{
+	const UCapsuleComponent* Capsule = CharacterOwner->GetCapsuleComponent();
+	const float Radius = Capsule->GetScaledCapsuleRadius();
+	const float HalfHeight = Capsule->GetScaledCapsuleHalfHeight();
+
+	// Close enough in front of us, and not higher than the profile the client picked can take
+	if (FVector::Dist2D(Start, End) > MaxVaultReach + ServerValidationTolerance)
+		return false;
+
+	// Measured like BeginVault does on the client
+	const float LedgeHeight = End.Z - Start.Z;
+	if (VaultProfiles.Num() > 0 && (!VaultProfiles.IsValidIndex(VaultProfile) || LedgeHeight > VaultProfiles[VaultProfile].MaxLedgeHeight + ServerValidationTolerance))
+		return false;
+
+	// Same test the client's vault probe passed: the capsule a radius over the end, so the quantized end touching
+	// the ledge or a slope under it doesn't count as blocked. See UVaultComponent::GetFitTestLocation
+	// The client already moved, the check can't wait. It still counts against the budget
+	UParkourQueryBudget::TryConsumeIn(GetWorld(), this, EParkourQueryPriority::Critical, 2);
+
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(ParkourValidateVault), false, CharacterOwner);
+	const FVector FitLocation = End + FVector(0, 0, Radius);
+	if (GetWorld()->OverlapBlockingTestByChannel(FitLocation, CharacterOwner->GetActorRotation().Quaternion(), ECC_Parkour, FCollisionShape::MakeCapsule(Radius, HalfHeight), Params))
+		return false;
+
+	// And we have to stand on something walkable, the ledge is a half height under the end
+	FHitResult FloorHit;
+	const FVector FloorEnd = End - FVector(0, 0, HalfHeight + Radius + ServerValidationTolerance);
+	return GetWorld()->LineTraceSingleByChannel(FloorHit, End, FloorEnd, ECC_Parkour, Params) && IsWalkable(FloorHit);
+}
+
+bool UParkourMovementComponent::IsValidGrappleAnchor(const FVector& Anchor) const
+{
+	const FVector Location = UpdatedComponent->GetComponentLocation();
+	const float Distance = FVector::Dist(Location, Anchor);
+	if (Distance > GrappleParams.MaxAnchorDistance + ServerValidationTolerance)
+		return false;
+
+	// The hook can't go through walls either
+	UParkourQueryBudget::TryConsumeIn(GetWorld(), this, EParkourQueryPriority::Critical);
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(ParkourValidateGrapple), false, CharacterOwner);
+	FHitResult Hit;
+	if (!GetWorld()->LineTraceSingleByChannel(Hit, Location, Anchor, ECC_Parkour, Params))
+		return true;
+
+	return Hit.Distance >= Distance - ServerValidationTolerance;
+}
+
+void UParkourMovementComponent::ServerSetWallRunDirection_Implementation(FVector_NetQuantizeNormal Direction)
+{
+	WallRunDirection = Direction;
+}
+
+void UParkourMovementComponent::ServerBeginVault_Implementation(FVector_NetQuantize10 EndLocation, uint8 Profile)
+{
+	VaultEndLocation = EndLocation;
+	VaultProfile = Profile;
+	VaultProgress = 0;
+	bVaultDataReceived = true;
+}
+
+void UParkourMovementComponent::ServerBeginGrapple_Implementation(FVector_NetQuantize10 Anchor)
+{
+	GrappleAnchor = Anchor;
+	bGrappleDataReceived = true;
+}
+
+// -- < Saved Move > ---------------------------------------------------------------------
+
+void FSavedMove_Parkour::Clear()
+{
+	Super::Clear();
+
+	bSavedWantsToWallRun = false;
+	bSavedWantsToSlide = false;
+	bSavedWantsToVault = false;
+	bSavedWantsToGrapple = false;
+
+	SavedWallRunDirection = FVector::ZeroVector;
+	SavedVaultStartLocation = FVector::ZeroVector;
+	SavedVaultEndLocation = FVector::ZeroVector;
+	SavedVaultProfile = 0;
+	SavedVaultProgress = 0;
+	SavedGrappleAnchor = FVector::ZeroVector;
+	SavedGrappleHorizontalSpeed = 0;
+	SavedGrappleVerticalSpeed = 0;
+	SavedParkourStepAccumulator = 0;
+}
+
+uint8 FSavedMove_Parkour::GetCompressedFlags() const
+{
+	uint8 Result = Super::GetCompressedFlags();
+
+	if (bSavedWantsToWallRun)
+		Result |= FLAG_Custom_0;
+
+	if (bSavedWantsToSlide)
+		Result |= FLAG_Custom_1;
+
+	if (bSavedWantsToVault)
+		Result |= FLAG_Custom_2;
+
+	if (bSavedWantsToGrapple)
+		Result |= FLAG_Custom_3;
+
+	return Result;
+}
+
+bool FSavedMove_Parkour::CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* InCharacter, float MaxDelta) const
+{
+	const FSavedMove_Parkour* NewParkourMove = static_cast<const FSavedMove_Parkour*>(NewMove.Get());
+
+	if (bSavedWantsToWallRun != NewParkourMove->bSavedWantsToWallRun ||
+		bSavedWantsToSlide != NewParkourMove->bSavedWantsToSlide ||
+		bSavedWantsToVault != NewParkourMove->bSavedWantsToVault ||
+		bSavedWantsToGrapple != NewParkourMove->bSavedWantsToGrapple)
+		return false;
+
+	if (!SavedWallRunDirection.Equals(NewParkourMove->SavedWallRunDirection) ||
+		!SavedVaultEndLocation.Equals(NewParkourMove->SavedVaultEndLocation) ||
+		SavedVaultProfile != NewParkourMove->SavedVaultProfile ||
+		!SavedGrappleAnchor.Equals(NewParkourMove->SavedGrappleAnchor))
+		return false;
+
+	// Combining moves doesn't put back the step accumulator, so moves in the middle of fixed steps stay apart
+	if (!FMath::IsNearlyEqual(SavedParkourStepAccumulator, NewParkourMove->SavedParkourStepAccumulator))
+		return false;
+
+	return Super::CanCombineWith(NewMove, InCharacter, MaxDelta);
+}
+
+void FSavedMove_Parkour::SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, FNetworkPredictionData_Client_Character& ClientData)
+{
+	Super::SetMoveFor(C, InDeltaTime, NewAccel, ClientData);
+
+	UParkourMovementComponent* Movement = Cast<UParkourMovementComponent>(C->GetCharacterMovement());
+	if (Movement == nullptr)
+		return;
+
+	bSavedWantsToWallRun = Movement->bWantsToWallRun;
+	bSavedWantsToSlide = Movement->bWantsToSlide;
+	bSavedWantsToVault = Movement->bWantsToVault;
+	bSavedWantsToGrapple = Movement->bWantsToGrapple;
+
+	SavedWallRunDirection = Movement->WallRunDirection;
+	SavedVaultStartLocation = Movement->VaultStartLocation;
+	SavedVaultEndLocation = Movement->VaultEndLocation;
+	SavedVaultProfile = Movement->VaultProfile;
+	SavedVaultProgress = Movement->VaultProgress;
+	SavedGrappleAnchor = Movement->GrappleAnchor;
+	SavedGrappleHorizontalSpeed = Movement->GrappleHorizontalSpeed;
+	SavedGrappleVerticalSpeed = Movement->GrappleVerticalSpeed;
+	SavedParkourStepAccumulator = Movement->ParkourStepAccumulator;
+}
+
+void FSavedMove_Parkour::PrepMoveFor(ACharacter* C)
+{
+	Super::PrepMoveFor(C);
+
+	// Put back the mode state this move started with, so replaying it after a correction gives the same result
+	UParkourMovementComponent* Movement = Cast<UParkourMovementComponent>(C->GetCharacterMovement());
+	if (Movement == nullptr)
+		return;
+
+	Movement->WallRunDirection = SavedWallRunDirection;
+	Movement->VaultStartLocation = SavedVaultStartLocation;
+	Movement->VaultEndLocation = SavedVaultEndLocation;
+	Movement->VaultProfile = SavedVaultProfile;
+	Movement->VaultProgress = SavedVaultProgress;
+	Movement->GrappleAnchor = SavedGrappleAnchor;
+	Movement->GrappleHorizontalSpeed = SavedGrappleHorizontalSpeed;
+	Movement->GrappleVerticalSpeed = SavedGrappleVerticalSpeed;
+	Movement->ParkourStepAccumulator = SavedParkourStepAccumulator;
+}
+
+FNetworkPredictionData_Client_Parkour::FNetworkPredictionData_Client_Parkour(const UCharacterMovementComponent& ClientMovement)
+	: Super(ClientMovement)
+{
+}
+
+FSavedMovePtr FNetworkPredictionData_Client_Parkour::AllocateNewMove()
+{
+	return FSavedMovePtr(new FSavedMove_Parkour());
+}
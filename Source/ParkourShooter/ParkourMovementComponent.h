@@ -0,0 +1,409 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "ParkourMovementComponent.generated.h"
+
+class UCurveFloat;
+
+/** Parkour movement modes, used as custom movement modes with MOVE_Custom */
+UENUM(BlueprintType)
+enum class EParkourMovementMode : uint8
+{
+	None UMETA(Hidden),
+	WallRun UMETA(DisplayName = "Wallrun"),
+	Slide UMETA(DisplayName = "Slide"),
+	Vault UMETA(DisplayName = "Vault"),
+	Grapple UMETA(DisplayName = "Grapple"),
+	MAX UMETA(Hidden)
+};
+
+/** Tuning for the slide, owned by the character */
+struct FParkourSlideParams
+{
+	/** Horizontal speed we get pushed to when the slide starts */
+	float InitialSpeed = 1400;
+
+	/** Max speed when sliding, slopes can't push us faster than this */
+	float MaxSpeed = 1600;
+
+	float GroundFriction = 1;
+	float BrakingDeceleration = 1000;
+
+	/** Force pulling us downhill, scaled by how steep the floor is */
+	float FloorInfluenceForce = 500000;
+};
+
+/** How a vault moves the character over a ledge. The vault component owns a few of them and picks one by ledge height */
+USTRUCT(BlueprintType)
+struct FParkourVaultProfile
+{
+	GENERATED_BODY()
+
+	/** Only to tell profiles apart in the editor, like StepUp, OverVault or Mantle */
+	UPROPERTY(EditAnywhere, Category = "Vault")
+	FName Name;
+
+	/** Highest ledge, measured from our feet, this profile is used for */
+	UPROPERTY(EditAnywhere, Category = "Vault")
+	float MaxLedgeHeight = 170;
+
+	/** Time in seconds to perform the vault */
+	UPROPERTY(EditAnywhere, Category = "Vault", meta = (ClampMin = "0.01"))
+	float Duration = 0.5f;
+
+	/** How far up we are over the vault, from 0 at the start height to 1 at the end height, with time from 0 to 1.
+	  * Generated from LiftPortion if not set */
+	UPROPERTY(EditAnywhere, Category = "Vault")
+	UCurveFloat* HeightCurve = nullptr;
+
+	/** How far forward we are over the vault, from 0 at the start to 1 at the end, with time from 0 to 1.
+	  * Generated from LiftPortion if not set */
+	UPROPERTY(EditAnywhere, Category = "Vault")
+	UCurveFloat* ForwardCurve = nullptr;
+
+	/** Part of the vault spent going up before moving forward, for the curves we generate */
+	UPROPERTY(EditAnywhere, Category = "Vault", meta = (ClampMin = "0.0", ClampMax = "0.95"))
+	float LiftPortion = 0.5f;
+
+	/** Extra height in the middle of the vault, to hop over the ledge instead of climbing onto it */
+	UPROPERTY(EditAnywhere, Category = "Vault")
+	float ArcHeight = 0;
+
+	/// <summary>
+	/// Where we are along the vault path at the given time, from 0 to 1
+	/// </summary>
+	FVector Evaluate(const FVector& Start, const FVector& End, float Alpha) const;
+};
+
+/** Tuning for the grapple pull, owned by the grappling hook component */
+struct FParkourGrappleParams
+{
+	/** Pull towards the hook per second, applied as a push per step at the parkour step rate. The pull speed is this over the step rate */
+	float ContinousPullSpeed = 100000;
+
+	/** Max speed to add when trying to go a bit to the side or up during hook pull */
+	float MaxHorizontalMovementSpeed = 10;
+	float MaxVerticalMovementSpeed = 10;
+
+	/** Continous speed when trying to go a bit to the side or up during hook pull */
+	float ContinousHorizontalSpeed = 500;
+	float ContinousVerticalSpeed = 500;
+
+	/** Speed towards the anchor the pull starts with */
+	float InitialSpeed = 2000;
+
+	/** Farthest anchor the server accepts from a client, the reach of the hook */
+	float MaxAnchorDistance = 100000;
+};
+
+/** Called after every fixed step of a parkour mode, with the mode and the step time */
+DECLARE_MULTICAST_DELEGATE_TwoParams(FParkourStepSignature, EParkourMovementMode, float);
+
+/**
+ * Character movement with native parkour movement modes. Wallrun, slide, vault and grapple run in PhysCustom
+ * and are requested through flags that travel in saved moves, so clients predict them and replay them on
+ * corrections like any other movement, instead of having their velocity overwritten from outside.
+ */
+UCLASS()
+class PARKOURSHOOTER_API UParkourMovementComponent : public UCharacterMovementComponent
+{
+	GENERATED_BODY()
+
+	friend class FSavedMove_Parkour;
+
+public:
+	UParkourMovementComponent();
+
+	/// <summary>
+	/// Checks if we're in the given parkour movement mode
+	/// </summary>
+	bool IsCustomMode(EParkourMovementMode Mode) const;
+
+	virtual bool IsMovingOnGround() const override;
+	virtual float GetMaxSpeed() const override;
+	virtual float GetMaxBrakingDeceleration() const override;
+	virtual FNetworkPredictionData_Client* GetPredictionData_Client() const override;
+
+	/// <summary>
+	/// Time in seconds of a single fixed step of the parkour modes
+	/// </summary>
+	float GetParkourStepTime() const { return 1.f / FMath::Max(ParkourStepRateOverride > 0 ? ParkourStepRateOverride : ParkourStepRate, 1.f); }
+
+	/// <summary>
+	/// Run the fixed steps at a different rate than ParkourStepRate, 0 goes back to it. Only for characters
+	/// no player controls, a player's moves have to be simulated at the same rate on both ends
+	/// </summary>
+	void SetParkourStepRateOverride(float NewRate) { ParkourStepRateOverride = NewRate; }
+
+	/// <summary>
+	/// Camera to move along with the mesh when showing the character in between fixed steps. Owned by the character
+	/// </summary>
+	void SetStepVisualCamera(USceneComponent* Camera) { StepVisualCamera = Camera; }
+
+	/// <summary>
+	/// Offset relative to the capsule we added to the camera to show it in between fixed steps. Anyone setting the
+	/// camera location by hand has to add it back
+	/// </summary>
+	FVector GetStepCameraOffset() const { return StepCameraOffset; }
+
+	/** Broadcast after every fixed step of wallrun, slide and grapple on the locally controlled character.
+	  * Not broadcast while replaying moves after a correction */
+	FParkourStepSignature OnParkourStep;
+
+	// -- < Wallrun > ---------------------------------------------------------------------
+
+	/// <summary>
+	/// Start running along a wall in the given direction, takes effect on the next movement update
+	/// </summary>
+	void BeginWallRun(const FVector& Direction);
+
+	/// <summary>
+	/// Change the wallrun direction, as the wall we're running on might be curved
+	/// </summary>
+	void SetWallRunDirection(const FVector& Direction);
+
+	void EndWallRun();
+
+	// -- < Slide > -----------------------------------------------------------------------
+
+	void SetSlideParams(const FParkourSlideParams& NewParams) { SlideParams = NewParams; }
+
+	void BeginSlide() { bWantsToSlide = true; }
+
+	void EndSlide() { bWantsToSlide = false; }
+
+	/// <summary>
+	/// Compute the force pulling us downhill while sliding
+	/// </summary>
+	/// <param name="FloorNormal"> Normal of the floor we're sliding on </param>
+	/// <returns> Force pointing downhill, scaled by how steep the floor is </returns>
+	FVector ComputeFloorInfluence(FVector FloorNormal) const;
+
+	// -- < Vault > -----------------------------------------------------------------------
+
+	/// <summary>
+	/// Profiles to vault with, from the lowest ledge to the highest. Owned by the vault component
+	/// </summary>
+	void SetVaultProfiles(const TArray<FParkourVaultProfile>& NewProfiles) { VaultProfiles = NewProfiles; }
+
+	/// <summary>
+	/// Start vaulting from our current location to the given one, with the profile for the ledge height in between
+	/// </summary>
+	/// <param name="EndLocation"> Where the vault ends </param>
+	void BeginVault(const FVector& EndLocation);
+
+	/// <summary>
+	/// Index of the first profile that can take a ledge this high, the highest one if none can
+	/// </summary>
+	int32 FindVaultProfile(float LedgeHeight) const;
+
+	/// <summary>
+	/// If we are vaulting, or we just asked to and the movement didn't catch up yet
+	/// </summary>
+	bool IsVaulting() const { return bWantsToVault || IsCustomMode(EParkourMovementMode::Vault); }
+
+	// -- < Grapple > ---------------------------------------------------------------------
+
+	void SetGrappleParams(const FParkourGrappleParams& NewParams) { GrappleParams = NewParams; }
+
+	/// <summary>
+	/// Start pulling the character towards the anchor point, at the initial speed of the grapple params
+	/// </summary>
+	/// <param name="Anchor"> Where the hook is attached </param>
+	void BeginGrapple(const FVector& Anchor);
+
+	/// <summary>
+	/// Stop pulling, the character keeps its velocity and starts falling
+	/// </summary>
+	void EndGrapple();
+
+protected:
+
+	virtual void UpdateFromCompressedFlags(uint8 Flags) override;
+	virtual void UpdateCharacterStateBeforeMovement(float DeltaSeconds) override;
+	virtual void OnMovementModeChanged(EMovementMode PreviousMovementMode, uint8 PreviousCustomMode) override;
+	virtual void PhysCustom(float deltaTime, int32 Iterations) override;
+	virtual void CalcVelocity(float DeltaTime, float Friction, bool bFluid, float BrakingDeceleration) override;
+	virtual void SmoothClientPosition_UpdateVisuals() override;
+
+	/// <summary>
+	/// Run the current parkour mode in fixed steps. Time that doesn't fill a whole step waits for the next
+	/// update. The capsule stays where the last step left it, the mesh and camera are shown in between the
+	/// last two steps in the meantime
+	/// </summary>
+	void PhysFixedSteps(float deltaTime, int32 Iterations);
+
+	/// <summary>
+	/// Show the mesh and camera at the given offset from the capsule, in world space. Only visual, the capsule
+	/// doesn't move. Zero puts them back in place
+	/// </summary>
+	void SetStepVisualOffset(const FVector& NewOffset);
+
+	void PhysWallRun(float deltaTime, int32 Iterations);
+	void PhysSlide(float deltaTime, int32 Iterations);
+	void PhysVault(float deltaTime, int32 Iterations);
+	void PhysGrapple(float deltaTime, int32 Iterations);
+
+	/// <summary>
+	/// Move in a straight line with the current velocity, sliding along anything we hit
+	/// </summary>
+	void MoveWithVelocity(float deltaTime);
+
+	/// <summary>
+	/// Utility function to update movement axis based on a new direction, used to update the horizontal and vertical movement
+	/// scalars when asking to pull the character a bit up or a bit to the side during a hook pull
+	/// </summary>
+	void UpdateGrappleAxis(float NewDirection, float& Axis, float Speed, float DeltaTime, float MaxSpeed) const;
+
+	/** Fixed steps per second for wallrun, slide and grapple. Same rate everywhere means same trajectories
+	  * no matter the frame rate of clients or the tick rate of the server */
+	UPROPERTY(EditAnywhere, Category = "Parkour")
+	float ParkourStepRate = 60;
+
+	// Step rate set by the character LOD, 0 when using ParkourStepRate
+	float ParkourStepRateOverride = 0;
+
+	/** Max fixed steps in a single update. If we fall further behind than this, the extra time is dropped */
+	UPROPERTY(EditAnywhere, Category = "Parkour")
+	int32 MaxParkourSteps = 8;
+
+	/** Show the character in between the last two fixed steps, instead of where the last step left it */
+	UPROPERTY(EditAnywhere, Category = "Parkour")
+	bool bInterpolateParkourSteps = true;
+
+	// Time we still have to simulate, less than a fixed step
+	float ParkourStepAccumulator = 0;
+
+	// Where the last two fixed steps left the character
+	FVector PrevStepLocation;
+	FVector LastStepLocation;
+	bool bHasFixedStepLocation = false;
+
+	// Offset from the capsule we show the character at, in world space, and what we added for it to the
+	// relative location of the mesh and the camera
+	FVector StepVisualOffset;
+	FVector StepMeshOffset;
+	FVector StepCameraOffset;
+
+	UPROPERTY(Transient)
+	USceneComponent* StepVisualCamera = nullptr;
+
+	// Requested parkour modes. They're sent in the compressed flags of every saved move
+	uint8 bWantsToWallRun : 1;
+	uint8 bWantsToSlide : 1;
+	uint8 bWantsToVault : 1;
+	uint8 bWantsToGrapple : 1;
+
+	// Wallrun state
+	FVector WallRunDirection;
+
+	// Slide state
+	FParkourSlideParams SlideParams;
+
+	// Vault state. The start location is taken when the vault mode begins, so it's the same on both ends
+	UPROPERTY()
+	TArray<FParkourVaultProfile> VaultProfiles;
+
+	FVector VaultStartLocation;
+	FVector VaultEndLocation;
+	uint8 VaultProfile = 0;
+	float VaultProgress = 0;
+
+	const FParkourVaultProfile& GetVaultProfile() const;
+
+	// Grapple state
+	FParkourGrappleParams GrappleParams;
+	FVector GrappleAnchor;
+	float GrappleHorizontalSpeed = 0;
+	float GrappleVerticalSpeed = 0;
+
+	// The server needs the data behind the flags to simulate the same moves as the owning client. The data
+	// comes in reliable RPCs and the flags in unreliable moves, so a move may ask for a mode before its data is
+	// here: the server only enters vault and grapple once it got their data, and uses it once
+	bool bVaultDataReceived = false;
+	bool bGrappleDataReceived = false;
+
+	/** Farthest vault end, horizontally, the server accepts from a client. Vault probe distance plus a capsule radius or so */
+	UPROPERTY(EditAnywhere, Category = "Parkour")
+	float MaxVaultReach = 150;
+
+	/** How far off the server lets a client's vault end and grapple anchor be from what it can check on its side */
+	UPROPERTY(EditAnywhere, Category = "Parkour")
+	float ServerValidationTolerance = 100;
+
+	UFUNCTION(Server, Reliable)
+	void ServerSetWallRunDirection(FVector_NetQuantizeNormal Direction);
+
+	UFUNCTION(Server, Reliable)
+	void ServerBeginVault(FVector_NetQuantize10 EndLocation, uint8 Profile);
+
+	UFUNCTION(Server, Reliable)
+	void ServerBeginGrapple(FVector_NetQuantize10 Anchor);
+
+	/// <summary>
+	/// True if we are the owning client and have to tell the server about mode data
+	/// </summary>
+	bool IsOwningClient() const;
+
+	/// <summary>
+	/// True if we are the server simulating moves sent by an owning client
+	/// </summary>
+	bool IsServerForRemoteClient() const;
+
+	/// <summary>
+	/// Checks if a mode we were asked for through the flags can start: always on the client, and on the server
+	/// once its data arrived. Consumes the data
+	/// </summary>
+	bool ConsumeModeData(bool& bDataReceived) const;
+
+	/// <summary>
+	/// Server side check of a client's vault: the end is in reach, fits the profile, has room for us and a floor
+	/// </summary>
+	bool IsValidVault(const FVector& Start, const FVector& End) const;
+
+	/// <summary>
+	/// Server side check of a client's grapple: the anchor is in reach and nothing is in between
+	/// </summary>
+	bool IsValidGrappleAnchor(const FVector& Anchor) const;
+};
+
+/** Saved move carrying the parkour flags and the data needed to replay parkour modes */
+class FSavedMove_Parkour : public FSavedMove_Character
+{
+public:
+	typedef FSavedMove_Character Super;
+
+	virtual void Clear() override;
+	virtual uint8 GetCompressedFlags() const override;
+	virtual bool CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* InCharacter, float MaxDelta) const override;
+	virtual void SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, class FNetworkPredictionData_Client_Character& ClientData) override;
+	virtual void PrepMoveFor(ACharacter* C) override;
+
+	uint8 bSavedWantsToWallRun : 1;
+	uint8 bSavedWantsToSlide : 1;
+	uint8 bSavedWantsToVault : 1;
+	uint8 bSavedWantsToGrapple : 1;
+
+	FVector SavedWallRunDirection;
+	FVector SavedVaultStartLocation;
+	FVector SavedVaultEndLocation;
+	uint8 SavedVaultProfile;
+	float SavedVaultProgress;
+	FVector SavedGrappleAnchor;
+	float SavedGrappleHorizontalSpeed;
+	float SavedGrappleVerticalSpeed;
+	float SavedParkourStepAccumulator;
+};
+
+class FNetworkPredictionData_Client_Parkour : public FNetworkPredictionData_Client_Character
+{
+public:
+	typedef FNetworkPredictionData_Client_Character Super;
+
+	FNetworkPredictionData_Client_Parkour(const UCharacterMovementComponent& ClientMovement);
+
+	virtual FSavedMovePtr AllocateNewMove() override;
+};
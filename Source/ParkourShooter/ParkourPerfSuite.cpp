@@ -0,0 +1,744 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ParkourPerfSuite.h"
+#include "ParkourShooter.h"
+#include "ParkourShooterCharacter.h"
+#include "ParkourMovementComponent.h"
+#include "CoreGlobals.h"
+#include "EngineUtils.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/MemoryBase.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+static FAutoConsoleCommandWithWorldAndArgs PerfSuiteCommand(
+	TEXT("Parkour.PerfSuite"),
+	TEXT("Drive the player through every parkour ability and write a performance report. ")
+	TEXT("Usage: Parkour.PerfSuite [Ticks=5000] [Abilities=Sprint,Slide,Wallrun,Vault,Grapple] [Report=Path] ")
+	TEXT("[MaxGameThreadMs=N] [MaxQueries=N] [MaxAllocations=N] [Quit]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&UParkourPerfSuite::RunSuite)
+);
+
+namespace ParkourPerfSuite
+{
+	/**
+	 * Wraps the allocator the engine is using and counts the allocations the game thread makes. FMalloc has its
+	 * own call counter, but most platform allocators never update it. Same trick as FMemory::EnablePurgatoryTests:
+	 * it goes on top of GMalloc while the game runs and never comes off, anything allocated before it still frees
+	 * through the allocator it wraps
+	 */
+	class FCountingMalloc final : public FMalloc
+	{
+	public:
+
+		explicit FCountingMalloc(FMalloc* InInner) : Inner(InInner) {}
+
+		/** Put the counter on top of GMalloc, only the first call does anything */
+		static void Install()
+		{
+			if (Instance != nullptr)
+				return;
+
+			// FMalloc news itself with the system allocator, so it doesn't go through GMalloc
+			Instance = new FCountingMalloc(GMalloc);
+			GMalloc = Instance;
+		}
+
+		/** Allocations the game thread made since the counter was installed */
+		static uint64 Get()
+		{
+			return Instance != nullptr ? Instance->GameThreadAllocations : 0;
+		}
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return Inner->Malloc(Count, Alignment);
+		}
+
+		virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return Inner->TryMalloc(Count, Alignment);
+		}
+
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return Inner->Realloc(Original, Count, Alignment);
+		}
+
+		virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return Inner->TryRealloc(Original, Count, Alignment);
+		}
+
+		virtual void Free(void* Original) override { Inner->Free(Original); }
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+		virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+		virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+		virtual void InitializeStatsMetadata() override { Inner->InitializeStatsMetadata(); }
+		virtual void UpdateStats() override { Inner->UpdateStats(); }
+		virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { Inner->GetAllocatorStats(OutStats); }
+		virtual void DumpAllocatorStats(FOutputDevice& Ar) override { Inner->DumpAllocatorStats(Ar); }
+		virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+		virtual bool ValidateHeap() override { return Inner->ValidateHeap(); }
+		virtual const TCHAR* GetDescriptiveName() override { return Inner->GetDescriptiveName(); }
+
+	private:
+
+		void CountAllocation()
+		{
+			// Only the game thread writes and reads it, other threads would just make the number noisy
+			if (IsInGameThread())
+				GameThreadAllocations++;
+		}
+
+		FMalloc* Inner;
+		uint64 GameThreadAllocations = 0;
+
+		static FCountingMalloc* Instance;
+	};
+
+	FCountingMalloc* FCountingMalloc::Instance = nullptr;
+
+	/** Side of the engine cube, the courses we build scale it to the size they need */
+	static const float CubeSize = 100.f;
+
+	/** How far above the player start the courses go, so nothing in the map gets in the way */
+	static const float CourseAltitude = 20000.f;
+
+	/** JSON object with the distribution of the given samples */
+	static FString Distribution(const TArray<float>& Samples)
+	{
+		const FParkourSampleStats Stats = FParkourSampleStats::Compute(Samples);
+		return FString::Printf(TEXT("{ \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }"),
+			Stats.Mean, Stats.P50, Stats.P95, Stats.P99, Stats.Max);
+	}
+}
+
+void UParkourPerfSuite::Deinitialize()
+{
+	// The world is going away, whatever we got so far is better than nothing
+	if (bRunning)
+		Finish();
+
+	Super::Deinitialize();
+}
+
+ETickableTickType UParkourPerfSuite::GetTickableTickType() const
+{
+	// The class default object must never tick
+	return HasAnyFlags(RF_ClassDefaultObject) ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UParkourPerfSuite::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UParkourPerfSuite, STATGROUP_Tickables);
+}
+
+const TCHAR* UParkourPerfSuite::GetAbilityName(EParkourPerfAbility Ability)
+{
+	switch (Ability)
+	{
+	case EParkourPerfAbility::Sprint:
+		return TEXT("Sprint");
+	case EParkourPerfAbility::Slide:
+		return TEXT("Slide");
+	case EParkourPerfAbility::Wallrun:
+		return TEXT("Wallrun");
+	case EParkourPerfAbility::Vault:
+		return TEXT("Vault");
+	case EParkourPerfAbility::Grapple:
+		return TEXT("Grapple");
+	default:
+		break;
+	}
+
+	return TEXT("Unknown");
+}
+
+void UParkourPerfSuite::RunSuite(const TArray<FString>& Args, UWorld* World)
+{
+	UParkourPerfSuite* Suite = World != nullptr ? World->GetSubsystem<UParkourPerfSuite>() : nullptr;
+	if (Suite == nullptr)
+	{
+		UE_LOG(LogParkour, Error, TEXT("Parkour.PerfSuite needs a game world"));
+		return;
+	}
+
+	if (Suite->IsRunning())
+	{
+		UE_LOG(LogParkour, Warning, TEXT("Parkour.PerfSuite is already running"));
+		return;
+	}
+
+	int32 Ticks = 5000;
+	FString ReportPath = FPaths::ProjectSavedDir() / TEXT("Automation") / TEXT("ParkourPerf.json");
+	TArray<EParkourPerfAbility> Abilities;
+	bool bQuit = false;
+
+	for (const FString& Arg : Args)
+	{
+		if (Arg.Equals(TEXT("Quit"), ESearchCase::IgnoreCase))
+			bQuit = true;
+
+		FParse::Value(*Arg, TEXT("Ticks="), Ticks);
+		FParse::Value(*Arg, TEXT("Report="), ReportPath);
+		FParse::Value(*Arg, TEXT("MaxGameThreadMs="), Suite->MaxGameThreadMs);
+		FParse::Value(*Arg, TEXT("MaxQueries="), Suite->MaxQueriesPerTick);
+		FParse::Value(*Arg, TEXT("MaxAllocations="), Suite->MaxAllocationsPerTick);
+
+		FString Value;
+		if (FParse::Value(*Arg, TEXT("Abilities="), Value, false))
+		{
+			TArray<FString> Names;
+			Value.ParseIntoArray(Names, TEXT(","));
+			for (const FString& Name : Names)
+			{
+				for (int32 i = 0; i < static_cast<int32>(EParkourPerfAbility::MAX); i++)
+				{
+					if (Name.Equals(GetAbilityName(static_cast<EParkourPerfAbility>(i)), ESearchCase::IgnoreCase))
+						Abilities.Add(static_cast<EParkourPerfAbility>(i));
+				}
+			}
+		}
+	}
+
+	if (Abilities.Num() == 0)
+	{
+		for (int32 i = 0; i < static_cast<int32>(EParkourPerfAbility::MAX); i++)
+			Abilities.Add(static_cast<EParkourPerfAbility>(i));
+	}
+
+	if (!Suite->Start(Abilities, FMath::Max(Ticks, 1), ReportPath, bQuit) && bQuit)
+		FPlatformMisc::RequestExitWithStatus(false, 1);
+}
+
+bool UParkourPerfSuite::Start(const TArray<EParkourPerfAbility>& Abilities, int32 InTicksPerAbility, const FString& InReportPath, bool bInQuitWhenDone)
+{
+	UWorld* World = GetWorld();
+	APlayerController* Controller = World != nullptr ? World->GetFirstPlayerController() : nullptr;
+	ACharacter* PlayerCharacter = Controller != nullptr ? Cast<ACharacter>(Controller->GetPawn()) : nullptr;
+	if (PlayerCharacter == nullptr)
+	{
+		UE_LOG(LogParkour, Error, TEXT("Parkour.PerfSuite needs a local player with a character to drive"));
+		return false;
+	}
+
+	PlayerController = Controller;
+	Character = PlayerCharacter;
+	PlayerStartTransform = PlayerCharacter->GetActorTransform();
+	PlayerStartTransform.SetRotation(Controller->GetControlRotation().Quaternion());
+
+	Queue = Abilities;
+	QueueIndex = INDEX_NONE;
+	TicksPerAbility = InTicksPerAbility;
+	ReportPath = InReportPath;
+	bQuitWhenDone = bInQuitWhenDone;
+
+	for (FAbilityResult& Result : Results)
+		Result = FAbilityResult();
+
+	ParkourPerfSuite::FCountingMalloc::Install();
+
+	UE_LOG(LogParkour, Display, TEXT("Parkour.PerfSuite: %d abilities, %d ticks each"), Queue.Num(), TicksPerAbility);
+
+	bRunning = true;
+	NextAbility();
+	return true;
+}
+
+void UParkourPerfSuite::Tick(float DeltaTime)
+{
+	if (!PlayerController.IsValid() || !Character.IsValid())
+	{
+		UE_LOG(LogParkour, Error, TEXT("Parkour.PerfSuite lost the player character, stopping"));
+		Finish();
+		return;
+	}
+
+	// The first tick of an ability measures the frame where the previous one ended, just start counting from here
+	if (AbilityTick > 0)
+		RecordSample();
+	else
+		ReadCounters(LastQueries, LastAllocations);
+
+	if (AbilityTick >= TicksPerAbility)
+	{
+		NextAbility();
+		return;
+	}
+
+	if (AttemptTick >= GetAttemptLength(Queue[QueueIndex]))
+		BeginAttempt();
+
+	DriveInput(AttemptTick);
+
+	if (!bAttemptEngaged && IsAbilityActive(Queue[QueueIndex]))
+	{
+		bAttemptEngaged = true;
+		Results[static_cast<int32>(Queue[QueueIndex])].EngagedAttempts++;
+	}
+
+	AttemptTick++;
+	AbilityTick++;
+}
+
+void UParkourPerfSuite::NextAbility()
+{
+	ReleaseAllKeys();
+
+	// Skip the abilities we don't have a place to run, the report fails them
+	while (++QueueIndex < Queue.Num())
+	{
+		EParkourPerfAbility Ability = Queue[QueueIndex];
+		if (FindStartTransform(Ability, AttemptStart) || SpawnCourse(Ability, AttemptStart))
+		{
+			UE_LOG(LogParkour, Display, TEXT("Parkour.PerfSuite: running %s"), GetAbilityName(Ability));
+			Results[static_cast<int32>(Ability)].bRan = true;
+			AbilityTick = 0;
+			BeginAttempt();
+			return;
+		}
+
+		Results[static_cast<int32>(Ability)].SkipReason = FString::Printf(TEXT("No actor tagged ParkourPerf.%s in the map and couldn't build a course"), GetAbilityName(Ability));
+		UE_LOG(LogParkour, Warning, TEXT("Parkour.PerfSuite: skipping %s, %s"), GetAbilityName(Ability), *Results[static_cast<int32>(Ability)].SkipReason);
+	}
+
+	Finish();
+}
+
+void UParkourPerfSuite::BeginAttempt()
+{
+	ReleaseAllKeys();
+
+	ACharacter* PlayerCharacter = Character.Get();
+	PlayerCharacter->SetActorLocationAndRotation(AttemptStart.GetLocation(), FRotator(0, AttemptStart.Rotator().Yaw, 0), false, nullptr, ETeleportType::TeleportPhysics);
+	PlayerCharacter->GetCharacterMovement()->StopMovementImmediately();
+	PlayerCharacter->GetCharacterMovement()->SetMovementMode(MOVE_Falling);
+	PlayerController->SetControlRotation(AttemptStart.Rotator());
+
+	AttemptTick = 0;
+	bAttemptEngaged = false;
+	Results[static_cast<int32>(Queue[QueueIndex])].Attempts++;
+}
+
+int32 UParkourPerfSuite::GetAttemptLength(EParkourPerfAbility Ability)
+{
+	switch (Ability)
+	{
+	case EParkourPerfAbility::Sprint:
+		return 240;
+	case EParkourPerfAbility::Slide:
+		return 150;
+	case EParkourPerfAbility::Wallrun:
+		return 180;
+	case EParkourPerfAbility::Vault:
+		return 120;
+	case EParkourPerfAbility::Grapple:
+		return 200;
+	default:
+		break;
+	}
+
+	return 120;
+}
+
+void UParkourPerfSuite::DriveInput(int32 Tick)
+{
+	// Same keys as in DefaultInput.ini. Every attempt starts with every key released
+	switch (Queue[QueueIndex])
+	{
+	case EParkourPerfAbility::Sprint:
+		if (Tick == 0)
+			PressKey(EKeys::W);
+		break;
+
+	case EParkourPerfAbility::Slide:
+		// Get some speed first, then slide until the slide runs out
+		if (Tick == 0)
+			PressKey(EKeys::W);
+		else if (Tick == 30)
+			PressKey(EKeys::LeftControl);
+		else if (Tick == 100)
+			ReleaseKey(EKeys::LeftControl);
+		break;
+
+	case EParkourPerfAbility::Wallrun:
+		// Run towards the wall on the right and jump, holding forward and right keeps us on it
+		if (Tick == 0)
+		{
+			PressKey(EKeys::W);
+			PressKey(EKeys::D);
+		}
+		else if (Tick == 15)
+		{
+			PressKey(EKeys::SpaceBar);
+		}
+		else if (Tick == 16)
+		{
+			ReleaseKey(EKeys::SpaceBar);
+		}
+		break;
+
+	case EParkourPerfAbility::Vault:
+		// Jump towards the ledge and hold jump, holding sends repeat events like a real key does
+		if (Tick == 0)
+			PressKey(EKeys::W);
+		else if (Tick == 15)
+			PressKey(EKeys::SpaceBar);
+		else if (Tick > 15 && Tick <= 60)
+			RepeatKey(EKeys::SpaceBar);
+		else if (Tick == 61)
+			ReleaseKey(EKeys::SpaceBar);
+		break;
+
+	case EParkourPerfAbility::Grapple:
+		// We're already aiming at the target, fire and hold until we get there
+		if (Tick == 5)
+			PressKey(EKeys::RightMouseButton);
+		else if (Tick == 150)
+			ReleaseKey(EKeys::RightMouseButton);
+		break;
+
+	default:
+		break;
+	}
+}
+
+bool UParkourPerfSuite::FindStartTransform(EParkourPerfAbility Ability, FTransform& OutTransform) const
+{
+	const FName Tag(*FString::Printf(TEXT("ParkourPerf.%s"), GetAbilityName(Ability)));
+	for (TActorIterator<AActor> It(GetWorld()); It; ++It)
+	{
+		if (It->ActorHasTag(Tag))
+		{
+			OutTransform = It->GetActorTransform();
+			return true;
+		}
+	}
+
+	// Sprint and slide only need some floor, and we were standing on some when we started
+	if (Ability == EParkourPerfAbility::Sprint || Ability == EParkourPerfAbility::Slide)
+	{
+		OutTransform = PlayerStartTransform;
+		return true;
+	}
+
+	return false;
+}
+
+bool UParkourPerfSuite::SpawnCourse(EParkourPerfAbility Ability, FTransform& OutTransform)
+{
+	using namespace ParkourPerfSuite;
+
+	if (Ability != EParkourPerfAbility::Wallrun && Ability != EParkourPerfAbility::Vault && Ability != EParkourPerfAbility::Grapple)
+		return false;
+
+	// Every ability gets its own floor, apart from each other. We always start at the back of it looking down +X
+	const FVector Origin = PlayerStartTransform.GetLocation() + FVector(0, static_cast<int32>(Ability) * 6000.f, CourseAltitude);
+	const FVector FloorSize(4000, 4000, CubeSize);
+	if (SpawnBox(Origin, FloorSize) == nullptr)
+		return false;
+
+	const float FloorTop = Origin.Z + FloorSize.Z / 2;
+	const float HalfHeight = Character->GetCapsuleComponent()->GetScaledCapsuleHalfHeight();
+	const FVector Start(Origin.X - 1500, Origin.Y, FloorTop + HalfHeight + 2);
+	FRotator StartRotation = FRotator::ZeroRotator;
+
+	AActor* Target = nullptr;
+	switch (Ability)
+	{
+	case EParkourPerfAbility::Wallrun:
+		// Along the run, a bit to the right so holding right takes us to it after the jump
+		Target = SpawnBox(FVector(Start.X + 1500, Start.Y + 150, FloorTop + 400), FVector(3000, 50, 800));
+		break;
+
+	case EParkourPerfAbility::Vault:
+		// Between the lowest and highest ledge we vault
+		Target = SpawnBox(FVector(Start.X + 400, Start.Y, FloorTop + 50), FVector(200, 400, 100));
+		break;
+
+	case EParkourPerfAbility::Grapple:
+	{
+		// Up ahead, and we start aiming at it from the camera
+		const FVector TargetCenter(Start.X + 2500, Start.Y, FloorTop + 1200);
+		Target = SpawnBox(TargetCenter, FVector(400, 400, 400));
+		StartRotation = (TargetCenter - (Start + FVector(0, 0, Character->BaseEyeHeight))).Rotation();
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	if (Target == nullptr)
+		return false;
+
+	UE_LOG(LogParkour, Display, TEXT("Parkour.PerfSuite: no actor tagged ParkourPerf.%s, built a course at %s"), GetAbilityName(Ability), *Origin.ToString());
+
+	OutTransform = FTransform(StartRotation, Start);
+	return true;
+}
+
+AActor* UParkourPerfSuite::SpawnBox(const FVector& Center, const FVector& Size)
+{
+	UStaticMesh* Cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	if (Cube == nullptr)
+	{
+		UE_LOG(LogParkour, Error, TEXT("Parkour.PerfSuite: couldn't load the engine cube to build a course with"));
+		return nullptr;
+	}
+
+	FActorSpawnParameters Params;
+	Params.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	Params.ObjectFlags |= RF_Transient;
+
+	AStaticMeshActor* Box = GetWorld()->SpawnActor<AStaticMeshActor>(Center, FRotator::ZeroRotator, Params);
+	if (Box == nullptr)
+		return nullptr;
+
+	// Static components can't change their mesh once the game is running
+	UStaticMeshComponent* Mesh = Box->GetStaticMeshComponent();
+	Mesh->SetMobility(EComponentMobility::Movable);
+	Mesh->SetStaticMesh(Cube);
+	Mesh->SetCollisionProfileName(UCollisionProfile::BlockAll_ProfileName);
+	Box->SetActorScale3D(Size / ParkourPerfSuite::CubeSize);
+
+	Courses.Add(Box);
+	return Box;
+}
+
+void UParkourPerfSuite::DestroyCourses()
+{
+	for (const TWeakObjectPtr<AActor>& Box : Courses)
+	{
+		if (Box.IsValid())
+			Box->Destroy();
+	}
+
+	Courses.Reset();
+}
+
+bool UParkourPerfSuite::IsAbilityActive(EParkourPerfAbility Ability) const
+{
+	AParkourShooterCharacter* ShooterCharacter = Cast<AParkourShooterCharacter>(Character.Get());
+	UParkourMovementComponent* Movement = ShooterCharacter != nullptr ? ShooterCharacter->GetParkourMovement() : nullptr;
+	if (Movement == nullptr)
+		return false;
+
+	switch (Ability)
+	{
+	case EParkourPerfAbility::Sprint:
+		return Movement->IsMovingOnGround() && Movement->Velocity.SizeSquared2D() > KINDA_SMALL_NUMBER;
+	case EParkourPerfAbility::Slide:
+		return Movement->IsCustomMode(EParkourMovementMode::Slide);
+	case EParkourPerfAbility::Wallrun:
+		return Movement->IsCustomMode(EParkourMovementMode::WallRun);
+	case EParkourPerfAbility::Vault:
+		return Movement->IsCustomMode(EParkourMovementMode::Vault);
+	case EParkourPerfAbility::Grapple:
+		return Movement->IsCustomMode(EParkourMovementMode::Grapple);
+	default:
+		break;
+	}
+
+	return false;
+}
+
+void UParkourPerfSuite::PressKey(const FKey& Key)
+{
+	if (!PlayerController.IsValid() || HeldKeys.Contains(Key))
+		return;
+
+	PlayerController->InputKey(Key, IE_Pressed, 1.f, false);
+	HeldKeys.Add(Key);
+}
+
+void UParkourPerfSuite::ReleaseKey(const FKey& Key)
+{
+	if (!PlayerController.IsValid() || !HeldKeys.Contains(Key))
+		return;
+
+	PlayerController->InputKey(Key, IE_Released, 0.f, false);
+	HeldKeys.Remove(Key);
+}
+
+void UParkourPerfSuite::RepeatKey(const FKey& Key)
+{
+	if (!PlayerController.IsValid() || !HeldKeys.Contains(Key))
+		return;
+
+	PlayerController->InputKey(Key, IE_Repeat, 1.f, false);
+}
+
+void UParkourPerfSuite::ReleaseAllKeys()
+{
+	TArray<FKey> KeysToRelease = HeldKeys;
+	for (const FKey& Key : KeysToRelease)
+		ReleaseKey(Key);
+
+	HeldKeys.Reset();
+}
+
+void UParkourPerfSuite::ReadCounters(uint64* OutQueries, uint64& OutAllocations) const
+{
+#if !UE_BUILD_SHIPPING
+	FMemory::Memcpy(OutQueries, GParkourQueryCounts, sizeof(GParkourQueryCounts));
+#else
+	FMemory::Memzero(OutQueries, sizeof(uint64) * static_cast<int32>(EParkourQueryType::MAX));
+#endif
+
+	OutAllocations = ParkourPerfSuite::FCountingMalloc::Get();
+}
+
+void UParkourPerfSuite::RecordSample()
+{
+	FAbilityResult& Result = Results[static_cast<int32>(Queue[QueueIndex])];
+
+	// Game thread time of the last frame, same number "stat unit" shows
+	Result.GameThreadMs.Add(FPlatformTime::ToMilliseconds(GGameThreadTime));
+
+	uint64 Queries[static_cast<int32>(EParkourQueryType::MAX)];
+	uint64 Allocations;
+	ReadCounters(Queries, Allocations);
+
+	uint64 TickQueries = 0;
+	for (int32 i = 0; i < static_cast<int32>(EParkourQueryType::MAX); i++)
+	{
+		const uint64 Delta = Queries[i] - LastQueries[i];
+		Result.QueriesByType[i] += Delta;
+		TickQueries += Delta;
+		LastQueries[i] = Queries[i];
+	}
+
+	Result.Queries.Add(static_cast<float>(TickQueries));
+	Result.Allocations.Add(static_cast<float>(Allocations - LastAllocations));
+	LastAllocations = Allocations;
+}
+
+void UParkourPerfSuite::Finish()
+{
+	ReleaseAllKeys();
+	DestroyCourses();
+	bRunning = false;
+
+	TArray<FString> Failures = CheckBudgets();
+	for (const FString& Failure : Failures)
+		UE_LOG(LogParkour, Error, TEXT("Parkour.PerfSuite: %s"), *Failure);
+
+	bool bPassed = Failures.Num() == 0;
+	if (bPassed)
+		UE_LOG(LogParkour, Display, TEXT("Parkour.PerfSuite: passed"));
+
+	const FString Report = BuildReport(Failures);
+	if (FFileHelper::SaveStringToFile(Report, *ReportPath))
+	{
+		UE_LOG(LogParkour, Display, TEXT("Parkour.PerfSuite: report written to %s"), *ReportPath);
+	}
+	else
+	{
+		UE_LOG(LogParkour, Error, TEXT("Parkour.PerfSuite: could not write report to %s"), *ReportPath);
+		bPassed = false;
+	}
+
+	if (bQuitWhenDone)
+		FPlatformMisc::RequestExitWithStatus(false, bPassed ? 0 : 1);
+}
+
+TArray<FString> UParkourPerfSuite::CheckBudgets() const
+{
+	TArray<FString> Failures;
+	for (EParkourPerfAbility Ability : Queue)
+	{
+		const FAbilityResult& Result = Results[static_cast<int32>(Ability)];
+		const TCHAR* Name = GetAbilityName(Ability);
+
+		if (!Result.bRan)
+		{
+			Failures.Add(FString::Printf(TEXT("%s didn't run: %s"), Name, *Result.SkipReason));
+			continue;
+		}
+
+		if (Result.EngagedAttempts == 0)
+			Failures.Add(FString::Printf(TEXT("%s never started in %d attempts"), Name, Result.Attempts));
+
+		const float GameThreadMs = FParkourSampleStats::Compute(Result.GameThreadMs).P95;
+		if (MaxGameThreadMs > 0 && GameThreadMs > MaxGameThreadMs)
+			Failures.Add(FString::Printf(TEXT("%s p95 game thread time is %.4fms, budget is %.4fms"), Name, GameThreadMs, MaxGameThreadMs));
+
+		const float Queries = FParkourSampleStats::Compute(Result.Queries).P95;
+		if (MaxQueriesPerTick > 0 && Queries > MaxQueriesPerTick)
+			Failures.Add(FString::Printf(TEXT("%s p95 physics queries per tick is %.0f, budget is %.0f"), Name, Queries, MaxQueriesPerTick));
+
+		const float Allocations = FParkourSampleStats::Compute(Result.Allocations).P95;
+		if (MaxAllocationsPerTick > 0 && Allocations > MaxAllocationsPerTick)
+			Failures.Add(FString::Printf(TEXT("%s p95 allocations per tick is %.0f, budget is %.0f"), Name, Allocations, MaxAllocationsPerTick));
+	}
+
+	return Failures;
+}
+
+FString UParkourPerfSuite::BuildReport(const TArray<FString>& Failures) const
+{
+	using namespace ParkourPerfSuite;
+
+	FString Report = TEXT("{\n");
+	Report += FString::Printf(TEXT("\t\"map\": \"%s\",\n"), *GetNameSafe(GetWorld()));
+	Report += FString::Printf(TEXT("\t\"ticks_per_ability\": %d,\n"), TicksPerAbility);
+	Report += FString::Printf(TEXT("\t\"passed\": %s,\n"), Failures.Num() == 0 ? TEXT("true") : TEXT("false"));
+	Report += FString::Printf(TEXT("\t\"budgets\": { \"game_thread_ms_p95\": %.4f, \"queries_per_tick_p95\": %.0f, \"allocations_per_tick_p95\": %.0f },\n"),
+		MaxGameThreadMs, MaxQueriesPerTick, MaxAllocationsPerTick);
+
+	Report += TEXT("\t\"failures\": [");
+	for (int32 i = 0; i < Failures.Num(); i++)
+		Report += FString::Printf(TEXT("%s\"%s\""), i > 0 ? TEXT(", ") : TEXT(""), *Failures[i].ReplaceCharWithEscapedChar());
+	Report += TEXT("],\n");
+
+	Report += TEXT("\t\"abilities\": {");
+
+	bool bFirst = true;
+	for (EParkourPerfAbility Ability : Queue)
+	{
+		const FAbilityResult& Result = Results[static_cast<int32>(Ability)];
+
+		Report += bFirst ? TEXT("\n") : TEXT(",\n");
+		bFirst = false;
+
+		Report += FString::Printf(TEXT("\t\t\"%s\": {\n"), GetAbilityName(Ability));
+		if (!Result.bRan)
+		{
+			Report += FString::Printf(TEXT("\t\t\t\"skipped\": \"%s\"\n\t\t}"), *Result.SkipReason);
+			continue;
+		}
+
+		Report += FString::Printf(TEXT("\t\t\t\"ticks\": %d,\n"), Result.GameThreadMs.Num());
+		Report += FString::Printf(TEXT("\t\t\t\"attempts\": %d,\n"), Result.Attempts);
+		Report += FString::Printf(TEXT("\t\t\t\"engaged_attempts\": %d,\n"), Result.EngagedAttempts);
+		Report += FString::Printf(TEXT("\t\t\t\"game_thread_ms\": %s,\n"), *Distribution(Result.GameThreadMs));
+		Report += FString::Printf(TEXT("\t\t\t\"queries_per_tick\": %s,\n"), *Distribution(Result.Queries));
+		Report += FString::Printf(TEXT("\t\t\t\"queries_total\": { \"headroom\": %llu, \"vault\": %llu, \"wallrun\": %llu, \"grapple\": %llu },\n"),
+			Result.QueriesByType[static_cast<int32>(EParkourQueryType::Headroom)],
+			Result.QueriesByType[static_cast<int32>(EParkourQueryType::Vault)],
+			Result.QueriesByType[static_cast<int32>(EParkourQueryType::Wallrun)],
+			Result.QueriesByType[static_cast<int32>(EParkourQueryType::Grapple)]);
+		Report += FString::Printf(TEXT("\t\t\t\"game_thread_allocations_per_tick\": %s\n"), *Distribution(Result.Allocations));
+		Report += TEXT("\t\t}");
+	}
+
+	Report += TEXT("\n\t}\n}\n");
+	return Report;
+}
@@ -0,0 +1,210 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "InputCoreTypes.h"
+#include "ParkourStats.h"
+#include "ParkourPerfSuite.generated.h"
+
+class APlayerController;
+class ACharacter;
+class AActor;
+
+/** Abilities the performance suite knows how to drive */
+enum class EParkourPerfAbility : uint8
+{
+	Sprint,
+	Slide,
+	Wallrun,
+	Vault,
+	Grapple,
+	MAX
+};
+
+/**
+ * Drives the local player character through scripted sprint, slide, wallrun, vault and grapple sequences by
+ * pressing the same keys a player would, and records what every tick costs while each ability runs. Meant to
+ * run headless, so we get a repeatable number per ability to compare between changes:
+ *
+ *   UE4Editor ParkourShooter <PerfMap> -game -nullrhi -unattended -benchmark -fps=60
+ *       -ExecCmds="Parkour.PerfSuite Ticks=5000 Quit"
+ *
+ * Wallrun, vault and grapple need somewhere to do it: a map can place an actor tagged ParkourPerf.Wallrun
+ * (wall on the right), ParkourPerf.Vault (facing a ledge) or ParkourPerf.Grapple (aiming at something to
+ * hook), and every attempt starts from its transform. Without one, the suite builds the same course out of
+ * engine cubes high above the map, so every map can run every ability. Sprint and slide use their tag if
+ * there's one, or wherever the player started otherwise.
+ *
+ * The report is a JSON file with p50/p95/p99 of game thread time, physics queries and game thread allocations
+ * per tick. The run fails, and quits with a non zero exit code, when an ability couldn't run or never started,
+ * or when its p95 goes over the budgets below.
+ */
+UCLASS(config=Game)
+class PARKOURSHOOTER_API UParkourPerfSuite : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override { return bRunning; }
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	/// <summary>
+	/// Start running the given abilities one after the other
+	/// </summary>
+	/// <param name="Abilities"> Abilities to run, in order </param>
+	/// <param name="TicksPerAbility"> How many ticks to record for each one </param>
+	/// <param name="ReportPath"> Where to write the report once we're done </param>
+	/// <param name="bQuitWhenDone"> Close the game after writing the report </param>
+	/// <returns> False if there's no local player character to drive </returns>
+	bool Start(const TArray<EParkourPerfAbility>& Abilities, int32 TicksPerAbility, const FString& ReportPath, bool bQuitWhenDone);
+
+	bool IsRunning() const { return bRunning; }
+
+	/// <summary>
+	/// Console command: Parkour.PerfSuite [Ticks=N] [Abilities=Sprint,Slide,...] [Report=Path] [Quit]
+	/// </summary>
+	static void RunSuite(const TArray<FString>& Args, UWorld* World);
+
+	static const TCHAR* GetAbilityName(EParkourPerfAbility Ability);
+
+	/** p95 game thread time an ability can take, 0 to not check it. Parkour.PerfSuite MaxGameThreadMs=N overrides it */
+	UPROPERTY(config)
+	float MaxGameThreadMs = 0;
+
+	/** p95 physics queries per tick an ability can issue, 0 to not check it. Overridden by MaxQueries=N */
+	UPROPERTY(config)
+	float MaxQueriesPerTick = 0;
+
+	/** p95 game thread allocations per tick an ability can make, 0 to not check it. Overridden by MaxAllocations=N */
+	UPROPERTY(config)
+	float MaxAllocationsPerTick = 0;
+
+protected:
+
+	/** Everything recorded while running a single ability, one entry per tick */
+	struct FAbilityResult
+	{
+		TArray<float> GameThreadMs;
+		TArray<float> Queries;
+		TArray<float> Allocations;
+
+		/** Queries issued over the whole run, by the ability that asked for them */
+		uint64 QueriesByType[static_cast<int32>(EParkourQueryType::MAX)] = {};
+
+		int32 Attempts = 0;
+
+		/** Attempts where the ability actually started, a run where it never does measured nothing */
+		int32 EngagedAttempts = 0;
+
+		bool bRan = false;
+		FString SkipReason;
+	};
+
+	/// <summary>
+	/// Move to the next ability in the queue, or finish if there's none left
+	/// </summary>
+	void NextAbility();
+
+	/// <summary>
+	/// Put the character back at the start of the current ability and let go of every key
+	/// </summary>
+	void BeginAttempt();
+
+	/// <summary>
+	/// Press and release keys for the current ability, depending on how far into the attempt we are
+	/// </summary>
+	void DriveInput(int32 Tick);
+
+	/// <summary>
+	/// How many ticks a single attempt of an ability lasts
+	/// </summary>
+	static int32 GetAttemptLength(EParkourPerfAbility Ability);
+
+	/// <summary>
+	/// Find where the given ability should start. Abilities that need specific geometry fail without a marker
+	/// </summary>
+	bool FindStartTransform(EParkourPerfAbility Ability, FTransform& OutTransform) const;
+
+	/// <summary>
+	/// Build somewhere to run the given ability when the map doesn't have a place for it
+	/// </summary>
+	/// <param name="OutTransform"> Where every attempt should start </param>
+	/// <returns> False if the ability doesn't need a course or we couldn't build it </returns>
+	bool SpawnCourse(EParkourPerfAbility Ability, FTransform& OutTransform);
+
+	/// <summary>
+	/// Spawn a box with the given center and size, it goes away when the suite finishes
+	/// </summary>
+	AActor* SpawnBox(const FVector& Center, const FVector& Size);
+
+	void DestroyCourses();
+
+	/// <summary>
+	/// Check if the character is doing the ability we're driving right now
+	/// </summary>
+	bool IsAbilityActive(EParkourPerfAbility Ability) const;
+
+	/// <summary>
+	/// Everything that makes the run fail: abilities we couldn't run or that never started, and budgets we went over
+	/// </summary>
+	TArray<FString> CheckBudgets() const;
+
+	void PressKey(const FKey& Key);
+	void ReleaseKey(const FKey& Key);
+	void RepeatKey(const FKey& Key);
+	void ReleaseAllKeys();
+
+	/// <summary>
+	/// Record what the last frame cost, it belongs to the ability running now
+	/// </summary>
+	void RecordSample();
+
+	/// <summary>
+	/// Read the running counters we compute per tick deltas from
+	/// </summary>
+	void ReadCounters(uint64* OutQueries, uint64& OutAllocations) const;
+
+	void Finish();
+
+	FString BuildReport(const TArray<FString>& Failures) const;
+
+	TWeakObjectPtr<APlayerController> PlayerController;
+	TWeakObjectPtr<ACharacter> Character;
+
+	// Where the player was when the suite started, for abilities that can run anywhere
+	FTransform PlayerStartTransform;
+
+	TArray<EParkourPerfAbility> Queue;
+	int32 QueueIndex = INDEX_NONE;
+	int32 TicksPerAbility = 0;
+	FString ReportPath;
+	bool bQuitWhenDone = false;
+	bool bRunning = false;
+
+	// Boxes we built for abilities the map had no place for
+	TArray<TWeakObjectPtr<AActor>> Courses;
+
+	// Current ability
+	FTransform AttemptStart;
+	int32 AbilityTick = 0;
+	int32 AttemptTick = 0;
+	bool bAttemptEngaged = false;
+	TArray<FKey> HeldKeys;
+
+	// Counters as they were on the previous tick
+	uint64 LastQueries[static_cast<int32>(EParkourQueryType::MAX)] = {};
+	uint64 LastAllocations = 0;
+
+	FAbilityResult Results[static_cast<int32>(EParkourPerfAbility::MAX)];
+};
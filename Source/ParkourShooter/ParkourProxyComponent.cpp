@@ -0,0 +1,170 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ParkourProxyComponent.h"
+#include "ParkourShooter.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "StaticMeshResources.h"
+
+#if WITH_EDITOR
+static FAutoConsoleCommandWithWorldAndArgs GenerateProxiesConsoleCommand(
+	TEXT("Parkour.GenerateProxies"),
+	TEXT("Give parkour box proxies to static meshes with expensive collision in the editor world. Usage: Parkour.GenerateProxies [MaxSimpleElements=8] [MinFill=0.6] [DryRun]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&UParkourProxyComponent::GenerateProxiesCommand)
+);
+
+namespace ParkourProxy
+{
+	/** Volume of the collision of a static mesh, unscaled. Complex collision is measured on the render mesh, open meshes measure next to nothing */
+	static float GetCollisionVolume(const UStaticMesh* StaticMesh, const UBodySetup* BodySetup, bool bComplex)
+	{
+		if (!bComplex)
+			return BodySetup->AggGeom.GetVolume(FVector::OneVector);
+
+		if (StaticMesh->RenderData == nullptr || StaticMesh->RenderData->LODResources.Num() == 0)
+			return 0;
+
+		// Sum of the signed volumes of the tetrahedrons every triangle makes with the origin
+		const FStaticMeshLODResources& LOD = StaticMesh->RenderData->LODResources[0];
+		const FPositionVertexBuffer& Positions = LOD.VertexBuffers.PositionVertexBuffer;
+		FIndexArrayView Indices = LOD.IndexBuffer.GetArrayView();
+
+		double Volume = 0;
+		for (int32 i = 0; i + 2 < Indices.Num(); i += 3)
+		{
+			const FVector& A = Positions.VertexPosition(Indices[i]);
+			const FVector& B = Positions.VertexPosition(Indices[i + 1]);
+			const FVector& C = Positions.VertexPosition(Indices[i + 2]);
+			Volume += FVector::DotProduct(A, FVector::CrossProduct(B, C)) / 6.0;
+		}
+
+		return FMath::Abs(static_cast<float>(Volume));
+	}
+}
+#endif
+
+UParkourProxyComponent::UParkourProxyComponent()
+{
+	SetCollisionProfileName(TEXT("ParkourProxy"));
+	SetGenerateOverlapEvents(false);
+	SetCanEverAffectNavigation(false);
+	bHiddenInGame = true;
+	PrimaryComponentTick.bCanEverTick = false;
+}
+
+#if WITH_EDITOR
+void UParkourProxyComponent::FitToParent()
+{
+	UPrimitiveComponent* Parent = Cast<UPrimitiveComponent>(GetAttachParent());
+	if (Parent == nullptr)
+		return;
+
+	Modify();
+
+	// Bounds in the space of the parent, we inherit its scale
+	FBox LocalBounds = Parent->CalcBounds(FTransform::Identity).GetBox();
+	SetRelativeLocationAndRotation(LocalBounds.GetCenter(), FRotator::ZeroRotator);
+	SetRelativeScale3D(FVector::OneVector);
+	SetBoxExtent(LocalBounds.GetExtent());
+}
+
+int32 UParkourProxyComponent::GenerateProxies(UWorld* World, int32 MaxSimpleElements, float MinFillRatio, bool bDryRun)
+{
+	int32 NumProxies = 0;
+	int32 NumConcave = 0;
+
+	for (TActorIterator<AActor> It(World); It; ++It)
+	{
+		AActor* Actor = *It;
+
+		TInlineComponentArray<UStaticMeshComponent*> Meshes(Actor);
+		for (UStaticMeshComponent* Mesh : Meshes)
+		{
+			UStaticMesh* StaticMesh = Mesh->GetStaticMesh();
+			UBodySetup* BodySetup = StaticMesh != nullptr ? StaticMesh->GetBodySetup() : nullptr;
+			if (BodySetup == nullptr || !Mesh->IsQueryCollisionEnabled() || Mesh->GetCollisionResponseToChannel(ECC_Parkour) != ECR_Block)
+				continue;
+
+			// Cheap enough already
+			bool bComplex = BodySetup->GetCollisionTraceFlag() == CTF_UseComplexAsSimple;
+			if (!bComplex && BodySetup->AggGeom.GetElementCount() <= MaxSimpleElements)
+				continue;
+
+			// Already has one, this mesh was set to block the channel again on purpose
+			bool bHasProxy = false;
+			for (USceneComponent* Child : Mesh->GetAttachChildren())
+				bHasProxy |= Child != nullptr && Child->IsA<UParkourProxyComponent>();
+
+			if (bHasProxy)
+				continue;
+
+			// A box only stands in for a mesh that fills most of it. Otherwise probes would hit solid volume where
+			// the Pawn channel has room, and you couldn't stand up inside a building
+			float BoxVolume = Mesh->CalcBounds(FTransform::Identity).GetBox().GetVolume();
+			float FillRatio = BoxVolume > 0 ? ParkourProxy::GetCollisionVolume(StaticMesh, BodySetup, bComplex) / BoxVolume : 0;
+			if (FillRatio < MinFillRatio)
+			{
+				NumConcave++;
+				UE_LOG(LogParkour, Warning, TEXT("  %s %s: skipped, its collision fills %.0f%% of its box, give it proxies by hand"),
+					*Actor->GetActorLabel(), *Mesh->GetName(), FillRatio * 100);
+				continue;
+			}
+
+			NumProxies++;
+			UE_LOG(LogParkour, Display, TEXT("  %s %s: %s"), *Actor->GetActorLabel(), *Mesh->GetName(),
+				bComplex ? TEXT("complex collision") : *FString::Printf(TEXT("%d simple shapes"), BodySetup->AggGeom.GetElementCount()));
+
+			if (bDryRun)
+				continue;
+
+			Actor->Modify();
+			Mesh->Modify();
+
+			// A static proxy on a static mesh goes into the parkour surface index too
+			UParkourProxyComponent* Proxy = NewObject<UParkourProxyComponent>(Actor, NAME_None, RF_Transactional);
+			Proxy->SetMobility(Mesh->Mobility);
+			Proxy->SetupAttachment(Mesh);
+			Actor->AddInstanceComponent(Proxy);
+			Proxy->RegisterComponent();
+			Proxy->FitToParent();
+
+			Mesh->SetCollisionResponseToChannel(ECC_Parkour, ECR_Ignore);
+			Actor->MarkPackageDirty();
+		}
+	}
+
+	if (NumConcave > 0)
+		UE_LOG(LogParkour, Warning, TEXT("%d meshes too concave for a single box proxy"), NumConcave);
+
+	return NumProxies;
+}
+
+void UParkourProxyComponent::GenerateProxiesCommand(const TArray<FString>& Args, UWorld* World)
+{
+	if (World == nullptr || World->WorldType != EWorldType::Editor)
+	{
+		UE_LOG(LogParkour, Error, TEXT("Parkour.GenerateProxies only runs on the editor world, not in play"));
+		return;
+	}
+
+	int32 MaxSimpleElements = 8;
+	float MinFillRatio = 0.6f;
+	bool bDryRun = false;
+
+	for (const FString& Arg : Args)
+	{
+		if (Arg.Equals(TEXT("DryRun"), ESearchCase::IgnoreCase))
+			bDryRun = true;
+
+		FParse::Value(*Arg, TEXT("MaxSimpleElements="), MaxSimpleElements);
+		FParse::Value(*Arg, TEXT("MinFill="), MinFillRatio);
+	}
+
+	int32 NumProxies = GenerateProxies(World, MaxSimpleElements, MinFillRatio, bDryRun);
+	UE_LOG(LogParkour, Display, TEXT("Parkour.GenerateProxies: %d meshes %s"), NumProxies, bDryRun ? TEXT("would get a proxy") : TEXT("got a proxy, save the level to keep them"));
+}
+#endif
@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/BoxComponent.h"
+#include "ParkourProxyComponent.generated.h"
+
+/**
+ * Simple box that stands in for detailed geometry in parkour probes, only the Parkour trace channel sees it. Make the
+ * detailed mesh ignore the Parkour channel and fit one of these around it, by hand or with Parkour.GenerateProxies
+ */
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class PARKOURSHOOTER_API UParkourProxyComponent : public UBoxComponent
+{
+	GENERATED_BODY()
+
+public:
+
+	UParkourProxyComponent();
+
+#if WITH_EDITOR
+	/** Fit the box around the component it's attached to */
+	UFUNCTION(CallInEditor, Category = "Parkour")
+	void FitToParent();
+
+	/// <summary>
+	/// Give a box proxy to every static mesh of the world that is expensive to probe: the ones using complex collision
+	/// as simple, or with too many simple shapes. The meshes stop blocking the Parkour channel. Concave meshes, like
+	/// rooms, arches or stairs, are skipped and reported: a box around them would fill the space you move through
+	/// </summary>
+	/// <param name="MaxSimpleElements"> Meshes with more simple collision shapes than this get a proxy </param>
+	/// <param name="MinFillRatio"> Meshes whose collision fills less of their box than this are too concave for one </param>
+	/// <param name="bDryRun"> Only count and log the meshes that would get one </param>
+	/// <returns> How many meshes got a proxy, or would get one </returns>
+	static int32 GenerateProxies(UWorld* World, int32 MaxSimpleElements, float MinFillRatio, bool bDryRun);
+
+	/// <summary>
+	/// Console command: GenerateProxies on the editor world
+	/// </summary>
+	static void GenerateProxiesCommand(const TArray<FString>& Args, UWorld* World);
+#endif
+};
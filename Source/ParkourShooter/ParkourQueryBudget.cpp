@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ParkourQueryBudget.h"
+#include "ParkourStats.h"
+#include "CoreGlobals.h"
+#include "Engine/World.h"
+
+bool UParkourQueryBudget::TryConsume(const UObject* Requester, EParkourQueryPriority Priority, int32 Cost, uint8 Slot)
+{
+	if (Frame != GFrameCounter)
+		BeginFrame();
+
+	uint64 Key = MakeKey(Requester, Slot);
+
+	if (Priority == EParkourQueryPriority::Critical || MaxQueriesPerFrame <= 0)
+	{
+		Queue.Remove(Key);
+		Execute(Cost);
+		return true;
+	}
+
+	// Our turn came up when the frame started, the room was kept for us
+	int32 ReservedCost;
+	if (Reservations.RemoveAndCopyValue(Key, ReservedCost))
+	{
+		Reserved -= ReservedCost;
+		Queue.Remove(Key);
+		Execute(Cost);
+		return true;
+	}
+
+	// Low priority always waits its turn. The rest can use what's left, unless someone more urgent is still waiting
+	bool bAllowed =
+		Priority != EParkourQueryPriority::Low &&
+		!Queue.Contains(Key) &&
+		(!bHasWaiting || Priority > WaitingPriority) &&
+		Executed + Reserved + Cost <= MaxQueriesPerFrame;
+
+	if (bAllowed)
+	{
+		Execute(Cost);
+		return true;
+	}
+
+	Defer(Key, Priority, Cost);
+	return false;
+}
+
+bool UParkourQueryBudget::TryConsumeIn(const UWorld* World, const UObject* Requester, EParkourQueryPriority Priority, int32 Cost, uint8 Slot)
+{
+	UParkourQueryBudget* Budget = World != nullptr ? World->GetSubsystem<UParkourQueryBudget>() : nullptr;
+	return Budget == nullptr || Budget->TryConsume(Requester, Priority, Cost, Slot);
+}
+
+void UParkourQueryBudget::BeginFrame()
+{
+	ExecutedLastFrame = Executed;
+	DeferredLastFrame = Deferred;
+	Executed = 0;
+	Deferred = 0;
+
+	uint64 LastFrame = Frame;
+	Frame = GFrameCounter;
+
+	// Room nobody came back for is lost, so are requests that didn't ask again last frame, they don't need it anymore
+	Reservations.Reset();
+	Reserved = 0;
+	bHasWaiting = false;
+
+	TArray<TPair<uint64, QueuedRequest>, TInlineAllocator<64>> Waiting;
+	for (auto It = Queue.CreateIterator(); It; ++It)
+	{
+		if (It->Value.LastFrame != LastFrame)
+			It.RemoveCurrent();
+		else
+			Waiting.Emplace(It->Key, It->Value);
+	}
+
+	// Most urgent first, and the ones that have been waiting longer within the same priority
+	Waiting.Sort([this](const TPair<uint64, QueuedRequest>& A, const TPair<uint64, QueuedRequest>& B)
+	{
+		EParkourQueryPriority PriorityA = GetWaitingPriority(A.Value);
+		EParkourQueryPriority PriorityB = GetWaitingPriority(B.Value);
+		return PriorityA != PriorityB ? PriorityA > PriorityB : A.Value.FirstFrame < B.Value.FirstFrame;
+	});
+
+	// Strictly in order, a cheap request further down doesn't get to skip ahead of one that doesn't fit. One bigger
+	// than the whole budget gets a frame to itself
+	for (const TPair<uint64, QueuedRequest>& Request : Waiting)
+	{
+		if (Reserved > 0 && Reserved + Request.Value.Cost > MaxQueriesPerFrame)
+		{
+			bHasWaiting = true;
+			WaitingPriority = GetWaitingPriority(Request.Value);
+			break;
+		}
+
+		Reservations.Add(Request.Key, Request.Value.Cost);
+		Reserved += Request.Value.Cost;
+	}
+}
+
+void UParkourQueryBudget::Execute(int32 Cost)
+{
+	Executed += Cost;
+	TotalExecuted += Cost;
+	INC_DWORD_STAT_BY(STAT_ParkourBudgetExecuted, Cost);
+}
+
+void UParkourQueryBudget::Defer(uint64 Key, EParkourQueryPriority Priority, int32 Cost)
+{
+	QueuedRequest* Request = Queue.Find(Key);
+	if (Request == nullptr)
+	{
+		Request = &Queue.Add(Key);
+		Request->FirstFrame = Frame;
+	}
+	else if (Request->LastFrame == Frame)
+	{
+		// Already turned down this frame, don't count it twice
+		Request->Priority = FMath::Max(Request->Priority, Priority);
+		Request->Cost = FMath::Max(Request->Cost, Cost);
+		return;
+	}
+
+	Request->Priority = Priority;
+	Request->Cost = Cost;
+	Request->LastFrame = Frame;
+
+	Deferred += Cost;
+	TotalDeferred += Cost;
+	INC_DWORD_STAT_BY(STAT_ParkourBudgetDeferred, Cost);
+}
+
+EParkourQueryPriority UParkourQueryBudget::GetWaitingPriority(const QueuedRequest& Request) const
+{
+	int32 Raised = static_cast<int32>(Request.Priority) + static_cast<int32>(FMath::Min<uint64>(Frame - Request.FirstFrame, MAX_uint8));
+	return static_cast<EParkourQueryPriority>(FMath::Min(Raised, static_cast<int32>(EParkourQueryPriority::High)));
+}
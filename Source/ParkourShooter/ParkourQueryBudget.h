@@ -0,0 +1,130 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "ParkourQueryBudget.generated.h"
+
+/** How badly a probe needs to run this frame */
+enum class EParkourQueryPriority : uint8
+{
+	// Idle on the ground, nothing is going to change soon
+	Low,
+	Normal,
+	// Falling next to something we could wallrun or vault to, the window for it is short
+	High,
+	// Skipping it would change a move the client already made, always runs
+	Critical,
+	MAX
+};
+
+/**
+ * Caps how many parkour scene queries run in a single frame across the world. Everything tracing for parkour asks for
+ * room first, and whoever doesn't get it keeps their last result and asks again next frame.
+ *
+ * Requests turned down wait in a queue. When a frame starts, the queue hands out room for that frame by priority,
+ * oldest first within the same priority, and keeps it for them until they ask again. Fresh requests only get what
+ * is left, and only if nobody more urgent is still waiting. Low priority requests always go through the queue, so
+ * they never take room an urgent request asking later in the frame would need. A request gets more urgent every
+ * frame it waits, up to high, so nobody waits forever. Critical requests always run, but still use up the budget.
+ * "stat parkour" shows how many queries ran and how many were deferred each frame.
+ */
+UCLASS(config=Game)
+class PARKOURSHOOTER_API UParkourQueryBudget : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	/// <summary>
+	/// Ask for room for some queries this frame. If there's none, the request waits in the queue, asking again
+	/// on the next frame picks up the room it was given
+	/// </summary>
+	/// <param name="Requester"> Who is asking, the same requester has to ask again for its turn </param>
+	/// <param name="Priority"> How badly the queries need to run </param>
+	/// <param name="Cost"> How many queries we're about to issue </param>
+	/// <param name="Slot"> Tells apart different requests from the same requester </param>
+	/// <returns> True if the queries can run now, false if they should wait for a later frame </returns>
+	bool TryConsume(const UObject* Requester, EParkourQueryPriority Priority, int32 Cost = 1, uint8 Slot = 0);
+
+	/// <summary>
+	/// Same as TryConsume on the budget of the given world. Worlds without one don't limit queries
+	/// </summary>
+	static bool TryConsumeIn(const UWorld* World, const UObject* Requester, EParkourQueryPriority Priority, int32 Cost = 1, uint8 Slot = 0);
+
+	void SetMaxQueriesPerFrame(int32 NewMax) { MaxQueriesPerFrame = NewMax; }
+
+	int32 GetMaxQueriesPerFrame() const { return MaxQueriesPerFrame; }
+
+	/// <summary>
+	/// Queries that ran and queries that were deferred during the last frame anyone asked for room
+	/// </summary>
+	int32 GetExecutedLastFrame() const { return ExecutedLastFrame; }
+	int32 GetDeferredLastFrame() const { return DeferredLastFrame; }
+
+	uint64 GetTotalExecuted() const { return TotalExecuted; }
+	uint64 GetTotalDeferred() const { return TotalDeferred; }
+
+protected:
+
+	/** Max parkour queries across the whole world in a single frame, 0 or less doesn't limit them */
+	UPROPERTY(config)
+	int32 MaxQueriesPerFrame = 0;
+
+	// A request turned down, waiting for its turn
+	struct QueuedRequest
+	{
+		EParkourQueryPriority Priority = EParkourQueryPriority::Low;
+		int32 Cost = 0;
+
+		// When it was first turned down, and the last frame it asked
+		uint64 FirstFrame = 0;
+		uint64 LastFrame = 0;
+	};
+
+	/// <summary>
+	/// Start counting a new frame, keeping what the last one did, and give the waiting requests room in this one
+	/// </summary>
+	void BeginFrame();
+
+	/// <summary>
+	/// Count queries that are about to run
+	/// </summary>
+	void Execute(int32 Cost);
+
+	/// <summary>
+	/// Put a request turned down in the queue, or update the one that's already waiting
+	/// </summary>
+	void Defer(uint64 Key, EParkourQueryPriority Priority, int32 Cost);
+
+	/// <summary>
+	/// Priority of a waiting request, raised for every frame it waited
+	/// </summary>
+	EParkourQueryPriority GetWaitingPriority(const QueuedRequest& Request) const;
+
+	static uint64 MakeKey(const UObject* Requester, uint8 Slot) { return (static_cast<uint64>(Requester != nullptr ? Requester->GetUniqueID() : 0) << 8) | Slot; }
+
+	uint64 Frame = MAX_uint64;
+
+	// Requests turned down, by requester and slot
+	TMap<uint64, QueuedRequest> Queue;
+
+	// Room given to waiting requests this frame, kept until they ask again
+	TMap<uint64, int32> Reservations;
+	int32 Reserved = 0;
+
+	// Most urgent request that's still waiting after handing out room this frame, if any
+	bool bHasWaiting = false;
+	EParkourQueryPriority WaitingPriority = EParkourQueryPriority::Low;
+
+	// This frame
+	int32 Executed = 0;
+	int32 Deferred = 0;
+
+	int32 ExecutedLastFrame = 0;
+	int32 DeferredLastFrame = 0;
+
+	uint64 TotalExecuted = 0;
+	uint64 TotalDeferred = 0;
+};
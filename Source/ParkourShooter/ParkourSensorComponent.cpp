@@ -0,0 +1,359 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ParkourSensorComponent.h"
+#include "ParkourShooter.h"
+#include "ParkourShooterCharacter.h"
+#include "Components/CapsuleComponent.h"
+#include "ParkourMovementComponent.h"
+#include "VaultComponent.h"
+#include "ParkourStats.h"
+#include "ParkourSurfaceIndex.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+static FAutoConsoleCommandWithWorldAndArgs ProbeBenchCommand(
+	TEXT("Parkour.ProbeBench"),
+	TEXT("Compare parkour probes on the Visibility and Parkour channels around the player. Usage: Parkour.ProbeBench [Count=5000] [Radius=3000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&UParkourSensorComponent::RunProbeBenchmark)
+);
+
+// Sets default values for this component's properties
+UParkourSensorComponent::UParkourSensorComponent()
+{
+	// We tick before the character and its abilities so they find this frame's results ready to use
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.TickGroup = TG_PrePhysics;
+}
+
+// Called when the game starts
+void UParkourSensorComponent::BeginPlay()
+{
+	Super::BeginPlay();
+	ShooterCharacter = Cast<AParkourShooterCharacter>(GetOwner());
+	VaultComponent = GetOwner()->FindComponentByClass<UVaultComponent>();
+	QueryBudget = GetWorld()->GetSubsystem<UParkourQueryBudget>();
+	SurfaceIndex = GetWorld()->GetSubsystem<UParkourSurfaceSubsystem>();
+
+	QueryParams = FCollisionQueryParams::DefaultQueryParam;
+	QueryParams.AddIgnoredActor(GetOwner());
+
+	DynamicQueryParams = QueryParams;
+	DynamicQueryParams.MobilityType = EQueryMobilityType::Dynamic;
+}
+
+void UParkourSensorComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	PARKOUR_SCOPE_CYCLE_COUNTER(STAT_ParkourSensorTick);
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	// Run every probe someone will need this frame in a single pass, the abilities read the results later on
+	if (bProbeHeadroom)
+		RefreshHeadroom();
+
+	if (bProbeLedge)
+		RefreshLedge();
+
+	if (bProbeWall && !WallProbeDirection.IsZero())
+		RefreshWall(WallProbeDirection);
+}
+
+bool UParkourSensorComponent::CanStand()
+{
+	RefreshHeadroom();
+
+	// Standing up into a ceiling is worse than waiting for the next probe
+	const float MaxFeetDrift = 1.f;
+	return Headroom.bCanStand && ShooterCharacter != nullptr && FVector::DistSquared(Headroom.Feet, GetFeetLocation()) <= MaxFeetDrift * MaxFeetDrift;
+}
+
+FVector UParkourSensorComponent::GetFeetLocation() const
+{
+	UCapsuleComponent* Capsule = ShooterCharacter->GetCapsuleComponent();
+	return ShooterCharacter->GetActorLocation() - FVector(0, 0, Capsule->GetScaledCapsuleHalfHeight());
+}
+
+bool UParkourSensorComponent::CanVault(FVector& OutVaultLocation)
+{
+	RefreshLedge();
+
+	if (Ledge.bCanVault)
+		OutVaultLocation = Ledge.VaultLocation;
+
+	return Ledge.bCanVault;
+}
+
+bool UParkourSensorComponent::GetWallContact(const FVector& Direction, FHitResult& OutHit)
+{
+	RefreshWall(Direction);
+
+	if (Wall.bHitWall)
+		OutHit = Wall.Hit;
+
+	return Wall.bHitWall;
+}
+
+void UParkourSensorComponent::SetProbeEnabled(EParkourProbe Probe, bool bEnabled)
+{
+	switch (Probe)
+	{
+	case EParkourProbe::Headroom:
+		bProbeHeadroom = bEnabled;
+		break;
+	case EParkourProbe::Ledge:
+		bProbeLedge = bEnabled;
+		break;
+	case EParkourProbe::Wall:
+		bProbeWall = bEnabled;
+		break;
+	default:
+		break;
+	}
+
+	// Nothing to run ahead of time, the probes still run on demand
+	SetComponentTickEnabled(bProbeHeadroom || bProbeLedge || bProbeWall);
+}
+
+void UParkourSensorComponent::SetProbeIntervals(float NewHeadroomInterval, float NewLedgeInterval, float NewWallInterval)
+{
+	HeadroomInterval = NewHeadroomInterval;
+	LedgeInterval = NewLedgeInterval;
+	WallInterval = NewWallInterval;
+}
+
+bool UParkourSensorComponent::IsFresh(uint64 Frame, double Time, float Interval) const
+{
+	if (Frame == GFrameCounter)
+		return true;
+
+	return Frame != MAX_uint64 && Interval > 0 && GetWorld()->GetTimeSeconds() - Time < Interval;
+}
+
+bool UParkourSensorComponent::ConsumeBudget(EParkourProbe Probe, ProbeResult& Result)
+{
+	if (QueryBudget == nullptr)
+		return true;
+
+	// Already turned down this frame, don't count it twice
+	if (Result.DeferredFrame == GFrameCounter)
+		return false;
+
+	// The budget makes us more urgent every frame we wait, up to high, so nobody waits forever
+	if (QueryBudget->TryConsume(this, GetProbePriority(Probe, Result), 1, static_cast<uint8>(Probe)))
+		return true;
+
+	Result.DeferredFrame = GFrameCounter;
+	return false;
+}
+
+EParkourQueryPriority UParkourSensorComponent::GetProbePriority(EParkourProbe Probe, const ProbeResult& Result) const
+{
+	// Nothing to fall back to, we have to probe anyway. It still counts against the budget
+	if (Result.Frame == MAX_uint64)
+		return EParkourQueryPriority::Critical;
+
+	if (ShooterCharacter == nullptr)
+		return EParkourQueryPriority::Normal;
+
+	bool bPlayer = ShooterCharacter->IsPlayerControlled();
+
+	// The wall probe runs from the wallrun steps of the locally controlled character: the owning client for players,
+	// the server for bots. The server doesn't probe for remote players, their wall direction comes from the client.
+	// Skipping it while running leaves the wallrun following a wall that might not be there, players would feel it
+	UParkourMovementComponent* Movement = ShooterCharacter->GetParkourMovement();
+	if (Probe == EParkourProbe::Wall && Movement->IsCustomMode(EParkourMovementMode::WallRun))
+		return bPlayer ? EParkourQueryPriority::Critical : EParkourQueryPriority::High;
+
+	if (Movement->IsFalling())
+	{
+		// Next to a ledge or a wall, we could vault or wallrun any moment now
+		bool bNearWall = Ledge.bCanVault || (Wall.bHitWall && IsFresh(Wall.Frame, Wall.Time, 0.5f));
+		return bPlayer || bNearWall ? EParkourQueryPriority::High : EParkourQueryPriority::Normal;
+	}
+
+	// Standing still on the ground, nothing around us is going to change soon
+	if (!bPlayer && Movement->Velocity.IsNearlyZero(1.f))
+		return EParkourQueryPriority::Low;
+
+	return EParkourQueryPriority::Normal;
+}
+
+void UParkourSensorComponent::Invalidate()
+{
+	Headroom.Frame = MAX_uint64;
+	Ledge.Frame = MAX_uint64;
+	Wall.Frame = MAX_uint64;
+}
+
+void UParkourSensorComponent::RefreshHeadroom()
+{
+	// Already up to date
+	if (IsFresh(Headroom.Frame, Headroom.Time, HeadroomInterval) || ShooterCharacter == nullptr)
+		return;
+
+	if (!ConsumeBudget(EParkourProbe::Headroom, Headroom))
+		return;
+
+	// We have to check if there's something over our heads stoping us from standing.
+	// Note that since we want to know if it's something where our head will be when we stand, we will
+	// cast a ray from our feet to our next head location, and this location depends on our old half height, not
+	// our current half height
+	FVector StartLocation = GetFeetLocation();
+	FVector EndLocation = StartLocation + FVector(0, 0, 2 * StandingHalfHeight);
+
+	FHitResult Hit;
+	PARKOUR_COUNT_QUERY(Headroom);
+	bool HitSomething = GetWorld()->LineTraceSingleByChannel(Hit, StartLocation, EndLocation, ECC_Parkour, QueryParams);
+
+	Headroom.bCanStand = !HitSomething;
+	Headroom.Feet = StartLocation;
+	Headroom.Frame = GFrameCounter;
+	Headroom.Time = GetWorld()->GetTimeSeconds();
+}
+
+void UParkourSensorComponent::RefreshLedge()
+{
+	if (IsFresh(Ledge.Frame, Ledge.Time, LedgeInterval))
+		return;
+
+	// The vault component knows what makes a ledge vaultable, we only make sure it's asked once per frame.
+	// With async probing this submits the next probe and hands us the latest complete one. It asks the
+	// query budget itself, its probes go through it wherever they come from
+	if (VaultComponent == nullptr)
+	{
+		Ledge.bCanVault = false;
+	}
+	else if (VaultComponent->UsesAsyncProbe())
+	{
+		Ledge.bCanVault = VaultComponent->UpdateAsyncProbe(Ledge.VaultLocation, GetProbePriority(EParkourProbe::Ledge, Ledge));
+	}
+	else
+	{
+		FVector VaultLocation = Ledge.VaultLocation;
+		bool bCanVault = VaultComponent->ProbeVault(VaultLocation, GetProbePriority(EParkourProbe::Ledge, Ledge));
+
+		// Turned down by the budget, keep the last result until our turn comes
+		if (VaultComponent->IsProbeDeferred())
+			return;
+
+		Ledge.bCanVault = bCanVault;
+		Ledge.VaultLocation = VaultLocation;
+	}
+	Ledge.Frame = GFrameCounter;
+	Ledge.Time = GetWorld()->GetTimeSeconds();
+}
+
+void UParkourSensorComponent::RefreshWall(const FVector& Direction)
+{
+	// Reuse a result only if we still look roughly the same way. The direction follows the wall as we run along
+	// it, so it's a bit different at every step than the one our tick probed
+	bool bSameDirection = FVector::DotProduct(Wall.Direction, Direction) > 0.95f;
+	if ((bSameDirection && IsFresh(Wall.Frame, Wall.Time, WallInterval)) || ShooterCharacter == nullptr)
+		return;
+
+	// A result for another side is no good to fall back to
+	if (!bSameDirection)
+		Wall.Frame = MAX_uint64;
+
+	if (!ConsumeBudget(EParkourProbe::Wall, Wall))
+		return;
+
+	FVector Start = ShooterCharacter->GetActorLocation();
+	FVector End = Start + WallProbeDistance * Direction;
+
+	// Static walls come from the surface index if we have one, then the trace only has to find dynamic ones
+	bool bUseIndex = bUseSurfaceIndex && SurfaceIndex != nullptr && SurfaceIndex->IsAvailable();
+
+	PARKOUR_COUNT_QUERY(Wallrun);
+	Wall.bHitWall = GetWorld()->LineTraceSingleByChannel(
+		Wall.Hit,
+		Start,
+		End,
+		ECC_Parkour,
+		bUseIndex ? DynamicQueryParams : QueryParams
+	);
+
+	// The closest of both is the one a full trace would hit
+	FHitResult BakedHit;
+	if (bUseIndex && SurfaceIndex->FindWall(Start, End, BakedHit) && (!Wall.bHitWall || BakedHit.Time < Wall.Hit.Time))
+	{
+		Wall.Hit = BakedHit;
+		Wall.bHitWall = true;
+	}
+
+	Wall.Direction = Direction;
+	Wall.Frame = GFrameCounter;
+	Wall.Time = GetWorld()->GetTimeSeconds();
+}
+
+void UParkourSensorComponent::RunProbeBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	APlayerController* PlayerController = World != nullptr ? World->GetFirstPlayerController() : nullptr;
+	APawn* Pawn = PlayerController != nullptr ? PlayerController->GetPawn() : nullptr;
+	if (Pawn == nullptr)
+	{
+		UE_LOG(LogParkour, Error, TEXT("Parkour.ProbeBench needs a game world with a player"));
+		return;
+	}
+
+	int32 Count = 5000;
+	float Radius = 3000;
+
+	for (const FString& Arg : Args)
+	{
+		FParse::Value(*Arg, TEXT("Count="), Count);
+		FParse::Value(*Arg, TEXT("Radius="), Radius);
+	}
+
+	Count = FMath::Max(Count, 1);
+
+	// Same probes on both channels: a vault ray down and a wallrun ray to the side, from random spots around the player
+	struct FProbe
+	{
+		FVector Start;
+		FVector End;
+	};
+
+	FRandomStream Random(1234);
+	FVector Center = Pawn->GetActorLocation();
+	TArray<FProbe> Probes;
+	Probes.Reserve(Count * 2);
+	for (int32 i = 0; i < Count; i++)
+	{
+		FVector2D Offset = FVector2D(Random.FRandRange(-1, 1), Random.FRandRange(-1, 1)) * Radius;
+		FVector Location = Center + FVector(Offset, Random.FRandRange(-200, 400));
+		FVector Side = FVector(FVector2D(Random.GetUnitVector()).GetSafeNormal(), 0);
+
+		Probes.Add({ Location + FVector(0, 0, 100), Location - FVector(0, 0, 100) });
+		Probes.Add({ Location, Location + Side * 200 });
+	}
+
+	FCollisionQueryParams Params = FCollisionQueryParams::DefaultQueryParam;
+	Params.AddIgnoredActor(Pawn);
+
+	auto Run = [&](const TCHAR* Name, ECollisionChannel Channel)
+	{
+		TArray<float> Micros;
+		Micros.Reserve(Probes.Num());
+		int32 Hits = 0;
+
+		for (const FProbe& Probe : Probes)
+		{
+			FHitResult Hit;
+			uint64 Start = FPlatformTime::Cycles64();
+			Hits += World->LineTraceSingleByChannel(Hit, Probe.Start, Probe.End, Channel, Params) ? 1 : 0;
+			float Elapsed = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - Start) * 1000;
+
+			Micros.Add(Elapsed);
+		}
+
+		const FParkourSampleStats Stats = FParkourSampleStats::Compute(Micros);
+		UE_LOG(LogParkour, Display, TEXT("  %s us per probe: mean %.3f, p50 %.3f, p99 %.3f, max %.3f, %d hits"), Name,
+			Stats.Mean, Stats.P50, Stats.P99, Stats.Max, Hits);
+	};
+
+	UE_LOG(LogParkour, Display, TEXT("Parkour.ProbeBench: %d probes in %.0f around the player"), Probes.Num(), Radius);
+	Run(TEXT("Visibility"), ECC_Visibility);
+	Run(TEXT("Parkour"), ECC_Parkour);
+}
@@ -0,0 +1,198 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "CollisionQueryParams.h"
+#include "Engine/EngineTypes.h"
+#include "ParkourQueryBudget.h"
+#include "ParkourSensorComponent.generated.h"
+
+class AParkourShooterCharacter;
+class UVaultComponent;
+class UParkourSurfaceSubsystem;
+
+/** Probes the sensor runs. Each can also run ahead of time during its own tick */
+enum class EParkourProbe : uint8
+{
+	Headroom,
+	Ledge,
+	Wall
+};
+
+/**
+ * Runs the scene queries shared by the parkour abilities (headroom, ledge in front, wall to the side)
+ * and publishes their results. Every probe some ability needs right now runs in a single pass during our tick,
+ * before the character and its abilities, which then read this frame's results. Asking for a probe nobody
+ * enabled computes it on demand, still at most once per frame. Probes also go through the world's query budget,
+ * when it's used up they keep their last result until a later frame.
+ */
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class PARKOURSHOOTER_API UParkourSensorComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this component's properties
+	UParkourSensorComponent();
+
+	// Called every frame
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	/// <summary>
+	/// Checks if there's enough space over the character's head to stand up. A result probed somewhere else, because
+	/// the query budget or our LOD pushed the probe back, counts as blocked until a new probe runs where we are
+	/// </summary>
+	/// <returns> True if nothing blocks the standing capsule height </returns>
+	bool CanStand();
+
+	/// <summary>
+	/// Checks if there's a ledge in front of the character we can vault to
+	/// </summary>
+	/// <param name="OutVaultLocation"> Position after performing vault, only valid if returns true </param>
+	/// <returns> True if we can vault </returns>
+	bool CanVault(FVector& OutVaultLocation);
+
+	/// <summary>
+	/// Checks if there's a wall in the given direction, used to keep wallrunning
+	/// </summary>
+	/// <param name="Direction"> Unit vector pointing from the character to where the wall should be </param>
+	/// <param name="OutHit"> Hit against the wall, only valid if returns true </param>
+	/// <returns> True if we hit something </returns>
+	bool GetWallContact(const FVector& Direction, FHitResult& OutHit);
+
+	/// <summary>
+	/// Choose if a probe should be refreshed during the sensor tick, before anyone asks for it. Disabled
+	/// probes are still computed on demand
+	/// </summary>
+	void SetProbeEnabled(EParkourProbe Probe, bool bEnabled);
+
+	/// <summary>
+	/// Side the wall probe looks at when it runs during our tick
+	/// </summary>
+	/// <param name="Direction"> Unit vector pointing from the character to where the wall should be </param>
+	void SetWallProbeDirection(const FVector& Direction) { WallProbeDirection = Direction; }
+
+	/// <summary>
+	/// Forget every result computed this frame. Use it when something the probes depend on changes
+	/// in the middle of a frame
+	/// </summary>
+	void Invalidate();
+
+	void SetStandingHalfHeight(float NewHalfHeight) { StandingHalfHeight = NewHalfHeight; }
+
+	/// <summary>
+	/// Let results be reused for a while instead of probing again every frame, for characters far from every player.
+	/// An interval of 0 probes at most once per frame, as usual
+	/// </summary>
+	void SetProbeIntervals(float NewHeadroomInterval, float NewLedgeInterval, float NewWallInterval);
+
+	/// <summary>
+	/// Console command: run the same vault and wall probes around the player on the Visibility and the Parkour
+	/// channels, and print what each costs
+	/// </summary>
+	static void RunProbeBenchmark(const TArray<FString>& Args, UWorld* World);
+
+protected:
+	// Called when the game starts
+	virtual void BeginPlay() override;
+
+	void RefreshHeadroom();
+	void RefreshLedge();
+	void RefreshWall(const FVector& Direction);
+
+	/** Bottom of our capsule, where the headroom probe starts */
+	FVector GetFeetLocation() const;
+
+	struct ProbeResult
+	{
+		uint64 Frame = MAX_uint64;
+		double Time = 0;
+
+		// Last frame the budget turned us down
+		uint64 DeferredFrame = MAX_uint64;
+	};
+
+	struct HeadroomResult : ProbeResult
+	{
+		bool bCanStand = true;
+
+		// Where our feet were when we probed
+		FVector Feet = FVector::ZeroVector;
+	};
+
+	struct LedgeResult : ProbeResult
+	{
+		bool bCanVault = false;
+		FVector VaultLocation = FVector::ZeroVector;
+	};
+
+	struct WallResult : ProbeResult
+	{
+		bool bHitWall = false;
+		FVector Direction = FVector::ZeroVector;
+		FHitResult Hit;
+	};
+
+	HeadroomResult Headroom;
+	LedgeResult Ledge;
+	WallResult Wall;
+
+	bool bProbeHeadroom = false;
+	bool bProbeLedge = true;
+	bool bProbeWall = false;
+	FVector WallProbeDirection = FVector::ZeroVector;
+
+	// Seconds a result stays valid for, on top of the frame it was computed in
+	float HeadroomInterval = 0;
+	float LedgeInterval = 0;
+	float WallInterval = 0;
+
+	/// <summary>
+	/// Checks if a result computed on the given frame and time can still be used
+	/// </summary>
+	bool IsFresh(uint64 Frame, double Time, float Interval) const;
+
+	/// <summary>
+	/// Ask the query budget if a probe can run now. If it can't, the probe keeps its last result
+	/// </summary>
+	/// <param name="Probe"> Probe about to run </param>
+	/// <param name="Result"> Its last result, to know if there's one to fall back to </param>
+	/// <returns> True if the probe should run </returns>
+	bool ConsumeBudget(EParkourProbe Probe, ProbeResult& Result);
+
+	/// <summary>
+	/// How urgent a probe is given what the character is doing right now, and whether it has a result to fall back to
+	/// </summary>
+	EParkourQueryPriority GetProbePriority(EParkourProbe Probe, const ProbeResult& Result) const;
+
+	/** How far to the side to look for a wall while wallrunning */
+	UPROPERTY(EditDefaultsOnly, Category = "Sensor")
+	float WallProbeDistance = 200;
+
+	/** Look static walls up in the baked surface index when every loaded level has one, and only trace dynamic objects */
+	UPROPERTY(EditDefaultsOnly, Category = "Sensor")
+	bool bUseSurfaceIndex = true;
+
+	// Half height of the capsule when standing, the headroom probe checks up to this height
+	float StandingHalfHeight = 0;
+
+	UPROPERTY()
+	AParkourShooterCharacter* ShooterCharacter;
+
+	UPROPERTY()
+	UVaultComponent* VaultComponent;
+
+	UPROPERTY()
+	UParkourQueryBudget* QueryBudget;
+
+	UPROPERTY()
+	UParkourSurfaceSubsystem* SurfaceIndex;
+
+	// Built once, all probes ignore the owner
+	FCollisionQueryParams QueryParams;
+
+	// Same, but only against dynamic objects, for when static ones come from the surface index
+	FCollisionQueryParams DynamicQueryParams;
+};
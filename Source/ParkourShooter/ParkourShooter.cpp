@@ -1,7 +1,136 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "ParkourShooter.h"
+#include "ParkourStats.h"
 #include "Modules/ModuleManager.h"
+#include "Containers/Ticker.h"
 
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, ParkourShooter, "ParkourShooter" );
- 
\ No newline at end of file
+
+DEFINE_LOG_CATEGORY(LogParkour);
+
+namespace ParkourLog
+{
+	/** Every throttled call site that ever logged, one static throttle per call site */
+	static TArray<FParkourLogThrottle*> Throttles;
+}
+
+bool FParkourLogThrottle::ShouldLog(ELogVerbosity::Type InVerbosity, const TCHAR* InFormat, float InInterval, int32& OutSuppressed, double& OutElapsed)
+{
+	if (!bRegistered)
+	{
+		bRegistered = true;
+		Verbosity = InVerbosity;
+		Format = InFormat;
+
+		if (ParkourLog::Throttles.Num() == 0)
+			FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateStatic(&FParkourLogThrottle::FlushAll));
+
+		ParkourLog::Throttles.Add(this);
+	}
+
+	Interval = InInterval;
+
+	const double Now = FPlatformTime::Seconds();
+	if (Now - LastLogTime < Interval)
+	{
+		Suppressed++;
+		return false;
+	}
+
+	OutSuppressed = Suppressed;
+	OutElapsed = Now - LastLogTime;
+	Suppressed = 0;
+	LastLogTime = Now;
+	return true;
+}
+
+bool FParkourLogThrottle::FlushAll(float DeltaTime)
+{
+	const double Now = FPlatformTime::Seconds();
+	for (FParkourLogThrottle* Throttle : ParkourLog::Throttles)
+	{
+		// Still inside its interval, the next message it writes reports them
+		if (Throttle->Suppressed == 0 || Now - Throttle->LastLogTime < Throttle->Interval)
+			continue;
+
+		FMsg::Logf(__FILE__, __LINE__, LogParkour.GetCategoryName(), Throttle->Verbosity, TEXT("%d more \"%s\" in the last %.1fs"),
+			Throttle->Suppressed, Throttle->Format, Now - Throttle->LastLogTime);
+
+		Throttle->Suppressed = 0;
+		Throttle->LastLogTime = Now;
+	}
+
+	return true;
+}
+
+DEFINE_STAT(STAT_ParkourCharacterTick);
+DEFINE_STAT(STAT_ParkourCanStand);
+DEFINE_STAT(STAT_ParkourUpdateSlide);
+DEFINE_STAT(STAT_ParkourUpdateWallrun);
+DEFINE_STAT(STAT_ParkourVaultTick);
+DEFINE_STAT(STAT_ParkourCanVault);
+DEFINE_STAT(STAT_ParkourGrappleTick);
+DEFINE_STAT(STAT_ParkourSensorTick);
+DEFINE_STAT(STAT_ParkourFixedSteps);
+DEFINE_STAT(STAT_ParkourBatchedTick);
+DEFINE_STAT(STAT_ParkourSignificance);
+DEFINE_STAT(STAT_ParkourGrappleAnchorQuery);
+
+DEFINE_STAT(STAT_ParkourHeadroomQueries);
+DEFINE_STAT(STAT_ParkourVaultQueries);
+DEFINE_STAT(STAT_ParkourWallrunQueries);
+DEFINE_STAT(STAT_ParkourGrappleQueries);
+
+DEFINE_STAT(STAT_ParkourBudgetExecuted);
+DEFINE_STAT(STAT_ParkourBudgetDeferred);
+
+DEFINE_STAT(STAT_ParkourAsyncVaultHits);
+DEFINE_STAT(STAT_ParkourAsyncVaultMisses);
+
+DEFINE_STAT(STAT_ParkourSurfaceLookups);
+DEFINE_STAT(STAT_ParkourCapsuleResizes);
+
+DEFINE_STAT(STAT_ParkourLODHigh);
+DEFINE_STAT(STAT_ParkourLODMedium);
+DEFINE_STAT(STAT_ParkourLODLow);
+
+#if !UE_BUILD_SHIPPING
+uint64 GParkourQueryCounts[static_cast<int32>(EParkourQueryType::MAX)] = {};
+#endif
+
+FParkourSampleStats FParkourSampleStats::Compute(TArray<float> Samples)
+{
+	FParkourSampleStats Stats;
+	if (Samples.Num() == 0)
+		return Stats;
+
+	Samples.Sort();
+
+	double Sum = 0;
+	for (float Sample : Samples)
+		Sum += Sample;
+
+	Stats.Num = Samples.Num();
+	Stats.Mean = Sum / Samples.Num();
+	Stats.P50 = Percentile(Samples, 50);
+	Stats.P95 = Percentile(Samples, 95);
+	Stats.P99 = Percentile(Samples, 99);
+	Stats.Max = Samples.Last();
+	return Stats;
+}
+
+float FParkourSampleStats::Percentile(const TArray<float>& Sorted, float Percent)
+{
+	if (Sorted.Num() == 0)
+		return 0;
+
+	// Nearest rank, the smallest sample with at least Percent of them at or below it
+	int32 Index = FMath::CeilToInt(Percent / 100.f * Sorted.Num()) - 1;
+	return Sorted[FMath::Clamp(Index, 0, Sorted.Num() - 1)];
+}
+
+FString FParkourSampleStats::ToString() const
+{
+	return FString::Printf(TEXT("mean %.4f, p50 %.4f, p95 %.4f, p99 %.4f, max %.4f"), Mean, P50, P95, P99, Max);
+}
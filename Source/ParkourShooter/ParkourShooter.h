@@ -3,3 +3,78 @@
 #pragma once
 
 #include "CoreMinimal.h"
+
+// Everything below Warning is stripped from Shipping builds, format strings and all
+#if UE_BUILD_SHIPPING
+	#define PARKOUR_LOG_COMPILE_VERBOSITY Warning
+#else
+	#define PARKOUR_LOG_COMPILE_VERBOSITY All
+#endif
+
+DECLARE_LOG_CATEGORY_EXTERN(LogParkour, Log, PARKOUR_LOG_COMPILE_VERBOSITY);
+
+/**
+ * Trace channel of every parkour probe, "Parkour" in the collision settings. It blocks by default like Visibility,
+ * but props, foliage and detailed meshes can ignore it and leave a simple ParkourProxyComponent in their place
+ */
+#define ECC_Parkour ECC_GameTraceChannel2
+
+/** Keeps track of a single log call site, so it writes at most once per interval. Only for game thread call sites */
+struct PARKOURSHOOTER_API FParkourLogThrottle
+{
+	/// <summary>
+	/// Checks if the call site should write now, counting the messages that don't
+	/// </summary>
+	/// <param name="InVerbosity"> Verbosity of the call site, to report the skipped messages with </param>
+	/// <param name="InFormat"> Format string of the call site, to tell which messages were skipped </param>
+	/// <param name="InInterval"> Min seconds between two writes </param>
+	/// <param name="OutSuppressed"> How many messages were skipped since the last write </param>
+	/// <param name="OutElapsed"> Seconds since the last write </param>
+	/// <returns> True if the message should be written </returns>
+	bool ShouldLog(ELogVerbosity::Type InVerbosity, const TCHAR* InFormat, float InInterval, int32& OutSuppressed, double& OutElapsed);
+
+	/// <summary>
+	/// Report the skipped messages of every call site that went quiet for a whole interval, so the count of a burst
+	/// isn't lost when it stops. Runs from the core ticker every frame
+	/// </summary>
+	static bool FlushAll(float DeltaTime);
+
+	double LastLogTime = -DBL_MAX;
+	int32 Suppressed = 0;
+	float Interval = 0;
+	ELogVerbosity::Type Verbosity = ELogVerbosity::Log;
+	const TCHAR* Format = nullptr;
+	bool bRegistered = false;
+};
+
+/**
+ * Log to LogParkour at most once every Interval seconds from this call site, for hot paths that would log
+ * every frame otherwise. Skipped messages are counted and reported with the next one that gets written, or on
+ * their own once the call site was quiet for a whole interval. Nothing is formatted unless the message is
+ * actually written, and it compiles out like any other UE_LOG
+ */
+#if NO_LOGGING
+	#define PARKOUR_LOG_THROTTLED(Verbosity, Interval, Format, ...)
+#else
+	#define PARKOUR_LOG_THROTTLED(Verbosity, Interval, Format, ...) \
+		do \
+		{ \
+			if (UE_LOG_ACTIVE(LogParkour, Verbosity)) \
+			{ \
+				static FParkourLogThrottle ParkourLogThrottle; \
+				int32 ParkourLogSuppressed = 0; \
+				double ParkourLogElapsed = 0; \
+				if (ParkourLogThrottle.ShouldLog(ELogVerbosity::Verbosity, Format, Interval, ParkourLogSuppressed, ParkourLogElapsed)) \
+				{ \
+					if (ParkourLogSuppressed > 0) \
+					{ \
+						UE_LOG(LogParkour, Verbosity, TEXT("%s (%d more in the last %.1fs)"), *FString::Printf(Format, ##__VA_ARGS__), ParkourLogSuppressed, ParkourLogElapsed); \
+					} \
+					else \
+					{ \
+						UE_LOG(LogParkour, Verbosity, Format, ##__VA_ARGS__); \
+					} \
+				} \
+			} \
+		} while (0)
+#endif
@@ -1,6 +1,7 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "ParkourShooterCharacter.h"
+#include "ParkourShooter.h"
 #include "ParkourShooterProjectile.h"
 #include "GameFramework/CharacterMovementComponent.h"
 #include "Animation/AnimInstance.h"
@@ -14,13 +15,36 @@
 #include "XRMotionControllerBase.h" // for FXRMotionControllerBase::RightHandSourceId
 #include "VaultComponent.h"
 #include "GraplingHookComponent.h"
+#include "ParkourSensorComponent.h"
+#include "ParkourMovementComponent.h"
+#include "ParkourInputRecorderComponent.h"
+#include "ParkourTickManager.h"
+#include "ParkourSignificanceSubsystem.h"
+#include "ProjectilePoolSubsystem.h"
+#include "ProjectileSimulationSubsystem.h"
+#include "ParkourStats.h"
+#include "ParkourShooterUtils.h"
+#include "GrappleAnchorSubsystem.h"
+#include "GrappleAimPreviewComponent.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+#include "Curves/CurveFloat.h"
+#include "Engine/ScopedMovementUpdate.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
 
 DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
 
+static FAutoConsoleCommandWithWorldAndArgs CrouchBenchCommand(
+	TEXT("Parkour.CrouchBench"),
+	TEXT("Crouch and stand the player up, resizing the capsule every frame and in steps, and print the capsule resizes per slide. Usage: Parkour.CrouchBench [Slides=100] [FrameRate=60]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&AParkourShooterCharacter::RunCrouchBenchmark)
+);
+
 //////////////////////////////////////////////////////////////////////////
 // AParkourShooterCharacter
 
-AParkourShooterCharacter::AParkourShooterCharacter()
+AParkourShooterCharacter::AParkourShooterCharacter(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer.SetDefaultSubobjectClass<UParkourMovementComponent>(ACharacter::CharacterMovementComponentName))
 {
 	PrimaryActorTick.bCanEverTick = true;
 	SetActorTickEnabled(true);
@@ -31,6 +55,13 @@ AParkourShooterCharacter::AParkourShooterCharacter()
 	// Set size for collision capsule
 	GetCapsuleComponent()->InitCapsuleSize(55.f, 96.0f);
 
+	// Environment probes shared by all abilities
+	SensorComponent = CreateDefaultSubobject<UParkourSensorComponent>(TEXT("ParkourSensor"));
+	ParkourLOD = EParkourLOD::High;
+
+	// Input recording and replay, idle unless asked to
+	InputRecorder = CreateDefaultSubobject<UParkourInputRecorderComponent>(TEXT("InputRecorder"));
+
 	// Wallrun Initialization
 	GetCapsuleComponent()->OnComponentHit.AddDynamic(this, &AParkourShooterCharacter::OnWallHit);
 	CameraTiltTimeline = CreateDefaultSubobject<UTimelineComponent>(TEXT("CameraTiltTimeline"));
@@ -42,6 +73,7 @@ AParkourShooterCharacter::AParkourShooterCharacter()
 	// Grappling Hook
 	GrapplingHook = CreateDefaultSubobject<UGraplingHookComponent>(TEXT("GrapplingHookComponent"));
 	GrapplingHookSpawnPoint = CreateDefaultSubobject<USceneComponent>(TEXT("GrapplingHookSpawnPoint"));
+	GrappleAimPreview = CreateDefaultSubobject<UGrappleAimPreviewComponent>(TEXT("GrappleAimPreview"));
 	GrapplingHookSpawnPoint->SetupAttachment(RootComponent);
 
 	// set our turn rates for input
@@ -128,7 +160,6 @@ void AParkourShooterCharacter::BeginPlay()
 	}
 
 	// Wallrun Setup
-	GetCharacterMovement()->SetPlaneConstraintEnabled(true);
 	CameraTiltTrack.BindDynamic(this, &AParkourShooterCharacter::UpdateCameraTilt);
 
 	if (CameraTiltCurve != nullptr)
@@ -141,20 +172,81 @@ void AParkourShooterCharacter::BeginPlay()
 
 	StandingHalfHeight = GetCapsuleComponent()->GetScaledCapsuleHalfHeight();
 	StandingCameraZOffset = GetFirstPersonCameraComponent()->GetRelativeLocation().Z;
+	GetParkourMovement()->SetStepVisualCamera(FirstPersonCameraComponent);
+	SensorComponent->SetStandingHalfHeight(StandingHalfHeight);
+
+	// We read probe results during our own tick, so the sensor has to run first
+	AddTickPrerequisiteComponent(SensorComponent);
+
 	SetMovementState(MovementState::Sprinting);
 
 	// Sliding
+	FParkourSlideParams SlideParams;
+	SlideParams.InitialSpeed = MaxSprintSpeed + (MaxSlideSpeed - MaxSprintSpeed) / 2.f;
+	SlideParams.MaxSpeed = MaxSlideSpeed;
+	SlideParams.GroundFriction = MinFrictionOnSlide;
+	SlideParams.BrakingDeceleration = MinBrakingDecelerationOnSlide;
+	SlideParams.FloorInfluenceForce = FloorInfluenceForce;
+	GetParkourMovement()->SetSlideParams(SlideParams);
+
+	// Wallrun checks the wall on every fixed step of the movement, so it runs the same at any frame rate
+	GetParkourMovement()->OnParkourStep.AddUObject(this, &AParkourShooterCharacter::OnParkourStep);
+
+	// Shooting: have projectiles ready so firing doesn't spawn actors
+	UProjectilePoolSubsystem* ProjectilePool = GetWorld()->GetSubsystem<UProjectilePoolSubsystem>();
+	if (ProjectilePool != nullptr && ProjectileClass != nullptr)
+		ProjectilePool->Prewarm(ProjectileClass);
+
+	// With lots of characters around, one tick function updating all of them is cheaper than a tick each
+	UParkourTickManager* TickManager = GetWorld()->GetSubsystem<UParkourTickManager>();
+	if (TickManager != nullptr)
+		TickManager->RegisterCharacter(this);
+
+	// Characters far from every player don't need to probe as often
+	UParkourSignificanceSubsystem* Significance = GetWorld()->GetSubsystem<UParkourSignificanceSubsystem>();
+	if (Significance != nullptr)
+		Significance->RegisterCharacter(this);
+}
 
-	OriginalProperties = MovementProperties{ 
-			GetCharacterMovement()->GravityScale, 
-			GetCharacterMovement()->AirControl, 
-			GetCharacterMovement()->GroundFriction, 
-			GetCharacterMovement()->BrakingDecelerationWalking 
-	};
+void AParkourShooterCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	UParkourTickManager* TickManager = GetWorld() != nullptr ? GetWorld()->GetSubsystem<UParkourTickManager>() : nullptr;
+	if (TickManager != nullptr)
+		TickManager->UnregisterCharacter(this);
+
+	UParkourSignificanceSubsystem* Significance = GetWorld() != nullptr ? GetWorld()->GetSubsystem<UParkourSignificanceSubsystem>() : nullptr;
+	if (Significance != nullptr)
+		Significance->UnregisterCharacter(this);
+
+	Super::EndPlay(EndPlayReason);
+}
+
+UParkourMovementComponent* AParkourShooterCharacter::GetParkourMovement() const
+{
+	return Cast<UParkourMovementComponent>(GetCharacterMovement());
+}
+
+void AParkourShooterCharacter::SetParkourLOD(EParkourLOD NewLOD, const FParkourLODSettings& Settings)
+{
+	ParkourLOD = NewLOD;
+
+	auto ToInterval = [](float Rate) { return Rate > 0 ? 1.f / Rate : 0.f; };
+	SensorComponent->SetProbeIntervals(ToInterval(Settings.HeadroomProbeRate), ToInterval(Settings.VaultProbeRate), ToInterval(Settings.WallProbeRate));
+
+	// A player's moves are simulated on both ends, and both have to use the same step rate
+	GetParkourMovement()->SetParkourStepRateOverride(IsPlayerControlled() ? 0.f : Settings.ParkourStepRate);
+}
+
+void AParkourShooterCharacter::RecordInputAction(EParkourInputAction Action)
+{
+	if (InputRecorder != nullptr)
+		InputRecorder->RecordAction(Action);
 }
 
 void AParkourShooterCharacter::Slide()
 {
+	RecordInputAction(EParkourInputAction::SlidePressed);
+
 	// Player requested sliding
 	IsCrouchKeyDown = true;
 
@@ -173,6 +265,8 @@ void AParkourShooterCharacter::Slide()
 
 void AParkourShooterCharacter::SlideRelease()
 {
+	RecordInputAction(EParkourInputAction::SlideReleased);
+
 	IsCrouchKeyDown = false;
 }
 
@@ -218,29 +312,21 @@ void AParkourShooterCharacter::SprintRelease()
 
 void AParkourShooterCharacter::BeginSlide()
 {
-	FVector ForwardVelocity = (MaxSprintSpeed + (MaxSlideSpeed - MaxSprintSpeed) / 2.f)*GetActorForwardVector();
-	GetCharacterMovement()->Velocity = ForwardVelocity;
-	GetCharacterMovement()->GroundFriction = MinFrictionOnSlide;
-	GetCharacterMovement()->BrakingDecelerationWalking = MinBrakingDecelerationOnSlide;
+	// The initial push, slope influence and speed clamp happen in the slide movement mode
+	GetParkourMovement()->BeginSlide();
 	BeginSlideBP();
 }
 
 void AParkourShooterCharacter::UpdateSlide()
 {
-	// I didn't know before that you can actually get the floor XD
-	FVector FloorNormal = GetCharacterMovement()->CurrentFloor.HitResult.Normal;
-	// Direction of floor downwards if floor has some slope
-	FVector Influence = ComputeFloorInfluence(FloorNormal);
-	GetCharacterMovement()->AddForce(Influence);
+	// Old Blueprint timelines still call this, the native tick already did the work
+}
+
+void AParkourShooterCharacter::TickSlide()
+{
+	PARKOUR_SCOPE_CYCLE_COUNTER(STAT_ParkourUpdateSlide);
 
-	// Now clamp velocity 
 	FVector Velocity = GetCharacterMovement()->Velocity;
-	if (Velocity.SizeSquared() > MaxSlideSpeed*MaxSlideSpeed)
-	{
-		Velocity.Normalize();
-		Velocity = MaxSlideSpeed * Velocity;
-		GetCharacterMovement()->Velocity = Velocity;
-	}
 
 	// In the other hand, if speed is too low, we should not be sliding, we should crouch or run
 	float MinSpeedToSlide = 1.5 * MaxCrouchSpeed;
@@ -253,20 +339,22 @@ void AParkourShooterCharacter::UpdateSlide()
 
 void AParkourShooterCharacter::EndSlide()
 {
-	RestoreMovementProperties();
+	GetParkourMovement()->EndSlide();
 
 	EndSlideBP();
 }
 
 void AParkourShooterCharacter::VaultOnHold()
 {
+	RecordInputAction(EParkourInputAction::JumpRepeat);
+
 	// If not in the air, we have nothing to do
 	if (!GetCharacterMovement()->IsFalling())
 		return;
 
 	// If you can't vault, do nothing
 	FVector VaultPosition;
-	if (!VaultComponent->CanVault(VaultPosition))
+	if (!VaultComponent->CanVaultNow(VaultPosition))
 		return;
 
 	// If you can vault and are holding jump, then vault
@@ -289,10 +377,13 @@ void AParkourShooterCharacter::SetupPlayerInputComponent(class UInputComponent*
 	// set up gameplay key bindings
 	check(PlayerInputComponent);
 
+	// Only a local player has a reticle to preview the grapple on
+	GrappleAimPreview->StartPreview();
+
 	// Bind jump events
 	PlayerInputComponent->BindAction("Jump", IE_Pressed, this, &AParkourShooterCharacter::Jump);
 	PlayerInputComponent->BindAction("Jump", IE_Repeat, this, &AParkourShooterCharacter::VaultOnHold);
-	PlayerInputComponent->BindAction("Jump", IE_Released, this, &ACharacter::StopJumping);
+	PlayerInputComponent->BindAction("Jump", IE_Released, this, &AParkourShooterCharacter::StopJumping);
 
 	// Bind fire event
 	PlayerInputComponent->BindAction("Fire", IE_Pressed, this, &AParkourShooterCharacter::OnFire);
@@ -323,44 +414,30 @@ void AParkourShooterCharacter::SetupPlayerInputComponent(class UInputComponent*
 	PlayerInputComponent->BindAxis("LookUpRate", this, &AParkourShooterCharacter::LookUpAtRate);
 }
 
-void AParkourShooterCharacter::RestoreMovementProperties()
-{
-	GetCharacterMovement()->GravityScale = OriginalProperties.GravityScale;
-	GetCharacterMovement()->AirControl = OriginalProperties.AirControl;
-	GetCharacterMovement()->GroundFriction = OriginalProperties.GroundFriction;
-	GetCharacterMovement()->BrakingDecelerationWalking = OriginalProperties.BrakingDeceleration;
-}
-
 void AParkourShooterCharacter::OnFire()
 {
+	RecordInputAction(EParkourInputAction::Fire);
+
 	// try and fire a projectile
 	if (IsVaulting())
 		return;
 
 	if (ProjectileClass != NULL)
 	{
-		UWorld* const World = GetWorld();
-		if (World != NULL)
+		if (bUsingMotionControllers)
 		{
-			if (bUsingMotionControllers)
-			{
-				const FRotator SpawnRotation = VR_MuzzleLocation->GetComponentRotation();
-				const FVector SpawnLocation = VR_MuzzleLocation->GetComponentLocation();
-				World->SpawnActor<AParkourShooterProjectile>(ProjectileClass, SpawnLocation, SpawnRotation);
-			}
-			else
-			{
-				const FRotator SpawnRotation = GetControlRotation();
-				// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
-				const FVector SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + SpawnRotation.RotateVector(GunOffset);
-
-				//Set Spawn Collision Handling Override
-				FActorSpawnParameters ActorSpawnParams;
-				ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+			const FRotator SpawnRotation = VR_MuzzleLocation->GetComponentRotation();
+			const FVector SpawnLocation = VR_MuzzleLocation->GetComponentLocation();
+			FireProjectile(SpawnLocation, SpawnRotation, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+		}
+		else
+		{
+			const FRotator SpawnRotation = GetControlRotation();
+			// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
+			const FVector SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + SpawnRotation.RotateVector(GunOffset);
 
-				// spawn the projectile at the muzzle
-				World->SpawnActor<AParkourShooterProjectile>(ProjectileClass, SpawnLocation, SpawnRotation, ActorSpawnParams);
-			}
+			// fire the projectile from the muzzle
+			FireProjectile(SpawnLocation, SpawnRotation, ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding);
 		}
 	}
 
@@ -382,8 +459,32 @@ void AParkourShooterCharacter::OnFire()
 	}
 }
 
+void AParkourShooterCharacter::FireProjectile(const FVector& Location, const FRotator& Rotation, ESpawnActorCollisionHandlingMethod CollisionHandling)
+{
+	UWorld* const World = GetWorld();
+	if (World == NULL)
+		return;
+
+	// Bulk projectiles are just data, they fly like our projectile class would
+	if (bUseBulkProjectiles)
+	{
+		UProjectileSimulationSubsystem* Simulation = World->GetSubsystem<UProjectileSimulationSubsystem>();
+		const AParkourShooterProjectile* Defaults = ProjectileClass->GetDefaultObject<AParkourShooterProjectile>();
+		if (Simulation != nullptr && Defaults != nullptr)
+			Simulation->Fire(Location, Rotation.Vector() * Defaults->GetProjectileMovement()->InitialSpeed, this, Defaults->InitialLifeSpan);
+
+		return;
+	}
+
+	UProjectilePoolSubsystem* ProjectilePool = World->GetSubsystem<UProjectilePoolSubsystem>();
+	if (ProjectilePool != nullptr)
+		ProjectilePool->Acquire(ProjectileClass, Location, Rotation, CollisionHandling);
+}
+
 void AParkourShooterCharacter::ShootGrapplingHook()
 {
+	RecordInputAction(EParkourInputAction::GrapplePressed);
+
 	// We have to compute the resulting location where we want to grapple to,
 	// we will raycast in the direction of the camera's POV
 	UCameraComponent* Camera = GetFirstPersonCameraComponent();
@@ -391,7 +492,7 @@ void AParkourShooterCharacter::ShootGrapplingHook()
 	APlayerController* PlayerController = Cast<APlayerController>(GetController());
 	if (PlayerController == nullptr)
 	{
-		UE_LOG(LogTemp, Error, TEXT("Can't get controller for FPS character to use Grapple hook"));
+		UE_LOG(LogParkour, Error, TEXT("Can't get controller for FPS character to use Grapple hook"));
 		return;
 	}
 	// TODO: We have to offset this start position so it matches with your sight
@@ -408,14 +509,40 @@ void AParkourShooterCharacter::ShootGrapplingHook()
 	// GetWorld()->DebugDrawTraceTag = nametag;
 	// ------------------------
 
-	bool HitSomething = GetWorld()->LineTraceSingleByChannel(Hit, StartPosition, CameraForward * MaxHookReachDistance, ECC_Visibility, Params);
+	// Anchors in the aim cone come first, the hash finds them without tracing the whole reach
+	UGrappleAnchorSubsystem* Anchors = GetWorld()->GetSubsystem<UGrappleAnchorSubsystem>();
+	if (Anchors != nullptr && Anchors->HasAnchors())
+	{
+		if (Anchors->FindBestAnchor(StartPosition, CameraForward, MaxHookReachDistance, Params, Hit) != nullptr)
+		{
+			GrapplingHook->FireGrapple(Hit.ImpactPoint, GrapplingHookSpawnPoint->GetRelativeLocation(), &Hit);
+			return;
+		}
+
+		if (bGrappleOnlyToAnchors)
+			return;
+	}
+
+	// The preview traced about this aim already, no need to trace it again
+	bool HitSomething;
+	if (!GrappleAimPreview->GetPreview(StartPosition, CameraForward, Hit, HitSomething))
+	{
+		FVector EndPosition = StartPosition + CameraForward * MaxHookReachDistance;
+		UParkourQueryBudget::TryConsumeIn(GetWorld(), this, EParkourQueryPriority::Critical);
+		PARKOUR_COUNT_QUERY(Grapple);
+		HitSomething = GetWorld()->LineTraceSingleByChannel(Hit, StartPosition, EndPosition, ECC_Parkour, Params);
+	}
+
 	FVector FinalPosition = HitSomething ? Hit.ImpactPoint : Hit.TraceEnd;
 
-	GrapplingHook->FireGrapple(FinalPosition, GrapplingHookSpawnPoint->GetRelativeLocation());
+	// The trace already knows where the hook will land, the hook component can use it to predict the impact
+	GrapplingHook->FireGrapple(FinalPosition, GrapplingHookSpawnPoint->GetRelativeLocation(), HitSomething ? &Hit : nullptr);
 }
 
 void AParkourShooterCharacter::CancelGrapplingHook()
 {
+	RecordInputAction(EParkourInputAction::GrappleReleased);
+
 	GrapplingHook->CancelGrapple();
 }
 
@@ -495,7 +622,6 @@ void AParkourShooterCharacter::MoveForward(float Value)
 		// add movement in that direction
 		AddMovementInput(GetActorForwardVector(), Value);
 	}
-	GrapplingHook->SetVerticalMovement(Value);
 }
 
 void AParkourShooterCharacter::MoveRight(float Value)
@@ -506,7 +632,6 @@ void AParkourShooterCharacter::MoveRight(float Value)
 		// add movement in that direction
 		AddMovementInput(GetActorRightVector(), Value);
 	}
-	GrapplingHook->SetHorizontalMovement(Value);
 }
 
 void AParkourShooterCharacter::TurnAtRate(float Rate)
@@ -538,22 +663,19 @@ bool AParkourShooterCharacter::EnableTouchscreenMovement(class UInputComponent*
 
 void AParkourShooterCharacter::BeginWallrun()
 {
-	GetCharacterMovement()->GravityScale = 0;
-	GetCharacterMovement()->AirControl = 1;
-	GetCharacterMovement()->SetPlaneConstraintNormal(FVector::UpVector);
-	
+	GetParkourMovement()->BeginWallRun(WallrunDirection);
+
 	// Update State
 	bIsWallRunning = true;
 
 	// Start tilting camera
 	BeginCameraTilt();
-
-	// Start update wallrun times
-	GetWorldTimerManager().SetTimer(WallrunTimerHandle, this, &AParkourShooterCharacter::UpdateWallrun, 0.1, true, 0);
 }
 
 void AParkourShooterCharacter::UpdateWallrun()
 {
+	PARKOUR_SCOPE_CYCLE_COUNTER(STAT_ParkourUpdateWallrun);
+
 	// Constantly get current side and direction
 
 	if (!AreRequiredKeysDown(CurrentSide) || !IsFastEnoughToWallrun())
@@ -576,16 +698,12 @@ void AParkourShooterCharacter::UpdateWallrun()
 		break;
 	}
 
+	// The sensor probes this side with the rest of its probes from now on, every step reads the same result
+	SensorComponent->SetWallProbeDirection(Direction);
+	SensorComponent->SetProbeEnabled(EParkourProbe::Wall, true);
+
 	FHitResult Hit;
-	FCollisionQueryParams Params = FCollisionQueryParams::DefaultQueryParam;
-	Params.AddIgnoredActor(this);
-	bool HitSomething = GetWorld()->LineTraceSingleByChannel(
-		Hit, 
-		GetActorLocation(), 
-		GetActorLocation() + 200 * Direction, 
-		ECollisionChannel::ECC_Visibility,
-		Params
-	);
+	bool HitSomething = SensorComponent->GetWallContact(Direction, Hit);
 
 
 	if (!HitSomething || !CanRunInWall(Hit.ImpactNormal))
@@ -607,15 +725,17 @@ void AParkourShooterCharacter::UpdateWallrun()
 	}
 
 	WallrunDirection = NewDirection;
-	FVector NewVelocity = WallrunDirection * GetCharacterMovement()->GetMaxSpeed();
-	NewVelocity.Z = 0;
-	GetCharacterMovement()->Velocity = NewVelocity;
+	GetParkourMovement()->SetWallRunDirection(WallrunDirection);
 }
 
-void AParkourShooterCharacter::EndWallrun(WallrunEndReason Reason)
+void AParkourShooterCharacter::OnParkourStep(EParkourMovementMode Mode, float StepTime)
 {
-	GetWorldTimerManager().ClearTimer(WallrunTimerHandle);
+	if (Mode == EParkourMovementMode::WallRun && bIsWallRunning)
+		UpdateWallrun();
+}
 
+void AParkourShooterCharacter::EndWallrun(WallrunEndReason Reason)
+{
 	// Reset jumps accordinly to the reason you fell off the wall
 	switch (Reason)
 	{
@@ -629,9 +749,9 @@ void AParkourShooterCharacter::EndWallrun(WallrunEndReason Reason)
 		break;
 	}
 
-	// Roll back changes we did starting the wallrun
-	RestoreMovementProperties();
-	GetCharacterMovement()->SetPlaneConstraintNormal(FVector::ZeroVector);
+	// Let the movement component drop us from the wall
+	GetParkourMovement()->EndWallRun();
+	SensorComponent->SetProbeEnabled(EParkourProbe::Wall, false);
 	bIsWallRunning = false;
 	EndCameraTilt();
 }
@@ -726,19 +846,11 @@ bool AParkourShooterCharacter::ConsumeJump()
 
 bool AParkourShooterCharacter::CanRunInWall(FVector SurfaceNormal) const
 {
-
-	// Check if this is the ceilling
-	if (SurfaceNormal.Z < -0.05)
+	// Neither floor we could walk on nor ceilling, the walkable floor Z is the cosine of the walkable angle
+	if (ParkourShooterUtils::ClassifySurface(SurfaceNormal, GetCharacterMovement()->GetWalkableFloorZ()) != EParkourSurfaceClass::Wallrunnable)
 		return false;
 
-	// Now we have to check surface angle. We can do it by taking the dot product between the normal 
-	// vector and its own XY projection
-	FVector Projection = FVector(SurfaceNormal.X, SurfaceNormal.Y, 0);
-	Projection.Normalize();
-	float FloorAngle = FMath::RadiansToDegrees(FMath::Acos(FVector::DotProduct(SurfaceNormal, Projection)));
-	FloorAngle = 180 - FloorAngle - 90;
-	
-	return  !(GetCharacterMovement()->GetWalkableFloorAngle() >= FloorAngle || !IsFacingAwayEnoughFromWall(SurfaceNormal));
+	return IsFacingAwayEnoughFromWall(SurfaceNormal);
 }
 
 bool AParkourShooterCharacter::IsFacingAwayEnoughFromWall(const FVector& SurfaceNormal) const
@@ -776,12 +888,14 @@ void AParkourShooterCharacter::OnWallHit(UPrimitiveComponent* HitComponent, AAct
 
 void AParkourShooterCharacter::Jump()
 {
+	RecordInputAction(EParkourInputAction::JumpPressed);
+
 	// If you're sliding, do nothing
 	if (CurrentMovementState == MovementState::Sliding || !CanStand())
 		return;
 
 	FVector VaultPosition;
-	if (!VaultComponent->CanVault(VaultPosition))
+	if (!VaultComponent->CanVaultNow(VaultPosition))
 	{
 		Super::Jump();
 
@@ -802,6 +916,27 @@ void AParkourShooterCharacter::Jump()
 	VaultComponent->BeginVault(VaultPosition);
 }
 
+void AParkourShooterCharacter::StopJumping()
+{
+	RecordInputAction(EParkourInputAction::JumpReleased);
+
+	Super::StopJumping();
+}
+
+void AParkourShooterCharacter::OnMovementModeChanged(EMovementMode PrevMovementMode, uint8 PreviousCustomMode)
+{
+	Super::OnMovementModeChanged(PrevMovementMode, PreviousCustomMode);
+
+	// If something else took us out of the wallrun (landing, a vault, the grapple), end it on our side too
+	bool bWasWallRunning = PrevMovementMode == MOVE_Custom && PreviousCustomMode == static_cast<uint8>(EParkourMovementMode::WallRun);
+	if (bWasWallRunning && IsOnWall() && !GetParkourMovement()->IsCustomMode(EParkourMovementMode::WallRun))
+		EndWallrun(WallrunEndReason::Fall);
+
+	// Vaults end with a mode change, and ledges only need probing while in the air
+	if (VaultComponent != nullptr)
+		VaultComponent->OnOwnerMovementModeChanged();
+}
+
 void AParkourShooterCharacter::Landed(const FHitResult& Hit)
 {
 	Super::Landed(Hit);
@@ -884,20 +1019,31 @@ void AParkourShooterCharacter::ClampHorizontalVelocity()
 
 void AParkourShooterCharacter::Tick(float DeltaSeconds)
 {
+	PARKOUR_SCOPE_CYCLE_COUNTER(STAT_ParkourCharacterTick);
 	Super::Tick(DeltaSeconds);
 
 	ClampHorizontalVelocity();
-	// Check if should end crouching 
-	if (CanStand() && !GetCrouchKeyDown())
-		switch (CurrentMovementState)
-		{
-		case Sliding:
-		case Crouching:
+
+	if (CurrentMovementState == MovementState::Sliding)
+		TickSlide();
+
+	UpdateStandUp();
+	TickCrouch(DeltaSeconds);
+}
+
+void AParkourShooterCharacter::UpdateStandUp()
+{
+	// Check if should end crouching. Only ask for headroom when we're actually down
+	switch (CurrentMovementState)
+	{
+	case Sliding:
+	case Crouching:
+		if (!GetCrouchKeyDown() && CanStand())
 			SetMovementState(MovementState::Sprinting);
-			break;
-		default:
-			break;
-		}
+		break;
+	default:
+		break;
+	}
 }
 
 bool AParkourShooterCharacter::IsFastEnoughToWallrun() const
@@ -908,19 +1054,101 @@ bool AParkourShooterCharacter::IsFastEnoughToWallrun() const
 
 void AParkourShooterCharacter::UpdateCrouch(float Progress)
 {
+	// Old Blueprint timelines still call this. Applying it would fight the native playback over the capsule
+}
+
+void AParkourShooterCharacter::SetCrouchPose(float Progress)
+{
+	CrouchProgress = Progress;
+
 	// map from [0,1] to [crouch half height, standing half height]
-	float NewHeight = Progress * (StandingHalfHeight - CrouchHalfHeight) + CrouchHalfHeight;
-	// Reduce size of capsule
-	GetCapsuleComponent()->SetCapsuleHalfHeight(NewHeight);
+	float VisualHalfHeight = Progress * (StandingHalfHeight - CrouchHalfHeight) + CrouchHalfHeight;
+
+	// The capsule lags behind the pose at its steps, so it's never taller than what we show
+	float CapsuleProgress = CrouchCapsuleSteps > 0 ? FMath::FloorToFloat(Progress * CrouchCapsuleSteps) / CrouchCapsuleSteps : Progress;
+	float CapsuleHalfHeight = CapsuleProgress * (StandingHalfHeight - CrouchHalfHeight) + CrouchHalfHeight;
 
+	UCapsuleComponent* Capsule = GetCapsuleComponent();
+	float CurrentHalfHeight = Capsule->GetUnscaledCapsuleHalfHeight();
+	bCapsuleResizePending = false;
+	if (CapsuleHalfHeight != CurrentHalfHeight)
+	{
+		// Growing needs room over our heads. If something got there since we started standing, keep the playback
+		// going until it leaves, even once the pose is done
+		if (CapsuleHalfHeight < CurrentHalfHeight || SensorComponent->CanStand())
+			ResizeCapsule(CapsuleHalfHeight);
+		else
+			bCapsuleResizePending = true;
+	}
+
+	// Move the camera every frame, making up for the difference between the capsule and the pose
 	float NewCameraZOffset = Progress * (StandingCameraZOffset - CrouchCameraZOffset) + CrouchCameraZOffset;
+	NewCameraZOffset += VisualHalfHeight - Capsule->GetUnscaledCapsuleHalfHeight();
 
-	// reduce camera position
 	FVector NewLocation = FirstPersonCameraComponent->GetRelativeLocation();
-	NewLocation.Z = NewCameraZOffset;
+	NewLocation.Z = NewCameraZOffset + GetParkourMovement()->GetStepCameraOffset().Z;
 	FirstPersonCameraComponent->SetRelativeLocation(NewLocation);
 }
 
+void AParkourShooterCharacter::ResizeCapsule(float NewHalfHeight)
+{
+	UCapsuleComponent* Capsule = GetCapsuleComponent();
+	float Offset = (NewHalfHeight - Capsule->GetUnscaledCapsuleHalfHeight()) * Capsule->GetShapeScale();
+
+	// Resize and move in one scope, overlaps are only updated once when it ends
+	{
+		FScopedMovementUpdate ScopedUpdate(Capsule, EScopedUpdate::DeferredUpdates);
+		Capsule->SetCapsuleHalfHeight(NewHalfHeight);
+
+		// Keep our feet on the floor instead of floating and falling back down, or popping up into it
+		if (GetCharacterMovement()->IsMovingOnGround())
+			Capsule->AddWorldOffset(FVector(0, 0, Offset));
+	}
+
+	NumCapsuleResizes++;
+	INC_DWORD_STAT(STAT_ParkourCapsuleResizes);
+}
+
+void AParkourShooterCharacter::PlayCrouch(bool bCrouched)
+{
+	bWantsCrouchedPose = bCrouched;
+}
+
+void AParkourShooterCharacter::TickCrouch(float DeltaSeconds)
+{
+	if (!IsCrouchPlaying())
+		return;
+
+	// Time runs forward to crouch and backwards to stand, so turning around halfway continues from the current pose
+	float Length = GetCrouchLength();
+	CrouchTime = FMath::Clamp(CrouchTime + (bWantsCrouchedPose ? DeltaSeconds : -DeltaSeconds), 0.f, Length);
+
+	float Progress;
+	if (CrouchTime >= Length)
+		Progress = 0;
+	else if (CrouchTime <= 0)
+		Progress = 1;
+	else if (CrouchCurve != nullptr)
+		Progress = FMath::Clamp(CrouchCurve->GetFloatValue(CrouchTime), 0.f, 1.f);
+	else
+		Progress = 1 - CrouchTime / Length;
+
+	SetCrouchPose(Progress);
+}
+
+float AParkourShooterCharacter::GetCrouchLength() const
+{
+	if (CrouchCurve != nullptr)
+	{
+		float MinTime, MaxTime;
+		CrouchCurve->GetTimeRange(MinTime, MaxTime);
+		if (MaxTime > 0)
+			return MaxTime;
+	}
+
+	return FMath::Max(CrouchDuration, KINDA_SMALL_NUMBER);
+}
+
 MovementState AParkourShooterCharacter::ResolveMovementState() const
 {
 	// If you can't stand, you can't do anything but crouch
@@ -947,6 +1175,7 @@ void AParkourShooterCharacter::SetMovementState(MovementState NewState)
 
 void AParkourShooterCharacter::OnMovementStateChanged(MovementState OldState, MovementState NewState)
 {
+	TRACE_BOOKMARK(TEXT("%s: %s -> %s"), *GetName(), *UEnum::GetValueAsString(OldState), *UEnum::GetValueAsString(NewState));
 
 	float NewMaxSpeed;
 	switch (NewState)
@@ -969,6 +1198,9 @@ void AParkourShooterCharacter::OnMovementStateChanged(MovementState OldState, Mo
 
 	GetCharacterMovement()->MaxWalkSpeed = NewMaxSpeed;
 
+	// Headroom only matters every frame while we're down, standing up asks for it on demand
+	SensorComponent->SetProbeEnabled(EParkourProbe::Headroom, NewState == MovementState::Crouching || NewState == MovementState::Sliding);
+
 	// Now we have to restore different things depending on previous state
 	switch (NewState)
 	{
@@ -1000,24 +1232,9 @@ void AParkourShooterCharacter::OnMovementStateChanged(MovementState OldState, Mo
 	default:
 		break;
 	}
-}
-
-FVector AParkourShooterCharacter::ComputeFloorInfluence(FVector FloorNormal) const
-{
-	// There's no influence if we're in a flat surface
-	if (FloorNormal == FVector::UpVector) return FVector::ZeroVector;
-	
-	// The first cross product will give us a vector pointing forward or backwards depending on floor normal, 
-	// The second one will give us a vector inside the floor plane pointing downwards
-	FVector SurfaceDownwardsDirection = FVector::CrossProduct(FloorNormal, FVector::CrossProduct(FloorNormal, FVector::UpVector));
-	SurfaceDownwardsDirection.Normalize();
-
-	// Now we will scale this direction to how steep this floor is
-	float Projection = FMath::Clamp(1.f -  FVector::DotProduct(FloorNormal, FVector::UpVector), 0.f, 1.f);
-	FVector ResultingInfluence = Projection * FloorInfluenceForce * SurfaceDownwardsDirection;
-	UE_LOG(LogTemp, Warning, TEXT("Floor influence is: (%f, %f, %f)"),ResultingInfluence.X, ResultingInfluence.Y, ResultingInfluence.Z);
 
-	return ResultingInfluence;
+	// Capsule and camera follow the state, the events above are only cosmetic
+	PlayCrouch(NewState == MovementState::Crouching || NewState == MovementState::Sliding);
 }
 
 bool AParkourShooterCharacter::CanSprint() const
@@ -1027,18 +1244,93 @@ bool AParkourShooterCharacter::CanSprint() const
 
 bool AParkourShooterCharacter::CanStand() const
 {
+	PARKOUR_SCOPE_CYCLE_COUNTER(STAT_ParkourCanStand);
+
 	if (GetCrouchKeyDown()) return false;
 
-	// We have to check if there's something over our heads stoping us from standing.
-	// Note that since we want to know if it's something where our head will be when we stand, we will 
-	// cast a ray from our feet to our next head location, and this location depends on our old half height, not 
-	// our current half height
-	FVector StartLocation = GetActorLocation() - FVector(0,0, GetCapsuleComponent()->GetScaledCapsuleHalfHeight());
-	FVector EndLocation = StartLocation + FVector(0,0, 2 * StandingHalfHeight);
-	FHitResult Hit;
-	FCollisionQueryParams Params = FCollisionQueryParams::DefaultQueryParam;
-	Params.AddIgnoredActor(this);
-	bool HitSomething = GetWorld()->LineTraceSingleByChannel(Hit, StartLocation, EndLocation, ECollisionChannel::ECC_Visibility, Params);
+	// The sensor checks if there's something over our heads stoping us from standing. It only
+	// traces once per frame no matter how many times we ask
+	return SensorComponent->CanStand();
+}
+
+void AParkourShooterCharacter::RunCrouchBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	APlayerController* PlayerController = World != nullptr ? World->GetFirstPlayerController() : nullptr;
+	AParkourShooterCharacter* Character = PlayerController != nullptr ? Cast<AParkourShooterCharacter>(PlayerController->GetPawn()) : nullptr;
+	if (Character == nullptr)
+	{
+		UE_LOG(LogParkour, Error, TEXT("Parkour.CrouchBench needs a game world with a parkour player"));
+		return;
+	}
+
+	if (Character->CurrentMovementState == MovementState::Crouching || Character->CurrentMovementState == MovementState::Sliding || Character->IsCrouchPlaying())
+	{
+		UE_LOG(LogParkour, Error, TEXT("Parkour.CrouchBench needs the player standing"));
+		return;
+	}
+
+	int32 Slides = 100;
+	float FrameRate = 60;
+
+	for (const FString& Arg : Args)
+	{
+		FParse::Value(*Arg, TEXT("Slides="), Slides);
+		FParse::Value(*Arg, TEXT("FrameRate="), FrameRate);
+	}
+
+	Slides = FMath::Max(Slides, 1);
+	float DeltaSeconds = 1.f / FMath::Max(FrameRate, 1.f);
+	int32 SavedSteps = Character->CrouchCapsuleSteps;
+
+	// A slide crouches all the way down and stands all the way back up, one fixed frame at a time
+	auto Run = [&](const FString& Name, int32 Steps)
+	{
+		Character->CrouchCapsuleSteps = Steps;
+		uint32 StartResizes = Character->NumCapsuleResizes;
+		TArray<float> FrameMicros;
+
+		// Something over our heads keeps the capsule from growing, and the playback waiting for it
+		int32 MaxTransitionFrames = FMath::CeilToInt(Character->GetCrouchLength() / DeltaSeconds) + 1;
+		bool bBlocked = false;
+
+		for (int32 i = 0; i < Slides && !bBlocked; i++)
+		{
+			for (bool bCrouched : { true, false })
+			{
+				Character->PlayCrouch(bCrouched);
+				for (int32 Frame = 0; Character->IsCrouchPlaying(); Frame++)
+				{
+					if (Frame >= MaxTransitionFrames)
+					{
+						bBlocked = true;
+						break;
+					}
+
+					uint64 StartCycles = FPlatformTime::Cycles64();
+					Character->TickCrouch(DeltaSeconds);
+					FrameMicros.Add(FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles) * 1000);
+				}
+			}
+		}
+
+		if (bBlocked)
+		{
+			UE_LOG(LogParkour, Error, TEXT("  %s: no room to stand up, run it somewhere with headroom"), *Name);
+			return false;
+		}
+
+		// Without steps every frame of the transition resizes, with them each resize is a step
+		uint32 Resizes = Character->NumCapsuleResizes - StartResizes;
+		const FParkourSampleStats Stats = FParkourSampleStats::Compute(FrameMicros);
+		UE_LOG(LogParkour, Display, TEXT("  %s: %.1f %s per slide, %.3f us per frame, %d frames, p95 %.3f us"), *Name,
+			(float)Resizes / Slides, Steps > 0 ? TEXT("stepped resizes") : TEXT("per frame resizes"), Stats.Mean, Stats.Num, Stats.P95);
+		return true;
+	};
+
+	UE_LOG(LogParkour, Display, TEXT("Parkour.CrouchBench: %d slides at %.0f fps"), Slides, 1.f / DeltaSeconds);
+	int32 Steps = SavedSteps > 0 ? SavedSteps : 2;
+	if (Run(TEXT("Every frame"), 0))
+		Run(FString::Printf(TEXT("%d steps"), Steps), Steps);
 
-	return !HitSomething;
+	Character->CrouchCapsuleSteps = SavedSteps;
 }
@@ -11,6 +11,14 @@
 class UInputComponent;
 class UVaultComponent;
 class UGraplingHookComponent;
+class UGrappleAimPreviewComponent;
+class UParkourSensorComponent;
+class UParkourMovementComponent;
+class UParkourInputRecorderComponent;
+enum class EParkourMovementMode : uint8;
+enum class EParkourInputAction : uint8;
+enum class EParkourLOD : uint8;
+struct FParkourLODSettings;
 
 UENUM()
 enum  MovementState
@@ -26,6 +34,12 @@ class AParkourShooterCharacter : public ACharacter
 {
 	GENERATED_BODY()
 
+	// The recorder replays input straight into our handlers
+	friend class UParkourInputRecorderComponent;
+
+	// The tick manager runs our per frame update when batching
+	friend class UParkourTickManager;
+
 	/** Pawn mesh: 1st person view (arms; seen only by self) */
 	UPROPERTY(VisibleDefaultsOnly, Category=Mesh)
 	class USkeletalMeshComponent* Mesh1P;
@@ -59,24 +73,48 @@ class AParkourShooterCharacter : public ACharacter
 	class UMotionControllerComponent* L_MotionController;
 
 public:
-	AParkourShooterCharacter();
+	AParkourShooterCharacter(const FObjectInitializer& ObjectInitializer);
+
+	/** Returns the character movement as our parkour movement component */
+	UParkourMovementComponent* GetParkourMovement() const;
+
+	/// <summary>
+	/// Set how often we probe and update our parkour movement, depending on how much we matter to the players
+	/// </summary>
+	void SetParkourLOD(EParkourLOD NewLOD, const FParkourLODSettings& Settings);
+
+	EParkourLOD GetParkourLOD() const { return ParkourLOD; }
+
+	/// <summary>
+	/// Console command: crouch and stand the player back up a number of times, resizing the capsule every frame
+	/// and in steps, and print how many resizes each slide costs
+	/// </summary>
+	static void RunCrouchBenchmark(const TArray<FString>& Args, UWorld* World);
 
 protected:
 
 	virtual void BeginPlay();
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	UPROPERTY(EditDefaultsOnly, Category = "Movement", meta = (ClampMin = "0.0", ClampMax = "1.0"))
 	float AirControl;
 
-	struct MovementProperties
-	{
-		float GravityScale;
-		float AirControl;
-		float GroundFriction;
-		float BrakingDeceleration;
-	};
+	/** Runs the headroom, ledge and wall probes shared by every ability, once per frame */
+	UPROPERTY(VisibleAnywhere, Category = "Movement")
+	UParkourSensorComponent* SensorComponent;
 
-	MovementProperties OriginalProperties;
+	// Set by the significance subsystem
+	EParkourLOD ParkourLOD;
+
+	/** Records and replays the input that reaches our handlers, see Parkour.RecordInput and Parkour.ReplayInput */
+	UPROPERTY(VisibleAnywhere, Category = "Debug")
+	UParkourInputRecorderComponent* InputRecorder;
+
+	/// <summary>
+	/// Let the input recorder know an action binding fired this frame
+	/// </summary>
+	void RecordInputAction(EParkourInputAction Action);
 
 	// -- < Sliding > --------------------------------------------------------------------
 
@@ -114,6 +152,29 @@ protected:
 	UPROPERTY(EditDefaultsOnly, Category = "Slide")
 	float CrouchCameraZOffset = 25;
 
+	/** How standing we are over time when crouching, from 1 standing to 0 crouched. Played backwards to stand up. Linear if not set */
+	UPROPERTY(EditDefaultsOnly, Category = "Slide")
+	UCurveFloat* CrouchCurve;
+
+	/** How long it takes to crouch or stand up when there's no crouch curve */
+	UPROPERTY(EditDefaultsOnly, Category = "Slide")
+	float CrouchDuration = 0.2f;
+
+	/** The camera moves every frame, but the capsule only takes this many sizes between crouched and standing. 0 resizes it every frame */
+	UPROPERTY(EditDefaultsOnly, Category = "Slide", meta = (ClampMin = "0"))
+	int32 CrouchCapsuleSteps = 2;
+
+	// Crouch pose playback, time along the crouch curve and where we're going
+	float CrouchTime = 0;
+	float CrouchProgress = 1;
+	bool bWantsCrouchedPose = false;
+
+	// Capsule resizes since we spawned, each one is an overlap update
+	uint32 NumCapsuleResizes = 0;
+
+	// The capsule didn't reach the height of the pose yet, because there was no room to grow. Retried every tick
+	bool bCapsuleResizePending = false;
+
 	UPROPERTY(EditAnywhere, Category = "Slide")
 	float FloorInfluenceForce = 500000;
 
@@ -136,7 +197,13 @@ protected:
 
 	void BeginSlide();
 
-	UFUNCTION(BlueprintCallable, Category = "Slide")
+	/// <summary>
+	/// Leave the slide once we're too slow for it. Runs every frame while sliding
+	/// </summary>
+	void TickSlide();
+
+	/** Kept so the character Blueprint still compiles until its slide timeline is removed. The slide runs natively, this does nothing */
+	UFUNCTION(BlueprintCallable, Category = "Slide", meta = (DeprecatedFunction, DeprecationMessage = "The slide updates natively in the character tick, remove the UpdateSlideLoop timeline"))
 	void UpdateSlide();
 
 	UFUNCTION(BlueprintImplementableEvent, Category = "Slide")
@@ -147,9 +214,38 @@ protected:
 	UFUNCTION(BlueprintImplementableEvent)
 	void BeginCrouch();
 
-	UFUNCTION(BlueprintCallable)
+	/// <summary>
+	/// Set camera height, from 0 crouched to 1 standing, and the capsule height once we reach one of its steps
+	/// </summary>
+	void SetCrouchPose(float Progress);
+
+	/** Kept so the character Blueprint still compiles until its crouch timeline is removed. The pose plays natively, this does nothing */
+	UFUNCTION(BlueprintCallable, meta = (DeprecatedFunction, DeprecationMessage = "The crouch pose plays natively from CrouchCurve, remove the crouch timeline"))
 	void UpdateCrouch(float Progress);
 
+	/// <summary>
+	/// Resize the capsule keeping our feet where they are, with a single overlap update
+	/// </summary>
+	void ResizeCapsule(float NewHalfHeight);
+
+	/// <summary>
+	/// Start moving the crouch pose towards crouched or standing, from wherever it is now
+	/// </summary>
+	void PlayCrouch(bool bCrouched);
+
+	/// <summary>
+	/// Advance the crouch pose playback. Does nothing once the pose got where it was going
+	/// </summary>
+	void TickCrouch(float DeltaSeconds);
+
+	/** The pose is still moving, or it got there but the capsule is still waiting for room to catch up */
+	bool IsCrouchPlaying() const { return bCapsuleResizePending || CrouchProgress != (bWantsCrouchedPose ? 0.f : 1.f); }
+
+	/// <summary>
+	/// Length of the crouch playback, the crouch curve length or CrouchDuration
+	/// </summary>
+	float GetCrouchLength() const;
+
 	UFUNCTION(BlueprintImplementableEvent)
 	void EndCrouch();
 
@@ -157,8 +253,11 @@ protected:
 	void SetMovementState(MovementState NewState);
 	void OnMovementStateChanged(MovementState OldState, MovementState NewState);
 
-	// Compute floor direction downwards
-	FVector ComputeFloorInfluence(FVector FloorNormal) const;
+	/// <summary>
+	/// Stand back up once we let go of crouch and there's room for it. Only does something while crouching or sliding
+	/// </summary>
+	void UpdateStandUp();
+
 	bool CanSprint() const;
 	bool CanStand() const;
 	bool GetSprintKeyDown() const { return true; }
@@ -206,9 +305,13 @@ protected:
 
 	void BeginWallrun();
 
-	UFUNCTION()
 	void UpdateWallrun();
 
+	/// <summary>
+	/// Called by the movement component after every fixed step of a parkour mode
+	/// </summary>
+	void OnParkourStep(EParkourMovementMode Mode, float StepTime);
+
 	void EndWallrun(WallrunEndReason Reason);
 
 	void BeginCameraTilt();
@@ -240,6 +343,10 @@ protected:
 
 	virtual void Jump() override;
 
+	virtual void StopJumping() override;
+
+	virtual void OnMovementModeChanged(EMovementMode PrevMovementMode, uint8 PreviousCustomMode = 0) override;
+
 	virtual void Landed(const FHitResult& Hit) override;
 
 	FVector FindLaunchVelocity() const;
@@ -265,9 +372,6 @@ protected:
 	UPROPERTY(EditDefaultsOnly, Category = "Wallrun")
 	float ToleranceDegreesToStartWallrun = 45;
 
-	// Timer to manage wallrun update
-	FTimerHandle WallrunTimerHandle;
-
 	// Data to manage timeline for tilting camera
 	UPROPERTY(EditDefaultsOnly, Category = "Wallrun")
 	UCurveFloat* CameraTiltCurve;
@@ -299,15 +403,27 @@ protected:
 	UPROPERTY(EditDefaultsOnly, Category = "Grappling Hook")
 	UGraplingHookComponent* GrapplingHook;
 
+	/** Traces where the hook would land while we aim, for the reticle, and hands the result to the shot */
+	UPROPERTY(EditDefaultsOnly, Category = "Grappling Hook")
+	UGrappleAimPreviewComponent* GrappleAimPreview;
+
 	UPROPERTY(EditAnywhere, Category = "Grappling Hook")
 	float MaxHookReachDistance = 100000.f;
 
+	/** In maps with grapple anchors, only grapple to anchors. Otherwise we shoot wherever we aim if no anchor is in the aim cone */
+	UPROPERTY(EditAnywhere, Category = "Grappling Hook")
+	bool bGrappleOnlyToAnchors = false;
+
 	/** 
 	Where, relative to the player, to spawn the grappling hook
 	*/
 	UPROPERTY(EditDefaultsOnly, Category = "Grappling Hook")
 	USceneComponent* GrapplingHookSpawnPoint;
 
+public:
+
+	float GetMaxHookReachDistance() const { return MaxHookReachDistance; }
+
 	// -- < END GRAPPLING HOOK  > ----------------------------------------------------------------
 
 
@@ -328,6 +444,10 @@ public:
 	UPROPERTY(EditDefaultsOnly, Category=Projectile)
 	TSubclassOf<class AParkourShooterProjectile> ProjectileClass;
 
+	/** Fire bullets into the bulk projectile simulation instead of using projectile actors. Meant for high fire rates */
+	UPROPERTY(EditAnywhere, Category=Projectile)
+	bool bUseBulkProjectiles = false;
+
 	/** Sound to play each time we fire */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Gameplay)
 	class USoundBase* FireSound;
@@ -340,17 +460,14 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Gameplay)
 	uint32 bUsingMotionControllers : 1;
 
-	/// <summary>
-	/// This method is used to restore properties like friction and gravity that are changed by actions like grappling hook
-	/// or wallrunning.
-	/// </summary>
-	void RestoreMovementProperties();
-
 protected:
 	
 	/** Fires a projectile. */
 	void OnFire();
 
+	/** Fire a single projectile, either a pooled actor or a bulk one */
+	void FireProjectile(const FVector& Location, const FRotator& Rotation, ESpawnActorCollisionHandlingMethod CollisionHandling);
+
 	/** Resets HMD orientation and position in VR. */
 	void OnResetVR();
 
@@ -3,6 +3,8 @@
 #include "ParkourShooterProjectile.h"
 #include "GameFramework/ProjectileMovementComponent.h"
 #include "Components/SphereComponent.h"
+#include "ProjectilePoolSubsystem.h"
+#include "Engine/World.h"
 
 AParkourShooterProjectile::AParkourShooterProjectile() 
 {
@@ -38,6 +40,70 @@ void AParkourShooterProjectile::OnHit(UPrimitiveComponent* HitComp, AActor* Othe
 	{
 		OtherComp->AddImpulseAtLocation(GetVelocity() * 100.0f, GetActorLocation());
 
-		Destroy();
+		Expire();
 	}
+}
+
+void AParkourShooterProjectile::LifeSpanExpired()
+{
+	if (bPooled)
+		Expire();
+	else
+		Super::LifeSpanExpired();
+}
+
+void AParkourShooterProjectile::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Whatever destroyed us, the pool must stop handing us out and counting us as in use
+	UWorld* World = GetWorld();
+	UProjectilePoolSubsystem* Pool = bPooled && World != nullptr ? World->GetSubsystem<UProjectilePoolSubsystem>() : nullptr;
+	if (Pool != nullptr)
+		Pool->Remove(this);
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AParkourShooterProjectile::ActivateProjectile(const FVector& Location, const FRotator& Rotation)
+{
+	bInFlight = true;
+
+	SetActorLocationAndRotation(Location, Rotation, false, nullptr, ETeleportType::ResetPhysics);
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+
+	// Reset the movement to what a freshly spawned projectile would have
+	ProjectileMovement->SetUpdatedComponent(CollisionComp);
+	ProjectileMovement->bIsSliding = false;
+	ProjectileMovement->PreviousHitTime = 1.f;
+	ProjectileMovement->PreviousHitNormal = FVector::UpVector;
+	ProjectileMovement->Velocity = Rotation.Vector() * ProjectileMovement->InitialSpeed;
+	ProjectileMovement->UpdateComponentVelocity();
+	ProjectileMovement->Activate(true);
+
+	// SetLifeSpan overwrites InitialLifeSpan, so read it from our defaults
+	SetLifeSpan(GetClass()->GetDefaultObject<AParkourShooterProjectile>()->InitialLifeSpan);
+}
+
+void AParkourShooterProjectile::DeactivateProjectile()
+{
+	bInFlight = false;
+	SetLifeSpan(0);
+
+	// Without an updated component the movement stops right away, even in the middle of its hit handling
+	ProjectileMovement->StopMovementImmediately();
+	ProjectileMovement->SetUpdatedComponent(nullptr);
+	ProjectileMovement->Deactivate();
+
+	SetActorEnableCollision(false);
+	SetActorHiddenInGame(true);
+}
+
+void AParkourShooterProjectile::Expire()
+{
+	UProjectilePoolSubsystem* Pool = bPooled ? GetWorld()->GetSubsystem<UProjectilePoolSubsystem>() : nullptr;
+
+	if (Pool != nullptr)
+		Pool->Release(this);
+	else
+		Destroy();
 }
\ No newline at end of file
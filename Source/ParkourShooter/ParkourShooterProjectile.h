@@ -11,6 +11,8 @@ class AParkourShooterProjectile : public AActor
 {
 	GENERATED_BODY()
 
+	friend class UProjectilePoolSubsystem;
+
 	/** Sphere collision component */
 	UPROPERTY(VisibleDefaultsOnly, Category=Projectile)
 	class USphereComponent* CollisionComp;
@@ -26,9 +28,32 @@ public:
 	UFUNCTION()
 	void OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
 
+	virtual void LifeSpanExpired() override;
+
+	/** Pooled projectiles can still be destroyed by the engine, like when falling out of the world */
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Place the projectile and fire it again, used by the projectile pool */
+	void ActivateProjectile(const FVector& Location, const FRotator& Rotation);
+
+	/** Stop, hide and disable the projectile until it's fired again */
+	void DeactivateProjectile();
+
+	/** If the projectile was fired and didn't return to its pool yet */
+	bool IsInFlight() const { return bInFlight; }
+
 	/** Returns CollisionComp subobject **/
 	FORCEINLINE class USphereComponent* GetCollisionComp() const { return CollisionComp; }
 	/** Returns ProjectileMovement subobject **/
 	FORCEINLINE class UProjectileMovementComponent* GetProjectileMovement() const { return ProjectileMovement; }
+
+private:
+	/** Go back to the pool we came from, or destroy ourselves if we don't have one */
+	void Expire();
+
+	// If we belong to a projectile pool
+	bool bPooled = false;
+
+	bool bInFlight = true;
 };
 
@@ -2,6 +2,47 @@
 
 
 #include "ParkourShooterUtils.h"
+#include "ParkourShooter.h"
+#include "ParkourStats.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Math/RandomStream.h"
+
+static FAutoConsoleCommandWithArgs SurfaceBenchCommand(
+	TEXT("Parkour.SurfaceBench"),
+	TEXT("Classify random normals with the SIMD batch and with the scalar trig path. Usage: Parkour.SurfaceBench [Count=200000] [Runs=20]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&ParkourShooterUtils::RunSurfaceBenchmark)
+);
+
+namespace ParkourShooterUtilsPrivate
+{
+	/** Byte i is 1 if bit i of the index is set, to turn a 4 lane compare mask into 4 packed classes */
+	static const uint32 MaskToBytes[16] =
+	{
+		0x00000000, 0x00000001, 0x00000100, 0x00000101,
+		0x00010000, 0x00010001, 0x00010100, 0x00010101,
+		0x01000000, 0x01000001, 0x01000100, 0x01000101,
+		0x01010000, 0x01010001, 0x01010100, 0x01010101
+	};
+
+	static_assert(sizeof(EParkourSurfaceClass) == 1, "Classes are packed 4 per uint32");
+	static_assert(static_cast<uint8>(EParkourSurfaceClass::Walkable) == 0 && static_cast<uint8>(EParkourSurfaceClass::Wallrunnable) == 1 && static_cast<uint8>(EParkourSurfaceClass::Ceiling) == 2,
+		"Classes are computed as Wallrunnable - Walkable + Ceiling");
+
+	/** How we classified surfaces before, with an Acos per normal, kept to compare against */
+	static EParkourSurfaceClass ClassifyWithTrig(const FVector& Normal, float MaxWalkableAngle)
+	{
+		if (Normal.Z < -0.05)
+			return EParkourSurfaceClass::Ceiling;
+
+		FVector Projection(Normal.X, Normal.Y, 0);
+		Projection.Normalize();
+		float FloorAngle = FMath::RadiansToDegrees(FMath::Acos(FVector::DotProduct(Normal, Projection)));
+		FloorAngle = 180 - FloorAngle - 90;
+
+		return MaxWalkableAngle >= FloorAngle ? EParkourSurfaceClass::Walkable : EParkourSurfaceClass::Wallrunnable;
+	}
+}
 
 ParkourShooterUtils::ParkourShooterUtils()
 {
@@ -9,18 +50,9 @@ ParkourShooterUtils::ParkourShooterUtils()
 
 bool ParkourShooterUtils::FloorIsWalkable(const FVector FloorNormal, float MaxWalkableAngle)
 {
-	// Check if this is the ceilling
-	if (FloorNormal.Z < -0.05)
-		return false;
-
-	// Now we have to check surface angle. We can do it by taking the dot product between the normal 
-	// vector and its own XY projection
-	FVector Projection(FloorNormal.X, FloorNormal.Y, 0);
-	Projection.Normalize();
-	float FloorAngle = FMath::RadiansToDegrees(FMath::Acos(FVector::DotProduct(FloorNormal, Projection)));
-	FloorAngle = 180 - FloorAngle - 90;
-
-	return  MaxWalkableAngle >= FloorAngle;
+	// The slope of a surface is the angle between its normal and up, so it's under the max angle when the Z of the
+	// normal is over its cosine. No need for the angle itself
+	return ClassifySurface(FloorNormal, FMath::Cos(FMath::DegreesToRadians(MaxWalkableAngle))) == EParkourSurfaceClass::Walkable;
 }
 
 bool ParkourShooterUtils::FloorIsWalkableZ(const FVector FloorNormal, float MaxWalkableZ)
@@ -28,6 +60,128 @@ bool ParkourShooterUtils::FloorIsWalkableZ(const FVector FloorNormal, float MaxW
 	return FloorNormal.Z >= MaxWalkableZ;
 }
 
+EParkourSurfaceClass ParkourShooterUtils::ClassifySurface(const FVector& Normal, float WalkableFloorZ, float CeilingZ)
+{
+	if (Normal.Z < CeilingZ)
+		return EParkourSurfaceClass::Ceiling;
+
+	return Normal.Z >= WalkableFloorZ ? EParkourSurfaceClass::Walkable : EParkourSurfaceClass::Wallrunnable;
+}
+
+void ParkourShooterUtils::ClassifySurfaces(TArrayView<const FVector> Normals, TArrayView<EParkourSurfaceClass> OutClasses, float WalkableFloorZ, float CeilingZ)
+{
+	using namespace ParkourShooterUtilsPrivate;
+
+	check(OutClasses.Num() >= Normals.Num());
+
+	const int32 Num = Normals.Num();
+	const FVector* Source = Normals.GetData();
+	EParkourSurfaceClass* Destination = OutClasses.GetData();
+
+	const VectorRegister WalkableZ = VectorLoadFloat1(&WalkableFloorZ);
+	const VectorRegister MaxCeilingZ = VectorLoadFloat1(&CeilingZ);
+
+	int32 i = 0;
+	for (; i + 4 <= Num; i += 4)
+	{
+		// Four normals are 12 floats: [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3], gather the Zs in a single register
+		const float* Floats = reinterpret_cast<const float*>(Source + i);
+		VectorRegister A = VectorLoad(Floats);
+		VectorRegister B = VectorLoad(Floats + 4);
+		VectorRegister C = VectorLoad(Floats + 8);
+
+		VectorRegister Z01 = VectorShuffle(A, B, 2, 2, 1, 1);
+		VectorRegister Z23 = VectorShuffle(C, C, 0, 3, 0, 3);
+		VectorRegister Z = VectorShuffle(Z01, Z23, 0, 2, 0, 1);
+
+		int32 WalkableMask = VectorMaskBits(VectorCompareGE(Z, WalkableZ));
+		int32 CeilingMask = VectorMaskBits(VectorCompareGT(MaxCeilingZ, Z));
+
+		// Every lane starts as wallrunnable, walkable ones go down to 0 and ceilings up to 2
+		uint32 Packed = MaskToBytes[15] - MaskToBytes[WalkableMask] + MaskToBytes[CeilingMask];
+		FMemory::Memcpy(Destination + i, &Packed, sizeof(Packed));
+	}
+
+	for (; i < Num; i++)
+		Destination[i] = ClassifySurface(Source[i], WalkableFloorZ, CeilingZ);
+}
+
+void ParkourShooterUtils::RunSurfaceBenchmark(const TArray<FString>& Args)
+{
+	using namespace ParkourShooterUtilsPrivate;
+
+	int32 Count = 200000;
+	int32 Runs = 20;
+
+	for (const FString& Arg : Args)
+	{
+		FParse::Value(*Arg, TEXT("Count="), Count);
+		FParse::Value(*Arg, TEXT("Runs="), Runs);
+	}
+
+	Count = FMath::Max(Count, 1);
+	Runs = FMath::Max(Runs, 1);
+
+	// Same seed every time so runs can be compared
+	FRandomStream Random(1234);
+	TArray<FVector> Normals;
+	Normals.SetNumUninitialized(Count);
+	for (FVector& Normal : Normals)
+		Normal = Random.GetUnitVector();
+
+	const float MaxWalkableAngle = FMath::RadiansToDegrees(FMath::Acos(DefaultWalkableFloorZ));
+
+	TArray<EParkourSurfaceClass> TrigClasses;
+	TArray<EParkourSurfaceClass> ScalarClasses;
+	TArray<EParkourSurfaceClass> BatchClasses;
+	TrigClasses.SetNumUninitialized(Count);
+	ScalarClasses.SetNumUninitialized(Count);
+	BatchClasses.SetNumUninitialized(Count);
+
+	// Milliseconds of every run
+	TArray<float> TrigMs;
+	TArray<float> ScalarMs;
+	TArray<float> BatchMs;
+
+	for (int32 Run = 0; Run < Runs; Run++)
+	{
+		double Start = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Count; i++)
+			TrigClasses[i] = ClassifyWithTrig(Normals[i], MaxWalkableAngle);
+		TrigMs.Add((FPlatformTime::Seconds() - Start) * 1000);
+
+		Start = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Count; i++)
+			ScalarClasses[i] = ClassifySurface(Normals[i]);
+		ScalarMs.Add((FPlatformTime::Seconds() - Start) * 1000);
+
+		Start = FPlatformTime::Seconds();
+		ClassifySurfaces(Normals, BatchClasses);
+		BatchMs.Add((FPlatformTime::Seconds() - Start) * 1000);
+	}
+
+	// The trig path rounds differently right at the threshold, the batch has to match the scalar one exactly
+	int32 TrigMismatches = 0;
+	int32 BatchMismatches = 0;
+	for (int32 i = 0; i < Count; i++)
+	{
+		TrigMismatches += TrigClasses[i] != ScalarClasses[i] ? 1 : 0;
+		BatchMismatches += BatchClasses[i] != ScalarClasses[i] ? 1 : 0;
+	}
+
+	const FParkourSampleStats Trig = FParkourSampleStats::Compute(TrigMs);
+	const FParkourSampleStats Scalar = FParkourSampleStats::Compute(ScalarMs);
+	const FParkourSampleStats Batch = FParkourSampleStats::Compute(BatchMs);
+	auto PerNormal = [Count](const FParkourSampleStats& Stats) { return Stats.Mean * 1e6 / Count; };
+
+	// Same lines as always, with the spread between runs at the end
+	UE_LOG(LogParkour, Display, TEXT("Parkour.SurfaceBench: %d normals, %d runs"), Count, Runs);
+	UE_LOG(LogParkour, Display, TEXT("  Trig:   %.3f ms per run, %.2f ns per normal, %d differ, p95 %.3f ms"), Trig.Mean, PerNormal(Trig), TrigMismatches, Trig.P95);
+	UE_LOG(LogParkour, Display, TEXT("  Scalar: %.3f ms per run, %.2f ns per normal, p95 %.3f ms"), Scalar.Mean, PerNormal(Scalar), Scalar.P95);
+	UE_LOG(LogParkour, Display, TEXT("  Batch:  %.3f ms per run, %.2f ns per normal, %d differ, p95 %.3f ms"), Batch.Mean, PerNormal(Batch), BatchMismatches, Batch.P95);
+	UE_LOG(LogParkour, Display, TEXT("  Batch is %.1fx the trig path"), Batch.Mean > 0 ? Trig.Mean / Batch.Mean : 0.f);
+}
+
 ParkourShooterUtils::~ParkourShooterUtils()
 {
 }
@@ -4,6 +4,14 @@
 
 #include "CoreMinimal.h"
 
+/** What a surface is good for, by the way it faces */
+enum class EParkourSurfaceClass : uint8
+{
+	Walkable,
+	Wallrunnable,
+	Ceiling
+};
+
 /**
  * Simple class with utility functions used in many places
  */
@@ -12,9 +20,31 @@ class PARKOURSHOOTER_API ParkourShooterUtils
 public:
 	~ParkourShooterUtils();
 
+	/** Cosine of the default walkable floor angle of the character movement, 44.765 degrees */
+	static constexpr float DefaultWalkableFloorZ = 0.71f;
+
+	/** Normals with less Z than this face down, ceilings. Slightly under 0 so vertical walls are still walls */
+	static constexpr float DefaultCeilingZ = -0.05f;
+
 	static bool FloorIsWalkable(const FVector FloorNormal, float MaxWalkableAngle);
 	static bool FloorIsWalkableZ(const FVector FloorNormal, float MaxWalkableZ);
 
+	/// <summary>
+	/// Classify a single unit normal. Thresholds are cosines, compare them against the Z of the normal
+	/// </summary>
+	static EParkourSurfaceClass ClassifySurface(const FVector& Normal, float WalkableFloorZ = DefaultWalkableFloorZ, float CeilingZ = DefaultCeilingZ);
+
+	/// <summary>
+	/// Classify many unit normals at once, four per SIMD compare. Same results as ClassifySurface
+	/// </summary>
+	/// <param name="OutClasses"> One class per normal, has to be as big as Normals </param>
+	static void ClassifySurfaces(TArrayView<const FVector> Normals, TArrayView<EParkourSurfaceClass> OutClasses, float WalkableFloorZ = DefaultWalkableFloorZ, float CeilingZ = DefaultCeilingZ);
+
+	/// <summary>
+	/// Console command: classify random normals with the batch and with the old trig path and print how long each takes
+	/// </summary>
+	static void RunSurfaceBenchmark(const TArray<FString>& Args);
+
 private:
 	// We will use only static functions here, so the constructor is not necessary
 	ParkourShooterUtils();
@@ -0,0 +1,166 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ParkourSignificanceSubsystem.h"
+#include "ParkourShooter.h"
+#include "ParkourShooterCharacter.h"
+#include "ParkourStats.h"
+#include "SignificanceManager.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+
+namespace ParkourSignificance
+{
+	static const FName CharacterTag(TEXT("ParkourCharacter"));
+}
+
+void UParkourSignificanceSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	// Whatever the ini doesn't set runs at full rate
+	LODs.SetNum(static_cast<int32>(EParkourLOD::MAX));
+}
+
+void UParkourSignificanceSubsystem::Deinitialize()
+{
+	USignificanceManager* SignificanceManager = GetSignificanceManager();
+	if (SignificanceManager != nullptr)
+		SignificanceManager->UnregisterAll(ParkourSignificance::CharacterTag);
+
+	Characters.Reset();
+	FMemory::Memzero(LODCounts);
+
+	Super::Deinitialize();
+}
+
+void UParkourSignificanceSubsystem::Tick(float DeltaTime)
+{
+	PARKOUR_SCOPE_CYCLE_COUNTER(STAT_ParkourSignificance);
+
+	USignificanceManager* SignificanceManager = GetSignificanceManager();
+	if (SignificanceManager == nullptr)
+		return;
+
+	// Every player we know about is a viewpoint, on a server that's all of them
+	Viewpoints.Reset();
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		APlayerController* PlayerController = It->Get();
+		if (PlayerController == nullptr)
+			continue;
+
+		FVector Location;
+		FRotator Rotation;
+		PlayerController->GetPlayerViewPoint(Location, Rotation);
+		Viewpoints.Emplace(Rotation, Location);
+	}
+
+	// The significance of a character is the one from the viewpoint where it's most significant, its post
+	// significance function moves it to the matching LOD
+	SignificanceManager->Update(Viewpoints);
+
+	SET_DWORD_STAT(STAT_ParkourLODHigh, LODCounts[static_cast<int32>(EParkourLOD::High)]);
+	SET_DWORD_STAT(STAT_ParkourLODMedium, LODCounts[static_cast<int32>(EParkourLOD::Medium)]);
+	SET_DWORD_STAT(STAT_ParkourLODLow, LODCounts[static_cast<int32>(EParkourLOD::Low)]);
+}
+
+bool UParkourSignificanceSubsystem::IsTickable() const
+{
+	return Characters.Num() > 0;
+}
+
+ETickableTickType UParkourSignificanceSubsystem::GetTickableTickType() const
+{
+	// The class default object must never tick
+	return HasAnyFlags(RF_ClassDefaultObject) ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UParkourSignificanceSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UParkourSignificanceSubsystem, STATGROUP_Tickables);
+}
+
+void UParkourSignificanceSubsystem::RegisterCharacter(AParkourShooterCharacter* Character)
+{
+	USignificanceManager* SignificanceManager = GetSignificanceManager();
+	if (Character == nullptr || SignificanceManager == nullptr || Characters.Contains(Character))
+		return;
+
+	Characters.Add(Character);
+
+	// Everyone starts at full rate until the first update says otherwise
+	Character->SetParkourLOD(EParkourLOD::High, GetLODSettings(EParkourLOD::High));
+	LODCounts[static_cast<int32>(EParkourLOD::High)]++;
+
+	// Higher LODs are more significant, so the manager keeps the one from the closest viewpoint
+	auto Significance = [this](USignificanceManager::FManagedObjectInfo* Info, const FTransform& Viewpoint) -> float
+	{
+		const AParkourShooterCharacter* Managed = Cast<AParkourShooterCharacter>(Info->GetObject());
+		if (Managed == nullptr)
+			return 0;
+
+		return static_cast<float>(EParkourLOD::MAX) - static_cast<float>(ComputeLOD(Managed, Viewpoint));
+	};
+
+	auto PostSignificance = [this](USignificanceManager::FManagedObjectInfo* Info, float OldSignificance, float NewSignificance, bool bFinal)
+	{
+		AParkourShooterCharacter* Managed = Cast<AParkourShooterCharacter>(Info->GetObject());
+		if (Managed == nullptr)
+			return;
+
+		int32 LOD = static_cast<int32>(EParkourLOD::MAX) - FMath::RoundToInt(NewSignificance);
+		ApplyLOD(Managed, static_cast<EParkourLOD>(FMath::Clamp(LOD, 0, static_cast<int32>(EParkourLOD::MAX) - 1)));
+	};
+
+	SignificanceManager->RegisterObject(Character, ParkourSignificance::CharacterTag, Significance, USignificanceManager::EPostSignificanceType::Sequential, PostSignificance);
+}
+
+void UParkourSignificanceSubsystem::UnregisterCharacter(AParkourShooterCharacter* Character)
+{
+	if (Characters.RemoveSwap(Character) == 0)
+		return;
+
+	LODCounts[static_cast<int32>(Character->GetParkourLOD())]--;
+
+	USignificanceManager* SignificanceManager = GetSignificanceManager();
+	if (SignificanceManager != nullptr)
+		SignificanceManager->UnregisterObject(Character);
+}
+
+EParkourLOD UParkourSignificanceSubsystem::ComputeLOD(const AParkourShooterCharacter* Character, const FTransform& Viewpoint) const
+{
+	// Whoever we play with gets everything
+	if (Character->IsLocallyControlled() && Character->IsPlayerControlled())
+		return EParkourLOD::High;
+
+	float DistanceSquared = FVector::DistSquared(Character->GetActorLocation(), Viewpoint.GetLocation());
+
+	int32 LOD = 0;
+	int32 LowestLOD = static_cast<int32>(EParkourLOD::MAX) - 1;
+	while (LOD < LowestLOD && DistanceSquared > FMath::Square(LODs[LOD].MaxDistance))
+		LOD++;
+
+	// Off screen, one LOD lower. Nothing is ever rendered on a dedicated server, there we only go by distance
+	bool bCheckVisibility = bUseVisibility && GetWorld()->GetNetMode() != NM_DedicatedServer;
+	if (bCheckVisibility && LOD < LowestLOD && !Character->WasRecentlyRendered(VisibilityTimeout))
+		LOD++;
+
+	return static_cast<EParkourLOD>(LOD);
+}
+
+void UParkourSignificanceSubsystem::ApplyLOD(AParkourShooterCharacter* Character, EParkourLOD NewLOD)
+{
+	EParkourLOD OldLOD = Character->GetParkourLOD();
+	if (OldLOD == NewLOD)
+		return;
+
+	LODCounts[static_cast<int32>(OldLOD)]--;
+	LODCounts[static_cast<int32>(NewLOD)]++;
+
+	Character->SetParkourLOD(NewLOD, GetLODSettings(NewLOD));
+}
+
+USignificanceManager* UParkourSignificanceSubsystem::GetSignificanceManager() const
+{
+	return FSignificanceManagerModule::Get(GetWorld());
+}
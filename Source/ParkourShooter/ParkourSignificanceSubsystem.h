@@ -0,0 +1,120 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "ParkourSignificanceSubsystem.generated.h"
+
+class AParkourShooterCharacter;
+class USignificanceManager;
+
+/** How much parkour work a character gets, from the full rate of the local player to the cheapest we can get away with */
+UENUM()
+enum class EParkourLOD : uint8
+{
+	High,
+	Medium,
+	Low,
+	MAX UMETA(Hidden)
+};
+
+/** What a parkour LOD runs, and up to where it applies */
+USTRUCT()
+struct FParkourLODSettings
+{
+	GENERATED_BODY()
+
+	/** Characters further than this from every player go to the next LOD */
+	UPROPERTY(config)
+	float MaxDistance = 0;
+
+	/** Vault ledge probes per second, 0 probes every frame */
+	UPROPERTY(config)
+	float VaultProbeRate = 0;
+
+	/** Headroom probes per second, 0 probes every frame */
+	UPROPERTY(config)
+	float HeadroomProbeRate = 0;
+
+	/** Wallrun wall probes per second, 0 probes every fixed step */
+	UPROPERTY(config)
+	float WallProbeRate = 0;
+
+	/** Fixed steps per second of the wallrun, slide and grapple pull movement, 0 keeps the movement component's own.
+	  * Only for characters no player controls */
+	UPROPERTY(config)
+	float ParkourStepRate = 0;
+};
+
+/**
+ * Gives every parkour character an LOD through the significance manager, from how far it is from the nearest player
+ * and whether it was on screen lately, and sets how often it probes and updates its parkour movement accordingly.
+ * Locally controlled characters are always at the highest LOD. LODs are set in the ini, "stat parkour" shows how
+ * many characters are at each one
+ */
+UCLASS(config=Game)
+class PARKOURSHOOTER_API UParkourSignificanceSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	void RegisterCharacter(AParkourShooterCharacter* Character);
+
+	void UnregisterCharacter(AParkourShooterCharacter* Character);
+
+	/// <summary>
+	/// How many registered characters are at the given LOD right now
+	/// </summary>
+	int32 GetNumAtLOD(EParkourLOD LOD) const { return LODCounts[static_cast<int32>(LOD)]; }
+
+	const FParkourLODSettings& GetLODSettings(EParkourLOD LOD) const { return LODs[static_cast<int32>(LOD)]; }
+
+protected:
+
+	/** Settings of every LOD, from the highest to the lowest */
+	UPROPERTY(config)
+	TArray<FParkourLODSettings> LODs;
+
+	/** Go one LOD lower for characters that weren't on screen lately. Ignored on dedicated servers, they render nothing */
+	UPROPERTY(config)
+	bool bUseVisibility = true;
+
+	/** How long, in seconds, since the last time a character was rendered to still consider it visible */
+	UPROPERTY(config)
+	float VisibilityTimeout = 0.5f;
+
+	/// <summary>
+	/// LOD of a character seen from the given viewpoint
+	/// </summary>
+	EParkourLOD ComputeLOD(const AParkourShooterCharacter* Character, const FTransform& Viewpoint) const;
+
+	/// <summary>
+	/// Move a character to a new LOD, keeping the counters right
+	/// </summary>
+	void ApplyLOD(AParkourShooterCharacter* Character, EParkourLOD NewLOD);
+
+	USignificanceManager* GetSignificanceManager() const;
+
+	// Characters we gave an LOD to
+	UPROPERTY()
+	TArray<AParkourShooterCharacter*> Characters;
+
+	int32 LODCounts[static_cast<int32>(EParkourLOD::MAX)] = {};
+
+	// Where every player looks from, rebuilt every frame
+	TArray<FTransform> Viewpoints;
+};
@@ -0,0 +1,108 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/MiscTrace.h"
+
+// What the parkour code costs. Use "stat parkour" in game, or Unreal Insights for the trace scopes.
+// Stats and trace scopes both compile out in Shipping builds
+
+DECLARE_STATS_GROUP(TEXT("Parkour"), STATGROUP_Parkour, STATCAT_Advanced);
+
+// Time spent, the stat view shows how many times each one was called too
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Character Tick"), STAT_ParkourCharacterTick, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("CanStand"), STAT_ParkourCanStand, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Update Slide"), STAT_ParkourUpdateSlide, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Update Wallrun"), STAT_ParkourUpdateWallrun, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Vault Tick"), STAT_ParkourVaultTick, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("CanVault"), STAT_ParkourCanVault, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Grapple Tick"), STAT_ParkourGrappleTick, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Sensor Tick"), STAT_ParkourSensorTick, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Parkour Fixed Steps"), STAT_ParkourFixedSteps, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Batched Tick"), STAT_ParkourBatchedTick, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Significance"), STAT_ParkourSignificance, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Grapple Anchor Query"), STAT_ParkourGrappleAnchorQuery, STATGROUP_Parkour, PARKOURSHOOTER_API);
+
+// Physics queries issued every frame, by the ability that asked for them
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Headroom Queries"), STAT_ParkourHeadroomQueries, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Vault Queries"), STAT_ParkourVaultQueries, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Wallrun Queries"), STAT_ParkourWallrunQueries, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Grapple Queries"), STAT_ParkourGrappleQueries, STATGROUP_Parkour, PARKOURSHOOTER_API);
+
+// Probes that went through the query budget this frame, and the ones it pushed to a later frame
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Budgeted Queries Executed"), STAT_ParkourBudgetExecuted, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Budgeted Queries Deferred"), STAT_ParkourBudgetDeferred, STATGROUP_Parkour, PARKOURSHOOTER_API);
+
+// Explicit vault requests answered by a recent async probe, and the ones that had to block on a query
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Async Vault Results Used"), STAT_ParkourAsyncVaultHits, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Async Vault Results Missed"), STAT_ParkourAsyncVaultMisses, STATGROUP_Parkour, PARKOURSHOOTER_API);
+
+// Crouch capsule resizes, each one updates overlaps
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Capsule Resizes"), STAT_ParkourCapsuleResizes, STATGROUP_Parkour, PARKOURSHOOTER_API);
+
+// Static ledges and walls looked up in the baked surface index instead of traced
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Surface Index Lookups"), STAT_ParkourSurfaceLookups, STATGROUP_Parkour, PARKOURSHOOTER_API);
+
+// How many characters are at each parkour LOD
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Characters at LOD High"), STAT_ParkourLODHigh, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Characters at LOD Medium"), STAT_ParkourLODMedium, STATGROUP_Parkour, PARKOURSHOOTER_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Characters at LOD Low"), STAT_ParkourLODLow, STATGROUP_Parkour, PARKOURSHOOTER_API);
+
+/** Abilities we count physics queries for */
+enum class EParkourQueryType : uint8
+{
+	Headroom,
+	Vault,
+	Wallrun,
+	Grapple,
+	MAX
+};
+
+#if !UE_BUILD_SHIPPING
+/** Physics queries issued since startup by ability, so tools can read them without going through stats */
+extern PARKOURSHOOTER_API uint64 GParkourQueryCounts[static_cast<int32>(EParkourQueryType::MAX)];
+
+/** Count a physics query issued by the given ability, both in "stat parkour" and in GParkourQueryCounts */
+#define PARKOUR_COUNT_QUERY(Ability) \
+	do \
+	{ \
+		INC_DWORD_STAT(STAT_Parkour##Ability##Queries); \
+		GParkourQueryCounts[static_cast<int32>(EParkourQueryType::Ability)]++; \
+	} while (0)
+#else
+#define PARKOUR_COUNT_QUERY(Ability)
+#endif
+
+/** Distribution of benchmark samples, what every parkour benchmark and the perf suite report */
+struct PARKOURSHOOTER_API FParkourSampleStats
+{
+	int32 Num = 0;
+	float Mean = 0;
+	float P50 = 0;
+	float P95 = 0;
+	float P99 = 0;
+	float Max = 0;
+
+	/// <summary>
+	/// Compute the distribution of the given samples, in any order. All zeros if there's none
+	/// </summary>
+	static FParkourSampleStats Compute(TArray<float> Samples);
+
+	/// <summary>
+	/// Value at the given percentile of an already sorted array, 0 if it's empty
+	/// </summary>
+	static float Percentile(const TArray<float>& Sorted, float Percent);
+
+	/// <summary>
+	/// "mean X, p50 X, p95 X, p99 X, max X", for benchmark logs
+	/// </summary>
+	FString ToString() const;
+};
+
+/** Time a scope in the parkour stat group and show it as a named region in Unreal Insights */
+#define PARKOUR_SCOPE_CYCLE_COUNTER(Stat) \
+	SCOPE_CYCLE_COUNTER(Stat); \
+	TRACE_CPUPROFILER_EVENT_SCOPE(Stat)
@@ -0,0 +1,596 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ParkourSurfaceBakeCommandlet.h"
+#include "ParkourShooter.h"
+#include "Async/ParallelFor.h"
+#include "Components/ModelComponent.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/Level.h"
+#include "Engine/LevelStreaming.h"
+#include "Engine/World.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "UObject/Package.h"
+
+namespace ParkourSurfaceBake
+{
+	// How far past a surface the next trace of a line starts, so we don't hit it again
+	static const float Skin = 2.f;
+
+	// Surfaces a single line can cross at most, a safety net against broken geometry
+	static const int32 MaxHitsPerLine = 128;
+
+	// A neighbour this much higher than a surface still counts as the same floor
+	static const float StepTolerance = 10.f;
+
+	// Wall points this close to the line of a segment extend it
+	static const float LineTolerance = 2.f;
+
+	// Same segment on two slices if their ends are this close
+	static const float MergeTolerance = 2.f;
+
+	// Min dot product between the normals of points of the same wall
+	static const float NormalTolerance = 0.98f;
+
+	// Biggest grid of ledge columns we bake before asking for a bigger spacing
+	static const int64 MaxColumns = 16 * 1024 * 1024;
+
+	struct FSurface
+	{
+		float Z;
+		FVector Normal;
+		bool bWalkable;
+		bool bInLevel;
+	};
+
+	struct FWallPoint
+	{
+		FVector2D Location;
+		FVector Normal;
+	};
+
+	static bool IsInLevel(const FHitResult& Hit, const ULevel* Level)
+	{
+		UPrimitiveComponent* Component = Hit.GetComponent();
+		return Component != nullptr && Component->GetComponentLevel() == Level;
+	}
+
+	/** Trace along a line and call OnHit for every surface it crosses, in order */
+	template <typename FunctionType>
+	static void TraceLine(UWorld* World, const FVector& Start, const FVector& End, const FCollisionQueryParams& Params, float PenetrationStep, FunctionType&& OnHit)
+	{
+		FVector Direction = (End - Start).GetSafeNormal();
+		FVector From = Start;
+
+		for (int32 i = 0; i < MaxHitsPerLine; i++)
+		{
+			FHitResult Hit;
+			if (!World->LineTraceSingleByChannel(Hit, From, End, ECC_Parkour, Params))
+				return;
+
+			// Started inside something, get out of it before looking for the next surface
+			if (Hit.bStartPenetrating)
+			{
+				From += Direction * PenetrationStep;
+			}
+			else
+			{
+				OnHit(Hit);
+				From = Hit.ImpactPoint + Direction * Skin;
+			}
+
+			if (FVector::DotProduct(End - From, Direction) <= 0)
+				return;
+		}
+	}
+
+	/** Scan a slice of the level along one axis, a row every SampleSpacing, and merge the walls we hit into straight segments */
+	static void ScanSlice(UWorld* World, const ULevel* Level, const FBox& Bounds, float Z, int32 Axis, float Sign, const FParkourSurfaceBakeSettings& Settings, const FCollisionQueryParams& Params, TArray<FParkourWallSegment>& OutWalls)
+	{
+		const float Spacing = Settings.SampleSpacing;
+
+		// Rows are spread along the other axis
+		int32 RowAxis = 1 - Axis;
+		FVector2D RowDirection = Axis == 0 ? FVector2D(0, 1) : FVector2D(1, 0);
+
+		// Walls almost parallel to the scan leave big gaps between rows, the scan along the other axis gets those
+		float MaxGap = 3 * Spacing;
+
+		int32 FirstRow = FMath::FloorToInt(Bounds.Min[RowAxis] / Spacing);
+		int32 LastRow = FMath::CeilToInt(Bounds.Max[RowAxis] / Spacing);
+
+		struct FOpenSegment
+		{
+			FVector2D First;
+			FVector2D Last;
+			FVector Normal;
+		};
+
+		auto Close = [&](const FOpenSegment& Segment)
+		{
+			// Each point stands for the stretch of wall between its row and the next ones, half on each side
+			FVector2D Along = Segment.Last - Segment.First;
+			FVector2D Tangent = Along.IsNearlyZero() ? FVector2D(-Segment.Normal.Y, Segment.Normal.X).GetSafeNormal() : Along.GetSafeNormal();
+			float RowStep = FMath::Abs(FVector2D::DotProduct(Tangent, RowDirection));
+			float HalfFootprint = 0.5f * Spacing / FMath::Max(RowStep, 0.5f);
+
+			FParkourWallSegment Wall;
+			Wall.Start = Segment.First - Tangent * HalfFootprint;
+			Wall.End = Segment.Last + Tangent * HalfFootprint;
+			Wall.MinZ = Z - 0.5f * Settings.SliceHeight;
+			Wall.MaxZ = Z + 0.5f * Settings.SliceHeight;
+			Wall.Normal = Segment.Normal;
+			OutWalls.Add(Wall);
+		};
+
+		TArray<FOpenSegment> Open;
+		TArray<FOpenSegment> Continued;
+		TArray<FWallPoint> Points;
+
+		for (int32 Row = FirstRow; Row <= LastRow; Row++)
+		{
+			FVector Start(0, 0, Z);
+			FVector End(0, 0, Z);
+			Start[Axis] = Sign > 0 ? Bounds.Min[Axis] : Bounds.Max[Axis];
+			End[Axis] = Sign > 0 ? Bounds.Max[Axis] : Bounds.Min[Axis];
+			Start[RowAxis] = Row * Spacing;
+			End[RowAxis] = Row * Spacing;
+
+			Points.Reset();
+			TraceLine(World, Start, End, Params, Spacing, [&](const FHitResult& Hit)
+			{
+				if (IsInLevel(Hit, Level))
+					Points.Add({ FVector2D(Hit.ImpactPoint), Hit.ImpactNormal });
+			});
+
+			// Points on the line of a segment of the previous row extend it, the rest start new ones
+			Continued.Reset();
+			for (const FWallPoint& Point : Points)
+			{
+				int32 Found = INDEX_NONE;
+				for (int32 i = 0; i < Open.Num() && Found == INDEX_NONE; i++)
+				{
+					const FOpenSegment& Segment = Open[i];
+					FVector2D SegmentNormal = FVector2D(Segment.Normal.X, Segment.Normal.Y).GetSafeNormal();
+
+					if (FVector::DotProduct(Segment.Normal, Point.Normal) >= NormalTolerance
+						&& FMath::Abs(FVector2D::DotProduct(Point.Location - Segment.First, SegmentNormal)) <= LineTolerance
+						&& FVector2D::Distance(Point.Location, Segment.Last) <= MaxGap)
+						Found = i;
+				}
+
+				if (Found == INDEX_NONE)
+				{
+					Continued.Add({ Point.Location, Point.Location, Point.Normal });
+					continue;
+				}
+
+				FOpenSegment Segment = Open[Found];
+				Open.RemoveAtSwap(Found);
+				Segment.Last = Point.Location;
+				Continued.Add(Segment);
+			}
+
+			// Whatever didn't go on in this row ends in the previous one
+			for (const FOpenSegment& Segment : Open)
+				Close(Segment);
+
+			Swap(Open, Continued);
+		}
+
+		for (const FOpenSegment& Segment : Open)
+			Close(Segment);
+	}
+}
+
+UParkourSurfaceBakeCommandlet::UParkourSurfaceBakeCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UParkourSurfaceBakeCommandlet::Main(const FString& Params)
+{
+#if WITH_EDITOR
+	FParse::Value(*Params, TEXT("Spacing="), Settings.SampleSpacing);
+	FParse::Value(*Params, TEXT("SliceHeight="), Settings.SliceHeight);
+	FParse::Value(*Params, TEXT("Radius="), Settings.CapsuleRadius);
+	FParse::Value(*Params, TEXT("WalkableZ="), Settings.WalkableFloorZ);
+	FParse::Value(*Params, TEXT("MinDrop="), Settings.MinLedgeDrop);
+	FParse::Value(*Params, TEXT("SearchRadius="), Settings.LedgeSearchRadius);
+	bForce = FParse::Param(*Params, TEXT("Force"));
+
+	if (Settings.SampleSpacing <= 0 || Settings.SliceHeight <= 0 || Settings.CapsuleRadius <= 0)
+	{
+		UE_LOG(LogParkour, Error, TEXT("ParkourSurfaceBake: Spacing, SliceHeight and Radius have to be positive"));
+		return 1;
+	}
+
+	TArray<FString> Maps;
+	FString MapList;
+	if (FParse::Value(*Params, TEXT("Map="), MapList))
+	{
+		MapList.ParseIntoArray(Maps, TEXT("+"));
+	}
+	else
+	{
+		TArray<FString> Files;
+		FPackageName::FindPackagesInDirectory(Files, FPaths::ProjectContentDir());
+		for (const FString& File : Files)
+		{
+			FString PackageName;
+			if (FPaths::GetExtension(File, true) == FPackageName::GetMapPackageExtension() && FPackageName::TryConvertFilenameToLongPackageName(File, PackageName))
+				Maps.Add(PackageName);
+		}
+	}
+
+	double StartTime = FPlatformTime::Seconds();
+	int32 NumFailed = 0;
+	for (const FString& Map : Maps)
+	{
+		if (!BakeMap(Map))
+			NumFailed++;
+	}
+
+	UE_LOG(LogParkour, Display, TEXT("ParkourSurfaceBake: %d maps in %.1f s, %d failed"), Maps.Num(), FPlatformTime::Seconds() - StartTime, NumFailed);
+	return NumFailed > 0 ? 1 : 0;
+#else
+	UE_LOG(LogParkour, Error, TEXT("ParkourSurfaceBake only runs in the editor"));
+	return 1;
+#endif
+}
+
+bool UParkourSurfaceBakeCommandlet::BakeMap(const FString& MapPackageName)
+{
+#if WITH_EDITOR
+	UPackage* Package = LoadPackage(nullptr, *MapPackageName, LOAD_None);
+	UWorld* World = Package != nullptr ? UWorld::FindWorldInPackage(Package) : nullptr;
+	if (World == nullptr)
+	{
+		UE_LOG(LogParkour, Error, TEXT("ParkourSurfaceBake: couldn't load map %s"), *MapPackageName);
+		return false;
+	}
+
+	UE_LOG(LogParkour, Display, TEXT("ParkourSurfaceBake: %s"), *MapPackageName);
+
+	World->AddToRoot();
+	World->WorldType = EWorldType::Editor;
+
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Editor);
+	WorldContext.SetCurrentWorld(World);
+
+	// We only need collision to trace against
+	if (!World->bIsWorldInitialized)
+	{
+		UWorld::InitializationValues Values;
+		Values.RequiresHitProxies(false)
+			.ShouldSimulatePhysics(false)
+			.EnableTraceCollision(true)
+			.CreatePhysicsScene(true)
+			.CreateNavigation(false)
+			.CreateAISystem(false)
+			.AllowAudioPlayback(false);
+
+		World->InitWorld(Values);
+	}
+
+	World->PersistentLevel->UpdateModelComponents();
+	World->UpdateWorldComponents(true, false);
+
+	// Sublevels are floors and walls for each other, load all of them
+	for (ULevelStreaming* StreamingLevel : World->GetStreamingLevels())
+	{
+		if (StreamingLevel == nullptr)
+			continue;
+
+		StreamingLevel->SetShouldBeLoaded(true);
+		StreamingLevel->SetShouldBeVisible(true);
+	}
+
+	World->FlushLevelStreaming(EFlushLevelStreamingType::Full);
+
+	bool bSuccess = true;
+	for (ULevel* Level : World->GetLevels())
+	{
+		if (!BakeLevel(World, Level))
+			bSuccess = false;
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->CleanupWorld();
+	World->RemoveFromRoot();
+	CollectGarbage(RF_NoFlags);
+
+	return bSuccess;
+#else
+	return false;
+#endif
+}
+
+bool UParkourSurfaceBakeCommandlet::BakeLevel(UWorld* World, ULevel* Level)
+{
+#if WITH_EDITOR
+	if (Level == nullptr)
+		return true;
+
+	FString LevelPackageName = Level->GetOutermost()->GetName();
+	FString IndexPackageName = UParkourSurfaceIndex::GetIndexPackageName(LevelPackageName);
+	FString AssetName = FPackageName::GetShortName(IndexPackageName);
+
+	int32 NumComponents = 0;
+	uint32 Hash = UParkourSurfaceIndex::HashLevelCollision(Level, &NumComponents);
+
+	// Nothing changed since the last bake
+	if (!bForce && FPackageName::DoesPackageExist(IndexPackageName))
+	{
+		FString IndexPath = IndexPackageName + TEXT(".") + AssetName;
+		UParkourSurfaceIndex* Existing = LoadObject<UParkourSurfaceIndex>(nullptr, *IndexPath, nullptr, LOAD_NoWarn | LOAD_Quiet);
+		if (Existing != nullptr && Existing->IsUsable() && Existing->GetSourceHash() == Hash && Existing->GetSettings() == Settings)
+		{
+			UE_LOG(LogParkour, Display, TEXT("  %s is up to date"), *LevelPackageName);
+			return true;
+		}
+	}
+
+	double StartTime = FPlatformTime::Seconds();
+
+	FBox Bounds = GetCollisionBounds(Level);
+	TArray<FParkourLedge> Ledges;
+	TArray<FParkourWallSegment> Walls;
+	if (Bounds.IsValid)
+	{
+		BakeLedges(World, Level, Bounds, Ledges);
+		BakeWalls(World, Level, Bounds, Walls);
+	}
+
+	int32 NumLedges = Ledges.Num();
+	int32 NumWalls = Walls.Num();
+
+	UPackage* Package = CreatePackage(nullptr, *IndexPackageName);
+	Package->FullyLoad();
+
+	UParkourSurfaceIndex* Index = FindObject<UParkourSurfaceIndex>(Package, *AssetName);
+	if (Index == nullptr)
+		Index = NewObject<UParkourSurfaceIndex>(Package, *AssetName, RF_Public | RF_Standalone);
+
+	Index->SetContents(Settings, Hash, Bounds, MoveTemp(Ledges), MoveTemp(Walls));
+	Package->MarkPackageDirty();
+
+	FString Filename = FPackageName::LongPackageNameToFilename(IndexPackageName, FPackageName::GetAssetPackageExtension());
+	if (!UPackage::SavePackage(Package, Index, RF_Public | RF_Standalone, *Filename, GError, nullptr, false, true, SAVE_NoError))
+	{
+		UE_LOG(LogParkour, Error, TEXT("  Couldn't save %s"), *Filename);
+		return false;
+	}
+
+	UE_LOG(LogParkour, Display, TEXT("  %s: %d components, %d ledges, %d walls in %.1f s"), *LevelPackageName, NumComponents, NumLedges, NumWalls, FPlatformTime::Seconds() - StartTime);
+	return true;
+#else
+	return false;
+#endif
+}
+
+FBox UParkourSurfaceBakeCommandlet::GetCollisionBounds(const ULevel* Level)
+{
+	FBox Bounds(ForceInit);
+
+	for (AActor* Actor : Level->Actors)
+	{
+		if (Actor == nullptr)
+			continue;
+
+		TInlineComponentArray<UPrimitiveComponent*> Components(Actor);
+		for (UPrimitiveComponent* Component : Components)
+		{
+			if (UParkourSurfaceIndex::IsBakedComponent(Component))
+				Bounds += Component->Bounds.GetBox();
+		}
+	}
+
+	for (UModelComponent* ModelComponent : Level->ModelComponents)
+	{
+		if (UParkourSurfaceIndex::IsBakedComponent(ModelComponent))
+			Bounds += ModelComponent->Bounds.GetBox();
+	}
+
+	return Bounds;
+}
+
+void UParkourSurfaceBakeCommandlet::BakeLedges(UWorld* World, const ULevel* Level, const FBox& Bounds, TArray<FParkourLedge>& OutLedges) const
+{
+	using namespace ParkourSurfaceBake;
+
+	const float Spacing = Settings.SampleSpacing;
+
+	// Columns go past the edges of the level, that's where the drops of its outer ledges are
+	float Margin = Settings.LedgeSearchRadius + Spacing;
+	int32 MinX = FMath::FloorToInt((Bounds.Min.X - Margin) / Spacing);
+	int32 MinY = FMath::FloorToInt((Bounds.Min.Y - Margin) / Spacing);
+	int32 NumX = FMath::CeilToInt((Bounds.Max.X + Margin) / Spacing) - MinX + 1;
+	int32 NumY = FMath::CeilToInt((Bounds.Max.Y + Margin) / Spacing) - MinY + 1;
+
+	if (static_cast<int64>(NumX) * NumY > MaxColumns)
+	{
+		UE_LOG(LogParkour, Error, TEXT("  Too many columns (%d x %d), use a bigger -Spacing"), NumX, NumY);
+		return;
+	}
+
+	// Deep enough under the level to find the ground of other levels it could be a ledge over
+	float Top = Bounds.Max.Z + Spacing;
+	float Bottom = Bounds.Min.Z - Settings.MinLedgeDrop - Spacing;
+
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(ParkourSurfaceBake), false);
+	Params.MobilityType = EQueryMobilityType::Static;
+
+	// Every surface of every column, from top to bottom
+	TArray<TArray<FSurface>> Columns;
+	Columns.SetNum(NumX * NumY);
+
+	ParallelFor(NumY, [&](int32 Row)
+	{
+		for (int32 Column = 0; Column < NumX; Column++)
+		{
+			float X = (MinX + Column) * Spacing;
+			float Y = (MinY + Row) * Spacing;
+			TArray<FSurface>& Surfaces = Columns[Row * NumX + Column];
+
+			TraceLine(World, FVector(X, Y, Top), FVector(X, Y, Bottom), Params, Spacing, [&](const FHitResult& Hit)
+			{
+				Surfaces.Add({ Hit.ImpactPoint.Z, Hit.ImpactNormal, Hit.ImpactNormal.Z >= Settings.WalkableFloorZ, IsInLevel(Hit, Level) });
+			});
+		}
+	});
+
+	// Highest surface of a column that's not over the given height, false if there's nothing down there
+	auto FindGround = [&](int32 Column, int32 Row, float Z, float& OutGround)
+	{
+		if (Column < 0 || Column >= NumX || Row < 0 || Row >= NumY)
+			return false;
+
+		for (const FSurface& Surface : Columns[Row * NumX + Column])
+		{
+			if (Surface.Z <= Z + StepTolerance)
+			{
+				OutGround = Surface.Z;
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	// A surface is a ledge if we can find a drop around it, in any of 8 directions up to the search radius
+	static const FIntPoint Directions[] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1} };
+	auto IsLedge = [&](int32 Column, int32 Row, float Z)
+	{
+		for (const FIntPoint& Direction : Directions)
+		{
+			float StepLength = Spacing * FVector2D(Direction.X, Direction.Y).Size();
+			for (int32 Step = 1; Step * StepLength <= Settings.LedgeSearchRadius; Step++)
+			{
+				float Ground;
+				if (!FindGround(Column + Direction.X * Step, Row + Direction.Y * Step, Z, Ground) || Z - Ground >= Settings.MinLedgeDrop)
+					return true;
+			}
+		}
+
+		return false;
+	};
+
+	// Free height over a ledge for a capsule of the baked radius. Like the vault fit test, the capsule starts a radius
+	// over the surface to account for slopes
+	auto GetClearance = [&](const FVector& Location)
+	{
+		float Radius = Settings.CapsuleRadius;
+		FVector Start = Location + FVector(0, 0, 2 * Radius);
+		FVector End = Location + FVector(0, 0, Settings.MaxClearance - Radius);
+		if (End.Z <= Start.Z)
+			return 0.f;
+
+		FHitResult Hit;
+		if (!World->SweepSingleByChannel(Hit, Start, End, FQuat::Identity, ECC_Parkour, FCollisionShape::MakeSphere(Radius), Params))
+			return Settings.MaxClearance;
+
+		return Hit.bStartPenetrating ? 0.f : Hit.Location.Z + Radius - Location.Z;
+	};
+
+	TArray<TArray<FParkourLedge>> RowLedges;
+	RowLedges.SetNum(NumY);
+
+	ParallelFor(NumY, [&](int32 Row)
+	{
+		for (int32 Column = 0; Column < NumX; Column++)
+		{
+			for (const FSurface& Surface : Columns[Row * NumX + Column])
+			{
+				if (!Surface.bInLevel || !Surface.bWalkable || !IsLedge(Column, Row, Surface.Z))
+					continue;
+
+				FParkourLedge Ledge;
+				Ledge.Location = FVector((MinX + Column) * Spacing, (MinY + Row) * Spacing, Surface.Z);
+				Ledge.Normal = Surface.Normal;
+				Ledge.Clearance = GetClearance(Ledge.Location);
+				RowLedges[Row].Add(Ledge);
+			}
+		}
+	});
+
+	// Row by row keeps the ledges of every column together and from top to bottom
+	for (TArray<FParkourLedge>& Ledges : RowLedges)
+		OutLedges.Append(MoveTemp(Ledges));
+}
+
+void UParkourSurfaceBakeCommandlet::BakeWalls(UWorld* World, const ULevel* Level, const FBox& Bounds, TArray<FParkourWallSegment>& OutWalls) const
+{
+	using namespace ParkourSurfaceBake;
+
+	FBox ScanBounds = Bounds.ExpandBy(FVector(Settings.SampleSpacing, Settings.SampleSpacing, 0));
+	int32 NumSlices = FMath::Max(1, FMath::CeilToInt(Bounds.GetSize().Z / Settings.SliceHeight));
+
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(ParkourSurfaceBake), false);
+	Params.MobilityType = EQueryMobilityType::Static;
+
+	// Four scans per slice: along X both ways, then along Y both ways, so we hit walls facing everywhere
+	const int32 ScansPerSlice = 4;
+	TArray<TArray<FParkourWallSegment>> ScanWalls;
+	ScanWalls.SetNum(NumSlices * ScansPerSlice);
+
+	ParallelFor(ScanWalls.Num(), [&](int32 Task)
+	{
+		int32 Slice = Task / ScansPerSlice;
+		int32 Scan = Task % ScansPerSlice;
+		float Z = Bounds.Min.Z + (Slice + 0.5f) * Settings.SliceHeight;
+
+		ScanSlice(World, Level, ScanBounds, Z, Scan / 2, Scan % 2 == 0 ? 1.f : -1.f, Settings, Params, ScanWalls[Task]);
+	});
+
+	// The same wall on consecutive slices becomes a single taller segment
+	auto GetKey = [](const FVector2D& Location)
+	{
+		return FIntPoint(FMath::RoundToInt(Location.X / MergeTolerance), FMath::RoundToInt(Location.Y / MergeTolerance));
+	};
+
+	TMultiMap<FIntPoint, int32> Previous;
+	TMultiMap<FIntPoint, int32> Current;
+	TArray<int32, TInlineAllocator<8>> Candidates;
+
+	for (int32 Slice = 0; Slice < NumSlices; Slice++)
+	{
+		Current.Reset();
+
+		for (int32 Scan = 0; Scan < ScansPerSlice; Scan++)
+		{
+			for (const FParkourWallSegment& Wall : ScanWalls[Slice * ScansPerSlice + Scan])
+			{
+				FIntPoint Key = GetKey(Wall.Start);
+
+				int32 Merged = INDEX_NONE;
+				Candidates.Reset();
+				Previous.MultiFind(Key, Candidates);
+				for (int32 Candidate : Candidates)
+				{
+					FParkourWallSegment& Below = OutWalls[Candidate];
+					if (FVector2D::Distance(Below.End, Wall.End) <= MergeTolerance
+						&& FVector::DotProduct(Below.Normal, Wall.Normal) >= NormalTolerance
+						&& FMath::IsNearlyEqual(Below.MaxZ, Wall.MinZ, 1.f))
+					{
+						Below.MaxZ = Wall.MaxZ;
+						Merged = Candidate;
+						break;
+					}
+				}
+
+				if (Merged == INDEX_NONE)
+					Merged = OutWalls.Add(Wall);
+
+				Current.Add(Key, Merged);
+			}
+		}
+
+		Swap(Previous, Current);
+	}
+}
@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "ParkourSurfaceIndex.h"
+#include "ParkourSurfaceBakeCommandlet.generated.h"
+
+/**
+ * Bakes the parkour surface index of every level of a map: walkable ledges with a drop next to them and the free
+ * height over them, and the walls of the static collision. Each level gets its own index, and levels whose static
+ * collision didn't change since their last bake are skipped. The scans run in parallel on every core.
+ *
+ *   UE4Editor-Cmd ParkourShooter.uproject -run=ParkourSurfaceBake [-Map=/Game/Maps/A+/Game/Maps/B] [-Force]
+ *       [-Spacing=20] [-SliceHeight=50] [-Radius=42] [-WalkableZ=0.71] [-MinDrop=50] [-SearchRadius=120]
+ *
+ * Without -Map, every map of the project is baked. Pass persistent maps, their sublevels are baked with them
+ */
+UCLASS()
+class PARKOURSHOOTER_API UParkourSurfaceBakeCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UParkourSurfaceBakeCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+protected:
+
+	/// <summary>
+	/// Load a map with all its sublevels and bake every level that needs it
+	/// </summary>
+	/// <returns> False if the map couldn't be loaded or an index couldn't be saved </returns>
+	bool BakeMap(const FString& MapPackageName);
+
+	/// <summary>
+	/// Bake the index of a single level, traces see the whole map so surfaces next to other levels are right
+	/// </summary>
+	/// <returns> False if the index couldn't be saved </returns>
+	bool BakeLevel(UWorld* World, ULevel* Level);
+
+	/// <summary>
+	/// Bounds of the static collision of a level
+	/// </summary>
+	static FBox GetCollisionBounds(const ULevel* Level);
+
+	/// <summary>
+	/// Find every ledge of the level: walkable surfaces with a drop close to them, with the free height over them
+	/// </summary>
+	void BakeLedges(UWorld* World, const ULevel* Level, const FBox& Bounds, TArray<FParkourLedge>& OutLedges) const;
+
+	/// <summary>
+	/// Scan the level horizontally, slice by slice, and merge the walls we hit into straight segments
+	/// </summary>
+	void BakeWalls(UWorld* World, const ULevel* Level, const FBox& Bounds, TArray<FParkourWallSegment>& OutWalls) const;
+
+	FParkourSurfaceBakeSettings Settings;
+
+	// Bake levels even if their index is up to date
+	bool bForce = false;
+};
@@ -0,0 +1,453 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ParkourSurfaceIndex.h"
+#include "ParkourShooter.h"
+#include "ParkourStats.h"
+#include "Components/PrimitiveComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Level.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "Misc/PackageName.h"
+#include "Model.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace ParkourSurfaceIndex
+{
+	// Bump it when the layout of the saved data changes, older indices are ignored until they're baked again
+	static const int32 Version = 1;
+
+	static const TCHAR* PackageSuffix = TEXT("_ParkourSurfaces");
+}
+
+bool FParkourSurfaceBakeSettings::operator==(const FParkourSurfaceBakeSettings& Other) const
+{
+	return SampleSpacing == Other.SampleSpacing
+		&& SliceHeight == Other.SliceHeight
+		&& CapsuleRadius == Other.CapsuleRadius
+		&& WalkableFloorZ == Other.WalkableFloorZ
+		&& MinLedgeDrop == Other.MinLedgeDrop
+		&& LedgeSearchRadius == Other.LedgeSearchRadius
+		&& MaxClearance == Other.MaxClearance
+		&& CellSize == Other.CellSize;
+}
+
+FArchive& operator<<(FArchive& Ar, FParkourSurfaceBakeSettings& Settings)
+{
+	Ar << Settings.SampleSpacing << Settings.SliceHeight << Settings.CapsuleRadius << Settings.WalkableFloorZ;
+	Ar << Settings.MinLedgeDrop << Settings.LedgeSearchRadius << Settings.MaxClearance << Settings.CellSize;
+	return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FParkourLedge& Ledge)
+{
+	Ar << Ledge.Location << Ledge.Normal << Ledge.Clearance;
+	return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FParkourWallSegment& Segment)
+{
+	Ar << Segment.Start << Segment.End << Segment.MinZ << Segment.MaxZ << Segment.Normal;
+	return Ar;
+}
+
+void UParkourSurfaceIndex::Serialize(FArchive& Ar)
+{
+	Super::Serialize(Ar);
+
+	// Everything goes in a single blob behind a version, so an index saved with another layout can be skipped
+	// instead of read wrong
+	int32 Version = ParkourSurfaceIndex::Version;
+	Ar << Version;
+
+	TArray<uint8> Data;
+	if (Ar.IsSaving())
+	{
+		FMemoryWriter Writer(Data);
+		Writer << Settings << SourceHash << Bounds << Ledges << Walls;
+	}
+
+	Ar << Data;
+
+	if (Ar.IsLoading())
+	{
+		Ledges.Reset();
+		Walls.Reset();
+		SourceHash = 0;
+		bValid = false;
+
+		if (Version != ParkourSurfaceIndex::Version)
+		{
+			UE_LOG(LogParkour, Warning, TEXT("%s was baked with an older version, bake it again"), *GetPathName());
+			return;
+		}
+
+		FMemoryReader Reader(Data);
+		Reader << Settings << SourceHash << Bounds << Ledges << Walls;
+		bValid = !Reader.IsError();
+	}
+}
+
+void UParkourSurfaceIndex::PostLoad()
+{
+	Super::PostLoad();
+	BuildLookup();
+}
+
+void UParkourSurfaceIndex::SetContents(const FParkourSurfaceBakeSettings& NewSettings, uint32 NewSourceHash, const FBox& NewBounds, TArray<FParkourLedge>&& NewLedges, TArray<FParkourWallSegment>&& NewWalls)
+{
+	Settings = NewSettings;
+	SourceHash = NewSourceHash;
+	Bounds = NewBounds;
+	Ledges = MoveTemp(NewLedges);
+	Walls = MoveTemp(NewWalls);
+	bValid = true;
+
+	BuildLookup();
+}
+
+void UParkourSurfaceIndex::BuildLookup()
+{
+	LedgeColumns.Reset();
+	WallCells.Reset();
+
+	// Ledges of a column are next to each other
+	for (int32 i = 0; i < Ledges.Num(); i++)
+	{
+		FRange& Range = LedgeColumns.FindOrAdd(GetColumn(Ledges[i].Location));
+		if (Range.Num == 0)
+			Range.First = i;
+
+		Range.Num++;
+	}
+
+	// Walls go in every cell their box touches
+	for (int32 i = 0; i < Walls.Num(); i++)
+	{
+		const FParkourWallSegment& Wall = Walls[i];
+		FIntPoint MinCell = GetCell(FVector2D(FMath::Min(Wall.Start.X, Wall.End.X), FMath::Min(Wall.Start.Y, Wall.End.Y)));
+		FIntPoint MaxCell = GetCell(FVector2D(FMath::Max(Wall.Start.X, Wall.End.X), FMath::Max(Wall.Start.Y, Wall.End.Y)));
+
+		for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+			for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+				WallCells.FindOrAdd(FIntPoint(X, Y)).Add(i);
+	}
+}
+
+FIntPoint UParkourSurfaceIndex::GetColumn(const FVector& Location) const
+{
+	return FIntPoint(FMath::RoundToInt(Location.X / Settings.SampleSpacing), FMath::RoundToInt(Location.Y / Settings.SampleSpacing));
+}
+
+FIntPoint UParkourSurfaceIndex::GetCell(const FVector2D& Location) const
+{
+	return FIntPoint(FMath::FloorToInt(Location.X / Settings.CellSize), FMath::FloorToInt(Location.Y / Settings.CellSize));
+}
+
+bool UParkourSurfaceIndex::FindLedge(const FVector& Start, const FVector& End, const FParkourLedge*& OutLedge) const
+{
+	const FRange* Range = LedgeColumns.Find(GetColumn(Start));
+	if (Range == nullptr)
+		return false;
+
+	float Top = FMath::Max(Start.Z, End.Z);
+	float Bottom = FMath::Min(Start.Z, End.Z);
+
+	// From top to bottom, the first one in the segment is the one a trace going down would hit
+	for (int32 i = Range->First; i < Range->First + Range->Num; i++)
+	{
+		const FParkourLedge& Ledge = Ledges[i];
+		if (Ledge.Location.Z > Top)
+			continue;
+
+		if (Ledge.Location.Z < Bottom)
+			return false;
+
+		OutLedge = &Ledge;
+		return true;
+	}
+
+	return false;
+}
+
+bool UParkourSurfaceIndex::FindWall(const FVector& Start, const FVector& End, const FParkourWallSegment*& OutWall, float& OutTime) const
+{
+	FVector2D From(Start.X, Start.Y);
+	FVector2D Delta(End.X - Start.X, End.Y - Start.Y);
+
+	FIntPoint MinCell = GetCell(FVector2D(FMath::Min(Start.X, End.X), FMath::Min(Start.Y, End.Y)));
+	FIntPoint MaxCell = GetCell(FVector2D(FMath::Max(Start.X, End.X), FMath::Max(Start.Y, End.Y)));
+
+	OutWall = nullptr;
+	OutTime = 1.f;
+
+	for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+		{
+			const TArray<int32>* InCell = WallCells.Find(FIntPoint(X, Y));
+			if (InCell == nullptr)
+				continue;
+
+			for (int32 Index : *InCell)
+			{
+				const FParkourWallSegment& Wall = Walls[Index];
+				if (Start.Z < Wall.MinZ || Start.Z > Wall.MaxZ)
+					continue;
+
+				// Like a trace, we only hit walls facing us
+				if (FVector2D::DotProduct(FVector2D(Wall.Normal.X, Wall.Normal.Y), Delta) >= 0)
+					continue;
+
+				FVector2D Along = Wall.End - Wall.Start;
+				float Denominator = FVector2D::CrossProduct(Delta, Along);
+				if (FMath::IsNearlyZero(Denominator))
+					continue;
+
+				FVector2D ToWall = Wall.Start - From;
+				float Time = FVector2D::CrossProduct(ToWall, Along) / Denominator;
+				float WallTime = FVector2D::CrossProduct(ToWall, Delta) / Denominator;
+				if (Time < 0 || Time > OutTime || WallTime < 0 || WallTime > 1)
+					continue;
+
+				OutWall = &Wall;
+				OutTime = Time;
+			}
+		}
+	}
+
+	return OutWall != nullptr;
+}
+
+uint32 UParkourSurfaceIndex::HashLevelCollision(const ULevel* Level, int32* OutNumComponents)
+{
+	uint32 Hash = 0;
+	int32 NumComponents = 0;
+
+	if (Level != nullptr)
+	{
+		for (AActor* Actor : Level->Actors)
+		{
+			if (Actor == nullptr)
+				continue;
+
+			TInlineComponentArray<UPrimitiveComponent*> Components(Actor);
+			for (UPrimitiveComponent* Component : Components)
+			{
+				if (!IsBakedComponent(Component))
+					continue;
+
+				NumComponents++;
+
+				// Names relative to the level, so they're the same in the editor and in PIE
+				Hash = FCrc::StrCrc32(*Component->GetPathName(Level), Hash);
+				Hash = FCrc::StrCrc32(*Component->GetCollisionProfileName().ToString(), Hash);
+
+				const FTransform& Transform = Component->GetComponentTransform();
+				FVector Location = Transform.GetLocation();
+				FQuat Rotation = Transform.GetRotation();
+				FVector Scale = Transform.GetScale3D();
+				Hash = FCrc::MemCrc32(&Location, sizeof(Location), Hash);
+				Hash = FCrc::MemCrc32(&Rotation, sizeof(Rotation), Hash);
+				Hash = FCrc::MemCrc32(&Scale, sizeof(Scale), Hash);
+
+				const UStaticMeshComponent* MeshComponent = Cast<UStaticMeshComponent>(Component);
+				const UStaticMesh* Mesh = MeshComponent != nullptr ? MeshComponent->GetStaticMesh() : nullptr;
+				if (Mesh != nullptr)
+				{
+					Hash = FCrc::StrCrc32(*Mesh->GetPathName(), Hash);
+					if (Mesh->BodySetup != nullptr)
+					{
+						FGuid Guid = Mesh->BodySetup->BodySetupGuid;
+						int32 NumElements = Mesh->BodySetup->AggGeom.GetElementCount();
+						Hash = FCrc::MemCrc32(&Guid, sizeof(Guid), Hash);
+						Hash = FCrc::MemCrc32(&NumElements, sizeof(NumElements), Hash);
+					}
+				}
+			}
+		}
+
+		// BSP collides through the level model
+		if (Level->Model != nullptr && Level->Model->Points.Num() > 0)
+		{
+			NumComponents++;
+			Hash = FCrc::MemCrc32(Level->Model->Points.GetData(), Level->Model->Points.Num() * sizeof(FVector), Hash);
+		}
+	}
+
+	if (OutNumComponents != nullptr)
+		*OutNumComponents = NumComponents;
+
+	return Hash;
+}
+
+bool UParkourSurfaceIndex::IsBakedComponent(const UPrimitiveComponent* Component)
+{
+	return Component != nullptr
+		&& Component->Mobility == EComponentMobility::Static
+		&& Component->IsQueryCollisionEnabled()
+		&& Component->GetCollisionResponseToChannel(ECC_Parkour) == ECR_Block;
+}
+
+FString UParkourSurfaceIndex::GetIndexPackageName(const FString& LevelPackageName)
+{
+	return LevelPackageName + ParkourSurfaceIndex::PackageSuffix;
+}
+
+void UParkourSurfaceSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UParkourSurfaceSubsystem::OnLevelAdded);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UParkourSurfaceSubsystem::OnLevelRemoved);
+
+	// Only game worlds probe
+	UWorld* World = GetWorld();
+	if (World != nullptr && World->IsGameWorld())
+		AddLevel(World->PersistentLevel);
+}
+
+void UParkourSurfaceSubsystem::Deinitialize()
+{
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+
+	Indices.Reset();
+	LevelsWithoutIndex.Reset();
+
+	Super::Deinitialize();
+}
+
+void UParkourSurfaceSubsystem::OnLevelAdded(ULevel* Level, UWorld* World)
+{
+	if (World == GetWorld() && World->IsGameWorld())
+		AddLevel(Level);
+}
+
+void UParkourSurfaceSubsystem::OnLevelRemoved(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld())
+		return;
+
+	// No level means all of them are gone
+	if (Level == nullptr)
+	{
+		Indices.Reset();
+		LevelsWithoutIndex.Reset();
+		return;
+	}
+
+	Indices.Remove(Level);
+	LevelsWithoutIndex.Remove(Level);
+}
+
+void UParkourSurfaceSubsystem::AddLevel(ULevel* Level)
+{
+	if (Level == nullptr || Indices.Contains(Level))
+		return;
+
+	FString LevelPackageName = UWorld::RemovePIEPrefix(Level->GetOutermost()->GetName());
+	FString IndexPackageName = UParkourSurfaceIndex::GetIndexPackageName(LevelPackageName);
+	FString IndexPath = IndexPackageName + TEXT(".") + FPackageName::GetShortName(IndexPackageName);
+
+	UParkourSurfaceIndex* Index = LoadObject<UParkourSurfaceIndex>(nullptr, *IndexPath, nullptr, LOAD_NoWarn | LOAD_Quiet);
+	if (Index != nullptr && !Index->IsUsable())
+		Index = nullptr;
+
+	int32 NumComponents = 0;
+	uint32 Hash = UParkourSurfaceIndex::HashLevelCollision(Level, &NumComponents);
+
+#if WITH_EDITOR
+	// Levels change all the time in the editor, don't trust an index baked before the last change
+	if (Index != nullptr && Index->GetSourceHash() != Hash)
+	{
+		UE_LOG(LogParkour, Warning, TEXT("%s is out of date, run the ParkourSurfaceBake commandlet. Tracing static geometry until then"), *IndexPath);
+		Index = nullptr;
+	}
+#endif
+
+	if (Index != nullptr)
+	{
+		Indices.Add(Level, Index);
+		return;
+	}
+
+	// A level without static collision doesn't need one
+	if (NumComponents > 0)
+	{
+		UE_LOG(LogParkour, Log, TEXT("%s has no parkour surface index, tracing static geometry"), *LevelPackageName);
+		LevelsWithoutIndex.Add(Level);
+	}
+}
+
+bool UParkourSurfaceSubsystem::FindLedge(const FVector& Start, const FVector& End, FHitResult& OutHit, float& OutClearance, float& OutMaxRadius) const
+{
+	INC_DWORD_STAT(STAT_ParkourSurfaceLookups);
+
+	// Every level only knows about its own ledges, the highest one is the one a trace would hit
+	const FParkourLedge* Best = nullptr;
+	const UParkourSurfaceIndex* BestIndex = nullptr;
+	for (const TPair<ULevel*, UParkourSurfaceIndex*>& Pair : Indices)
+	{
+		const FParkourLedge* Ledge = nullptr;
+		if (Pair.Value == nullptr || !Pair.Value->FindLedge(Start, End, Ledge))
+			continue;
+
+		if (Best == nullptr || Ledge->Location.Z > Best->Location.Z)
+		{
+			Best = Ledge;
+			BestIndex = Pair.Value;
+		}
+	}
+
+	if (Best == nullptr)
+		return false;
+
+	float Length = FMath::Max(Start.Z - End.Z, KINDA_SMALL_NUMBER);
+
+	OutHit = FHitResult(Start, End);
+	OutHit.bBlockingHit = true;
+	OutHit.Location = Best->Location;
+	OutHit.ImpactPoint = Best->Location;
+	OutHit.Normal = Best->Normal;
+	OutHit.ImpactNormal = Best->Normal;
+	OutHit.Distance = Start.Z - Best->Location.Z;
+	OutHit.Time = OutHit.Distance / Length;
+
+	OutClearance = Best->Clearance;
+	OutMaxRadius = BestIndex->GetSettings().CapsuleRadius;
+	return true;
+}
+
+bool UParkourSurfaceSubsystem::FindWall(const FVector& Start, const FVector& End, FHitResult& OutHit) const
+{
+	INC_DWORD_STAT(STAT_ParkourSurfaceLookups);
+
+	const FParkourWallSegment* Best = nullptr;
+	float BestTime = 1.f;
+	for (const TPair<ULevel*, UParkourSurfaceIndex*>& Pair : Indices)
+	{
+		const FParkourWallSegment* Wall = nullptr;
+		float Time;
+		if (Pair.Value != nullptr && Pair.Value->FindWall(Start, End, Wall, Time) && (Best == nullptr || Time < BestTime))
+		{
+			Best = Wall;
+			BestTime = Time;
+		}
+	}
+
+	if (Best == nullptr)
+		return false;
+
+	OutHit = FHitResult(Start, End);
+	OutHit.bBlockingHit = true;
+	OutHit.Time = BestTime;
+	OutHit.Location = Start + (End - Start) * BestTime;
+	OutHit.ImpactPoint = OutHit.Location;
+	OutHit.Normal = Best->Normal;
+	OutHit.ImpactNormal = Best->Normal;
+	OutHit.Distance = (End - Start).Size() * BestTime;
+	return true;
+}
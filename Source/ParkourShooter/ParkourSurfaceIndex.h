@@ -0,0 +1,212 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/EngineTypes.h"
+#include "ParkourSurfaceIndex.generated.h"
+
+class ULevel;
+class UPrimitiveComponent;
+
+/** How a surface index was baked, an index baked with other settings is baked again */
+struct FParkourSurfaceBakeSettings
+{
+	/** Horizontal distance between ledge samples, and between the rows of the wall scan */
+	float SampleSpacing = 20;
+
+	/** Vertical distance between the slices of the wall scan */
+	float SliceHeight = 50;
+
+	/** Ledge clearance is baked for capsules up to this radius, bigger capsules don't use the index */
+	float CapsuleRadius = 42;
+
+	/** Walkable floor Z of the character movement, only walkable surfaces can be ledges */
+	float WalkableFloorZ = 0.71f;
+
+	/** A walkable surface is a ledge if there's a drop of at least this much close to it. Min vaulting height */
+	float MinLedgeDrop = 50;
+
+	/** How far from a surface to look for that drop. Distance of the vault probe in front of the character, plus its radius */
+	float LedgeSearchRadius = 120;
+
+	/** Clearance over a ledge is measured up to this height, enough for any standing capsule */
+	float MaxClearance = 300;
+
+	/** Size of the cells we sort wall segments into */
+	float CellSize = 400;
+
+	bool operator==(const FParkourSurfaceBakeSettings& Other) const;
+	bool operator!=(const FParkourSurfaceBakeSettings& Other) const { return !(*this == Other); }
+
+	friend FArchive& operator<<(FArchive& Ar, FParkourSurfaceBakeSettings& Settings);
+};
+
+/** A walkable surface with a drop next to it, sampled every SampleSpacing */
+struct FParkourLedge
+{
+	FVector Location = FVector::ZeroVector;
+	FVector Normal = FVector::UpVector;
+
+	// Free height over the surface for a capsule of the baked radius
+	float Clearance = 0;
+
+	friend FArchive& operator<<(FArchive& Ar, FParkourLedge& Ledge);
+};
+
+/** A stretch of static wall found by the wall scan, straight and facing the same way from MinZ to MaxZ */
+struct FParkourWallSegment
+{
+	FVector2D Start = FVector2D::ZeroVector;
+	FVector2D End = FVector2D::ZeroVector;
+	float MinZ = 0;
+	float MaxZ = 0;
+	FVector Normal = FVector::ForwardVector;
+
+	friend FArchive& operator<<(FArchive& Ar, FParkourWallSegment& Segment);
+};
+
+/**
+ * Ledges and walls of the static collision of a single level, baked offline by the ParkourSurfaceBake commandlet
+ * so the vault and wallrun probes can look static geometry up instead of tracing it. It's saved next to its level
+ * as <Level>_ParkourSurfaces, remember to cook the map folders with DirectoriesToAlwaysCook
+ */
+UCLASS()
+class PARKOURSHOOTER_API UParkourSurfaceIndex : public UObject
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Serialize(FArchive& Ar) override;
+	virtual void PostLoad() override;
+
+	/// <summary>
+	/// Find the highest ledge under a vertical segment going down, like a trace from Start to End would
+	/// </summary>
+	/// <returns> True if there's a ledge in the segment </returns>
+	bool FindLedge(const FVector& Start, const FVector& End, const FParkourLedge*& OutLedge) const;
+
+	/// <summary>
+	/// Find the closest wall along a horizontal segment, like a trace from Start to End would
+	/// </summary>
+	/// <param name="OutTime"> Where along the segment we hit the wall, from 0 to 1 </param>
+	/// <returns> True if we hit a wall </returns>
+	bool FindWall(const FVector& Start, const FVector& End, const FParkourWallSegment*& OutWall, float& OutTime) const;
+
+	/// <summary>
+	/// Hash of the static collision of a level, what we baked from. If it changes, the index is out of date
+	/// </summary>
+	/// <param name="OutNumComponents"> How many static components with collision went into the hash </param>
+	static uint32 HashLevelCollision(const ULevel* Level, int32* OutNumComponents = nullptr);
+
+	/// <summary>
+	/// Checks if a component is static geometry the index should answer for
+	/// </summary>
+	static bool IsBakedComponent(const UPrimitiveComponent* Component);
+
+	/// <summary>
+	/// Name of the package with the index of the given level package
+	/// </summary>
+	static FString GetIndexPackageName(const FString& LevelPackageName);
+
+	/// <summary>
+	/// Replace the contents of the index, ledges have to be sorted by column and from top to bottom
+	/// </summary>
+	void SetContents(const FParkourSurfaceBakeSettings& NewSettings, uint32 NewSourceHash, const FBox& NewBounds, TArray<FParkourLedge>&& NewLedges, TArray<FParkourWallSegment>&& NewWalls);
+
+	/** False if it was saved with an older layout and has to be baked again */
+	bool IsUsable() const { return bValid; }
+
+	const FParkourSurfaceBakeSettings& GetSettings() const { return Settings; }
+	uint32 GetSourceHash() const { return SourceHash; }
+	int32 GetNumLedges() const { return Ledges.Num(); }
+	int32 GetNumWalls() const { return Walls.Num(); }
+
+protected:
+
+	FParkourSurfaceBakeSettings Settings;
+
+	uint32 SourceHash = 0;
+
+	bool bValid = false;
+
+	// Static collision the index covers, invalid if the level has none
+	FBox Bounds = FBox(ForceInit);
+
+	TArray<FParkourLedge> Ledges;
+	TArray<FParkourWallSegment> Walls;
+
+	// Built on load, not saved: first ledge and count for every column, and walls touching every cell
+	struct FRange
+	{
+		int32 First = 0;
+		int32 Num = 0;
+	};
+
+	TMap<FIntPoint, FRange> LedgeColumns;
+	TMap<FIntPoint, TArray<int32>> WallCells;
+
+	/// <summary>
+	/// Build the lookup tables from the ledge and wall arrays
+	/// </summary>
+	void BuildLookup();
+
+	FIntPoint GetColumn(const FVector& Location) const;
+	FIntPoint GetCell(const FVector2D& Location) const;
+};
+
+/**
+ * Keeps the surface index of every loaded level and answers ledge and wall queries against static geometry from
+ * them. It only answers once every loaded level has an up to date index, otherwise the probes trace as usual
+ */
+UCLASS()
+class PARKOURSHOOTER_API UParkourSurfaceSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	/// <summary>
+	/// Checks if static geometry can be answered by the index instead of traces
+	/// </summary>
+	bool IsAvailable() const { return Indices.Num() > 0 && LevelsWithoutIndex.Num() == 0; }
+
+	/// <summary>
+	/// Highest static ledge under a vertical segment going down, as a hit like the one a trace would give
+	/// </summary>
+	/// <param name="OutClearance"> Free height over the ledge </param>
+	/// <param name="OutMaxRadius"> Biggest capsule radius the clearance is good for </param>
+	/// <returns> True if there's a ledge in the segment </returns>
+	bool FindLedge(const FVector& Start, const FVector& End, FHitResult& OutHit, float& OutClearance, float& OutMaxRadius) const;
+
+	/// <summary>
+	/// Closest static wall along a horizontal segment, as a hit like the one a trace would give
+	/// </summary>
+	/// <returns> True if we hit a wall </returns>
+	bool FindWall(const FVector& Start, const FVector& End, FHitResult& OutHit) const;
+
+protected:
+
+	void OnLevelAdded(ULevel* Level, UWorld* World);
+	void OnLevelRemoved(ULevel* Level, UWorld* World);
+
+	/// <summary>
+	/// Load the index of a level, or remember it doesn't have a usable one
+	/// </summary>
+	void AddLevel(ULevel* Level);
+
+	UPROPERTY()
+	TMap<ULevel*, UParkourSurfaceIndex*> Indices;
+
+	// Loaded levels with static collision and no index, or an out of date one
+	TSet<TWeakObjectPtr<ULevel>> LevelsWithoutIndex;
+
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+};
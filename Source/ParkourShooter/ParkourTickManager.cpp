@@ -0,0 +1,322 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ParkourTickManager.h"
+#include "ParkourShooter.h"
+#include "ParkourShooterCharacter.h"
+#include "GraplingHookComponent.h"
+#include "ParkourStats.h"
+#include "CoreGlobals.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+static FAutoConsoleCommandWithWorldAndArgs TickBenchCommand(
+	TEXT("Parkour.TickBench"),
+	TEXT("Spawn parkour characters and compare per actor ticks with the batched update. Usage: Parkour.TickBench [Count=500] [Frames=300] [Quit]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&UParkourTickManager::RunBenchmark)
+);
+
+namespace ParkourTickManager
+{
+	static void LogDistribution(const TCHAR* Name, const TArray<float>& Samples)
+	{
+		const FParkourSampleStats Stats = FParkourSampleStats::Compute(Samples);
+		UE_LOG(LogParkour, Display, TEXT("  %s ms: mean %.4f, p50 %.4f, p95 %.4f, p99 %.4f"), Name, Stats.Mean, Stats.P50, Stats.P95, Stats.P99);
+	}
+}
+
+void FParkourBatchedTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if (Manager != nullptr && TickType != LEVELTICK_ViewportsOnly)
+		Manager->TickCharacters(DeltaTime);
+}
+
+FString FParkourBatchedTickFunction::DiagnosticMessage()
+{
+	return TEXT("FParkourBatchedTickFunction");
+}
+
+void UParkourTickManager::Deinitialize()
+{
+	if (TickFunction.IsTickFunctionRegistered())
+		TickFunction.UnRegisterTickFunction();
+
+	Characters.Reset();
+	Movements.Reset();
+	Grapples.Reset();
+	Benchmark = FBenchmark();
+
+	Super::Deinitialize();
+}
+
+void UParkourTickManager::RegisterCharacter(AParkourShooterCharacter* Character)
+{
+	if (Character == nullptr || Characters.Contains(Character))
+		return;
+
+	Characters.Add(Character);
+	Movements.Add(Character->GetCharacterMovement());
+	Grapples.Add(Character->GrapplingHook);
+
+	// Registered before the prerequisite goes in, so the first character gets it too
+	ApplyTickMode(Characters.Num() - 1);
+	RefreshTickFunction();
+
+	// The movement has to see this frame's speed clamp, like it did when the character ticked before it
+	if (Character->GetCharacterMovement() != nullptr)
+		Character->GetCharacterMovement()->PrimaryComponentTick.AddPrerequisite(this, TickFunction);
+}
+
+void UParkourTickManager::UnregisterCharacter(AParkourShooterCharacter* Character)
+{
+	int32 Index = Characters.IndexOfByKey(Character);
+	if (Index == INDEX_NONE)
+		return;
+
+	if (Movements[Index] != nullptr)
+		Movements[Index]->PrimaryComponentTick.RemovePrerequisite(this, TickFunction);
+
+	Characters.RemoveAtSwap(Index, 1, false);
+	Movements.RemoveAtSwap(Index, 1, false);
+	Grapples.RemoveAtSwap(Index, 1, false);
+
+	RefreshTickFunction();
+}
+
+void UParkourTickManager::SetBatching(bool bEnabled)
+{
+	if (bBatchTicks == bEnabled)
+		return;
+
+	bBatchTicks = bEnabled;
+	for (int32 i = 0; i < Characters.Num(); i++)
+		ApplyTickMode(i);
+
+	RefreshTickFunction();
+}
+
+void UParkourTickManager::ApplyTickMode(int32 Index)
+{
+	AParkourShooterCharacter* Character = Characters[Index];
+	if (!IsValid(Character))
+		return;
+
+	// Characters with a blueprint tick still need their own, we can't run it for them
+	static const FName ReceiveTickName(TEXT("ReceiveTick"));
+	bool bBatched = bBatchTicks && !Character->GetClass()->IsFunctionImplementedInScript(ReceiveTickName);
+
+	Character->SetActorTickEnabled(!bBatched);
+	if (Grapples[Index] != nullptr)
+		Grapples[Index]->SetBatchedTick(bBatched);
+}
+
+void UParkourTickManager::RefreshTickFunction()
+{
+	UWorld* World = GetWorld();
+	if (World == nullptr || World->PersistentLevel == nullptr)
+		return;
+
+	if (!TickFunction.IsTickFunctionRegistered())
+	{
+		TickFunction.Manager = this;
+		TickFunction.RegisterTickFunction(World->PersistentLevel);
+	}
+
+	TickFunction.SetTickFunctionEnable((bBatchTicks && Characters.Num() > 0) || Benchmark.bRunning);
+}
+
+void UParkourTickManager::TickCharacters(float DeltaTime)
+{
+	if (Benchmark.bRunning)
+		UpdateBenchmark();
+
+	if (!bBatchTicks)
+		return;
+
+	PARKOUR_SCOPE_CYCLE_COUNTER(STAT_ParkourBatchedTick);
+	double StartTime = FPlatformTime::Seconds();
+
+	StandUpIndices.Reset();
+	CrouchIndices.Reset();
+	GrappleIndices.Reset();
+
+	// Air speed clamp, everyone goes through it. Gather who needs the other passes on the way
+	for (int32 i = 0; i < Characters.Num(); i++)
+	{
+		// Skip the ones still ticking on their own
+		AParkourShooterCharacter* Character = Characters[i];
+		if (Character == nullptr || Character->IsActorTickEnabled())
+			continue;
+
+		Character->ClampHorizontalVelocity();
+
+		if (Character->CurrentMovementState == MovementState::Sliding || Character->CurrentMovementState == MovementState::Crouching)
+			StandUpIndices.Add(i);
+		else if (Character->IsCrouchPlaying())
+			CrouchIndices.Add(i);
+
+		if (Grapples[i] != nullptr && Grapples[i]->IsInUse())
+			GrappleIndices.Add(i);
+	}
+
+	// Slide and standing up, only the ones that are down
+	for (int32 Index : StandUpIndices)
+	{
+		AParkourShooterCharacter* Character = Characters[Index];
+		if (Character->CurrentMovementState == MovementState::Sliding)
+			Character->TickSlide();
+
+		Character->UpdateStandUp();
+	}
+
+	// Crouch pose, the ones that are down or still getting up. Standing up above may have started it
+	for (int32 Index : StandUpIndices)
+		Characters[Index]->TickCrouch(DeltaTime);
+	for (int32 Index : CrouchIndices)
+		Characters[Index]->TickCrouch(DeltaTime);
+
+	// Grapple checks, only the ones with the hook out. The pull itself runs in their movement
+	for (int32 Index : GrappleIndices)
+		Grapples[Index]->UpdateGrapple();
+
+	LastUpdateSeconds = FPlatformTime::Seconds() - StartTime;
+}
+
+void UParkourTickManager::RunBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	UParkourTickManager* Manager = World != nullptr ? World->GetSubsystem<UParkourTickManager>() : nullptr;
+	if (Manager == nullptr || !World->IsGameWorld())
+	{
+		UE_LOG(LogParkour, Error, TEXT("Parkour.TickBench needs a game world"));
+		return;
+	}
+
+	if (Manager->Benchmark.bRunning)
+	{
+		UE_LOG(LogParkour, Warning, TEXT("Parkour.TickBench is already running"));
+		return;
+	}
+
+	int32 Count = 500;
+	int32 Frames = 300;
+	bool bQuit = false;
+
+	for (const FString& Arg : Args)
+	{
+		if (Arg.Equals(TEXT("Quit"), ESearchCase::IgnoreCase))
+			bQuit = true;
+
+		FParse::Value(*Arg, TEXT("Count="), Count);
+		FParse::Value(*Arg, TEXT("Frames="), Frames);
+	}
+
+	// Same class as the player, so bots come with everything the blueprint sets up
+	TSubclassOf<AParkourShooterCharacter> CharacterClass = AParkourShooterCharacter::StaticClass();
+	APlayerController* PlayerController = World->GetFirstPlayerController();
+	if (PlayerController != nullptr && Cast<AParkourShooterCharacter>(PlayerController->GetPawn()) != nullptr)
+		CharacterClass = PlayerController->GetPawn()->GetClass();
+
+	FBenchmark& Bench = Manager->Benchmark;
+	Bench = FBenchmark();
+	Bench.FramesPerPhase = FMath::Max(Frames, 1);
+	Bench.bQuitWhenDone = bQuit;
+	Bench.bPreviousBatching = Manager->IsBatching();
+
+	// A grid high above the level, so they fall in the open the whole run and we measure them and not the level
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	int32 GridSize = FMath::CeilToInt(FMath::Sqrt(static_cast<float>(FMath::Max(Count, 1))));
+	for (int32 i = 0; i < Count; i++)
+	{
+		FVector Location(i % GridSize * 300.f, i / GridSize * 300.f, 50000.f);
+		AParkourShooterCharacter* Character = World->SpawnActor<AParkourShooterCharacter>(CharacterClass, Location, FRotator::ZeroRotator, SpawnParams);
+		if (Character == nullptr)
+			continue;
+
+		// Without a controller the movement doesn't run at all
+		Character->SpawnDefaultController();
+		Bench.Spawned.Add(Character);
+		Bench.SpawnLocations.Add(Location);
+	}
+
+	UE_LOG(LogParkour, Display, TEXT("Parkour.TickBench: %d characters of %s, %d frames per phase"), Bench.Spawned.Num(), *CharacterClass->GetName(), Bench.FramesPerPhase);
+
+	Bench.bRunning = true;
+	Manager->SetBatching(false);
+	Manager->ResetBenchmarkCharacters();
+	Manager->RefreshTickFunction();
+}
+
+void UParkourTickManager::UpdateBenchmark()
+{
+	// The first frame of a phase still pays for the switch, skip it
+	if (Benchmark.Frame > 0)
+	{
+		Benchmark.GameThreadMs[Benchmark.Phase].Add(FPlatformTime::ToMilliseconds(GGameThreadTime));
+		if (Benchmark.Phase == 1)
+			Benchmark.UpdateMs.Add(LastUpdateSeconds * 1000.0);
+	}
+
+	Benchmark.Frame++;
+	if (Benchmark.Frame <= Benchmark.FramesPerPhase)
+		return;
+
+	if (Benchmark.Phase == 1)
+	{
+		FinishBenchmark();
+		return;
+	}
+
+	// Same characters from the same place, updated by us this time
+	Benchmark.Phase = 1;
+	Benchmark.Frame = 0;
+	SetBatching(true);
+	ResetBenchmarkCharacters();
+}
+
+void UParkourTickManager::ResetBenchmarkCharacters()
+{
+	for (int32 i = 0; i < Benchmark.Spawned.Num(); i++)
+	{
+		AParkourShooterCharacter* Character = Benchmark.Spawned[i].Get();
+		if (Character == nullptr)
+			continue;
+
+		Character->SetActorLocation(Benchmark.SpawnLocations[i], false, nullptr, ETeleportType::TeleportPhysics);
+		Character->GetCharacterMovement()->Velocity = FVector::ZeroVector;
+		Character->GetCharacterMovement()->SetMovementMode(MOVE_Falling);
+	}
+}
+
+void UParkourTickManager::FinishBenchmark()
+{
+	using namespace ParkourTickManager;
+
+	UE_LOG(LogParkour, Display, TEXT("Parkour.TickBench results, %d characters:"), Benchmark.Spawned.Num());
+	LogDistribution(TEXT("Game thread, per actor ticks"), Benchmark.GameThreadMs[0]);
+	LogDistribution(TEXT("Game thread, batched update"), Benchmark.GameThreadMs[1]);
+	LogDistribution(TEXT("Batched update alone"), Benchmark.UpdateMs);
+
+	for (const TWeakObjectPtr<AParkourShooterCharacter>& Character : Benchmark.Spawned)
+	{
+		if (!Character.IsValid())
+			continue;
+
+		if (AController* Controller = Character->GetController())
+			Controller->Destroy();
+
+		Character->Destroy();
+	}
+
+	bool bQuit = Benchmark.bQuitWhenDone;
+	bool bPreviousBatching = Benchmark.bPreviousBatching;
+	Benchmark = FBenchmark();
+
+	SetBatching(bPreviousBatching);
+	RefreshTickFunction();
+
+	if (bQuit)
+		FPlatformMisc::RequestExit(false);
+}
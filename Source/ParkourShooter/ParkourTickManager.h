@@ -0,0 +1,149 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/EngineBaseTypes.h"
+#include "ParkourTickManager.generated.h"
+
+class AParkourShooterCharacter;
+class UCharacterMovementComponent;
+class UGraplingHookComponent;
+class UParkourTickManager;
+
+/** The single tick function running the parkour update of every registered character */
+struct FParkourBatchedTickFunction : public FTickFunction
+{
+	UParkourTickManager* Manager = nullptr;
+
+	FParkourBatchedTickFunction()
+	{
+		// AddPrerequisite ignores targets that can't tick, and characters can register before we do
+		bCanEverTick = true;
+		bStartWithTickEnabled = false;
+		TickGroup = TG_PrePhysics;
+	}
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+/**
+ * Updates every parkour character from a single tick function instead of letting each one tick its actor and
+ * grapple on its own. Characters register on BeginPlay, and their per frame work runs ability by ability: the
+ * air speed clamp for everyone, standing up for the ones crouching or sliding, then the grapple checks for the
+ * ones with the hook out. It runs before physics and before the movement of every character, like their own
+ * ticks did. Movement itself, wallrun included, still runs in each movement component's fixed steps.
+ *
+ *   Parkour.TickBench [Count=500] [Frames=300] [Quit] compares both ways of ticking with Count characters
+ */
+UCLASS(config=Game)
+class PARKOURSHOOTER_API UParkourTickManager : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Deinitialize() override;
+
+	/// <summary>
+	/// Start updating the given character, from now on its own tick is off while we're batching
+	/// </summary>
+	void RegisterCharacter(AParkourShooterCharacter* Character);
+
+	void UnregisterCharacter(AParkourShooterCharacter* Character);
+
+	/// <summary>
+	/// Switch between the batched update and letting every character tick on its own
+	/// </summary>
+	void SetBatching(bool bEnabled);
+
+	bool IsBatching() const { return bBatchTicks; }
+
+	int32 GetNumCharacters() const { return Characters.Num(); }
+
+	/// <summary>
+	/// Run this frame's parkour update of every registered character
+	/// </summary>
+	void TickCharacters(float DeltaTime);
+
+	/// <summary>
+	/// Console command: spawn characters and compare a frame with per actor ticks and with the batched update
+	/// </summary>
+	static void RunBenchmark(const TArray<FString>& Args, UWorld* World);
+
+protected:
+
+	/** Update every parkour character from a single tick function. Set it off to let each one tick on its own */
+	UPROPERTY(config)
+	bool bBatchTicks = true;
+
+	/// <summary>
+	/// Turn a character's own ticks on or off, depending on if we're updating it
+	/// </summary>
+	void ApplyTickMode(int32 Index);
+
+	/// <summary>
+	/// Register our tick function if we didn't yet, and only let it run when there's something to do
+	/// </summary>
+	void RefreshTickFunction();
+
+	// Registered characters and the components we use every frame, one array each and all of them the same size
+	UPROPERTY()
+	TArray<AParkourShooterCharacter*> Characters;
+
+	UPROPERTY()
+	TArray<UCharacterMovementComponent*> Movements;
+
+	UPROPERTY()
+	TArray<UGraplingHookComponent*> Grapples;
+
+	// Characters each pass has to look at this frame, rebuilt every frame to avoid checking everyone twice
+	TArray<int32> StandUpIndices;
+	TArray<int32> CrouchIndices;
+	TArray<int32> GrappleIndices;
+
+	FParkourBatchedTickFunction TickFunction;
+
+	// -- < Benchmark > -------------------------------------------------------------------
+
+	struct FBenchmark
+	{
+		bool bRunning = false;
+		bool bQuitWhenDone = false;
+		int32 FramesPerPhase = 0;
+		int32 Frame = 0;
+
+		// 0 ticks every character on its own, 1 runs the batched update
+		int32 Phase = 0;
+		bool bPreviousBatching = true;
+
+		TArray<TWeakObjectPtr<AParkourShooterCharacter>> Spawned;
+		TArray<FVector> SpawnLocations;
+
+		TArray<float> GameThreadMs[2];
+
+		// Batched update only, per actor ticks are spread all over the frame
+		TArray<float> UpdateMs;
+	};
+
+	FBenchmark Benchmark;
+
+	// Time the last TickCharacters took, in seconds
+	double LastUpdateSeconds = 0;
+
+	/// <summary>
+	/// Called every frame while the benchmark runs, records the last frame and moves to the next phase when it's time
+	/// </summary>
+	void UpdateBenchmark();
+
+	/// <summary>
+	/// Put every spawned character back where it started, so both phases do the same work
+	/// </summary>
+	void ResetBenchmarkCharacters();
+
+	void FinishBenchmark();
+
+	// -- < End Benchmark > ---------------------------------------------------------------
+};
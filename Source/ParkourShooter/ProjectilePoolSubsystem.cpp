@@ -0,0 +1,165 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ProjectilePoolSubsystem.h"
+#include "ParkourShooter.h"
+#include "ParkourShooterProjectile.h"
+#include "Engine/World.h"
+
+void UProjectilePoolSubsystem::Deinitialize()
+{
+	// Report how many projectiles we actually needed, so the initial size can be tuned
+	for (const TPair<UClass*, FProjectilePool>& Entry : Pools)
+	{
+		UE_LOG(LogParkour, Log, TEXT("Projectile pool for %s: %d projectiles, high-water mark %d"),
+			*GetNameSafe(Entry.Key), Entry.Value.All.Num(), Entry.Value.HighWaterMark);
+	}
+
+	Pools.Empty();
+	Super::Deinitialize();
+}
+
+void UProjectilePoolSubsystem::Prewarm(TSubclassOf<AParkourShooterProjectile> ProjectileClass, int32 Count)
+{
+	if (!IsValid(ProjectileClass))
+		return;
+
+	if (Count < 0)
+		Count = InitialPoolSize;
+
+	FProjectilePool& Pool = Pools.FindOrAdd(ProjectileClass);
+	Grow(Pool, ProjectileClass, Count - Pool.All.Num());
+}
+
+AParkourShooterProjectile* UProjectilePoolSubsystem::Acquire(
+	TSubclassOf<AParkourShooterProjectile> ProjectileClass,
+	const FVector& Location,
+	const FRotator& Rotation,
+	ESpawnActorCollisionHandlingMethod CollisionHandling)
+{
+	if (!IsValid(ProjectileClass))
+		return nullptr;
+
+	FProjectilePool& Pool = Pools.FindOrAdd(ProjectileClass);
+
+	// Something destroyed behind our back never gets fired again
+	AParkourShooterProjectile* Projectile = nullptr;
+	while (Projectile == nullptr && Pool.Available.Num() > 0)
+	{
+		Projectile = Pool.Available.Pop(false);
+		if (!IsValid(Projectile))
+		{
+			Pool.All.RemoveSwap(Projectile, false);
+			Projectile = nullptr;
+		}
+	}
+
+	// Ran dry, we need more projectiles than we thought
+	if (Projectile == nullptr)
+	{
+		Grow(Pool, ProjectileClass, FMath::Max(GrowthSize, 1));
+		UE_LOG(LogParkour, Warning, TEXT("Projectile pool for %s ran dry, grown to %d"), *GetNameSafe(ProjectileClass), Pool.All.Num());
+
+		if (Pool.Available.Num() == 0)
+			return nullptr;
+
+		Projectile = Pool.Available.Pop(false);
+	}
+
+	// Same as spawning, try to move it out of whatever it would start inside of
+	FVector FinalLocation = Location;
+	switch (CollisionHandling)
+	{
+	case ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn:
+	case ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding:
+		Projectile->SetActorEnableCollision(true);
+		if (!GetWorld()->FindTeleportSpot(Projectile, FinalLocation, Rotation) &&
+			CollisionHandling == ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding)
+		{
+			Projectile->SetActorEnableCollision(false);
+			Pool.Available.Push(Projectile);
+			return nullptr;
+		}
+		break;
+	default:
+		break;
+	}
+
+	Projectile->ActivateProjectile(FinalLocation, Rotation);
+
+	Pool.NumInUse++;
+	Pool.HighWaterMark = FMath::Max(Pool.HighWaterMark, Pool.NumInUse);
+
+	return Projectile;
+}
+
+void UProjectilePoolSubsystem::Release(AParkourShooterProjectile* Projectile)
+{
+	if (Projectile == nullptr || !Projectile->IsInFlight())
+		return;
+
+	Projectile->DeactivateProjectile();
+
+	FProjectilePool* Pool = Pools.Find(Projectile->GetClass());
+	if (Pool == nullptr)
+		return;
+
+	Pool->Available.Push(Projectile);
+	Pool->NumInUse--;
+}
+
+void UProjectilePoolSubsystem::Remove(AParkourShooterProjectile* Projectile)
+{
+	if (Projectile == nullptr)
+		return;
+
+	FProjectilePool* Pool = Pools.Find(Projectile->GetClass());
+	if (Pool == nullptr || Pool->All.RemoveSwap(Projectile, false) == 0)
+		return;
+
+	if (Projectile->IsInFlight())
+		Pool->NumInUse--;
+	else
+		Pool->Available.RemoveSwap(Projectile, false);
+}
+
+int32 UProjectilePoolSubsystem::GetHighWaterMark(TSubclassOf<AParkourShooterProjectile> ProjectileClass) const
+{
+	const FProjectilePool* Pool = Pools.Find(ProjectileClass);
+	return Pool != nullptr ? Pool->HighWaterMark : 0;
+}
+
+int32 UProjectilePoolSubsystem::GetPoolSize(TSubclassOf<AParkourShooterProjectile> ProjectileClass) const
+{
+	const FProjectilePool* Pool = Pools.Find(ProjectileClass);
+	return Pool != nullptr ? Pool->All.Num() : 0;
+}
+
+void UProjectilePoolSubsystem::Grow(FProjectilePool& Pool, TSubclassOf<AParkourShooterProjectile> ProjectileClass, int32 Count)
+{
+	UWorld* World = GetWorld();
+	if (World == nullptr || Count <= 0)
+		return;
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	Pool.All.Reserve(Pool.All.Num() + Count);
+	Pool.Available.Reserve(Pool.Available.Num() + Count);
+
+	for (int32 i = 0; i < Count; i++)
+	{
+		AParkourShooterProjectile* Projectile = World->SpawnActor<AParkourShooterProjectile>(ProjectileClass, FVector::ZeroVector, FRotator::ZeroRotator, SpawnParams);
+		if (Projectile == nullptr)
+		{
+			UE_LOG(LogParkour, Error, TEXT("Could not spawn projectile for pool of %s"), *GetNameSafe(ProjectileClass));
+			return;
+		}
+
+		// Spawned projectiles start flying right away, park them until someone fires them
+		Projectile->bPooled = true;
+		Projectile->DeactivateProjectile();
+
+		Pool.All.Add(Projectile);
+		Pool.Available.Add(Projectile);
+	}
+}
@@ -0,0 +1,105 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/EngineTypes.h"
+#include "ProjectilePoolSubsystem.generated.h"
+
+class AParkourShooterProjectile;
+
+/** Projectiles of a single class, either waiting to be fired or in flight */
+USTRUCT()
+struct FProjectilePool
+{
+	GENERATED_BODY()
+
+	/** Projectiles ready to be fired again */
+	UPROPERTY()
+	TArray<AParkourShooterProjectile*> Available;
+
+	/** Every projectile this pool owns, fired or not */
+	UPROPERTY()
+	TArray<AParkourShooterProjectile*> All;
+
+	int32 NumInUse = 0;
+
+	/** Max amount of projectiles in flight at the same time */
+	int32 HighWaterMark = 0;
+};
+
+/**
+ * Keeps projectiles alive between shots so firing doesn't spawn and destroy actors all the time.
+ * Projectiles go back to the pool when they hit something or their lifespan expires, and the pool
+ * grows on its own if we ever run out of them.
+ */
+UCLASS(config=Game)
+class PARKOURSHOOTER_API UProjectilePoolSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Deinitialize() override;
+
+	/// <summary>
+	/// Create projectiles of the given class ahead of time so the first shots don't have to
+	/// </summary>
+	/// <param name="ProjectileClass"> Class of projectiles to create </param>
+	/// <param name="Count"> How many projectiles should be ready, uses the configured initial size if negative </param>
+	void Prewarm(TSubclassOf<AParkourShooterProjectile> ProjectileClass, int32 Count = -1);
+
+	/// <summary>
+	/// Fire a projectile from the pool, growing the pool if there's none available
+	/// </summary>
+	/// <param name="ProjectileClass"> Class of projectile to fire </param>
+	/// <param name="Location"> Where to fire it from </param>
+	/// <param name="Rotation"> Direction to fire it to </param>
+	/// <param name="CollisionHandling"> What to do if the projectile would start inside something, like when spawning </param>
+	/// <returns> Fired projectile, nullptr if it couldn't be placed </returns>
+	AParkourShooterProjectile* Acquire(
+		TSubclassOf<AParkourShooterProjectile> ProjectileClass,
+		const FVector& Location,
+		const FRotator& Rotation,
+		ESpawnActorCollisionHandlingMethod CollisionHandling = ESpawnActorCollisionHandlingMethod::AlwaysSpawn
+	);
+
+	/// <summary>
+	/// Return a projectile to its pool. Does nothing if it's already there
+	/// </summary>
+	void Release(AParkourShooterProjectile* Projectile);
+
+	/// <summary>
+	/// Forget about a projectile that's going away, fired or not
+	/// </summary>
+	void Remove(AParkourShooterProjectile* Projectile);
+
+	/// <summary>
+	/// Max amount of projectiles of this class that were in flight at the same time
+	/// </summary>
+	int32 GetHighWaterMark(TSubclassOf<AParkourShooterProjectile> ProjectileClass) const;
+
+	/// <summary>
+	/// How many projectiles of this class the pool owns
+	/// </summary>
+	int32 GetPoolSize(TSubclassOf<AParkourShooterProjectile> ProjectileClass) const;
+
+protected:
+
+	/** How many projectiles to create when prewarming a class */
+	UPROPERTY(config)
+	int32 InitialPoolSize = 32;
+
+	/** How many projectiles to add when a pool runs out */
+	UPROPERTY(config)
+	int32 GrowthSize = 8;
+
+	/// <summary>
+	/// Spawn new projectiles into a pool, all of them inactive
+	/// </summary>
+	void Grow(FProjectilePool& Pool, TSubclassOf<AParkourShooterProjectile> ProjectileClass, int32 Count);
+
+	UPROPERTY()
+	TMap<UClass*, FProjectilePool> Pools;
+};
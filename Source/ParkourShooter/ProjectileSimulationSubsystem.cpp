@@ -0,0 +1,373 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ProjectileSimulationSubsystem.h"
+#include "ParkourShooter.h"
+#include "ParkourStats.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Async/ParallelFor.h"
+#include "Math/VectorRegister.h"
+
+static FAutoConsoleCommandWithWorldAndArgs BulletBenchCommand(
+	TEXT("Parkour.BulletBench"),
+	TEXT("Simulate bulk projectiles and print the cost per frame. Usage: Parkour.BulletBench [Count=10000] [Frames=300]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&UProjectileSimulationSubsystem::RunBenchmark)
+);
+
+void UProjectileSimulationSubsystem::Deinitialize()
+{
+	// The render actor goes away with the world, don't touch it while it's torn down
+	RenderComponent = nullptr;
+	VisibleInstances = 0;
+	Clear();
+	Super::Deinitialize();
+}
+
+void UProjectileSimulationSubsystem::Tick(float DeltaTime)
+{
+	Simulate(DeltaTime);
+}
+
+bool UProjectileSimulationSubsystem::IsTickable() const
+{
+	return GetNumBullets() > 0;
+}
+
+ETickableTickType UProjectileSimulationSubsystem::GetTickableTickType() const
+{
+	// The class default object must never tick
+	return HasAnyFlags(RF_ClassDefaultObject) ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+TStatId UProjectileSimulationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UProjectileSimulationSubsystem, STATGROUP_Tickables);
+}
+
+void UProjectileSimulationSubsystem::Fire(const FVector& Location, const FVector& Velocity, AActor* Owner, float LifeSpan)
+{
+	PositionX.Add(Location.X);
+	PositionY.Add(Location.Y);
+	PositionZ.Add(Location.Z);
+	VelocityX.Add(Velocity.X);
+	VelocityY.Add(Velocity.Y);
+	VelocityZ.Add(Velocity.Z);
+	RemainingLife.Add(LifeSpan);
+	Owners.Add(Owner);
+}
+
+void UProjectileSimulationSubsystem::Simulate(float DeltaTime)
+{
+	if (DeltaTime <= 0)
+		return;
+
+	double Start = FPlatformTime::Seconds();
+	Integrate(DeltaTime);
+
+	double AfterIntegrate = FPlatformTime::Seconds();
+	Sweep();
+
+	double AfterSweep = FPlatformTime::Seconds();
+	Resolve();
+
+	double AfterResolve = FPlatformTime::Seconds();
+	UpdateRender();
+
+	double End = FPlatformTime::Seconds();
+
+	LastTimings.Integrate = AfterIntegrate - Start;
+	LastTimings.Sweep = AfterSweep - AfterIntegrate;
+	LastTimings.Resolve = AfterResolve - AfterSweep;
+	LastTimings.Render = End - AfterResolve;
+}
+
+void UProjectileSimulationSubsystem::Clear()
+{
+	PositionX.Reset();
+	PositionY.Reset();
+	PositionZ.Reset();
+	VelocityX.Reset();
+	VelocityY.Reset();
+	VelocityZ.Reset();
+	RemainingLife.Reset();
+	Owners.Reset();
+
+	UpdateRender();
+}
+
+void UProjectileSimulationSubsystem::Integrate(float DeltaTime)
+{
+	const int32 Num = GetNumBullets();
+
+	// Remember where every bullet was, the sweeps go from there to the new position
+	SweepStart.SetNumUninitialized(Num, false);
+	for (int32 i = 0; i < Num; i++)
+		SweepStart[i] = FVector(PositionX[i], PositionY[i], PositionZ[i]);
+
+	float* PX = PositionX.GetData();
+	float* PY = PositionY.GetData();
+	float* PZ = PositionZ.GetData();
+	float* VX = VelocityX.GetData();
+	float* VY = VelocityY.GetData();
+	float* VZ = VelocityZ.GetData();
+	float* Life = RemainingLife.GetData();
+
+	const float GravityStep = GetWorld()->GetGravityZ() * DeltaTime;
+
+	// Four bullets at a time
+	const VectorRegister VDeltaTime = VectorSetFloat1(DeltaTime);
+	const VectorRegister VGravityStep = VectorSetFloat1(GravityStep);
+
+	int32 i = 0;
+	for (; i + 4 <= Num; i += 4)
+	{
+		const VectorRegister NewVZ = VectorAdd(VectorLoad(VZ + i), VGravityStep);
+		VectorStore(NewVZ, VZ + i);
+
+		VectorStore(VectorMultiplyAdd(VectorLoad(VX + i), VDeltaTime, VectorLoad(PX + i)), PX + i);
+		VectorStore(VectorMultiplyAdd(VectorLoad(VY + i), VDeltaTime, VectorLoad(PY + i)), PY + i);
+		VectorStore(VectorMultiplyAdd(NewVZ, VDeltaTime, VectorLoad(PZ + i)), PZ + i);
+		VectorStore(VectorSubtract(VectorLoad(Life + i), VDeltaTime), Life + i);
+	}
+
+	// And the ones left
+	for (; i < Num; i++)
+	{
+		VZ[i] += GravityStep;
+		PX[i] += VX[i] * DeltaTime;
+		PY[i] += VY[i] * DeltaTime;
+		PZ[i] += VZ[i] * DeltaTime;
+		Life[i] -= DeltaTime;
+	}
+}
+
+void UProjectileSimulationSubsystem::Sweep()
+{
+	const int32 Num = GetNumBullets();
+	UWorld* World = GetWorld();
+
+	SweepHits.SetNum(Num, false);
+	SweepHitSomething.SetNumUninitialized(Num, false);
+
+	// Resolve owners here, weak pointers are not meant to be read from worker threads
+	SweepIgnore.SetNumUninitialized(Num, false);
+	for (int32 i = 0; i < Num; i++)
+		SweepIgnore[i] = Owners[i].Get();
+
+	const FCollisionShape Shape = FCollisionShape::MakeSphere(BulletRadius);
+
+	// Scene queries only read the physics scene, so they can run in parallel like the async traces do
+	ParallelFor(Num, [&](int32 Index)
+	{
+		FCollisionQueryParams Params(SCENE_QUERY_STAT(BulkProjectileSweep), false, SweepIgnore[Index]);
+		const FVector End(PositionX[Index], PositionY[Index], PositionZ[Index]);
+
+		SweepHitSomething[Index] = World->SweepSingleByProfile(
+			SweepHits[Index],
+			SweepStart[Index],
+			End,
+			FQuat::Identity,
+			CollisionProfile,
+			Shape,
+			Params
+		);
+	}, !bParallelSweeps);
+}
+
+void UProjectileSimulationSubsystem::Resolve()
+{
+	// Backwards, so removing a bullet only swaps in one we already visited
+	for (int32 i = GetNumBullets() - 1; i >= 0; i--)
+	{
+		if (RemainingLife[i] <= 0)
+		{
+			RemoveBullet(i);
+			continue;
+		}
+
+		if (!SweepHitSomething[i])
+			continue;
+
+		const FHitResult& Hit = SweepHits[i];
+		FVector Velocity(VelocityX[i], VelocityY[i], VelocityZ[i]);
+
+		// Same as the projectile actor: push physics objects and die
+		UPrimitiveComponent* OtherComp = Hit.GetComponent();
+		if (Hit.GetActor() != nullptr && OtherComp != nullptr && OtherComp->IsSimulatingPhysics())
+		{
+			OtherComp->AddImpulseAtLocation(Velocity * 100.0f, Hit.Location);
+			RemoveBullet(i);
+			continue;
+		}
+
+		// Otherwise bounce, losing some speed along the normal and some along the surface
+		const FVector Normal = Hit.Normal;
+		const FVector NormalVelocity = FVector::DotProduct(Velocity, Normal) * Normal;
+		const FVector TangentVelocity = Velocity - NormalVelocity;
+		Velocity = TangentVelocity * (1.f - Friction) - NormalVelocity * Bounciness;
+
+		if (Velocity.SizeSquared() < MinBounceSpeed * MinBounceSpeed)
+		{
+			RemoveBullet(i);
+			continue;
+		}
+
+		// Stay where we hit, pushed out of the surface if we started inside it
+		FVector Location = Hit.Location;
+		if (Hit.bStartPenetrating)
+			Location += Normal * (Hit.PenetrationDepth + 0.1f);
+
+		PositionX[i] = Location.X;
+		PositionY[i] = Location.Y;
+		PositionZ[i] = Location.Z;
+		VelocityX[i] = Velocity.X;
+		VelocityY[i] = Velocity.Y;
+		VelocityZ[i] = Velocity.Z;
+	}
+}
+
+void UProjectileSimulationSubsystem::UpdateRender()
+{
+	UWorld* World = GetWorld();
+
+	// Create the instanced mesh the first time we need it, if we have something to draw
+	if (!bRenderInitialized && GetNumBullets() > 0)
+	{
+		bRenderInitialized = true;
+
+		UStaticMesh* Mesh = Cast<UStaticMesh>(BulletMesh.TryLoad());
+		if (Mesh != nullptr && World != nullptr && World->IsGameWorld() && FApp::CanEverRender())
+		{
+			FActorSpawnParameters SpawnParams;
+			SpawnParams.ObjectFlags |= RF_Transient;
+			AActor* RenderActor = World->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, SpawnParams);
+
+			if (RenderActor != nullptr)
+			{
+				RenderComponent = NewObject<UInstancedStaticMeshComponent>(RenderActor, TEXT("BulletInstances"));
+				RenderComponent->SetMobility(EComponentMobility::Movable);
+				RenderComponent->SetStaticMesh(Mesh);
+				RenderComponent->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+				RenderComponent->SetCastShadow(false);
+				RenderActor->SetRootComponent(RenderComponent);
+				RenderComponent->RegisterComponent();
+
+				GrowRenderInstances(InitialRenderInstances);
+			}
+		}
+	}
+
+	if (RenderComponent == nullptr)
+		return;
+
+	const int32 Num = GetNumBullets();
+
+	// Instances are never removed, adding or removing them one by one dirties the component every time and a burst
+	// of bullets would spike the frame. We keep as many as we ever needed and hide the ones we don't need now
+	if (RenderComponent->GetInstanceCount() < Num)
+		GrowRenderInstances(FMath::Max(Num, 2 * RenderComponent->GetInstanceCount()));
+
+	// Instances that showed a bullet last time and don't anymore get hidden, the rest were hidden already
+	const int32 NumToUpdate = FMath::Max(Num, VisibleInstances);
+	if (NumToUpdate == 0)
+		return;
+
+	InstanceTransforms.SetNumUninitialized(NumToUpdate, false);
+	const FVector Scale(BulletMeshScale);
+	for (int32 i = 0; i < Num; i++)
+		InstanceTransforms[i] = FTransform(FQuat::Identity, FVector(PositionX[i], PositionY[i], PositionZ[i]), Scale);
+
+	for (int32 i = Num; i < NumToUpdate; i++)
+		InstanceTransforms[i] = FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+
+	RenderComponent->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true, true);
+	VisibleInstances = Num;
+}
+
+void UProjectileSimulationSubsystem::GrowRenderInstances(int32 NumInstances)
+{
+	// Hidden until a bullet needs them, the render state is rebuilt once at the end of the frame
+	const FTransform Hidden(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+	RenderComponent->PerInstanceSMData.Reserve(NumInstances);
+	while (RenderComponent->GetInstanceCount() < NumInstances)
+		RenderComponent->AddInstance(Hidden);
+}
+
+void UProjectileSimulationSubsystem::RemoveBullet(int32 Index)
+{
+	PositionX.RemoveAtSwap(Index, 1, false);
+	PositionY.RemoveAtSwap(Index, 1, false);
+	PositionZ.RemoveAtSwap(Index, 1, false);
+	VelocityX.RemoveAtSwap(Index, 1, false);
+	VelocityY.RemoveAtSwap(Index, 1, false);
+	VelocityZ.RemoveAtSwap(Index, 1, false);
+	RemainingLife.RemoveAtSwap(Index, 1, false);
+	Owners.RemoveAtSwap(Index, 1, false);
+
+	// Scratch data has to follow, Resolve keeps reading it after a removal
+	SweepHits.RemoveAtSwap(Index, 1, false);
+	SweepHitSomething.RemoveAtSwap(Index, 1, false);
+}
+
+void UProjectileSimulationSubsystem::RunBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	UProjectileSimulationSubsystem* Simulation = World != nullptr ? World->GetSubsystem<UProjectileSimulationSubsystem>() : nullptr;
+	if (Simulation == nullptr)
+	{
+		UE_LOG(LogParkour, Error, TEXT("Parkour.BulletBench needs a game world"));
+		return;
+	}
+
+	int32 Count = 10000;
+	int32 Frames = 300;
+
+	for (const FString& Arg : Args)
+	{
+		FParse::Value(*Arg, TEXT("Count="), Count);
+		FParse::Value(*Arg, TEXT("Frames="), Frames);
+	}
+
+	Count = FMath::Max(Count, 0);
+	Frames = FMath::Max(Frames, 1);
+	const float DeltaTime = 1.f / 60.f;
+
+	// High above the level, so we measure the simulation and not how much geometry happens to be around.
+	// Life is long enough for every bullet to survive the whole run
+	Simulation->Clear();
+	FRandomStream Random(1234);
+	for (int32 i = 0; i < Count; i++)
+	{
+		FVector Location = FVector(0, 0, 50000) + Random.GetUnitVector() * Random.FRandRange(0, 5000);
+		Simulation->Fire(Location, Random.GetUnitVector() * 3000, nullptr, 1000000);
+	}
+
+	// Milliseconds of every frame, by stage
+	TArray<float> TotalMs;
+	TArray<float> IntegrateMs;
+	TArray<float> SweepMs;
+	TArray<float> ResolveMs;
+	TArray<float> RenderMs;
+	for (int32 Frame = 0; Frame < Frames; Frame++)
+	{
+		Simulation->Simulate(DeltaTime);
+
+		const FSimulationTimings& Timings = Simulation->GetLastTimings();
+		IntegrateMs.Add(Timings.Integrate * 1000.0);
+		SweepMs.Add(Timings.Sweep * 1000.0);
+		ResolveMs.Add(Timings.Resolve * 1000.0);
+		RenderMs.Add(Timings.Render * 1000.0);
+		TotalMs.Add((Timings.Integrate + Timings.Sweep + Timings.Resolve + Timings.Render) * 1000.0);
+	}
+
+	UE_LOG(LogParkour, Display, TEXT("Parkour.BulletBench: %d bullets (%d alive at the end), %d frames"), Count, Simulation->GetNumBullets(), Frames);
+	UE_LOG(LogParkour, Display, TEXT("  Total ms:     %s"), *FParkourSampleStats::Compute(TotalMs).ToString());
+	UE_LOG(LogParkour, Display, TEXT("  Integrate ms: %s"), *FParkourSampleStats::Compute(IntegrateMs).ToString());
+	UE_LOG(LogParkour, Display, TEXT("  Sweep ms:     %s"), *FParkourSampleStats::Compute(SweepMs).ToString());
+	UE_LOG(LogParkour, Display, TEXT("  Resolve ms:   %s"), *FParkourSampleStats::Compute(ResolveMs).ToString());
+	UE_LOG(LogParkour, Display, TEXT("  Render ms:    %s"), *FParkourSampleStats::Compute(RenderMs).ToString());
+
+	Simulation->Clear();
+}
@@ -0,0 +1,152 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "ProjectileSimulationSubsystem.generated.h"
+
+class UInstancedStaticMeshComponent;
+class UStaticMesh;
+
+/**
+ * Simulates lots of bullets without an actor per bullet. Bullets live in plain arrays, one per
+ * attribute, get integrated four at a time and collide through sweeps issued in a single batch.
+ * They behave like AParkourShooterProjectile: they bounce on static geometry, push physics objects
+ * and die when they run out of life. All of them are drawn by a single instanced mesh.
+ */
+UCLASS(config=Game)
+class PARKOURSHOOTER_API UProjectileSimulationSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	/// <summary>
+	/// Fire a new bullet
+	/// </summary>
+	/// <param name="Location"> Where the bullet starts </param>
+	/// <param name="Velocity"> Initial velocity </param>
+	/// <param name="Owner"> Actor firing it, bullets don't collide with their owner </param>
+	/// <param name="LifeSpan"> Seconds until the bullet dies on its own </param>
+	void Fire(const FVector& Location, const FVector& Velocity, AActor* Owner, float LifeSpan);
+
+	/// <summary>
+	/// Advance every bullet DeltaTime seconds: integrate, sweep, resolve hits and update the instanced mesh
+	/// </summary>
+	void Simulate(float DeltaTime);
+
+	/// <summary>
+	/// Kill every bullet
+	/// </summary>
+	void Clear();
+
+	int32 GetNumBullets() const { return PositionX.Num(); }
+
+	/** Time in seconds spent in each step of the last simulation */
+	struct FSimulationTimings
+	{
+		double Integrate = 0;
+		double Sweep = 0;
+		double Resolve = 0;
+		double Render = 0;
+	};
+
+	const FSimulationTimings& GetLastTimings() const { return LastTimings; }
+
+	/// <summary>
+	/// Console command: fill the simulation with bullets and print how long a frame takes
+	/// </summary>
+	static void RunBenchmark(const TArray<FString>& Args, UWorld* World);
+
+protected:
+
+	/** Radius of the sphere swept for every bullet */
+	UPROPERTY(config)
+	float BulletRadius = 5;
+
+	/** Collision profile used by the sweeps, same as the projectile actor */
+	UPROPERTY(config)
+	FName CollisionProfile = TEXT("Projectile");
+
+	/** How much speed is kept after bouncing, along the surface normal */
+	UPROPERTY(config)
+	float Bounciness = 0.6f;
+
+	/** How much speed is lost after bouncing, along the surface */
+	UPROPERTY(config)
+	float Friction = 0.2f;
+
+	/** Bullets slower than this after a bounce stop and die */
+	UPROPERTY(config)
+	float MinBounceSpeed = 10;
+
+	/** Issue the sweeps from worker threads */
+	UPROPERTY(config)
+	bool bParallelSweeps = true;
+
+	/** Mesh to draw every bullet with, nothing is drawn if empty */
+	UPROPERTY(config)
+	FSoftObjectPath BulletMesh;
+
+	UPROPERTY(config)
+	float BulletMeshScale = 0.06f;
+
+	/** Instances created with the render component, so the first shots don't have to add any */
+	UPROPERTY(config)
+	int32 InitialRenderInstances = 256;
+
+	void Integrate(float DeltaTime);
+	void Sweep();
+	void Resolve();
+	void UpdateRender();
+
+	/// <summary>
+	/// Add hidden instances to the render component until it has the given number
+	/// </summary>
+	void GrowRenderInstances(int32 NumInstances);
+
+	/// <summary>
+	/// Remove a bullet by swapping the last one into its place
+	/// </summary>
+	void RemoveBullet(int32 Index);
+
+	// Bullet attributes, one array each and all of them the same size
+	TArray<float> PositionX;
+	TArray<float> PositionY;
+	TArray<float> PositionZ;
+	TArray<float> VelocityX;
+	TArray<float> VelocityY;
+	TArray<float> VelocityZ;
+	TArray<float> RemainingLife;
+	TArray<TWeakObjectPtr<AActor>> Owners;
+
+	// Scratch data for a single simulation step, kept around to avoid allocating every frame
+	TArray<FVector> SweepStart;
+	TArray<const AActor*> SweepIgnore;
+	TArray<FHitResult> SweepHits;
+	TArray<uint8> SweepHitSomething;
+	TArray<FTransform> InstanceTransforms;
+
+	// Instances showing a bullet after the last render update, the ones after it are hidden
+	int32 VisibleInstances = 0;
+
+	FSimulationTimings LastTimings;
+
+	UPROPERTY()
+	UInstancedStaticMeshComponent* RenderComponent = nullptr;
+
+	// If we already tried to create the render component, so we don't try every shot when there's no mesh
+	bool bRenderInitialized = false;
+};
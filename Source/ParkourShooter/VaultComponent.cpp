@@ -1,21 +1,46 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
+#include "ParkourShooter.h"
 #include "ParkourShooterUtils.h"
 #include "ParkourShooterCharacter.h"
+#include "ParkourSensorComponent.h"
 #include "Blueprint/UserWidget.h"
 #include "GameFramework/PlayerController.h"
 #include "Components/CapsuleComponent.h"
-#include "GameFramework/CharacterMovementComponent.h"
+#include "ParkourMovementComponent.h"
+#include "ParkourStats.h"
+#include "ParkourSurfaceIndex.h"
 #include "VaultComponent.h"
 
 // Sets default values for this component's properties
 UVaultComponent::UVaultComponent()
 {
-	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
-	// off to improve performance if you don't need them.
+	// We only tick to update the vault suggestion, RefreshProbing turns it on when that can matter
 	PrimaryComponentTick.bCanEverTick = true;
-
-	// ...
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+
+	// Step up onto low ledges, hop over the middle ones and climb onto the high ones
+	FParkourVaultProfile StepUp;
+	StepUp.Name = TEXT("StepUp");
+	StepUp.MaxLedgeHeight = 80;
+	StepUp.Duration = 0.25f;
+	StepUp.LiftPortion = 0.4f;
+	VaultProfiles.Add(StepUp);
+
+	FParkourVaultProfile OverVault;
+	OverVault.Name = TEXT("OverVault");
+	OverVault.MaxLedgeHeight = 130;
+	OverVault.Duration = 0.45f;
+	OverVault.LiftPortion = 0.35f;
+	OverVault.ArcHeight = 30;
+	VaultProfiles.Add(OverVault);
+
+	FParkourVaultProfile Mantle;
+	Mantle.Name = TEXT("Mantle");
+	Mantle.MaxLedgeHeight = 170;
+	Mantle.Duration = 0.8f;
+	Mantle.LiftPortion = 0.6f;
+	VaultProfiles.Add(Mantle);
 }
 
 
@@ -24,9 +49,25 @@ void UVaultComponent::BeginPlay()
 {
 	Super::BeginPlay();
 	ShooterCharacter =  Cast<AParkourShooterCharacter>(GetOwner());
+	Sensor = GetOwner()->FindComponentByClass<UParkourSensorComponent>();
+	SurfaceIndex = GetWorld()->GetSubsystem<UParkourSurfaceSubsystem>();
+
+	// The movement runs the vault, on the server too, so it needs the profiles to follow
+	ShooterCharacter->GetParkourMovement()->SetVaultProfiles(VaultProfiles);
+
+	// Make sure the sensor already probed this frame by the time we ask
+	if (Sensor != nullptr)
+		AddTickPrerequisiteComponent(Sensor);
+
+	// Bind them once, every async probe reuses them
+	LedgeTraceDelegate.BindUObject(this, &UVaultComponent::OnLedgeTraceDone);
+	FitTraceDelegate.BindUObject(this, &UVaultComponent::OnFitTraceDone);
+
 	VaultSuggestionWidget = CreateWidget(Cast<APlayerController>(ShooterCharacter->GetController()), VaultSuggestionClass);
 	// if (VaultSuggestionWidget != nullptr)
 	// 	VaultSuggestionWidget->AddToViewport();
+
+	RefreshProbing();
 }
 
 UVaultComponent::VaultingState UVaultComponent::GetCurrentState() const
@@ -37,31 +78,118 @@ UVaultComponent::VaultingState UVaultComponent::GetCurrentState() const
 void UVaultComponent::SetVaultingState(VaultingState NewVaultState)
 {
 	CurrentState = NewVaultState;
+
+	// No one needs to know about ledges while we're already vaulting
+	RefreshProbing();
+}
+
+void UVaultComponent::RefreshProbing()
+{
+	if (ShooterCharacter == nullptr)
+		return;
+
+	// Vault on hold only works in the air. A jump on the ground still probes, just on demand
+	bool bProbeLedge = CurrentState == VaultingState::NotVaulting && ShooterCharacter->GetCharacterMovement()->IsFalling();
+
+	if (Sensor != nullptr)
+		Sensor->SetProbeEnabled(EParkourProbe::Ledge, bProbeLedge);
+
+	// The end of a vault comes from the movement mode change, our tick is only for the suggestion
+	SetComponentTickEnabled(bProbeLedge && bShowVaultSuggestion && VaultSuggestionWidget != nullptr);
+
+	// Whatever we showed doesn't hold anymore
+	if (!bProbeLedge)
+		ModifyWidgetToViewport(false);
+}
+
+void UVaultComponent::OnOwnerMovementModeChanged()
+{
+	if (CurrentState == VaultingState::Vaulting)
+		UpdateVault(0);
+
+	RefreshProbing();
 }
 
 bool UVaultComponent::CanVault(FVector& OutFinalPosition) const
 {
+	PARKOUR_SCOPE_CYCLE_COUNTER(STAT_ParkourCanVault);
+
 	// If you're already vaulting, the you can't vault
 	if (CurrentState != VaultingState::NotVaulting)
 		return false;
 
+	// The sensor shares a single probe per frame between the widget, jump and vault on hold
+	if (Sensor != nullptr)
+		return Sensor->CanVault(OutFinalPosition);
+
+	return ProbeVault(OutFinalPosition, EParkourQueryPriority::Normal);
+}
+
+bool UVaultComponent::CanVaultNow(FVector& OutFinalPosition) const
+{
+	if (CurrentState != VaultingState::NotVaulting)
+		return false;
+
+	if (!bUseAsyncProbe)
+		return CanVault(OutFinalPosition);
+
+	// The probe we submitted a moment ago still describes where we are, no need to trace again
+	if (IsAsyncResultUsable())
+	{
+		AsyncResultHits++;
+		INC_DWORD_STAT(STAT_ParkourAsyncVaultHits);
+
+		if (AsyncResult.bCanVault)
+			OutFinalPosition = AsyncResult.FinalPosition;
+
+		return AsyncResult.bCanVault;
+	}
+
+	// Nothing recent enough, this time we have to block on the query. The player is vaulting right now, it can't wait
+	AsyncResultMisses++;
+	INC_DWORD_STAT(STAT_ParkourAsyncVaultMisses);
+	return ProbeVault(OutFinalPosition, EParkourQueryPriority::Critical);
+}
+
+void UVaultComponent::GetLedgeTraceSegment(FVector& OutStart, FVector& OutEnd) const
+{
 	UCapsuleComponent * Capsule = ShooterCharacter->GetCapsuleComponent();
 
 	// We want to cast a ray right in front of our character
 	// pointing to the ground, to check height of the object we would 
 	// want to jump over. 
-	FVector Start =
+	OutStart =
 		ShooterCharacter->GetActorLocation() +
 		ShooterCharacter->GetActorForwardVector() * DistanceFromPlayer + // How much to the front
 		ShooterCharacter->GetActorUpVector() * Capsule->GetScaledCapsuleHalfHeight();       // How much Upwards
 		 
 	// End is in the ground just in front of you
-	FVector End = Start - ShooterCharacter->GetActorUpVector() * Capsule->GetScaledCapsuleHalfHeight() * 2;
+	OutEnd = OutStart - ShooterCharacter->GetActorUpVector() * Capsule->GetScaledCapsuleHalfHeight() * 2;
+}
 
+bool UVaultComponent::ProbeVault(FVector& OutFinalPosition, EParkourQueryPriority Priority) const
+{
+	// Standing still in front of the same wall gives the same answer, no need to trace it again
+	bool bCachedCanVault;
+	if (ConsumeProbeCache(bCachedCanVault, OutFinalPosition))
+		return bCachedCanVault;
+
+	// Out of budget, the probe waits for its turn on a later frame
+	if (!UParkourQueryBudget::TryConsumeIn(GetWorld(), this, Priority, GetProbeCost()))
+	{
+		DeferredFrame = GFrameCounter;
+		return false;
+	}
+
+	FVector Start, End;
+	GetLedgeTraceSegment(Start, End);
+
+	// Static ledges come from the surface index if we have one, then the trace only has to find dynamic ones
+	BakedLedge Baked;
+	bool bUseIndex = FindBakedLedge(Start, End, Baked);
 
 	FHitResult Hit;
-	FCollisionQueryParams Params = FCollisionQueryParams::DefaultQueryParam;
-	Params.AddIgnoredActor(ShooterCharacter);
+	FCollisionQueryParams Params = GetProbeQueryParams(bUseIndex);
 	
 	// DEBUG ONLY, DELETE LATER  -------
 	// const FName MyTag("VaultTracing");
@@ -70,18 +198,33 @@ bool UVaultComponent::CanVault(FVector& OutFinalPosition) const
 	// ---------------------------------
 
 	// Check if there's something to grab to 
+	PARKOUR_COUNT_QUERY(Vault);
 	bool HitSomething = GetWorld()->LineTraceSingleByChannel(
 		Hit, 
 		Start, End, 
-		ECollisionChannel::ECC_Visibility, 
+		ECC_Parkour, 
 		Params
 	);
 
-	if (!HitSomething)
+	FVector Origin = ShooterCharacter->GetActorLocation();
+	FVector Forward = ShooterCharacter->GetActorForwardVector();
+
+	// The trace hits the highest surface, so the baked ledge wins if it's over whatever dynamic object we hit
+	bool bBakedLedge = Baked.bFound && (!HitSomething || Baked.Hit.Location.Z > Hit.Location.Z);
+	if (!HitSomething && !bBakedLedge)
+	{
+		StoreProbe(Origin, Forward, nullptr, false, FVector::ZeroVector);
 		return false;
+	}
+
+	const FHitResult& LedgeHit = bBakedLedge ? Baked.Hit : Hit;
+	bool bStaticChecked = false;
 
 	FVector FinalPosition;
-	if (!CanVaultToLocation(Hit, FinalPosition))
+	bool bCanVault = (!bBakedLedge || IsBakedClearanceEnough(Baked, bStaticChecked)) && CanVaultToLocation(LedgeHit, FinalPosition, bStaticChecked);
+	StoreProbe(Origin, Forward, &LedgeHit, bCanVault, FinalPosition);
+
+	if (!bCanVault)
 		return false;
 
 	OutFinalPosition = FinalPosition;
@@ -89,9 +232,121 @@ bool UVaultComponent::CanVault(FVector& OutFinalPosition) const
 	return true;
 }
 
-bool UVaultComponent::CanVaultToLocation(const FHitResult& Hit, FVector& OutFinalPosition) const
+bool UVaultComponent::IsProbeCacheValid() const
+{
+	if (!bUseProbeCache || !Cache.bValid || ShooterCharacter == nullptr)
+		return false;
+
+	if (GFrameCounter - Cache.Frame > static_cast<uint64>(ProbeCacheMaxFrames))
+		return false;
+
+	// Crouching changes where we trace from and the capsule we test with
+	if (Cache.CapsuleHalfHeight != ShooterCharacter->GetCapsuleComponent()->GetScaledCapsuleHalfHeight())
+		return false;
+
+	if (FVector::DistSquared(Cache.Origin, ShooterCharacter->GetActorLocation()) > ProbeCacheMaxDistance * ProbeCacheMaxDistance)
+		return false;
+
+	float MinCos = FMath::Cos(FMath::DegreesToRadians(ProbeCacheMaxAngle));
+	if (FVector::DotProduct(Cache.Forward, ShooterCharacter->GetActorForwardVector()) < MinCos)
+		return false;
+
+	// If what we hit moved (a platform, a door) or is gone, the ledge is not where we think it is
+	if (Cache.bHitLedge && !Cache.LedgeComponent.IsExplicitlyNull())
+	{
+		UPrimitiveComponent* LedgeComponent = Cache.LedgeComponent.Get();
+		if (LedgeComponent == nullptr || !LedgeComponent->GetComponentTransform().Equals(Cache.LedgeComponentTransform))
+			return false;
+	}
+
+	// Anything dynamic around that moved could be over the ledge, in our way or under the spot we missed
+	for (const WatchedComponent& Watched : Cache.Watched)
+	{
+		UPrimitiveComponent* Component = Watched.Component.Get();
+		if (Component == nullptr || !Component->GetComponentTransform().Equals(Watched.Transform))
+			return false;
+	}
+
+	return true;
+}
+
+void UVaultComponent::StoreProbe(const FVector& Origin, const FVector& Forward, const FHitResult* LedgeHit, bool bCanVault, const FVector& FinalPosition) const
 {
+	// Running we're past ProbeCacheMaxDistance by next frame, storing would only cost the watch query
+	UWorld* World = GetWorld();
+	Cache.bValid = bUseProbeCache && World != nullptr && ShooterCharacter->GetVelocity().Size() * World->GetDeltaSeconds() <= ProbeCacheMaxDistance;
+	if (!Cache.bValid)
+		return;
+
+	Cache.Origin = Origin;
+	Cache.Forward = Forward;
+	Cache.CapsuleHalfHeight = ShooterCharacter->GetCapsuleComponent()->GetScaledCapsuleHalfHeight();
+	Cache.Frame = GFrameCounter;
+
+	Cache.bHitLedge = LedgeHit != nullptr;
+	Cache.LedgeComponent = nullptr;
+	if (Cache.bHitLedge)
+	{
+		Cache.LedgeHit = *LedgeHit;
+		Cache.LedgeComponent = Cache.LedgeHit.Component;
+		if (Cache.LedgeComponent.IsValid())
+			Cache.LedgeComponentTransform = Cache.LedgeComponent->GetComponentTransform();
+	}
 
+	Cache.bCanVault = bCanVault;
+	Cache.FinalPosition = FinalPosition;
+
+	// Static geometry never changes the answer, only dynamic objects near enough to get in the way do
+	FBox Bounds = GetProbeBounds(Origin, Forward).ExpandBy(ProbeCacheWatchMargin);
+	FCollisionQueryParams Params = GetProbeQueryParams(true);
+	TArray<FOverlapResult> Overlaps;
+
+	PARKOUR_COUNT_QUERY(Vault);
+	World->OverlapMultiByChannel(Overlaps, Bounds.GetCenter(), FQuat::Identity, ECC_Parkour, FCollisionShape::MakeBox(Bounds.GetExtent()), Params);
+
+	Cache.Watched.Reset();
+	for (const FOverlapResult& Overlap : Overlaps)
+	{
+		UPrimitiveComponent* Component = Overlap.GetComponent();
+		if (Component != nullptr)
+			Cache.Watched.Add({ Component, Component->GetComponentTransform() });
+	}
+}
+
+FBox UVaultComponent::GetProbeBounds(const FVector& Origin, const FVector& Forward) const
+{
+	UCapsuleComponent* Capsule = ShooterCharacter->GetCapsuleComponent();
+	float Radius = Capsule->GetScaledCapsuleRadius();
+	float HalfHeight = Capsule->GetScaledCapsuleHalfHeight();
+
+	// The trace goes from a half height over us to a half height under us, the fit capsule sits on whatever it
+	// hits a radius up, see GetLedgeTraceSegment and GetFitTestLocation
+	FVector Column = Origin + Forward * DistanceFromPlayer;
+	FBox Bounds(Column - FVector(Radius, Radius, HalfHeight), Column + FVector(Radius, Radius, 3 * HalfHeight + 2 * Radius));
+	return Bounds;
+}
+
+bool UVaultComponent::ConsumeProbeCache(bool& OutCanVault, FVector& OutFinalPosition) const
+{
+	if (!bUseProbeCache)
+		return false;
+
+	if (!IsProbeCacheValid())
+	{
+		ProbeCacheMisses++;
+		return false;
+	}
+
+	ProbeCacheHits++;
+	OutCanVault = Cache.bCanVault;
+	if (Cache.bCanVault)
+		OutFinalPosition = Cache.FinalPosition;
+
+	return true;
+}
+
+bool UVaultComponent::IsVaultableSurface(const FHitResult& Hit) const
+{
 	// Check if the place we want to go is walkable to start with
 	if (!ParkourShooterUtils::FloorIsWalkableZ(Hit.Normal, ShooterCharacter->GetCharacterMovement()->GetWalkableFloorZ()))
 		return false;
@@ -100,18 +355,28 @@ bool UVaultComponent::CanVaultToLocation(const FHitResult& Hit, FVector& OutFina
 	float Height = Hit.Location.Z - Hit.TraceEnd.Z;
 
 	// If too high or too low, we dont vault
-	if (Height > MaxVaultingHeight || Height < MinVaultingHeight)
+	return Height <= MaxVaultingHeight && Height >= MinVaultingHeight;
+}
+
+FVector UVaultComponent::GetFitTestLocation(const FHitResult& Hit) const
+{
+	// We spawn a capsule in the position we want to be: Hit location plus half height of capsule
+	// We add capsule radius to account for slope surfaces
+	UCapsuleComponent *Capsule = ShooterCharacter->GetCapsuleComponent();
+	return FVector(0, 0, Capsule->GetScaledCapsuleHalfHeight() + Capsule->GetScaledCapsuleRadius()) + Hit.Location;
+}
+
+bool UVaultComponent::CanVaultToLocation(const FHitResult& Hit, FVector& OutFinalPosition, bool bDynamicOnly) const
+{
+	if (!IsVaultableSurface(Hit))
 		return false;
 
 	UCapsuleComponent *Capsule = ShooterCharacter->GetCapsuleComponent();
 
 	// Check if we fit: We spawn a capsule in the position we want to be and if it doesn't hits anything, everything is ok
-	// We first search the position for the capsule to spawn: Hit location plus half height of capsule
-	// We add capsule radius to account for slope surfaces
-	FVector CapsuleLocation = FVector(0, 0, Capsule->GetScaledCapsuleHalfHeight() + Capsule->GetScaledCapsuleRadius()) + Hit.Location;
+	FVector CapsuleLocation = GetFitTestLocation(Hit);
 	FHitResult CapsuleHit;
-	FCollisionQueryParams Params = FCollisionQueryParams::DefaultQueryParam;
-	Params.AddIgnoredActor(ShooterCharacter);
+	FCollisionQueryParams Params = GetProbeQueryParams(bDynamicOnly);
 
 	// DEBUG ONLY, DELETE LATER  -------
 	// const FName MyTag("VaultTracing");
@@ -122,12 +387,13 @@ bool UVaultComponent::CanVaultToLocation(const FHitResult& Hit, FVector& OutFina
 
 	// TODO you have to properly set up what you want to hit here since we might want to vault objects with enemies 
 	// over them, for example
+	PARKOUR_COUNT_QUERY(Vault);
 	bool HitSomething = GetWorld()->SweepSingleByChannel(
 		CapsuleHit,
 		CapsuleLocation,
 		CapsuleLocation,
 		ShooterCharacter->GetActorRotation().Quaternion(),
-		ECC_Visibility,
+		ECC_Parkour,
 		FCollisionShape::MakeCapsule(Capsule->GetScaledCapsuleRadius(), Capsule->GetScaledCapsuleHalfHeight()),
 		Params
 	);
@@ -141,6 +407,200 @@ bool UVaultComponent::CanVaultToLocation(const FHitResult& Hit, FVector& OutFina
 	return true;
 }
 
+FCollisionQueryParams UVaultComponent::GetProbeQueryParams(bool bDynamicOnly) const
+{
+	FCollisionQueryParams Params = FCollisionQueryParams::DefaultQueryParam;
+	Params.AddIgnoredActor(ShooterCharacter);
+
+	if (bDynamicOnly)
+		Params.MobilityType = EQueryMobilityType::Dynamic;
+
+	return Params;
+}
+
+bool UVaultComponent::FindBakedLedge(const FVector& Start, const FVector& End, BakedLedge& OutLedge) const
+{
+	if (!bUseSurfaceIndex || SurfaceIndex == nullptr || !SurfaceIndex->IsAvailable())
+		return false;
+
+	OutLedge.bFound = SurfaceIndex->FindLedge(Start, End, OutLedge.Hit, OutLedge.Clearance, OutLedge.MaxRadius);
+	return true;
+}
+
+bool UVaultComponent::IsBakedClearanceEnough(const BakedLedge& Ledge, bool& bOutStaticChecked) const
+{
+	UCapsuleComponent* Capsule = ShooterCharacter->GetCapsuleComponent();
+	float Radius = Capsule->GetScaledCapsuleRadius();
+	float HalfHeight = Capsule->GetScaledCapsuleHalfHeight();
+
+	bOutStaticChecked = Radius <= Ledge.MaxRadius;
+	if (!bOutStaticChecked)
+		return true;
+
+	// Top of the capsule of the fit test, see GetFitTestLocation
+	return Ledge.Clearance >= 2 * HalfHeight + Radius;
+}
+
+bool UVaultComponent::UpdateAsyncProbe(FVector& OutFinalPosition, EParkourQueryPriority Priority)
+{
+	UWorld* World = GetWorld();
+	if (World == nullptr || ShooterCharacter == nullptr)
+		return false;
+
+	// If we didn't move since the last complete probe, there's nothing new to submit
+	bool bCachedCanVault;
+	if (ConsumeProbeCache(bCachedCanVault, OutFinalPosition))
+		return bCachedCanVault;
+
+	// Out of budget, the latest complete probe has to do until our turn comes. The fit stage is paid for here too
+	if (UParkourQueryBudget::TryConsumeIn(World, this, Priority, GetProbeCost()))
+		SubmitAsyncProbe();
+
+	if (!AsyncResult.bValid || !AsyncResult.bCanVault)
+		return false;
+
+	OutFinalPosition = AsyncResult.FinalPosition;
+	return true;
+}
+
+void UVaultComponent::SubmitAsyncProbe()
+{
+	UWorld* World = GetWorld();
+
+	// Whatever we submitted on previous frames was already delivered to our delegates by the world,
+	// so now we only have to submit the probe for the next frame
+	FVector Start, End;
+	GetLedgeTraceSegment(Start, End);
+
+	LedgeRequest = { ShooterCharacter->GetActorLocation(), ShooterCharacter->GetActorForwardVector(), ShooterCharacter->GetVelocity(), GFrameCounter, World->GetTimeSeconds() };
+
+	// The index answers right away, we put it together with the dynamic trace when that one is done
+	LedgeBaked = BakedLedge();
+	FCollisionQueryParams Params = GetProbeQueryParams(FindBakedLedge(Start, End, LedgeBaked));
+
+	PARKOUR_COUNT_QUERY(Vault);
+	LedgeTraceHandle = World->AsyncLineTraceByChannel(
+		EAsyncTraceType::Single,
+		Start, End,
+		ECC_Parkour,
+		Params,
+		FCollisionResponseParams::DefaultResponseParam,
+		&LedgeTraceDelegate
+	);
+}
+
+void UVaultComponent::OnLedgeTraceDone(const FTraceHandle& Handle, FTraceDatum& Datum)
+{
+	// A newer probe replaced this one, or we started vaulting since it was submitted
+	if (!(Handle == LedgeTraceHandle))
+		return;
+
+	LedgeTraceHandle.Invalidate();
+
+	FHitResult* Hit = FHitResult::GetFirstBlockingHit(Datum.OutHits);
+
+	// With the surface index the trace only saw dynamic objects, the baked ledge wins if it's higher
+	bool bStaticChecked = false;
+	if (LedgeBaked.bFound && (Hit == nullptr || LedgeBaked.Hit.Location.Z > Hit->Location.Z))
+	{
+		Hit = &LedgeBaked.Hit;
+		if (!IsBakedClearanceEnough(LedgeBaked, bStaticChecked))
+		{
+			PublishAsyncResult(LedgeRequest, Hit, false, FVector::ZeroVector);
+			return;
+		}
+	}
+
+	if (Hit == nullptr || !IsVaultableSurface(*Hit) || GetWorld() == nullptr)
+	{
+		PublishAsyncResult(LedgeRequest, Hit, false, FVector::ZeroVector);
+		return;
+	}
+
+	// There's a ledge, now submit the second stage to check if we fit on top of it
+	UCapsuleComponent* Capsule = ShooterCharacter->GetCapsuleComponent();
+	FVector CapsuleLocation = GetFitTestLocation(*Hit);
+	FitRequest = LedgeRequest;
+	FitLedgeHit = *Hit;
+	FitFinalPosition = FVector(0, 0, Capsule->GetScaledCapsuleHalfHeight()) + Hit->Location;
+
+	FCollisionQueryParams Params = GetProbeQueryParams(bStaticChecked);
+
+	PARKOUR_COUNT_QUERY(Vault);
+	FitTraceHandle = GetWorld()->AsyncSweepByChannel(
+		EAsyncTraceType::Single,
+		CapsuleLocation,
+		CapsuleLocation,
+		ShooterCharacter->GetActorRotation().Quaternion(),
+		ECC_Parkour,
+		FCollisionShape::MakeCapsule(Capsule->GetScaledCapsuleRadius(), Capsule->GetScaledCapsuleHalfHeight()),
+		Params,
+		FCollisionResponseParams::DefaultResponseParam,
+		&FitTraceDelegate
+	);
+}
+
+void UVaultComponent::OnFitTraceDone(const FTraceHandle& Handle, FTraceDatum& Datum)
+{
+	if (!(Handle == FitTraceHandle))
+		return;
+
+	FitTraceHandle.Invalidate();
+
+	// If the capsule hit anything, there's not enough space
+	bool bFits = FHitResult::GetFirstBlockingHit(Datum.OutHits) == nullptr;
+	PublishAsyncResult(FitRequest, &FitLedgeHit, bFits, FitFinalPosition);
+}
+
+void UVaultComponent::PublishAsyncResult(const ProbeRequest& Request, const FHitResult* LedgeHit, bool bCanVault, const FVector& FinalPosition)
+{
+	// Both stages complete out of order across frames, never replace a result with an older one
+	if (AsyncResult.bValid && AsyncResult.Request.Frame > Request.Frame)
+		return;
+
+	AsyncResult.Request = Request;
+	AsyncResult.bValid = true;
+	AsyncResult.bCanVault = bCanVault;
+	AsyncResult.FinalPosition = FinalPosition;
+
+	StoreProbe(Request.Origin, Request.Forward, LedgeHit, bCanVault, FinalPosition);
+}
+
+void UVaultComponent::DiscardAsyncProbe()
+{
+	LedgeTraceHandle.Invalidate();
+	FitTraceHandle.Invalidate();
+	AsyncResult.bValid = false;
+	Cache.bValid = false;
+}
+
+bool UVaultComponent::IsAsyncResultUsable() const
+{
+	if (!AsyncResult.bValid || ShooterCharacter == nullptr || GetWorld() == nullptr)
+		return false;
+
+	const ProbeRequest& Request = AsyncResult.Request;
+	if (GFrameCounter - Request.Frame > static_cast<uint64>(MaxAsyncResultAge))
+		return false;
+
+	// Still going where we were going when we submitted it
+	const FVector Location = ShooterCharacter->GetActorLocation();
+	const FVector Predicted = Request.Origin + Request.Velocity * (GetWorld()->GetTimeSeconds() - Request.Time);
+	if (FVector::DistSquared(Predicted, Location) > AsyncResultMaxDistance * AsyncResultMaxDistance)
+		return false;
+
+	if (FVector::DistSquared2D(Request.Origin, Location) > AsyncResultMaxTravel * AsyncResultMaxTravel)
+		return false;
+
+	const FVector Forward = ShooterCharacter->GetActorForwardVector();
+	float MinCos = FMath::Cos(FMath::DegreesToRadians(AsyncResultMaxAngle));
+	if (FVector::DotProduct(Request.Forward, Forward) < MinCos)
+		return false;
+
+	// The ledge it found has to still be ahead of us, not under our feet
+	return !AsyncResult.bCanVault || FVector::DotProduct(AsyncResult.FinalPosition - Location, Forward) > 0;
+}
+
 void UVaultComponent::ModifyWidgetToViewport(bool Add)
 {
 	//if (VaultSuggestionWidget != nullptr && Add && !VaultSuggestionWidget->IsInViewport())
@@ -151,46 +611,32 @@ void UVaultComponent::ModifyWidgetToViewport(bool Add)
 
 void UVaultComponent::BeginVault(FVector NewLocation)
 {
-	Progress = 0;
-	StartingLocation = ShooterCharacter->GetActorLocation();
-	EndLocation = NewLocation;
-	CurrentState = VaultingState::Vaulting;
+	// The movement component moves us over the ledge in its vault mode, with the profile for the ledge height
+	ShooterCharacter->GetParkourMovement()->BeginVault(NewLocation);
+	SetVaultingState(VaultingState::Vaulting);
+
+	// Anything probed before vaulting is meaningless once we're on the other side
+	DiscardAsyncProbe();
 }
 
 void UVaultComponent::UpdateVault(float DeltaSeconds)
 {
-	Progress += DeltaSeconds / TimeToVault;
-	Progress = FMath::Clamp(Progress, 0.f, 1.f);
-
-	FVector NewLocation = FMath::Lerp(StartingLocation, EndLocation, Progress);
-
-	ShooterCharacter->SetActorLocation(NewLocation, false, nullptr, ETeleportType::TeleportPhysics);
-
-	// Check if all required time just passed or if we are near enough
-	float DistSquared =  (ShooterCharacter->GetActorLocation() - EndLocation).SizeSquared();
-	if (Progress >= 1.f || DistSquared <= 10 * 10)
-		CurrentState = VaultingState::NotVaulting;
+	// The movement component does the actual vault, we're done as soon as it is
+	if (!ShooterCharacter->GetParkourMovement()->IsVaulting())
+		SetVaultingState(VaultingState::NotVaulting);
 }
 
 // Called every frame
 void UVaultComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
+	PARKOUR_SCOPE_CYCLE_COUNTER(STAT_ParkourVaultTick);
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	// We only tick while we could vault, to show if we can
 	FVector NewLocation;
-	switch (CurrentState)
-	{
-	case VaultingState::NotVaulting:
-		if (CanVault(NewLocation))
-			ModifyWidgetToViewport(true);
-		else 
-			ModifyWidgetToViewport(false);
-
-		break;
-	case VaultingState::Vaulting:
-		UpdateVault(DeltaTime);
-		break;
-	default:
-		break;
-	}
+	if (CanVault(NewLocation))
+		ModifyWidgetToViewport(true);
+	else 
+		ModifyWidgetToViewport(false);
 }
 
@@ -4,10 +4,15 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "WorldCollision.h"
+#include "ParkourMovementComponent.h"
+#include "ParkourQueryBudget.h"
 #include "VaultComponent.generated.h"
 
 class UUSerWidget;
 class AParkourShooterCharacter;
+class UParkourSensorComponent;
+class UParkourSurfaceSubsystem;
 
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class PARKOURSHOOTER_API UVaultComponent : public UActorComponent
@@ -38,8 +43,16 @@ protected:
 	UPROPERTY(EditAnywhere, Category = "Vaulting")
 	TSubclassOf<class UUserWidget> VaultSuggestionClass;
 
+	/** Probe for ledges every frame in the air to show the vault suggestion. Without it we only probe when asked to vault */
+	UPROPERTY(EditAnywhere, Category = "Vaulting")
+	bool bShowVaultSuggestion = false;
+
 	UUserWidget* VaultSuggestionWidget;
 
+	// Sensor that runs our ledge probe at most once per frame
+	UPROPERTY()
+	UParkourSensorComponent* Sensor;
+
 	VaultingState CurrentState;
 
 	FVector EndingLocation;
@@ -50,23 +63,20 @@ protected:
 	UPROPERTY(EditDefaultsOnly, Category = "Vaulting")
 	float MaxVaultingHeight = 170;
 
-	/** Time in seconds to perform vault */
+	/** How to move over a ledge, from the lowest ledge to the highest. We use the first one that can take the ledge in front of us */
 	UPROPERTY(EditDefaultsOnly, Category = "Vaulting")
-	float TimeToVault = 1;
-
-	// Marks how much progress we have with vaulting
-	float Progress = 0;
-
-	// Where we started vaulting
-	FVector StartingLocation;
-
-	// Where we finish vaulting
-	FVector EndLocation;
+	TArray<FParkourVaultProfile> VaultProfiles;
 
 	VaultingState GetCurrentState() const;
 
 	void SetVaultingState(VaultingState NewVaultState);
 
+	/// <summary>
+	/// Turn our tick and the sensor ledge probe on only when they can matter: we tick to update the vault suggestion,
+	/// and the ledge is probed ahead of time while falling, where holding jump vaults
+	/// </summary>
+	void RefreshProbing();
+
 	/// <summary>
 	/// Checks if the specified location is "vaultable", meaning that you can vault to that 
 	/// location in space. In order for a location to be vaultable, you need:
@@ -79,8 +89,245 @@ protected:
 	/// checking for any surface
 	/// </param>
 	/// <param name="OutFinalPosition"> Resulting position after performing vault</param>
+	/// <param name="bDynamicOnly"> Only test dynamic objects, static ones were checked against the baked clearance </param>
 	/// <returns> True if can vault, false otherwise </returns>
-	bool CanVaultToLocation(const FHitResult& Hit, FVector& OutFinalPosition) const;
+	bool CanVaultToLocation(const FHitResult& Hit, FVector& OutFinalPosition, bool bDynamicOnly = false) const;
+
+	/// <summary>
+	/// Cheap part of CanVaultToLocation: checks that the surface is walkable and in vaulting height range,
+	/// without checking if we fit there
+	/// </summary>
+	bool IsVaultableSurface(const FHitResult& Hit) const;
+
+	/// <summary>
+	/// Segment of the ray we cast in front of the character, from forehead height down to the feet
+	/// </summary>
+	void GetLedgeTraceSegment(FVector& OutStart, FVector& OutEnd) const;
+
+	/// <summary>
+	/// Where to test that our capsule fits on top of a surface, accounting for slopes
+	/// </summary>
+	FVector GetFitTestLocation(const FHitResult& Hit) const;
+
+	/// <summary>
+	/// Params for the ledge trace and the fit test, only against dynamic objects when static ones come from the surface index
+	/// </summary>
+	FCollisionQueryParams GetProbeQueryParams(bool bDynamicOnly) const;
+
+	// -- < Surface index > ---------------------------------------------------------------
+
+	/** Look static ledges up in the baked surface index when every loaded level has one, and only trace dynamic objects */
+	UPROPERTY(EditAnywhere, Category = "Vaulting|Surface Index")
+	bool bUseSurfaceIndex = true;
+
+	UPROPERTY()
+	UParkourSurfaceSubsystem* SurfaceIndex = nullptr;
+
+	// Static ledge found in the surface index
+	struct BakedLedge
+	{
+		bool bFound = false;
+		FHitResult Hit;
+		float Clearance = 0;
+		float MaxRadius = 0;
+	};
+
+	/// <summary>
+	/// Look the static ledge under the ledge trace segment up in the surface index
+	/// </summary>
+	/// <returns> False if there's no usable index, then static geometry has to be traced as usual </returns>
+	bool FindBakedLedge(const FVector& Start, const FVector& End, BakedLedge& OutLedge) const;
+
+	/// <summary>
+	/// Checks the baked clearance over a ledge against our capsule, it stands for the static part of the fit test
+	/// </summary>
+	/// <param name="bOutStaticChecked"> False if our capsule is bigger than the one the index was baked for, then the fit test has to sweep static geometry too </param>
+	/// <returns> False if we don't fit under the static geometry over the ledge </returns>
+	bool IsBakedClearanceEnough(const BakedLedge& Ledge, bool& bOutStaticChecked) const;
+
+	// -- < End Surface index > -----------------------------------------------------------
+
+	// -- < Probe cache > -----------------------------------------------------------------
+
+	/** Reuse the last ledge probe while the character stays still, instead of tracing the same spot again */
+	UPROPERTY(EditAnywhere, Category = "Vaulting|Cache")
+	bool bUseProbeCache = true;
+
+	/** How much the character can move before the cached probe is considered stale */
+	UPROPERTY(EditAnywhere, Category = "Vaulting|Cache")
+	float ProbeCacheMaxDistance = 5;
+
+	/** How much the character can turn, in degrees, before the cached probe is considered stale */
+	UPROPERTY(EditAnywhere, Category = "Vaulting|Cache")
+	float ProbeCacheMaxAngle = 2;
+
+	/** 
+	 * Max age in frames of a cached probe. Dynamic objects around the probe are watched, see ProbeCacheWatchMargin,
+	 * so this only bounds how fast something coming from further away can get in front of us unnoticed
+	 */
+	UPROPERTY(EditAnywhere, Category = "Vaulting|Cache", meta = (ClampMin = "0"))
+	int32 ProbeCacheMaxFrames = 15;
+
+	/** 
+	 * How far around the probed space we look for dynamic objects when storing a probe. If any of them moves the
+	 * probe is stale. Something from outside has to cover this distance in ProbeCacheMaxFrames to go unnoticed
+	 */
+	UPROPERTY(EditAnywhere, Category = "Vaulting|Cache", meta = (ClampMin = "0"))
+	float ProbeCacheWatchMargin = 300;
+
+	// A dynamic object near the probe and where it was when we stored it
+	struct WatchedComponent
+	{
+		TWeakObjectPtr<UPrimitiveComponent> Component;
+		FTransform Transform;
+	};
+
+	struct ProbeCache
+	{
+		bool bValid = false;
+
+		// Where the probe was run from
+		FVector Origin = FVector::ZeroVector;
+		FVector Forward = FVector::ForwardVector;
+		float CapsuleHalfHeight = 0;
+		uint64 Frame = 0;
+
+		// Ledge we hit, if any, and where it was at the time
+		bool bHitLedge = false;
+		FHitResult LedgeHit;
+		TWeakObjectPtr<UPrimitiveComponent> LedgeComponent;
+		FTransform LedgeComponentTransform;
+
+		// Dynamic objects that could get in the way of the probe
+		TArray<WatchedComponent> Watched;
+
+		bool bCanVault = false;
+		FVector FinalPosition = FVector::ZeroVector;
+	};
+
+	// Written from const probing functions, it's just a memo
+	mutable ProbeCache Cache;
+	mutable uint32 ProbeCacheHits = 0;
+	mutable uint32 ProbeCacheMisses = 0;
+
+	/// <summary>
+	/// Checks if the cached probe still describes what's in front of us: we didn't move or turn past the
+	/// thresholds, the ledge we hit and the dynamic objects around didn't move, and the probe is at most
+	/// ProbeCacheMaxFrames old
+	/// </summary>
+	bool IsProbeCacheValid() const;
+
+	/// <summary>
+	/// Store the result of a probe run from the given location and facing, hit or miss, along with the dynamic
+	/// objects that could change it. Nothing is stored while we move too fast for it to be reused next frame
+	/// </summary>
+	void StoreProbe(const FVector& Origin, const FVector& Forward, const FHitResult* LedgeHit, bool bCanVault, const FVector& FinalPosition) const;
+
+	/// <summary>
+	/// Returns the cached result if valid, counting it as a hit or a miss
+	/// </summary>
+	bool ConsumeProbeCache(bool& OutCanVault, FVector& OutFinalPosition) const;
+
+	/// <summary>
+	/// Space a probe from the given location and facing looks at: the ledge trace and the fit capsule over it
+	/// </summary>
+	FBox GetProbeBounds(const FVector& Origin, const FVector& Forward) const;
+
+	// -- < End Probe cache > -------------------------------------------------------------
+
+	// -- < Async probing > --------------------------------------------------------------
+
+	/** 
+	 * Probe ledges every frame with async traces, submitted this frame and consumed on the next ones, so the
+	 * physics work overlaps other game thread work. Only an explicit vault request blocks on a query
+	 */
+	UPROPERTY(EditAnywhere, Category = "Vaulting|Async")
+	bool bUseAsyncProbe = true;
+
+	/** Oldest async result, in frames, that an explicit vault request can reuse instead of tracing again */
+	UPROPERTY(EditAnywhere, Category = "Vaulting|Async")
+	int32 MaxAsyncResultAge = 3;
+
+	/** 
+	 * How far the character can be from where it was going when an async probe was submitted, for its result to
+	 * still be valid. Results arrive a couple of frames late, so we compare against the location predicted from
+	 * the velocity we had back then: running in a straight line keeps the result, stopping or a knockback drops it
+	 */
+	UPROPERTY(EditAnywhere, Category = "Vaulting|Async")
+	float AsyncResultMaxDistance = 10;
+
+	/** 
+	 * How far the character can travel since an async probe was submitted for its result to still be valid. A
+	 * probe that found nothing only looked at one spot, past this we could have reached a ledge it didn't see
+	 */
+	UPROPERTY(EditAnywhere, Category = "Vaulting|Async")
+	float AsyncResultMaxTravel = 50;
+
+	/** How much the character can turn, in degrees, since an async probe was submitted for its result to still be valid */
+	UPROPERTY(EditAnywhere, Category = "Vaulting|Async")
+	float AsyncResultMaxAngle = 5;
+
+	// Where the character was when a probe was submitted
+	struct ProbeRequest
+	{
+		FVector Origin = FVector::ZeroVector;
+		FVector Forward = FVector::ForwardVector;
+		FVector Velocity = FVector::ZeroVector;
+		uint64 Frame = 0;
+		float Time = 0;
+	};
+
+	struct AsyncProbeResult
+	{
+		ProbeRequest Request;
+		bool bValid = false;
+		bool bCanVault = false;
+		FVector FinalPosition = FVector::ZeroVector;
+	};
+
+	// First stage: ray down in front of the character
+	FTraceHandle LedgeTraceHandle;
+	ProbeRequest LedgeRequest;
+	BakedLedge LedgeBaked;
+	FTraceDelegate LedgeTraceDelegate;
+
+	// Second stage: capsule on top of the ledge found by the first one
+	FTraceHandle FitTraceHandle;
+	ProbeRequest FitRequest;
+	FHitResult FitLedgeHit;
+	FVector FitFinalPosition;
+	FTraceDelegate FitTraceDelegate;
+
+	// Latest complete probe
+	AsyncProbeResult AsyncResult;
+	mutable uint32 AsyncResultHits = 0;
+	mutable uint32 AsyncResultMisses = 0;
+
+	// Last frame the query budget turned down a probe
+	mutable uint64 DeferredFrame = MAX_uint64;
+
+	/// <summary>
+	/// Submit the first stage of an async probe from where we are now
+	/// </summary>
+	void SubmitAsyncProbe();
+
+	void OnLedgeTraceDone(const FTraceHandle& Handle, FTraceDatum& Datum);
+
+	void OnFitTraceDone(const FTraceHandle& Handle, FTraceDatum& Datum);
+
+	void PublishAsyncResult(const ProbeRequest& Request, const FHitResult* LedgeHit, bool bCanVault, const FVector& FinalPosition);
+
+	/// <summary>
+	/// Drop the latest async result, any probe in flight and the probe cache, they don't describe the world anymore
+	/// </summary>
+	void DiscardAsyncProbe();
+
+	/// <summary>
+	/// Checks if the latest async result is recent enough and was probed close enough to where we are now
+	/// </summary>
+	bool IsAsyncResultUsable() const;
+
+	// -- < End Async probing > ----------------------------------------------------------
 
 	/// <summary>
 	/// Add vaulting widget to viewport if argument is true, or remove it if false.
@@ -97,12 +344,68 @@ public:
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
 	/// <summary>
-	/// Check if you can actually vault, and if so, set the output as the resulting position after vault
+	/// Check if you can actually vault, and if so, set the output as the resulting position after vault.
+	/// With async probing, the answer may be a couple of frames old, use CanVaultNow when you're about to vault
 	/// </summary>
 	/// <param name="OutFinalPosition">Position after performing vault</param>
 	/// <returns>if can vault</returns>
 	bool CanVault(FVector& OutFinalPosition) const;
 
+	/// <summary>
+	/// Like CanVault, but for an explicit vault request: reuses the latest async result if it's still valid
+	/// for where we are, and blocks on a query otherwise
+	/// </summary>
+	/// <param name="OutFinalPosition">Position after performing vault</param>
+	/// <returns>if can vault</returns>
+	bool CanVaultNow(FVector& OutFinalPosition) const;
+
+	bool UsesAsyncProbe() const { return bUseAsyncProbe; }
+
+	/// <summary>
+	/// Submit this frame's async ledge probe and return the latest complete result. If the query budget has no
+	/// room for it, nothing is submitted and the latest result has to do
+	/// </summary>
+	/// <param name="OutFinalPosition">Position after performing vault</param>
+	/// <param name="Priority">How urgent the probe is, for the query budget</param>
+	/// <returns>if can vault, according to the latest complete probe</returns>
+	bool UpdateAsyncProbe(FVector& OutFinalPosition, EParkourQueryPriority Priority);
+
+	/** Number of ledge probes answered by the cache since the last reset */
+	uint32 GetProbeCacheHits() const { return ProbeCacheHits; }
+
+	/** Number of ledge probes that had to query the scene since the last reset */
+	uint32 GetProbeCacheMisses() const { return ProbeCacheMisses; }
+
+	void ResetProbeCacheCounters() { ProbeCacheHits = 0; ProbeCacheMisses = 0; }
+
+	/** Number of vault requests answered by an async result since the last reset */
+	uint32 GetAsyncResultHits() const { return AsyncResultHits; }
+
+	/** Number of vault requests that had to block on a query because no async result was usable */
+	uint32 GetAsyncResultMisses() const { return AsyncResultMisses; }
+
+	void ResetAsyncResultCounters() { AsyncResultHits = 0; AsyncResultMisses = 0; }
+
+	/// <summary>
+	/// Trace for a ledge in front of the character and check if we can vault to it. Queries the scene unless the
+	/// probe cache still holds a probe from where we are. Prefer CanVault, which reuses this frame's result from
+	/// the owner's sensor
+	/// </summary>
+	/// <param name="OutFinalPosition">Position after performing vault</param>
+	/// <param name="Priority">How urgent the probe is, for the query budget</param>
+	/// <returns>if can vault, false if the query budget deferred the probe, see IsProbeDeferred</returns>
+	bool ProbeVault(FVector& OutFinalPosition, EParkourQueryPriority Priority) const;
+
+	/// <summary>
+	/// If the query budget turned down a ProbeVault this frame, its answer doesn't mean anything
+	/// </summary>
+	bool IsProbeDeferred() const { return DeferredFrame == GFrameCounter; }
+
+	/// <summary>
+	/// Scene queries a ledge probe can issue: the ledge trace, the fit sweep and the overlap storing it in the cache
+	/// </summary>
+	int32 GetProbeCost() const { return bUseProbeCache ? 3 : 2; }
+
 	/// <summary>
 	/// Start a vaulting 
 	/// </summary>
@@ -112,4 +415,10 @@ public:
 	UFUNCTION()
 	bool IsVaulting() const { return CurrentState == VaultingState::Vaulting; }
 
+	/// <summary>
+	/// Called by the owner when its movement mode changes: that's when a vault ends, and when we go
+	/// from the ground to the air and back
+	/// </summary>
+	void OnOwnerMovementModeChanged();
+
 };